@@ -0,0 +1,560 @@
+#include "bigmath.h"
+#include <time.h>
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * Kernel benchmarks.
+ *
+ *   ./bench [--json] [--kernel name] [--max-limbs n] [--samples n]
+ *           [--baseline file.csv] [--threshold pct]
+ *
+ * Every kernel is timed over operand sizes 1, 2, 5, 10, ... 10^6
+ * segments (each kernel has its own cap, quadratic ones stop early).
+ * Each size gets a warmup, then `samples` timed runs of enough
+ * operations to last a few milliseconds. Reported per operation:
+ * min/median/mean/stddev ns, TSC cycles per segment, and the number of
+ * allocations and bytes allocated.
+ *
+ * With --baseline, the medians are compared against an earlier CSV run
+ * and any kernel/size slower by more than the threshold (default 10%)
+ * is reported on stderr; the exit status is then 1.
+ */
+
+#define MAX_SAMPLES 64
+#define SAMPLE_NS 4000000.0
+
+typedef struct {
+  uint64_t length;
+  uint64_t* a;
+  uint64_t* b;
+  uint64_t* c;
+  uint64_t* work;
+  void* extra;
+} bench_ctx;
+
+typedef struct {
+  const char* name;
+  uint64_t max_limbs;
+  void (*setup)(bench_ctx*);
+  void (*run)(bench_ctx*);
+  void (*teardown)(bench_ctx*);
+} bench_kernel;
+
+typedef struct {
+  char kernel[64];
+  uint64_t limbs;
+  double median;
+} bench_baseline;
+
+///
+/// allocation counting
+///
+
+#ifdef __GLIBC__
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void __libc_free(void* ptr);
+
+static bool counting = FALSE;
+static uint64_t alloc_count = 0;
+static uint64_t alloc_bytes = 0;
+
+void* malloc(size_t size) {
+  if(counting) {
+    alloc_count++;
+    alloc_bytes += size;
+  }
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+  if(counting) {
+    alloc_count++;
+    alloc_bytes += count * size;
+  }
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+  if(counting) {
+    alloc_count++;
+    alloc_bytes += size;
+  }
+  return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr) {
+  __libc_free(ptr);
+}
+#else
+static bool counting = FALSE;
+static uint64_t alloc_count = 0;
+static uint64_t alloc_bytes = 0;
+#endif
+
+///
+/// timing
+///
+
+static double now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static uint64_t cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15;
+
+static uint64_t rng(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+static void fill_random(uint64_t* segments, uint64_t length) {
+  uint64_t i;
+  for(i = 0; i < length; i++) {
+    segments[i] = rng();
+  }
+}
+
+///
+/// kernels
+///
+
+static void setup_random(bench_ctx* ctx) {
+  fill_random(ctx->a, ctx->length);
+  fill_random(ctx->b, ctx->length);
+  fill_random(ctx->c, ctx->length);
+}
+
+/**
+ * Multiplication operands only fill the low half so the truncated
+ * product is the full product.
+ */
+static void setup_half(bench_ctx* ctx) {
+  uint64_t half = (ctx->length + 1) / 2;
+  setup_random(ctx);
+  memset(ctx->a + half, 0, (ctx->length - half) * sizeof(uint64_t));
+  memset(ctx->b + half, 0, (ctx->length - half) * sizeof(uint64_t));
+}
+
+static void setup_divide(bench_ctx* ctx) {
+  setup_random(ctx);
+  memset(ctx->b + (ctx->length + 1) / 2, 0,
+	 (ctx->length - (ctx->length + 1) / 2) * sizeof(uint64_t));
+  ctx->b[0] |= 1;
+}
+
+static void run_add(bench_ctx* ctx) {
+  add_segments(ctx->a, ctx->b, ctx->length);
+}
+
+static void run_sub(bench_ctx* ctx) {
+  sub_segments(ctx->a, ctx->b, ctx->length);
+}
+
+static void run_shl(bench_ctx* ctx) {
+  shl_segments(ctx->a, ctx->length, 13);
+}
+
+static void run_shr(bench_ctx* ctx) {
+  shr_segments(ctx->a, ctx->length, 13);
+}
+
+static void run_xor(bench_ctx* ctx) {
+  xor_segments(ctx->a, ctx->b, ctx->length);
+}
+
+static void run_xor_popcount(bench_ctx* ctx) {
+  ctx->c[0] += xor_popcount_segments(ctx->a, ctx->b, ctx->length);
+}
+
+static void run_mul_1(bench_ctx* ctx) {
+  ctx->c[0] += mul_1_segments(ctx->a, ctx->b, ctx->length, 0xFEDCBA9876543210);
+}
+
+static void run_addmul_1(bench_ctx* ctx) {
+  ctx->c[0] += addmul_1_segments(ctx->a, ctx->b, ctx->length, 0xFEDCBA9876543210);
+}
+
+static void run_divrem_1(bench_ctx* ctx) {
+  ctx->c[0] += divrem_1_segments(ctx->a, ctx->b, ctx->length, 10000000000000000000UL);
+}
+
+static void run_mod_1(bench_ctx* ctx) {
+  ctx->c[0] += mod_1_segments(ctx->b, ctx->length, 1000000007);
+}
+
+static void run_hash(bench_ctx* ctx) {
+  ctx->c[0] += hash_segments(ctx->b, ctx->length, ctx->c[0]);
+}
+
+static void run_fingerprint(bench_ctx* ctx) {
+  ctx->c[0] += fingerprint_segments(ctx->b, ctx->length);
+}
+
+static void setup_mod_multi(bench_ctx* ctx) {
+  uint64_t moduli[256], count = 0, candidate, d;
+  setup_random(ctx);
+  for(candidate = 3; count < 256; candidate += 2) {
+    for(d = 3; d * d <= candidate && candidate % d; d += 2);
+    if(d * d > candidate) {
+      moduli[count++] = candidate;
+    }
+  }
+  ctx->extra = create_nat_divisor_set(moduli, count);
+}
+
+static void run_mod_multi(bench_ctx* ctx) {
+  uint64_t residues[256];
+  mod_multi_segments(residues, ctx->b, ctx->length, ctx->extra);
+  ctx->c[0] += residues[0];
+}
+
+static void teardown_mod_multi(bench_ctx* ctx) {
+  free_nat_divisor_set(ctx->extra);
+}
+
+/**
+ * A base with range for length limbs, the residues of a and b and room
+ * for from_rns_segments, which writes base->length segments.
+ */
+typedef struct {
+  rns_base* base;
+  uint64_t* ra;
+  uint64_t* rb;
+  uint64_t* value;
+} bench_rns;
+
+static void setup_rns(bench_ctx* ctx) {
+  bench_rns* rns = malloc(sizeof(bench_rns));
+  setup_random(ctx);
+  //each modulus carries just under 63 bits
+  rns->base = create_rns_base(NULL, ctx->length * 64 / 62 + 1);
+  rns->ra = malloc(rns->base->count * sizeof(uint64_t));
+  rns->rb = malloc(rns->base->count * sizeof(uint64_t));
+  rns->value = malloc((rns->base->length + 1) * sizeof(uint64_t));
+  to_rns_segments(rns->ra, ctx->a, ctx->length, rns->base);
+  to_rns_segments(rns->rb, ctx->b, ctx->length, rns->base);
+  ctx->extra = rns;
+}
+
+static void run_to_rns(bench_ctx* ctx) {
+  bench_rns* rns = ctx->extra;
+  to_rns_segments(rns->ra, ctx->a, ctx->length, rns->base);
+}
+
+static void run_from_rns(bench_ctx* ctx) {
+  bench_rns* rns = ctx->extra;
+  from_rns_segments(rns->value, rns->ra, rns->base);
+}
+
+static void run_mul_rns(bench_ctx* ctx) {
+  bench_rns* rns = ctx->extra;
+  mul_rns(rns->ra, rns->ra, rns->rb, rns->base);
+}
+
+static void teardown_rns(bench_ctx* ctx) {
+  bench_rns* rns = ctx->extra;
+  free_rns_base(rns->base);
+  free(rns->ra);
+  free(rns->rb);
+  free(rns->value);
+  free(rns);
+}
+
+static void run_mul(bench_ctx* ctx) {
+  memcpy(ctx->work, ctx->a, ctx->length * sizeof(uint64_t));
+  mul_segments(ctx->work, ctx->b, ctx->length);
+}
+
+static void run_mul_full(bench_ctx* ctx) {
+  uint64_t half = (ctx->length + 1) / 2;
+  mul_full_segments(ctx->work, ctx->a, half, ctx->b, ctx->length - half);
+}
+
+static void run_factorial(bench_ctx* ctx) {
+  //n! has about n log2(n / e) bits, n = 8 length is in the right range
+  free_bigint(factorial_bigint(ctx->length * 8));
+}
+
+static void run_div_mod(bench_ctx* ctx) {
+  memcpy(ctx->work, ctx->a, ctx->length * sizeof(uint64_t));
+  free(div_segments_mod(ctx->work, ctx->b, ctx->length));
+}
+
+static void run_pow(bench_ctx* ctx) {
+  memset(ctx->work, 0, ctx->length * sizeof(uint64_t));
+  ctx->work[0] = 3;
+  //3^e just fills the operand
+  pow_segments(ctx->work, ctx->length * 64 * 100 / 159, ctx->length);
+}
+
+static void run_powmod(bench_ctx* ctx) {
+  memcpy(ctx->work, ctx->a, ctx->length * sizeof(uint64_t));
+  ctx->c[0] |= 1;
+  powmod_segments(ctx->work, ctx->b, ctx->length, ctx->c, ctx->length);
+}
+
+static void run_multi_powmod(bench_ctx* ctx) {
+  uint64_t *bases[2] = {ctx->a, ctx->b}, *exponents[2] = {ctx->b, ctx->a};
+  ctx->c[0] |= 1;
+  multi_powmod_segments(ctx->work, bases, exponents, ctx->length, 2, ctx->c, ctx->length);
+}
+
+static void run_gcd(bench_ctx* ctx) {
+  memcpy(ctx->work, ctx->a, ctx->length * sizeof(uint64_t));
+  gcd_segments(ctx->work, ctx->c, ctx->length);
+}
+
+static void run_invmod(bench_ctx* ctx) {
+  memcpy(ctx->work, ctx->a, ctx->length * sizeof(uint64_t));
+  ctx->c[0] |= 1;
+  invmod_segments(ctx->work, ctx->c, ctx->length);
+}
+
+static void run_sqrt(bench_ctx* ctx) {
+  memcpy(ctx->work, ctx->a, ctx->length * sizeof(uint64_t));
+  sqrt_segments(ctx->work, ctx->length);
+}
+
+static void run_to_str(bench_ctx* ctx) {
+  bigint value;
+  value.data = ctx->a;
+  value.length = ctx->length;
+  free(bigint_to_new_str_base(&value, 10));
+}
+
+static bench_kernel kernels[] = {
+  {"add_segments", 1000000, setup_random, run_add, NULL},
+  {"sub_segments", 1000000, setup_random, run_sub, NULL},
+  {"shl_segments", 1000000, setup_random, run_shl, NULL},
+  {"shr_segments", 1000000, setup_random, run_shr, NULL},
+  {"xor_segments", 1000000, setup_random, run_xor, NULL},
+  {"xor_popcount_segments", 1000000, setup_random, run_xor_popcount, NULL},
+  {"mul_1_segments", 1000000, setup_random, run_mul_1, NULL},
+  {"addmul_1_segments", 1000000, setup_random, run_addmul_1, NULL},
+  {"divrem_1_segments", 1000000, setup_random, run_divrem_1, NULL},
+  {"mod_1_segments", 1000000, setup_random, run_mod_1, NULL},
+  {"hash_segments", 1000000, setup_random, run_hash, NULL},
+  {"fingerprint_segments", 1000000, setup_random, run_fingerprint, NULL},
+  {"mod_multi_segments", 100000, setup_mod_multi, run_mod_multi, teardown_mod_multi},
+  {"to_rns_segments", 1000, setup_rns, run_to_rns, teardown_rns},
+  {"from_rns_segments", 1000, setup_rns, run_from_rns, teardown_rns},
+  {"mul_rns", 1000, setup_rns, run_mul_rns, teardown_rns},
+  {"mul_segments", 10000, setup_half, run_mul, NULL},
+  {"mul_full_segments", 100000, setup_random, run_mul_full, NULL},
+  {"factorial_bigint", 100000, setup_random, run_factorial, NULL},
+  {"div_segments_mod", 10000, setup_divide, run_div_mod, NULL},
+  {"pow_segments", 2000, setup_random, run_pow, NULL},
+  {"powmod_segments", 200, setup_random, run_powmod, NULL},
+  {"multi_powmod_segments", 200, setup_random, run_multi_powmod, NULL},
+  {"gcd_segments", 2000, setup_random, run_gcd, NULL},
+  {"invmod_segments", 1000, setup_random, run_invmod, NULL},
+  {"sqrt_segments", 10000, setup_random, run_sqrt, NULL},
+  {"bigint_to_new_str_base", 50, setup_random, run_to_str, NULL},
+};
+
+///
+/// measurement and reporting
+///
+
+static int compare_double(const void* x, const void* y) {
+  double a = *(const double*) x, b = *(const double*) y;
+  return a < b ? -1 : a > b;
+}
+
+static uint64_t load_baseline(const char* path, bench_baseline** out) {
+  FILE* file = fopen(path, "r");
+  char line[512];
+  uint64_t count = 0, capacity = 64;
+  bench_baseline* rows;
+
+  if(file == NULL) {
+    fprintf(stderr, "cannot open baseline %s\n", path);
+    exit(2);
+  }
+  rows = malloc(capacity * sizeof(bench_baseline));
+  while(fgets(line, sizeof(line), file)) {
+    if(count == capacity) {
+      capacity *= 2;
+      rows = realloc(rows, capacity * sizeof(bench_baseline));
+    }
+    //kernel,limbs,reps,samples,ns_min,ns_median,...
+    if(sscanf(line, "%63[^,],%lu,%*u,%*u,%*f,%lf",
+	      rows[count].kernel, &rows[count].limbs, &rows[count].median) == 3) {
+      count++;
+    }
+  }
+  fclose(file);
+  *out = rows;
+  return count;
+}
+
+int main(int argc, char** argv) {
+  static const uint64_t steps[] = {1, 2, 5};
+  bool json = FALSE, first = TRUE, regressed = FALSE;
+  const char* filter = NULL;
+  const char* baseline_path = NULL;
+  uint64_t max_limbs = 1000000, samples = 7, baseline_count = 0;
+  double threshold = 10.0;
+  bench_baseline* baseline = NULL;
+  uint64_t k, i, s, decade, limbs, reps, allocs, bytes, cycle_start, cycle_total;
+  double per_op[MAX_SAMPLES], start, elapsed, mean, stddev, median;
+  bench_ctx ctx;
+
+  for(i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--json") == 0) {
+      json = TRUE;
+    } else if(strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) {
+      filter = argv[++i];
+    } else if(strcmp(argv[i], "--max-limbs") == 0 && i + 1 < argc) {
+      max_limbs = strtoul(argv[++i], NULL, 10);
+    } else if(strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+      samples = strtoul(argv[++i], NULL, 10);
+      samples = samples < 1 ? 1 : samples > MAX_SAMPLES ? MAX_SAMPLES : samples;
+    } else if(strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+      baseline_path = argv[++i];
+    } else if(strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+      threshold = atof(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s [--json] [--kernel name] [--max-limbs n] [--samples n]"
+	      " [--baseline file.csv] [--threshold pct]\n", argv[0]);
+      return 2;
+    }
+  }
+  if(baseline_path) {
+    baseline_count = load_baseline(baseline_path, &baseline);
+  }
+
+  if(json) {
+    printf("[\n");
+  } else {
+    printf("kernel,limbs,reps,samples,ns_min,ns_median,ns_mean,ns_stddev,"
+	   "cycles_per_limb,allocs_per_op,bytes_per_op\n");
+  }
+
+  for(k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+    if(filter && strcmp(filter, kernels[k].name) != 0) {
+      continue;
+    }
+    for(decade = 1; decade <= max_limbs; decade *= 10) {
+      for(s = 0; s < 3; s++) {
+	limbs = decade * steps[s];
+	if(limbs > max_limbs || limbs > kernels[k].max_limbs) {
+	  break;
+	}
+
+	ctx.length = limbs;
+	ctx.a = malloc(limbs * sizeof(uint64_t));
+	ctx.b = malloc(limbs * sizeof(uint64_t));
+	ctx.c = malloc(limbs * sizeof(uint64_t));
+	ctx.work = malloc(limbs * sizeof(uint64_t));
+	ctx.extra = NULL;
+	kernels[k].setup(&ctx);
+
+	//warmup, and size the sample so it lasts about SAMPLE_NS
+	reps = 1;
+	while(TRUE) {
+	  start = now_ns();
+	  for(i = 0; i < reps; i++) {
+	    kernels[k].run(&ctx);
+	  }
+	  elapsed = now_ns() - start;
+	  if(elapsed > SAMPLE_NS / 4 || reps >= (1 << 24)) {
+	    break;
+	  }
+	  reps *= 2;
+	}
+	reps = elapsed > 0 ? reps * SAMPLE_NS / elapsed : reps;
+	reps = reps < 1 ? 1 : reps;
+
+	alloc_count = 0;
+	alloc_bytes = 0;
+	cycle_total = 0;
+	for(i = 0; i < samples; i++) {
+	  uint64_t r;
+	  counting = i == 0;
+	  cycle_start = cycles();
+	  start = now_ns();
+	  for(r = 0; r < reps; r++) {
+	    kernels[k].run(&ctx);
+	  }
+	  per_op[i] = (now_ns() - start) / reps;
+	  cycle_total += cycles() - cycle_start;
+	  counting = FALSE;
+	}
+	allocs = alloc_count;
+	bytes = alloc_bytes;
+
+	mean = 0;
+	for(i = 0; i < samples; i++) {
+	  mean += per_op[i];
+	}
+	mean /= samples;
+	stddev = 0;
+	for(i = 0; i < samples; i++) {
+	  stddev += (per_op[i] - mean) * (per_op[i] - mean);
+	}
+	stddev = samples > 1 ? sqrt(stddev / (samples - 1)) : 0;
+	qsort(per_op, samples, sizeof(double), compare_double);
+	median = per_op[samples / 2];
+
+	if(json) {
+	  printf("%s  {\"kernel\": \"%s\", \"limbs\": %lu, \"reps\": %lu, \"samples\": %lu, "
+		 "\"ns_min\": %.1f, \"ns_median\": %.1f, \"ns_mean\": %.1f, \"ns_stddev\": %.1f, "
+		 "\"cycles_per_limb\": %.3f, \"allocs_per_op\": %.2f, \"bytes_per_op\": %.1f}",
+		 first ? "" : ",\n", kernels[k].name, limbs, reps, samples,
+		 per_op[0], median, mean, stddev,
+		 (double) cycle_total / (reps * samples) / limbs,
+		 (double) allocs / reps, (double) bytes / reps);
+	} else {
+	  printf("%s,%lu,%lu,%lu,%.1f,%.1f,%.1f,%.1f,%.3f,%.2f,%.1f\n",
+		 kernels[k].name, limbs, reps, samples,
+		 per_op[0], median, mean, stddev,
+		 (double) cycle_total / (reps * samples) / limbs,
+		 (double) allocs / reps, (double) bytes / reps);
+	}
+	first = FALSE;
+	fflush(stdout);
+
+	for(i = 0; i < baseline_count; i++) {
+	  if(baseline[i].limbs == limbs && strcmp(baseline[i].kernel, kernels[k].name) == 0 &&
+	     median > baseline[i].median * (1 + threshold / 100)) {
+	    fprintf(stderr, "regression: %s limbs=%lu median %.1f ns vs baseline %.1f ns (+%.1f%%)\n",
+		    kernels[k].name, limbs, median, baseline[i].median,
+		    (median / baseline[i].median - 1) * 100);
+	    regressed = TRUE;
+	  }
+	}
+
+	if(kernels[k].teardown) {
+	  kernels[k].teardown(&ctx);
+	}
+	free(ctx.a);
+	free(ctx.b);
+	free(ctx.c);
+	free(ctx.work);
+      }
+    }
+  }
+
+  if(json) {
+    printf("\n]\n");
+  }
+  free(baseline);
+  return regressed ? 1 : 0;
+}
@@ -1,4 +1,11 @@
 #include "bigmath.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <sys/random.h>
+#include <sys/eventfd.h>
 
 //************* WARNING ***************
 // * If you do not allocate sufficient *
@@ -8,6 +15,583 @@
 // * There are no checks               *
 // *************************************/
 
+#ifdef BIGMATH_INSTRUMENT
+#include <x86intrin.h>
+
+static __thread bigmath_stats _stats;
+static stat_trace_hook _trace_hook = NULL;
+static void* _trace_context = NULL;
+
+static inline void _stat_record(stat_kernel kernel, uint64_t limbs, uint64_t start) {
+  uint64_t cycles = __rdtsc() - start;
+  kernel_stats* entry = &_stats.kernels[kernel];
+  entry->calls++;
+  entry->limbs += limbs;
+  entry->cycles += cycles;
+  if(_trace_hook != NULL) {
+    _trace_hook(kernel, limbs, cycles, _trace_context);
+  }
+}
+
+#define STAT_BEGIN() uint64_t _stat_start = __rdtsc()
+#define STAT_END(kernel, limbs) _stat_record(kernel, limbs, _stat_start)
+#define STAT_BYTES(kernel, size) (_stats.kernels[kernel].bytes += (size))
+#else
+#define STAT_BEGIN()
+#define STAT_END(kernel, limbs)
+#define STAT_BYTES(kernel, size)
+#endif
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+///
+/// CPU dispatch
+///
+
+/**
+ * Kernels with ISA specific versions. _cpu starts out portable and is
+ * upgraded once at load time, so it is usable from other libraries'
+ * constructors too.
+ */
+typedef struct {
+  uint64_t (*add_n)(uint64_t* dest, uint64_t* incr, uint64_t length);
+  uint64_t (*sub_n)(uint64_t* dest, uint64_t* decr, uint64_t length);
+  uint64_t (*mul_1)(uint64_t* dest, uint64_t* src, uint64_t length, uint64_t scale);
+  uint64_t (*addmul_1)(uint64_t* dest, uint64_t* src, uint64_t length, uint64_t scale);
+  uint64_t (*submul_1)(uint64_t* dest, uint64_t* src, uint64_t length, uint64_t scale);
+  uint64_t (*popcount)(uint64_t* segments, uint64_t length);
+  uint64_t (*xor_popcount)(uint64_t* seg1, uint64_t* seg2, uint64_t length);
+  void (*hash_blocks)(uint64_t* acc, uint64_t* segments, uint64_t blocks, uint64_t* keys);
+} cpu_kernels;
+
+static uint64_t _add_n_portable(uint64_t* dest, uint64_t* incr, uint64_t length) {
+  uint64_t i, sum, carry = 0;
+  for(i = 0; i < length; i++) {
+    sum = dest[i] + carry;
+    carry = sum < carry;
+    dest[i] = sum + incr[i];
+    carry += dest[i] < sum;
+  }
+  return carry;
+}
+
+static uint64_t _sub_n_portable(uint64_t* dest, uint64_t* decr, uint64_t length) {
+  uint64_t i, diff, borrow = 0;
+  for(i = 0; i < length; i++) {
+    diff = dest[i] - borrow;
+    borrow = dest[i] < borrow;
+    borrow += diff < decr[i];
+    dest[i] = diff - decr[i];
+  }
+  return borrow;
+}
+
+static uint64_t _mul_1_portable(uint64_t* dest, uint64_t* src, uint64_t length, uint64_t scale) {
+  unsigned __int128 product;
+  uint64_t i, carry = 0;
+  for(i = 0; i < length; i++) {
+    product = (unsigned __int128) src[i] * scale + carry;
+    dest[i] = (uint64_t) product;
+    carry = product >> 64;
+  }
+  return carry;
+}
+
+static uint64_t _addmul_1_portable(uint64_t* dest, uint64_t* src, uint64_t length, uint64_t scale) {
+  unsigned __int128 product;
+  uint64_t i, carry = 0;
+  for(i = 0; i < length; i++) {
+    product = (unsigned __int128) src[i] * scale + dest[i] + carry;
+    dest[i] = (uint64_t) product;
+    carry = product >> 64;
+  }
+  return carry;
+}
+
+static uint64_t _submul_1_portable(uint64_t* dest, uint64_t* src, uint64_t length, uint64_t scale) {
+  unsigned __int128 product;
+  uint64_t i, lo, hi, borrow = 0;
+  for(i = 0; i < length; i++) {
+    product = (unsigned __int128) src[i] * scale + borrow;
+    lo = (uint64_t) product;
+    hi = product >> 64;
+    hi += dest[i] < lo;
+    dest[i] -= lo;
+    borrow = hi;
+  }
+  return borrow;
+}
+
+static uint64_t _popcount_portable(uint64_t* segments, uint64_t length) {
+  uint64_t i, count = 0;
+  for(i = 0; i < length; i++) {
+    count += __builtin_popcountl(segments[i]);
+  }
+  return count;
+}
+
+static uint64_t _xor_popcount_portable(uint64_t* seg1, uint64_t* seg2, uint64_t length) {
+  uint64_t i, count = 0;
+  for(i = 0; i < length; i++) {
+    count += __builtin_popcountl(seg1[i] ^ seg2[i]);
+  }
+  return count;
+}
+
+/**
+ * Limb hash accumulation. Segment j goes to lane j % 4 of acc as
+ *   acc += lo32(x ^ k) * hi32(x ^ k) + x
+ * with k the lane's key advanced by _hash_step per block of 4
+ * segments. Lanes only ever add, so wider tiers can run several
+ * blocks side by side and fold them at the end.
+ */
+static const uint64_t _hash_step = 0x9E3779B97F4A7C15;
+
+static inline uint64_t _hash_limb(uint64_t x, uint64_t key) {
+  uint64_t v = x ^ key;
+  return (v & 0xFFFFFFFF) * (v >> 32) + x;
+}
+
+static void _hash_blocks_portable(uint64_t* acc, uint64_t* segments, uint64_t blocks,
+				  uint64_t* keys) {
+  uint64_t i, lane, key[4];
+  memcpy(key, keys, sizeof(key));
+  for(i = 0; i < blocks; i++) {
+    for(lane = 0; lane < 4; lane++) {
+      acc[lane] += _hash_limb(segments[4 * i + lane], key[lane]);
+      key[lane] += _hash_step;
+    }
+  }
+}
+
+static const cpu_kernels _cpu_portable = {
+  _add_n_portable, _sub_n_portable, _mul_1_portable, _addmul_1_portable,
+  _submul_1_portable, _popcount_portable, _xor_popcount_portable, _hash_blocks_portable
+};
+
+static cpu_kernels _cpu = {
+  _add_n_portable, _sub_n_portable, _mul_1_portable, _addmul_1_portable,
+  _submul_1_portable, _popcount_portable, _xor_popcount_portable, _hash_blocks_portable
+};
+
+static cpu_tier _cpu_supported = CPU_PORTABLE;
+static cpu_tier _cpu_active = CPU_PORTABLE;
+
+#if defined(__x86_64__)
+
+/**
+ * BMI2/ADX tier. The loops index from -length up to 0 in rcx so that
+ * lea and jrcxz can advance them without touching the carry flags.
+ * addmul_1 and submul_1 keep two carry chains in flight: CF (adcx)
+ * adds the previous high word into the low product, OF (adox) adds it
+ * into dest. submul_1 subtracts through OF as ~(~dest + x), since sbb
+ * would clobber OF.
+ */
+static uint64_t _add_n_adx(uint64_t* dest, uint64_t* incr, uint64_t length) {
+  long index = -(long) length;
+  uint64_t word;
+  if(length == 0) {
+    return 0;
+  }
+  asm volatile(
+      "clc\n\t"
+      "1: movq (%[dest],%[index],8), %[word]\n\t"
+      "adcq (%[incr],%[index],8), %[word]\n\t"
+      "movq %[word], (%[dest],%[index],8)\n\t"
+      "leaq 1(%[index]), %[index]\n\t"
+      "jrcxz 2f\n\t"
+      "jmp 1b\n\t"
+      "2: setc %b[word]\n\t"
+      "movzbq %b[word], %[word]"
+      : [index] "+&c" (index), [word] "=&r" (word)
+      : [dest] "r" (dest + length), [incr] "r" (incr + length)
+      : "cc", "memory");
+  return word;
+}
+
+static uint64_t _sub_n_adx(uint64_t* dest, uint64_t* decr, uint64_t length) {
+  long index = -(long) length;
+  uint64_t word;
+  if(length == 0) {
+    return 0;
+  }
+  asm volatile(
+      "clc\n\t"
+      "1: movq (%[dest],%[index],8), %[word]\n\t"
+      "sbbq (%[decr],%[index],8), %[word]\n\t"
+      "movq %[word], (%[dest],%[index],8)\n\t"
+      "leaq 1(%[index]), %[index]\n\t"
+      "jrcxz 2f\n\t"
+      "jmp 1b\n\t"
+      "2: setc %b[word]\n\t"
+      "movzbq %b[word], %[word]"
+      : [index] "+&c" (index), [word] "=&r" (word)
+      : [dest] "r" (dest + length), [decr] "r" (decr + length)
+      : "cc", "memory");
+  return word;
+}
+
+static uint64_t _mul_1_mulx(uint64_t* dest, uint64_t* src, uint64_t length, uint64_t scale) {
+  long index = -(long) length;
+  uint64_t carry = 0, lo, hi;
+  if(length == 0) {
+    return 0;
+  }
+  asm volatile(
+      "xorl %k[lo], %k[lo]\n\t"
+      "1: mulxq (%[src],%[index],8), %[lo], %[hi]\n\t"
+      "adcxq %[carry], %[lo]\n\t"
+      "movq %[lo], (%[dest],%[index],8)\n\t"
+      "movq %[hi], %[carry]\n\t"
+      "leaq 1(%[index]), %[index]\n\t"
+      "jrcxz 2f\n\t"
+      "jmp 1b\n\t"
+      "2: adcxq %[index], %[carry]"
+      : [carry] "+&r" (carry), [index] "+&c" (index), [lo] "=&r" (lo), [hi] "=&r" (hi)
+      : [dest] "r" (dest + length), [src] "r" (src + length), "d" (scale)
+      : "cc", "memory");
+  return carry;
+}
+
+static uint64_t _addmul_1_mulx(uint64_t* dest, uint64_t* src, uint64_t length, uint64_t scale) {
+  long index = -(long) length;
+  uint64_t carry = 0, lo, hi;
+  if(length == 0) {
+    return 0;
+  }
+  asm volatile(
+      "xorl %k[lo], %k[lo]\n\t"
+      "1: mulxq (%[src],%[index],8), %[lo], %[hi]\n\t"
+      "adcxq %[carry], %[lo]\n\t"
+      "adoxq (%[dest],%[index],8), %[lo]\n\t"
+      "movq %[lo], (%[dest],%[index],8)\n\t"
+      "movq %[hi], %[carry]\n\t"
+      "leaq 1(%[index]), %[index]\n\t"
+      "jrcxz 2f\n\t"
+      "jmp 1b\n\t"
+      "2: adcxq %[index], %[carry]\n\t"
+      "adoxq %[index], %[carry]"
+      : [carry] "+&r" (carry), [index] "+&c" (index), [lo] "=&r" (lo), [hi] "=&r" (hi)
+      : [dest] "r" (dest + length), [src] "r" (src + length), "d" (scale)
+      : "cc", "memory");
+  return carry;
+}
+
+static uint64_t _submul_1_mulx(uint64_t* dest, uint64_t* src, uint64_t length, uint64_t scale) {
+  long index = -(long) length;
+  uint64_t carry = 0, lo, hi, word;
+  if(length == 0) {
+    return 0;
+  }
+  asm volatile(
+      "xorl %k[lo], %k[lo]\n\t"
+      "1: mulxq (%[src],%[index],8), %[lo], %[hi]\n\t"
+      "adcxq %[carry], %[lo]\n\t"
+      "movq (%[dest],%[index],8), %[word]\n\t"
+      "notq %[word]\n\t"
+      "adoxq %[lo], %[word]\n\t"
+      "notq %[word]\n\t"
+      "movq %[word], (%[dest],%[index],8)\n\t"
+      "movq %[hi], %[carry]\n\t"
+      "leaq 1(%[index]), %[index]\n\t"
+      "jrcxz 2f\n\t"
+      "jmp 1b\n\t"
+      "2: adcxq %[index], %[carry]\n\t"
+      "adoxq %[index], %[carry]"
+      : [carry] "+&r" (carry), [index] "+&c" (index), [lo] "=&r" (lo), [hi] "=&r" (hi),
+	[word] "=&r" (word)
+      : [dest] "r" (dest + length), [src] "r" (src + length), "d" (scale)
+      : "cc", "memory");
+  return carry;
+}
+
+__attribute__((target("popcnt")))
+static uint64_t _popcount_hw(uint64_t* segments, uint64_t length) {
+  uint64_t i, count = 0;
+  for(i = 0; i < length; i++) {
+    count += __builtin_popcountl(segments[i]);
+  }
+  return count;
+}
+
+__attribute__((target("popcnt")))
+static uint64_t _xor_popcount_hw(uint64_t* seg1, uint64_t* seg2, uint64_t length) {
+  uint64_t i, count = 0;
+  for(i = 0; i < length; i++) {
+    count += __builtin_popcountl(seg1[i] ^ seg2[i]);
+  }
+  return count;
+}
+
+/**
+ * AVX2 tier: per byte popcounts by nibble table lookup (vpshufb),
+ * summed into 64 bit lanes with vpsadbw.
+ */
+__attribute__((target("avx2,popcnt")))
+static inline __m256i _popcount_lanes_avx2(__m256i v) {
+  const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+					 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  __m256i lo = _mm256_shuffle_epi8(table, _mm256_and_si256(v, nibble));
+  __m256i hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+  return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2,popcnt")))
+static uint64_t _sum_lanes_avx2(__m256i acc) {
+  return _mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) +
+    _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3);
+}
+
+__attribute__((target("avx2,popcnt")))
+static uint64_t _popcount_avx2(uint64_t* segments, uint64_t length) {
+  __m256i acc = _mm256_setzero_si256();
+  uint64_t i, count;
+  for(i = 0; i + 4 <= length; i += 4) {
+    acc = _mm256_add_epi64(acc, _popcount_lanes_avx2(_mm256_loadu_si256((__m256i*) (segments + i))));
+  }
+  for(count = _sum_lanes_avx2(acc); i < length; i++) {
+    count += __builtin_popcountl(segments[i]);
+  }
+  return count;
+}
+
+__attribute__((target("avx2,popcnt")))
+static uint64_t _xor_popcount_avx2(uint64_t* seg1, uint64_t* seg2, uint64_t length) {
+  __m256i acc = _mm256_setzero_si256();
+  uint64_t i, count;
+  for(i = 0; i + 4 <= length; i += 4) {
+    acc = _mm256_add_epi64(acc, _popcount_lanes_avx2(
+	_mm256_xor_si256(_mm256_loadu_si256((__m256i*) (seg1 + i)),
+			 _mm256_loadu_si256((__m256i*) (seg2 + i)))));
+  }
+  for(count = _sum_lanes_avx2(acc); i < length; i++) {
+    count += __builtin_popcountl(seg1[i] ^ seg2[i]);
+  }
+  return count;
+}
+
+/**
+ * One block of 4 segments per step, vpmuludq doing the 32 x 32 bit
+ * products
+ */
+__attribute__((target("avx2")))
+static void _hash_blocks_avx2(uint64_t* acc, uint64_t* segments, uint64_t blocks,
+			      uint64_t* keys) {
+  const __m256i step = _mm256_set1_epi64x(_hash_step);
+  __m256i sum = _mm256_loadu_si256((__m256i*) acc);
+  __m256i key = _mm256_loadu_si256((__m256i*) keys);
+  __m256i x, v;
+  uint64_t i;
+  for(i = 0; i < blocks; i++) {
+    x = _mm256_loadu_si256((__m256i*) (segments + 4 * i));
+    v = _mm256_xor_si256(x, key);
+    sum = _mm256_add_epi64(sum, _mm256_add_epi64(_mm256_mul_epu32(v, _mm256_srli_epi64(v, 32)), x));
+    key = _mm256_add_epi64(key, step);
+  }
+  _mm256_storeu_si256((__m256i*) acc, sum);
+}
+
+/**
+ * AVX-512 tier: vpopcntq on 8 segments at a time, the tail through a
+ * masked load.
+ */
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static uint64_t _popcount_avx512(uint64_t* segments, uint64_t length) {
+  __m512i acc = _mm512_setzero_si512();
+  uint64_t i;
+  for(i = 0; i + 8 <= length; i += 8) {
+    acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(_mm512_loadu_si512(segments + i)));
+  }
+  if(i < length) {
+    __mmask8 tail = (1 << (length - i)) - 1;
+    acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(_mm512_maskz_loadu_epi64(tail, segments + i)));
+  }
+  return _mm512_reduce_add_epi64(acc);
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static uint64_t _xor_popcount_avx512(uint64_t* seg1, uint64_t* seg2, uint64_t length) {
+  __m512i acc = _mm512_setzero_si512();
+  uint64_t i;
+  for(i = 0; i + 8 <= length; i += 8) {
+    acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(
+	_mm512_xor_si512(_mm512_loadu_si512(seg1 + i), _mm512_loadu_si512(seg2 + i))));
+  }
+  if(i < length) {
+    __mmask8 tail = (1 << (length - i)) - 1;
+    acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(
+	_mm512_xor_si512(_mm512_maskz_loadu_epi64(tail, seg1 + i),
+			 _mm512_maskz_loadu_epi64(tail, seg2 + i))));
+  }
+  return _mm512_reduce_add_epi64(acc);
+}
+
+/**
+ * Two blocks per step, the upper half of the registers one block
+ * ahead; an odd last block only adds into the lower half
+ */
+__attribute__((target("avx512f")))
+static void _hash_blocks_avx512(uint64_t* acc, uint64_t* segments, uint64_t blocks,
+				uint64_t* keys) {
+  const __m512i step = _mm512_set1_epi64(2 * _hash_step);
+  __m256i first = _mm256_loadu_si256((__m256i*) keys);
+  __m512i sum = _mm512_zextsi256_si512(_mm256_loadu_si256((__m256i*) acc));
+  __m512i key = _mm512_inserti64x4(_mm512_castsi256_si512(first),
+				   _mm256_add_epi64(first, _mm256_set1_epi64x(_hash_step)), 1);
+  __m512i x, v;
+  uint64_t i;
+  for(i = 0; i + 2 <= blocks; i += 2) {
+    x = _mm512_loadu_si512(segments + 4 * i);
+    v = _mm512_xor_si512(x, key);
+    sum = _mm512_add_epi64(sum, _mm512_add_epi64(_mm512_mul_epu32(v, _mm512_srli_epi64(v, 32)), x));
+    key = _mm512_add_epi64(key, step);
+  }
+  if(i < blocks) {
+    x = _mm512_maskz_loadu_epi64(0x0F, segments + 4 * i);
+    v = _mm512_xor_si512(x, key);
+    sum = _mm512_mask_add_epi64(sum, 0x0F, sum,
+				_mm512_add_epi64(_mm512_mul_epu32(v, _mm512_srli_epi64(v, 32)), x));
+  }
+  _mm256_storeu_si256((__m256i*) acc, _mm256_add_epi64(_mm512_castsi512_si256(sum),
+						       _mm512_extracti64x4_epi64(sum, 1)));
+}
+
+/**
+ * Highest tier whose instructions the CPU has and the OS saves the
+ * registers of
+ */
+static cpu_tier _detect_cpu_tier(void) {
+  unsigned int eax, ebx, ecx, edx, xcr0_lo = 0, xcr0_hi;
+  bool popcnt, osxsave;
+  cpu_tier tier = CPU_PORTABLE;
+
+  if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return tier;
+  }
+  popcnt = (ecx & bit_POPCNT) != 0;
+  osxsave = (ecx & bit_OSXSAVE) != 0;
+  if(osxsave) {
+    asm("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+  }
+  if(!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    return tier;
+  }
+
+  if(popcnt && (ebx & bit_BMI2) && (ebx & bit_ADX)) {
+    tier = CPU_BMI2;
+  } else {
+    return tier;
+  }
+  //ymm state
+  if((ebx & bit_AVX2) && (xcr0_lo & 0x06) == 0x06) {
+    tier = CPU_AVX2;
+  } else {
+    return tier;
+  }
+  //opmask and zmm state
+  if((ebx & bit_AVX512F) && (ecx & bit_AVX512VPOPCNTDQ) && (xcr0_lo & 0xe6) == 0xe6) {
+    tier = CPU_AVX512;
+  }
+  return tier;
+}
+
+#else
+
+static cpu_tier _detect_cpu_tier(void) {
+  return CPU_PORTABLE;
+}
+
+#endif
+
+static void _select_cpu_kernels(cpu_tier tier) {
+  _cpu = _cpu_portable;
+#if defined(__x86_64__)
+  if(tier >= CPU_BMI2) {
+    _cpu.add_n = _add_n_adx;
+    _cpu.sub_n = _sub_n_adx;
+    _cpu.mul_1 = _mul_1_mulx;
+    _cpu.addmul_1 = _addmul_1_mulx;
+    _cpu.submul_1 = _submul_1_mulx;
+    _cpu.popcount = _popcount_hw;
+    _cpu.xor_popcount = _xor_popcount_hw;
+  }
+  if(tier >= CPU_AVX2) {
+    _cpu.popcount = _popcount_avx2;
+    _cpu.xor_popcount = _xor_popcount_avx2;
+    _cpu.hash_blocks = _hash_blocks_avx2;
+  }
+  if(tier >= CPU_AVX512) {
+    _cpu.popcount = _popcount_avx512;
+    _cpu.xor_popcount = _xor_popcount_avx512;
+    _cpu.hash_blocks = _hash_blocks_avx512;
+  }
+#endif
+  _cpu_active = tier;
+}
+
+static const char* _cpu_tier_names[CPU_TIER_COUNT] = {
+  "portable", "bmi2", "avx2", "avx512"
+};
+
+/**
+ * Picks the kernels once at load. BIGMATH_CPU=portable|bmi2|avx2|avx512
+ * caps the tier, so lower tiers can be exercised on newer hardware.
+ */
+__attribute__((constructor))
+static void _init_cpu_dispatch(void) {
+  const char* forced = getenv("BIGMATH_CPU");
+  cpu_tier tier;
+
+  _cpu_supported = _detect_cpu_tier();
+  tier = _cpu_supported;
+  if(forced != NULL) {
+    for(tier = CPU_PORTABLE; tier < CPU_TIER_COUNT; tier++) {
+      if(strcmp(forced, _cpu_tier_names[tier]) == 0) {
+	break;
+      }
+    }
+    if(tier == CPU_TIER_COUNT) {
+      fprintf(stderr, "bigmath: unknown BIGMATH_CPU tier '%s'\n", forced);
+      tier = _cpu_supported;
+    } else if(tier > _cpu_supported) {
+      tier = _cpu_supported;
+    }
+  }
+  _select_cpu_kernels(tier);
+}
+
+cpu_tier cpu_tier_supported(void) {
+  return _cpu_supported;
+}
+
+cpu_tier cpu_tier_active(void) {
+  return _cpu_active;
+}
+
+/**
+ * Switches kernels to the given tier, clamped to what the CPU
+ * supports, and returns the tier now in use. Not thread safe; call it
+ * before other threads use the library.
+ */
+cpu_tier set_cpu_tier(cpu_tier tier) {
+  if(tier > _cpu_supported) {
+    tier = _cpu_supported;
+  }
+  _select_cpu_kernels(tier);
+  return tier;
+}
+
+const char* cpu_tier_name(cpu_tier tier) {
+  if(tier >= CPU_TIER_COUNT) {
+    return NULL;
+  }
+  return _cpu_tier_names[tier];
+}
+
 bigint* alloc_bigint(uint64_t digits) {
   return alloc_bigint_base(digits, 10);
 }
@@ -44,11 +628,14 @@ void free_bigint(bigint* value) {
 ///
 
 uint64_t* shl_segments(uint64_t* dest, uint64_t length, uint64_t offset) {
+  STAT_BEGIN();
   while(offset > 63) {
     _shl_segments(dest, length, 63);
     offset -= 63;
   }
-  return _shl_segments(dest, length, offset);
+  dest = _shl_segments(dest, length, offset);
+  STAT_END(STAT_SHL, length);
+  return dest;
 }
 
 uint64_t* _shl_segments(uint64_t* dest, uint64_t length, byte offset) {
@@ -56,6 +643,10 @@ uint64_t* _shl_segments(uint64_t* dest, uint64_t length, byte offset) {
     return NULL;
   }
 
+  if(offset == 0) {
+    return dest;
+  }
+
   const byte carry_shift = sizeof(uint64_t) * 8 - offset;
   uint64_t i, orig, overflow = 0;
   for(i = 0; i < length; i++) {
@@ -67,11 +658,14 @@ uint64_t* _shl_segments(uint64_t* dest, uint64_t length, byte offset) {
 }
 
 uint64_t* shr_segments(uint64_t* dest, uint64_t length, uint64_t offset) {
+  STAT_BEGIN();
   while(offset > 63) {
     _shr_segments(dest, length, 63);
     offset -= 63;
   }
-  return _shr_segments(dest, length, offset);
+  dest = _shr_segments(dest, length, offset);
+  STAT_END(STAT_SHR, length);
+  return dest;
 }
 
 uint64_t* _shr_segments(uint64_t* dest, uint64_t length, byte offset) {
@@ -79,6 +673,10 @@ uint64_t* _shr_segments(uint64_t* dest, uint64_t length, byte offset) {
     return NULL;
   }
 
+  if(offset == 0) {
+    return dest;
+  }
+
   const byte carry_shift = sizeof(uint64_t) * 8 - offset;
   uint64_t i;
   for(i = 0; i < length-1; i++) {
@@ -92,33 +690,9 @@ uint64_t* _shr_segments(uint64_t* dest, uint64_t length, byte offset) {
  * Requires both dest and incr to have the same length
  */
 uint64_t* add_segments(uint64_t* dest, uint64_t* incr, uint64_t length) {
-  unsigned long preserve_carry_bool = FALSE;
-  unsigned long index = 0;
-  asm __volatile__(
-      "movq $1, %%r10\n\t"
-      "1:movq (%0,%2,8), %%r11\n\t"
-      "movq (%1,%2,8), %%r12\n\t"
-      "cmp $0x0, %4\n\t"
-      "jne 2f\n\t"
-      "addq %%r11, %%r12\n\t"
-      "cmovc %%r10, %4\n\t" //preserve with carry is already 0 
-      "jmp 3f\n\t"
-      "2: stc\n\t"
-      "movq $0, %4\n\t"
-      "adcq %%r11, %%r12\n\t"
-      "cmovc %%r10, %4\n\t"
-      "3: movq %%r12, (%0,%2,8)\n\t"
-      "inc %2\n\t"
-      "cmp %2, %3\n\t"
-      "jne 1b"
-      : /* no outputs */
-      : "r" (dest), 
-	"r" (incr), 
-	"r" (index),
-	"r" (length),
-	"r" (preserve_carry_bool)
-      : "r10", "r11", "r12", "memory"
-		   );
+  STAT_BEGIN();
+  _cpu.add_n(dest, incr, length);
+  STAT_END(STAT_ADD, length);
   return dest;
 }
 
@@ -126,475 +700,6912 @@ uint64_t* add_segments(uint64_t* dest, uint64_t* incr, uint64_t length) {
  * Requires both dest and decr to have the same length
  */
 uint64_t* sub_segments(uint64_t* dest, uint64_t* decr, uint64_t length) {
-  //check gt/e etc
-  unsigned long preserve_carry_bool = FALSE;
-  unsigned long index = 0;
-  asm __volatile__(
-      "movq $1, %%r10\n\t"
-      "1:movq (%0,%2,8), %%r12\n\t"
-      "movq (%1,%2,8), %%r11\n\t"
-      "cmp $0x0, %4\n\t"
-      "jne 2f\n\t"
-      "subq %%r11, %%r12\n\t"
-      "cmovc %%r10, %4\n\t" //preserve with carry is already 0 
-      "jmp 3f\n\t"
-      "2: stc\n\t"
-      "movq $0, %4\n\t"
-      "sbbq %%r11, %%r12\n\t"
-      "cmovc %%r10, %4\n\t"
-      "3: movq %%r12, (%0,%2,8)\n\t"
-      "inc %2\n\t"
-      "cmp %2, %3\n\t"
-      "jne 1b"
-      : /* no outputs */
-      : "r" (dest), 
-	"r" (decr), 
-	"r" (index),
-	"r" (length),
-	"r" (preserve_carry_bool)
-      : "r10", "r11", "r12", "memory"
-		   );
-  //should output preserve_carry_bool and detect overflow?
+  STAT_BEGIN();
+  //should output the borrow and detect overflow?
+  _cpu.sub_n(dest, decr, length);
+  STAT_END(STAT_SUB, length);
   return dest;
 }
 
-uint64_t* mul_segments(uint64_t* dest, uint64_t *scale, uint64_t length) {
-  size_t scratch_size = sizeof(uint64_t) * length;
-  uint64_t* scratch = malloc(scratch_size);
-  memset(scratch, 0, scratch_size);
+/**
+ * Number of significant segments, i.e. the index of the highest non
+ * zero segment + 1. Zero has size 0.
+ */
+static uint64_t _size_segments(uint64_t* segments, uint64_t length) {
+  while(length && segments[length-1] == 0) {
+    length--;
+  }
+  return length;
+}
 
-  uint64_t msb = _msb(dest, length);
+/**
+ * Trailing zero bits of a non zero value
+ */
+static uint64_t _ctz_segments(uint64_t* segments, uint64_t length) {
+  uint64_t i;
+  for(i = 0; i < length && segments[i] == 0; i++);
+  return i * sizeof(uint64_t) * 8 + __builtin_ctzl(segments[i]);
+}
 
-  int i, j;
-  uint64_t multiplier, bits=0;
-  for(i = 0; i < length; i++) {
-    multiplier = scale[i];
-    for(j=0; j < sizeof(uint64_t) * 8; j++) {
-      if(multiplier & 0x1) {
-	add_segments(scratch, dest, length);
-      }
-      shl_segments(dest, length, 1);
-      multiplier >>= 1;
-      bits++;
-    }
-    if(bits > msb) {
-      break;
-    }
+/**
+ * shr_segments, but whole segments are moved in one step instead of
+ * 63 bits at a time
+ */
+static void _shr_bits(uint64_t* dest, uint64_t length, uint64_t bits) {
+  const byte segment_size_bits = sizeof(uint64_t) * 8;
+  uint64_t words = bits / segment_size_bits;
+  if(words) {
+    memmove(dest, dest + words, (length - words) * sizeof(uint64_t));
+    memset(dest + length - words, 0, words * sizeof(uint64_t));
   }
+  if(bits % segment_size_bits) {
+    shr_segments(dest, length - words, bits % segment_size_bits);
+  }
+}
 
-  memcpy(dest, scratch, scratch_size);
-  free(scratch);
-  return dest;
+static uint64_t _add_n(uint64_t* dest, uint64_t* incr, uint64_t length) {
+  return _cpu.add_n(dest, incr, length);
 }
 
-uint64_t* div_segments(uint64_t* dest, uint64_t *divisor, uint64_t length) {
-  uint64_t msb_dest = _msb(dest, length);
-  uint64_t msb_divisor = _msb(divisor, length);
-  int diff;
+/**
+ * Single segment kernels. One linear pass each, no allocation; the
+ * carry, borrow or remainder out of the top segment is returned.
+ */
 
-  size_t scratch_size = length * sizeof(uint64_t);
+/**
+ * dest = src * scale. dest may be src.
+ */
+uint64_t mul_1_segments(uint64_t* dest, uint64_t* src, uint64_t length, uint64_t scale) {
+  STAT_BEGIN();
+  uint64_t carry = _cpu.mul_1(dest, src, length, scale);
+  STAT_END(STAT_MUL_1, length);
+  return carry;
+}
 
-  if(msb_divisor > msb_dest) {
-    memset(dest, 0, scratch_size);
-    return dest;
-  } else if(msb_divisor < msb_dest) {
-    diff = msb_dest - msb_divisor;
-    shl_segments(divisor, length, diff);
-  } //else already aligned
+/**
+ * dest += src * scale
+ */
+uint64_t addmul_1_segments(uint64_t* dest, uint64_t* src, uint64_t length, uint64_t scale) {
+  STAT_BEGIN();
+  uint64_t carry = _cpu.addmul_1(dest, src, length, scale);
+  STAT_END(STAT_ADDMUL_1, length);
+  return carry;
+}
 
-  uint64_t *scratch = malloc(scratch_size);
-  memcpy(scratch, dest, scratch_size);
-  memset(dest, 0, scratch_size);
+/**
+ * dest -= src * scale
+ */
+uint64_t submul_1_segments(uint64_t* dest, uint64_t* src, uint64_t length, uint64_t scale) {
+  STAT_BEGIN();
+  uint64_t borrow = _cpu.submul_1(dest, src, length, scale);
+  STAT_END(STAT_SUBMUL_1, length);
+  return borrow;
+}
 
-  int i;
-  for(i = 0; i <= diff; i++) {
-    shl_segments(dest, length, 1);
-    if(gte(scratch, divisor, length)) {
-      sub_segments(scratch, divisor, length);
-      dest[0] |= 0x1;
-    }
-    shl_segments(scratch, length, 1);
+/**
+ * dest += incr, stops as soon as the carry dies out
+ */
+uint64_t add_1_segments(uint64_t* dest, uint64_t length, uint64_t incr) {
+  uint64_t i;
+  for(i = 0; i < length && incr; i++) {
+    dest[i] += incr;
+    incr = dest[i] < incr;
   }
+  return incr;
+}
 
-  free(scratch);
+/**
+ * dest -= decr, stops as soon as the borrow dies out
+ */
+uint64_t sub_1_segments(uint64_t* dest, uint64_t length, uint64_t decr) {
+  uint64_t i, orig;
+  for(i = 0; i < length && decr; i++) {
+    orig = dest[i];
+    dest[i] -= decr;
+    decr = dest[i] > orig;
+  }
+  return decr;
+}
 
-  return dest;
+/**
+ * Reciprocal of a normalized (top bit set) divisor:
+ * floor((2^128 - 1) / divisor) - 2^64
+ */
+uint64_t reciprocal_word(uint64_t divisor) {
+  return (((unsigned __int128) ~divisor << 64) | ~(uint64_t) 0) / divisor;
 }
 
-uint64_t* div_segments_mod(uint64_t* dest, uint64_t* divisor, uint64_t length) {
-  uint64_t* remainder;
+/**
+ * Divide the two segment value high:low (high < divisor) by a
+ * normalized divisor using its precomputed reciprocal; multiplications
+ * only (Moller & Granlund, "Improved division by invariant integers",
+ * algorithm 4).
+ */
+static inline uint64_t _divrem_2by1(uint64_t* remainder, uint64_t high, uint64_t low,
+				   uint64_t divisor, uint64_t reciprocal) {
+  unsigned __int128 q = (unsigned __int128) reciprocal * high +
+    ((unsigned __int128) high << 64 | low);
+  uint64_t q1 = (uint64_t) (q >> 64) + 1, q0 = (uint64_t) q;
+  uint64_t r = low - q1 * divisor;
+  if(r > q0) {
+    q1--;
+    r += divisor;
+  }
+  if(r >= divisor) {
+    q1++;
+    r -= divisor;
+  }
+  *remainder = r;
+  return q1;
+}
 
-  uint64_t msb_dest = _msb(dest, length);
-  uint64_t msb_divisor = _msb(divisor, length);
-  int diff;
+/**
+ * Fill in the normalized form and reciprocal of a non zero divisor
+ */
+void init_nat_divisor(nat_divisor* pre, uint64_t divisor) {
+  pre->divisor = divisor;
+  pre->shift = sizeof(uint64_t) * 8 - 1 - _log2(divisor);
+  pre->norm = divisor << pre->shift;
+  pre->reciprocal = reciprocal_word(pre->norm);
+}
 
-  size_t scratch_size = length * sizeof(uint64_t);
+/**
+ * Precompute everything needed to divide by a fixed word, so repeated
+ * divisions skip the reciprocal. Returns NULL for a zero divisor.
+ */
+nat_divisor* create_nat_divisor(uint64_t divisor) {
+  nat_divisor* pre;
+  if(divisor == 0) {
+    return NULL;
+  }
+  pre = malloc(sizeof(nat_divisor));
+  init_nat_divisor(pre, divisor);
+  return pre;
+}
 
-  if(msb_divisor > msb_dest) {
-    remainder = malloc(scratch_size);
-    memcpy(remainder, dest, scratch_size);
-    memset(dest, 0, scratch_size);
-    return rem;
-  } else if(msb_divisor < msb_dest) {
-    diff = msb_dest - msb_divisor;
-    shl_segments(divisor, length, diff);
-  } //else already aligned
+void free_nat_divisor(nat_divisor* pre) {
+  free(pre);
+}
 
-  remainder = malloc(scratch_size);
-  memcpy(remainder, dest, scratch_size);
-  memset(dest, 0, scratch_size);
+/**
+ * The loop behind divrem_pre_segments and mod_pre_segments; a NULL
+ * dest drops the quotient, and inlining folds the test away.
+ */
+static inline uint64_t _divrem_pre(uint64_t* dest, uint64_t* src, uint64_t length,
+				   nat_divisor* pre) {
+  const byte segment_size_bits = sizeof(uint64_t) * 8;
+  uint64_t i, numerator, q, r = 0;
 
-  int i;
-  for(i = 0; i <= diff; i++) {
-    shl_segments(dest, length, 1);
-    if(gte(remainder, divisor, length)) {
-      sub_segments(remainder, divisor, length);
-      dest[0] |= 0x1;
+  if(pre->shift) {
+    r = src[length-1] >> (segment_size_bits - pre->shift);
+  }
+  for(i = length; i-- > 0;) {
+    numerator = src[i] << pre->shift;
+    if(pre->shift && i) {
+      numerator |= src[i-1] >> (segment_size_bits - pre->shift);
+    }
+    q = _divrem_2by1(&r, r, numerator, pre->norm, pre->reciprocal);
+    if(dest) {
+      dest[i] = q;
     }
-    shl_segments(remainder, length, 1);
   }
-  shr_segments(remainder, length, diff+1);
+  return r >> pre->shift;
+}
 
-  return remainder;
+/**
+ * dest = src / divisor, returns src % divisor. dest may be src. The
+ * operand is shifted on the fly to match the normalized divisor, so
+ * each segment costs two multiplications instead of a div.
+ */
+uint64_t divrem_pre_segments(uint64_t* dest, uint64_t* src, uint64_t length,
+			     nat_divisor* pre) {
+  uint64_t r;
+  if(length == 0) {
+    return 0;
+  }
+  STAT_BEGIN();
+  r = _divrem_pre(dest, src, length, pre);
+  STAT_END(STAT_DIVREM_1, length);
+  return r;
 }
 
-uint64_t* pow_segments(uint64_t *dest, uint64_t pow, uint64_t len) {
-  size_t scratch_size = sizeof(uint64_t) * len;
-  if(pow == 0) {
-    memset(dest, 0, scratch_size);
-    dest[0] = 1;
-    return dest;
-  } else if(pow == 1) {
-    return dest;
+uint64_t mod_pre_segments(uint64_t* src, uint64_t length, nat_divisor* pre) {
+  uint64_t r;
+  if(length == 0) {
+    return 0;
   }
-  uint64_t* scratch_square = malloc(scratch_size);
+  STAT_BEGIN();
+  r = _divrem_pre(NULL, src, length, pre);
+  STAT_END(STAT_MOD_1, length);
+  return r;
+}
 
-  uint64_t* scratch_factor = malloc(scratch_size);
-  memcpy(scratch_factor, dest, scratch_size);
+/**
+ * dest = src / divisor, returns src % divisor. divisor must be non zero.
+ */
+uint64_t divrem_1_segments(uint64_t* dest, uint64_t* src, uint64_t length, uint64_t divisor) {
+  nat_divisor pre;
+  init_nat_divisor(&pre, divisor);
+  return divrem_pre_segments(dest, src, length, &pre);
+}
 
-  uint64_t* scratch_dest = malloc(scratch_size);
-  scratch_dest[0] = 1;
+/**
+ * src % divisor, divisor must be non zero
+ */
+uint64_t mod_1_segments(uint64_t* src, uint64_t length, uint64_t divisor) {
+  nat_divisor pre;
+  init_nat_divisor(&pre, divisor);
+  return mod_pre_segments(src, length, &pre);
+}
 
-  while(pow) {
-    if(pow & 0x1) {
-      mul_segments(scratch_dest, scratch_factor, len);
-    }
-    memcpy(scratch_square, scratch_factor, scratch_size);
-    mul_segments(scratch_factor, scratch_square, len);
-    pow >>=1;
+/**
+ * Reduce a residue r < divisor extended by one more segment:
+ * (r * 2^64 + segment) % divisor. The unnormalized remainder shifted
+ * up stays below the normalized divisor, so no state carries between
+ * segments beyond r itself.
+ */
+static uint64_t _mod_pre_step(uint64_t r, uint64_t segment, nat_divisor* pre) {
+  const byte segment_size_bits = sizeof(uint64_t) * 8;
+  uint64_t high = r << pre->shift;
+  if(pre->shift) {
+    high |= segment >> (segment_size_bits - pre->shift);
   }
-  free(scratch_square);
-  free(scratch_factor);
-  memcpy(dest, scratch_dest, scratch_size);
-  free(scratch_dest);
-  return dest;
+  _divrem_2by1(&r, high, segment << pre->shift, pre->norm, pre->reciprocal);
+  return r >> pre->shift;
 }
 
+/**
+ * A batch of word moduli reduced together. Consecutive moduli are
+ * packed into groups whose product still fits a word; the operand is
+ * reduced once per group and each modulus then only needs its group
+ * residue reduced, by its own reciprocal.
+ */
+nat_divisor_set* create_nat_divisor_set(uint64_t* moduli, uint64_t count) {
+  nat_divisor_set* set = malloc(sizeof(nat_divisor_set));
+  uint64_t i, product;
 
-bool gt(uint64_t* seg1, uint64_t* seg2, uint64_t length) {
-  return _gt(seg1, seg2, length, FALSE);
-}
-
-bool gte(uint64_t* seg1, uint64_t* seg2, uint64_t length) {
-  return _gt(seg1, seg2, length, TRUE);
-}
+  set->count = count;
+  set->moduli = malloc(count * sizeof(uint64_t));
+  memcpy(set->moduli, moduli, count * sizeof(uint64_t));
+  set->divisors = malloc(count * sizeof(nat_divisor));
+  set->groups = malloc(count * sizeof(nat_divisor));
+  set->group_end = malloc(count * sizeof(uint64_t));
+  set->group_count = 0;
 
-bool _gt(uint64_t* seg1, uint64_t* seg2, uint64_t length, bool or_equal) {
-  int i;
-  for(i = length-1; i >= 0; i--) {
-    if(seg1[i] || seg2[i]) {
-      return or_equal ? seg1[i] >= seg2[i] : seg1[i] > seg2[i];
+  for(i = 0; i < count; i++) {
+    if(moduli[i] == 0) {
+      free_nat_divisor_set(set);
+      return NULL;
     }
+    init_nat_divisor(set->divisors + i, moduli[i]);
   }
-  return or_equal;
+  for(i = 0; i < count;) {
+    for(product = moduli[i++]; i < count && product <= ~(uint64_t) 0 / moduli[i]; i++) {
+      product *= moduli[i];
+    }
+    init_nat_divisor(set->groups + set->group_count, product);
+    set->group_end[set->group_count++] = i;
+  }
+  return set;
 }
 
-bool lt(uint64_t* seg1, uint64_t* seg2, uint64_t length) {
-  return _lt(seg1, seg2, length, FALSE);
+void free_nat_divisor_set(nat_divisor_set* set) {
+  free(set->moduli);
+  free(set->divisors);
+  free(set->groups);
+  free(set->group_end);
+  free(set);
 }
 
-bool lte(uint64_t* seg1, uint64_t* seg2, uint64_t length) {
-  return _lt(seg1, seg2, length, TRUE);
-}
+/**
+ * residues[i] = src % set->moduli[i] for every modulus in one pass
+ * over src.
+ */
+uint64_t* mod_multi_segments(uint64_t* residues, uint64_t* src, uint64_t length,
+			     nat_divisor_set* set) {
+  STAT_BEGIN();
+  uint64_t* group_residues = malloc(set->group_count * sizeof(uint64_t));
+  uint64_t i, g, m;
 
-bool _lt(uint64_t* seg1, uint64_t* seg2, uint64_t length, bool or_equal) {
-  int i;
-  for(i = length-1; i >= 0; i--) {
-    if(seg1[i] == 0 && seg2[i] == 0)
-      continue;
-    return or_equal ? seg1[i] <= seg2[i] : seg1[i] < seg2[i];
+  STAT_BYTES(STAT_MOD_MULTI, set->group_count * sizeof(uint64_t));
+  memset(group_residues, 0, set->group_count * sizeof(uint64_t));
+  for(i = length; i-- > 0;) {
+    for(g = 0; g < set->group_count; g++) {
+      group_residues[g] = _mod_pre_step(group_residues[g], src[i], set->groups + g);
+    }
   }
-  return or_equal;
-}
 
-bool eq(uint64_t* seg1, uint64_t* seg2, uint64_t length) {
-  int i;
-  for(i = 0; i < length; i++) {
-    if(seg1[i] != seg2[i]) return FALSE;
+  for(g = 0, m = 0; g < set->group_count; g++) {
+    for(; m < set->group_end[g]; m++) {
+      residues[m] = _mod_pre_step(0, group_residues[g], set->divisors + m);
+    }
   }
-  return TRUE;
+
+  free(group_residues);
+  STAT_END(STAT_MOD_MULTI, length);
+  return residues;
 }
 
-uint64_t _msb(uint64_t* segments, uint64_t length) {
-  int i = length - 1;
-  byte segment_size_bits = sizeof(uint64_t) * 8;
-  for(; i >= 0; i--) {
-    if(segments[i]) {
-      return (i * segment_size_bits) + _log2(segments[i]);
+/**
+ * Schoolbook long division (Knuth vol. 2, 4.3.1, algorithm D).
+ *
+ * quotient receives nlen - dlen + 1 segments and may be NULL,
+ * remainder receives dlen segments. divisor[dlen-1] must be non zero.
+ * Neither output may alias the inputs.
+ */
+static void _divrem_knuth(uint64_t* quotient, uint64_t* remainder,
+			  uint64_t* num, uint64_t nlen,
+			  uint64_t* divisor, uint64_t dlen) {
+  unsigned __int128 top, qhat, rhat;
+  uint64_t j, borrow, *un, *vn;
+  byte shift;
+
+  if(nlen < dlen) {
+    memcpy(remainder, num, nlen * sizeof(uint64_t));
+    memset(remainder + nlen, 0, (dlen - nlen) * sizeof(uint64_t));
+    return;
+  }
+
+  if(dlen == 1) {
+    if(quotient) {
+      remainder[0] = divrem_1_segments(quotient, num, nlen, divisor[0]);
+    } else {
+      remainder[0] = mod_1_segments(num, nlen, divisor[0]);
     }
+    return;
   }
-  return 0;
-}
 
-byte _log2(uint64_t segment) {
-  const uint64_t mask[] = {
-    0x2, 0xC, 0xF0, 0xFF00, 0xFFFF0000, 0xFFFFFFFF00000000
-  };
-  const byte offset[] = {
-    1, 2, 4, 8, 16, 32
-  };
-  int i;
-  register uint64_t l2 = 0;
-  for(i = 5; i >= 0; i--) {
-    if(segment & mask[i]) {
-      segment >>= offset[i];
-      l2 = l2 | offset[i];
+  STAT_BEGIN();
+  shift = sizeof(uint64_t) * 8 - 1 - _log2(divisor[dlen-1]);
+  un = malloc((nlen + 1 + dlen) * sizeof(uint64_t));
+  STAT_BYTES(STAT_DIV_KNUTH, (nlen + 1 + dlen) * sizeof(uint64_t));
+  vn = un + nlen + 1;
+  memcpy(vn, divisor, dlen * sizeof(uint64_t));
+  memcpy(un, num, nlen * sizeof(uint64_t));
+  un[nlen] = 0;
+  if(shift) {
+    _shl_segments(vn, dlen, shift);
+    _shl_segments(un, nlen + 1, shift);
+  }
+
+  for(j = nlen - dlen + 1; j-- > 0;) {
+    top = (unsigned __int128) un[j+dlen] << 64 | un[j+dlen-1];
+    if(un[j+dlen] >= vn[dlen-1]) {
+      qhat = ~(uint64_t) 0;
+      rhat = top - qhat * vn[dlen-1];
+    } else {
+      qhat = top / vn[dlen-1];
+      rhat = top % vn[dlen-1];
+    }
+    while(rhat >> 64 == 0 &&
+	  qhat * vn[dlen-2] > (rhat << 64 | un[j+dlen-2])) {
+      qhat--;
+      rhat += vn[dlen-1];
+    }
+
+    borrow = submul_1_segments(un + j, vn, dlen, qhat);
+    if(un[j+dlen] < borrow) {
+      qhat--;
+      un[j+dlen] += _add_n(un + j, vn, dlen);
+    }
+    un[j+dlen] -= borrow;
+
+    if(quotient) {
+      quotient[j] = qhat;
     }
   }
-  return l2;
+
+  if(shift) {
+    _shr_segments(un, dlen, shift);
+  }
+  memcpy(remainder, un, dlen * sizeof(uint64_t));
+  free(un);
+  STAT_END(STAT_DIV_KNUTH, nlen);
 }
 
 ///
-///
+/// Number theoretic transform
 ///
 
-inline char* bigint_to_new_str(bigint* value) {
-  return bigint_to_new_str_base(value, 10);
+/**
+ * Three primes c * 2^50 + 1 just below 2^63. Transforms of up to 2^50
+ * points exist in each, and their product, about 2^189, bounds the
+ * coefficients of a convolution of 64 bit limbs (< points * 2^128) so
+ * CRT recovers them exactly. Arithmetic is Montgomery with R = 2^64;
+ * the primes being below 2^63 means a sum of two residues never
+ * overflows a word.
+ */
+#define NTT_PRIMES 3
+#define NTT_MAX_LOG 50
+
+typedef struct {
+  uint64_t prime;
+  uint64_t inverse; /* -prime^-1 mod 2^64 */
+  uint64_t r2;      /* 2^128 mod prime */
+  uint64_t generator;
+} ntt_prime;
+
+static ntt_prime _ntt_primes[NTT_PRIMES] = {
+  {0x7fa8000000000001, 0, 0, 3},
+  {0x7f18000000000001, 0, 0, 3},
+  {0x7e78000000000001, 0, 0, 5}
+};
+
+/* Garner constants, Montgomery form: p0^-1 mod p1, (p0 p1)^-1 mod p2, p0 mod p2 */
+static uint64_t _ntt_garner[3];
+
+/**
+ * t * 2^-64 mod prime, for t < prime * 2^64
+ */
+static inline uint64_t _mont_redc(unsigned __int128 t, ntt_prime* p) {
+  uint64_t m = (uint64_t) t * p->inverse;
+  uint64_t r = (t + (unsigned __int128) m * p->prime) >> 64;
+  return r >= p->prime ? r - p->prime : r;
 }
 
-char* bigint_to_new_str_base(bigint* value, byte base) {
-  static const char decimal_alpha[] = {
-    '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 
-    'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J',
-    'K', 'L', 'M', 'N', 'O', 'P', 'Q', 'R', 'S', 'T',
-    'U', 'V', 'W', 'X', 'Y', 'Z'
-  }; //eulers will break for base > 36
+static inline uint64_t _mont_mul(uint64_t a, uint64_t b, ntt_prime* p) {
+  return _mont_redc((unsigned __int128) a * b, p);
+}
 
-  if(base == 16) {
-    return bigint_to_new_str_hex(value);
-  } else {
-    return eulers(value, base, decimal_alpha);
+static inline uint64_t _mont_from(uint64_t a, ntt_prime* p) {
+  return _mont_redc((unsigned __int128) a * p->r2, p);
+}
+
+static inline uint64_t _mod_add(uint64_t a, uint64_t b, uint64_t prime) {
+  a += b;
+  return a >= prime ? a - prime : a;
+}
+
+static inline uint64_t _mod_sub(uint64_t a, uint64_t b, uint64_t prime) {
+  return a >= b ? a - b : a + prime - b;
+}
+
+/**
+ * base^power with base and result in Montgomery form
+ */
+static uint64_t _mont_pow(uint64_t base, uint64_t power, ntt_prime* p) {
+  uint64_t result = _mont_from(1, p);
+  for(; power; power >>= 1) {
+    if(power & 1) {
+      result = _mont_mul(result, base, p);
+    }
+    base = _mont_mul(base, base, p);
   }
+  return result;
 }
 
-char* bigint_to_new_str_hex(bigint* value) {
- size_t size;
-  char* buffer, *output;
-  uint64_t temp, i, j;
-  
-  size = sizeof(char) * value->length * sizeof(uint64_t) * 8 + 1;
-  buffer = malloc(size);
-  output = malloc(size);
-  output[0] = '\0';
-  
-  for(i = 0; i < value->length; i++) {
-    temp = value->data[i];
-    for(j = 0; j < 2*sizeof(uint64_t); j++) {
-      strcpy(buffer, output);
-      sprintf(output, "%x%s", (byte) temp & 0xf, buffer);
-      temp >>= 4;
+/**
+ * Montgomery constants at load, so that transforms can run on several
+ * threads without a lazy init race
+ */
+__attribute__((constructor))
+static void _init_ntt(void) {
+  ntt_prime* p;
+  uint64_t inverse, r;
+  int i, j;
+  for(i = 0; i < NTT_PRIMES; i++) {
+    p = &_ntt_primes[i];
+    //p * p = 1 mod 8, each step doubles the correct bits
+    inverse = p->prime;
+    for(j = 0; j < 5; j++) {
+      inverse *= 2 - p->prime * inverse;
     }
-    //do we add spaces every qword?
+    p->inverse = -inverse;
+    r = ((unsigned __int128) 1 << 64) % p->prime;
+    p->r2 = (unsigned __int128) r * r % p->prime;
   }
+  p = _ntt_primes;
+  _ntt_garner[0] = _mont_pow(_mont_from(p[0].prime, &p[1]), p[1].prime - 2, &p[1]);
+  r = _mont_mul(_mont_from(p[0].prime, &p[2]), p[1].prime, &p[2]);
+  _ntt_garner[1] = _mont_pow(_mont_from(r, &p[2]), p[2].prime - 2, &p[2]);
+  _ntt_garner[2] = _mont_from(p[0].prime, &p[2]);
+}
 
-  free(buffer);
+/**
+ * Root tables for one transform size: size/2 powers of a primitive
+ * size-th root and of its inverse per prime, plus the factor that
+ * undoes both the 1/size of the inverse transform and the 2^-64 the
+ * Montgomery pointwise product leaves behind.
+ */
+typedef struct {
+  uint64_t size;
+  uint64_t* roots[NTT_PRIMES];
+  uint64_t* inverse_roots[NTT_PRIMES];
+  uint64_t scale[NTT_PRIMES];
+} ntt_plan;
 
-  return output;
-}
+/**
+ * size is a power of two, at most 2^NTT_MAX_LOG
+ */
+static ntt_plan* _create_ntt_plan(uint64_t size) {
+  ntt_plan* plan = malloc(sizeof(ntt_plan));
+  uint64_t root, inverse_root, half = size > 1 ? size >> 1 : 1, i;
+  ntt_prime* p;
+  int k;
 
-void print_bigint(bigint* value) {
-  char* output = bigint_to_new_str(value);
-  if(output != NULL) {
-    printf("%s", output);
-    free(output);
+  plan->size = size;
+  for(k = 0; k < NTT_PRIMES; k++) {
+    p = &_ntt_primes[k];
+    root = _mont_pow(_mont_from(p->generator, p), (p->prime - 1) / size, p);
+    inverse_root = _mont_pow(root, size - 1, p);
+    plan->roots[k] = malloc(half * sizeof(uint64_t));
+    plan->inverse_roots[k] = malloc(half * sizeof(uint64_t));
+    plan->roots[k][0] = plan->inverse_roots[k][0] = _mont_from(1, p);
+    for(i = 1; i < half; i++) {
+      plan->roots[k][i] = _mont_mul(plan->roots[k][i-1], root, p);
+      plan->inverse_roots[k][i] = _mont_mul(plan->inverse_roots[k][i-1], inverse_root, p);
+    }
+    //(size^-1 R) R, so that a Montgomery product by it is x / size * R
+    plan->scale[k] = _mont_from(_mont_pow(_mont_from(size, p), p->prime - 2, p), p);
   }
+  return plan;
 }
 
-void print_bigint_base(bigint* value, byte base) {
-  char* output = bigint_to_new_str_base(value, base);
-  if(output != NULL) {
-    printf("%s", output);
-    free(output);
+static void _free_ntt_plan(ntt_plan* plan) {
+  int k;
+  for(k = 0; k < NTT_PRIMES; k++) {
+    free(plan->roots[k]);
+    free(plan->inverse_roots[k]);
   }
+  free(plan);
 }
 
-void print_bigint_hex(bigint* value) {
-  char* output = bigint_to_new_str_hex(value);
-  if(output != NULL) {
-    printf("%s", output);
-    free(output);
+/**
+ * Reduce count limbs into residues mod the k-th prime, zero padded to
+ * the plan size. 2^64 < 3 * prime, so two subtractions suffice.
+ */
+static void _ntt_load(uint64_t* dest, uint64_t* src, uint64_t count,
+		      ntt_plan* plan, int k) {
+  uint64_t prime = _ntt_primes[k].prime, i, x;
+  for(i = 0; i < count; i++) {
+    x = src[i];
+    x = x >= prime ? x - prime : x;
+    dest[i] = x >= prime ? x - prime : x;
   }
+  memset(dest + count, 0, (plan->size - count) * sizeof(uint64_t));
 }
 
-///
-///
-///
+/**
+ * Decimation in frequency, natural order in, bit reversed out
+ */
+static void _ntt_forward(uint64_t* a, ntt_plan* plan, int k) {
+  ntt_prime* p = &_ntt_primes[k];
+  uint64_t* roots = plan->roots[k];
+  uint64_t n = plan->size, half, stride, start, j, u, v;
+  for(half = n >> 1, stride = 1; half > 0; half >>= 1, stride <<= 1) {
+    for(start = 0; start < n; start += half << 1) {
+      for(j = 0; j < half; j++) {
+	u = a[start + j];
+	v = a[start + j + half];
+	a[start + j] = _mod_add(u, v, p->prime);
+	a[start + j + half] = _mont_mul(_mod_sub(u, v, p->prime), roots[j * stride], p);
+      }
+    }
+  }
+}
 
-bigint* shl_bigint(bigint* dest, byte offset) {
-  if(offset > sizeof(uint64_t) * 8) {
-    return NULL;
+/**
+ * Decimation in time, bit reversed in, natural order out. Inverts
+ * _ntt_forward of a pointwise Montgomery product, scale included.
+ */
+static void _ntt_inverse(uint64_t* a, ntt_plan* plan, int k) {
+  ntt_prime* p = &_ntt_primes[k];
+  uint64_t* roots = plan->inverse_roots[k];
+  uint64_t n = plan->size, half, stride, start, j, u, v;
+  for(half = 1, stride = n >> 1; half < n; half <<= 1, stride >>= 1) {
+    for(start = 0; start < n; start += half << 1) {
+      for(j = 0; j < half; j++) {
+	u = a[start + j];
+	v = _mont_mul(a[start + j + half], roots[j * stride], p);
+	a[start + j] = _mod_add(u, v, p->prime);
+	a[start + j + half] = _mod_sub(u, v, p->prime);
+      }
+    }
   }
-  
-  if(shl_segments(dest->data, dest->length, offset) == NULL) {
-    return NULL;
+  for(j = 0; j < n; j++) {
+    a[j] = _mont_mul(a[j], plan->scale[k], p);
   }
-
-  return dest;
 }
 
-bigint* shr_bigint(bigint* dest, byte offset) {
-  if(offset > sizeof(uint64_t) * 8) {
-    return NULL;
+/**
+ * acc += a * b pointwise, leaving a factor 2^-64 that _ntt_inverse
+ * takes out
+ */
+static void _ntt_mul_add(uint64_t* acc, uint64_t* a, uint64_t* b, uint64_t n, int k) {
+  ntt_prime* p = &_ntt_primes[k];
+  uint64_t i;
+  for(i = 0; i < n; i++) {
+    acc[i] = _mod_add(acc[i], _mont_mul(a[i], b[i], p), p->prime);
   }
+}
 
-  if(shr_segments(dest->data, dest->length, offset) == NULL) {
-    return NULL;
+/**
+ * Garner: rebuild count convolution coefficients from their residues
+ * and carry them into dest, which gets count + 2 limbs
+ */
+static void _ntt_crt(uint64_t* dest, uint64_t* residues[NTT_PRIMES], uint64_t count) {
+  ntt_prime* p = _ntt_primes;
+  unsigned __int128 low, w, p01 = (unsigned __int128) p[0].prime * p[1].prime;
+  uint64_t i, r0, t1, t2, x0, x1, x2, c0 = 0, c1 = 0;
+  for(i = 0; i < count; i++) {
+    r0 = residues[0][i];
+    t1 = _mod_sub(residues[1][i], r0 >= p[1].prime ? r0 - p[1].prime : r0, p[1].prime);
+    t1 = _mont_mul(t1, _ntt_garner[0], &p[1]);
+    t2 = _mod_sub(residues[2][i], r0 >= p[2].prime ? r0 - p[2].prime : r0, p[2].prime);
+    t2 = _mod_sub(t2, _mont_mul(t1, _ntt_garner[2], &p[2]), p[2].prime);
+    t2 = _mont_mul(t2, _ntt_garner[1], &p[2]);
+
+    //r0 + p0 t1 + p0 p1 t2
+    low = r0 + (unsigned __int128) p[0].prime * t1;
+    w = (unsigned __int128) t2 * (uint64_t) p01 + (uint64_t) low;
+    x0 = w;
+    w = (w >> 64) + (unsigned __int128) t2 * (uint64_t) (p01 >> 64) + (uint64_t) (low >> 64);
+    x1 = w;
+    x2 = w >> 64;
+
+    w = (unsigned __int128) x0 + c0;
+    dest[i] = w;
+    w = (w >> 64) + x1 + c1;
+    c0 = w;
+    c1 = (w >> 64) + x2;
   }
-  return dest;
+  dest[count] = c0;
+  dest[count+1] = c1;
 }
 
-bigint* add_bigint(bigint* dest, bigint* offset) {
-  if(dest->length != offset->length) {
-    return NULL;
-  }
+///
+/// Full products
+///
 
-  if(add_segments(dest->data, offset->data, dest->length) == NULL) {
-    return NULL;
-  }
+/**
+ * dest += src where src is no longer than dest, carry out returned
+ */
+static uint64_t _add_into(uint64_t* dest, uint64_t dest_length, uint64_t* src,
+			  uint64_t src_length) {
+  uint64_t carry = src_length ? _add_n(dest, src, src_length) : 0;
+  return add_1_segments(dest + src_length, dest_length - src_length, carry);
+}
 
-  return dest;
+static uint64_t _sub_from(uint64_t* dest, uint64_t dest_length, uint64_t* src,
+			  uint64_t src_length) {
+  uint64_t borrow = src_length ? _cpu.sub_n(dest, src, src_length) : 0;
+  return sub_1_segments(dest + src_length, dest_length - src_length, borrow);
 }
 
-bigint* sub_bigint(bigint* dest, bigint* offset) {
-  if(dest->length != offset->length) {
-    return NULL;
-  }
-  if(sub_segments(dest->data, offset->data, dest->length) == NULL) {
-    return NULL;
+static void _mul_full(uint64_t* dest, uint64_t* a, uint64_t a_length,
+		      uint64_t* b, uint64_t b_length);
+
+static void _mul_schoolbook(uint64_t* dest, uint64_t* a, uint64_t a_length,
+			    uint64_t* b, uint64_t b_length) {
+  uint64_t i;
+  dest[a_length] = _cpu.mul_1(dest, a, a_length, b[0]);
+  for(i = 1; i < b_length; i++) {
+    dest[i + a_length] = _cpu.addmul_1(dest + i, a, a_length, b[i]);
   }
-  return dest;
 }
 
-bigint* mul_bigint_nat(bigint* dest, uint64_t scale) {
-  //todo: opt native
-  bigint* multiplier;
-  uint64_t* temp = malloc(sizeof(uint64_t)); //later 
-  multiplier = create_bigint(temp, 1);
-  mul_bigint(dest, multiplier);
-  free_bigint(multiplier);
-  return dest;
+/**
+ * b much shorter than a: one balanced product per b sized slice of a
+ */
+static void _mul_unbalanced(uint64_t* dest, uint64_t* a, uint64_t a_length,
+			    uint64_t* b, uint64_t b_length) {
+  uint64_t* slice = malloc(2 * b_length * sizeof(uint64_t));
+  uint64_t i, count;
+  memset(dest, 0, (a_length + b_length) * sizeof(uint64_t));
+  for(i = 0; i < a_length; i += count) {
+    count = a_length - i < b_length ? a_length - i : b_length;
+    _mul_full(slice, a + i, count, b, b_length);
+    _add_into(dest + i, a_length + b_length - i, slice, count + b_length);
+  }
+  free(slice);
 }
 
+/**
+ * a_length / 2 < b_length <= a_length. With a = a1 B^m + a0 and b the
+ * same, the middle term is (a0 + a1)(b0 + b1) - a0 b0 - a1 b1.
+ */
+static void _mul_karatsuba(uint64_t* dest, uint64_t* a, uint64_t a_length,
+			   uint64_t* b, uint64_t b_length) {
+  uint64_t m = (a_length + 1) / 2, high = a_length + b_length - 2 * m;
+  uint64_t middle_length = a_length + b_length - m < 2 * m + 2 ?
+    a_length + b_length - m : 2 * m + 2;
+  uint64_t* scratch = malloc((4 * m + 4) * sizeof(uint64_t));
+  uint64_t *sum_a = scratch, *sum_b = scratch + m + 1, *middle = scratch + 2 * m + 2;
 
-bigint* mul_bigint(bigint* dest, bigint* scale) {
-  size_t scratch_size = sizeof(uint64_t) * dest->length;
-  uint64_t* scratch = malloc(scratch_size);
-  memset(scratch, 0, scratch_size);
+  memcpy(sum_a, a, m * sizeof(uint64_t));
+  sum_a[m] = _add_into(sum_a, m, a + m, a_length - m);
+  memcpy(sum_b, b, m * sizeof(uint64_t));
+  sum_b[m] = _add_into(sum_b, m, b + m, b_length - m);
+  _mul_full(middle, sum_a, m + 1, sum_b, m + 1);
 
-  int i, j=0;
-  uint64_t multiplier;
+  _mul_full(dest, a, m, b, m);
+  _mul_full(dest + 2 * m, a + m, a_length - m, b + m, b_length - m);
+  _sub_from(middle, 2 * m + 2, dest, 2 * m);
+  _sub_from(middle, 2 * m + 2, dest + 2 * m, high);
+  //the middle term is below 2^(64 (a_length + b_length - m)), so no segment of it is lost
+  _add_into(dest + m, a_length + b_length - m, middle, middle_length);
+  free(scratch);
+}
+
+/**
+ * Three prime NTT convolution, squaring when a and b are the same
+ */
+static void _mul_ntt(uint64_t* dest, uint64_t* a, uint64_t a_length,
+		     uint64_t* b, uint64_t b_length) {
+  uint64_t n = 1, i, *residues[NTT_PRIMES], *fa, *fb, *product;
+  bool square = a == b && a_length == b_length;
+  ntt_prime* p;
+  ntt_plan* plan;
+  int k;
+
+  while(n < a_length + b_length) {
+    n <<= 1;
+  }
+  plan = _create_ntt_plan(n);
+  fa = malloc(NTT_PRIMES * n * sizeof(uint64_t));
+  fb = square ? fa : malloc(n * sizeof(uint64_t));
+  for(k = 0; k < NTT_PRIMES; k++) {
+    p = &_ntt_primes[k];
+    residues[k] = fa + k * n;
+    _ntt_load(residues[k], a, a_length, plan, k);
+    _ntt_forward(residues[k], plan, k);
+    if(!square) {
+      _ntt_load(fb, b, b_length, plan, k);
+      _ntt_forward(fb, plan, k);
+    }
+    for(i = 0; i < n; i++) {
+      residues[k][i] = _mont_mul(residues[k][i], square ? residues[k][i] : fb[i], p);
+    }
+    _ntt_inverse(residues[k], plan, k);
+  }
+  product = malloc((n + 2) * sizeof(uint64_t));
+  _ntt_crt(product, residues, a_length + b_length);
+  memcpy(dest, product, (a_length + b_length) * sizeof(uint64_t));
+
+  free(product);
+  if(!square) {
+    free(fb);
+  }
+  free(fa);
+  _free_ntt_plan(plan);
+}
+
+/**
+ * dest = a * b in a_length + b_length segments, picking schoolbook,
+ * Karatsuba or NTT by the shorter operand
+ */
+static void _mul_full(uint64_t* dest, uint64_t* a, uint64_t a_length,
+		      uint64_t* b, uint64_t b_length) {
+  uint64_t* swap;
+  if(a_length < b_length) {
+    swap = a;
+    a = b;
+    b = swap;
+    a_length ^= b_length;
+    b_length ^= a_length;
+    a_length ^= b_length;
+  }
+  if(b_length == 0) {
+    memset(dest, 0, a_length * sizeof(uint64_t));
+  } else if(b_length < MUL_KARATSUBA_THRESHOLD) {
+    STAT_BEGIN();
+    _mul_schoolbook(dest, a, a_length, b, b_length);
+    STAT_END(STAT_MUL_SCHOOLBOOK, a_length + b_length);
+  } else if(b_length <= (a_length + 1) / 2) {
+    // pieces are charged to the tier each b_length-square product lands in
+    _mul_unbalanced(dest, a, a_length, b, b_length);
+  } else if(b_length < MUL_NTT_THRESHOLD) {
+    STAT_BEGIN();
+    _mul_karatsuba(dest, a, a_length, b, b_length);
+    STAT_END(STAT_MUL_KARATSUBA, a_length + b_length);
+  } else {
+    STAT_BEGIN();
+    _mul_ntt(dest, a, a_length, b, b_length);
+    STAT_END(STAT_MUL_NTT, a_length + b_length);
+  }
+}
+
+/**
+ * dest = a * b without truncation: dest gets a_length + b_length
+ * segments and may not overlap a or b
+ */
+uint64_t* mul_full_segments(uint64_t* dest, uint64_t* a, uint64_t a_length,
+			    uint64_t* b, uint64_t b_length) {
+  _mul_full(dest, a, a_length, b, b_length);
+  return dest;
+}
+
+/**
+ * dest = dest * scale, truncated to length segments. Word by word
+ * schoolbook; only the significant segments of each operand are
+ * visited. Once both operands reach MUL_KARATSUBA_THRESHOLD segments
+ * the full product is formed with _mul_full and cut down instead.
+ * dest and scale may be the same array.
+ */
+uint64_t* mul_segments(uint64_t* dest, uint64_t *scale, uint64_t length) {
+  uint64_t dest_size = _size_segments(dest, length);
+  uint64_t scale_size = _size_segments(scale, length);
+  uint64_t* product;
+
+  if(dest_size >= MUL_KARATSUBA_THRESHOLD && scale_size >= MUL_KARATSUBA_THRESHOLD) {
+    product = malloc((dest_size + scale_size) * sizeof(uint64_t));
+    _mul_full(product, dest, dest_size, scale, scale_size);
+    if(dest_size + scale_size < length) {
+      memset(dest + dest_size + scale_size, 0,
+	     (length - dest_size - scale_size) * sizeof(uint64_t));
+      length = dest_size + scale_size;
+    }
+    memcpy(dest, product, length * sizeof(uint64_t));
+    free(product);
+    return dest;
+  }
+
+  STAT_BEGIN();
+  size_t scratch_size = sizeof(uint64_t) * length;
+  uint64_t* scratch = malloc(scratch_size);
+  memset(scratch, 0, scratch_size);
+  STAT_BYTES(STAT_MUL_SCHOOLBOOK, scratch_size);
+
+  uint64_t i, row, carry;
+  for(i = 0; i < scale_size; i++) {
+    if(scale[i] == 0) {
+      continue;
+    }
+    row = dest_size < length - i ? dest_size : length - i;
+    carry = addmul_1_segments(scratch + i, dest, row, scale[i]);
+    if(i + row < length) {
+      scratch[i + row] = carry;
+    }
+  }
+
+  memcpy(dest, scratch, scratch_size);
+  free(scratch);
+  STAT_END(STAT_MUL_SCHOOLBOOK, length);
+  return dest;
+}
+
+/**
+ * dest = dest / divisor. Returns NULL on division by zero. divisor is
+ * left untouched.
+ */
+uint64_t* div_segments(uint64_t* dest, uint64_t *divisor, uint64_t length) {
+  uint64_t* remainder = div_segments_mod(dest, divisor, length);
+  if(remainder == NULL) {
+    return NULL;
+  }
+  free(remainder);
+  return dest;
+}
+
+/**
+ * dest = dest / divisor, returns a newly allocated array of length
+ * segments holding the remainder, or NULL on division by zero.
+ */
+uint64_t* div_segments_mod(uint64_t* dest, uint64_t* divisor, uint64_t length) {
+  uint64_t* remainder;
+  uint64_t* quotient;
+
+  uint64_t dest_size = _size_segments(dest, length);
+  uint64_t divisor_size = _size_segments(divisor, length);
+
+  size_t scratch_size = length * sizeof(uint64_t);
+
+  if(divisor_size == 0) {
+    return NULL;
+  }
+
+  remainder = malloc(scratch_size);
+  memset(remainder, 0, scratch_size);
+  if(dest_size < divisor_size) {
+    memcpy(remainder, dest, scratch_size);
+    memset(dest, 0, scratch_size);
+    return remainder;
+  }
+
+  quotient = malloc(scratch_size);
+  memset(quotient, 0, scratch_size);
+  STAT_BYTES(STAT_DIV_KNUTH, 2 * scratch_size);
+  _divrem_knuth(quotient, remainder, dest, dest_size, divisor, divisor_size);
+  memcpy(dest, quotient, scratch_size);
+  free(quotient);
+
+  return remainder;
+}
+
+uint64_t* pow_segments(uint64_t *dest, uint64_t pow, uint64_t len) {
+  size_t scratch_size = sizeof(uint64_t) * len;
+  if(pow == 0) {
+    memset(dest, 0, scratch_size);
+    dest[0] = 1;
+    return dest;
+  } else if(pow == 1) {
+    return dest;
+  }
+  STAT_BEGIN();
+  STAT_BYTES(STAT_POW, 3 * scratch_size);
+  uint64_t* scratch_square = malloc(scratch_size);
+
+  uint64_t* scratch_factor = malloc(scratch_size);
+  memcpy(scratch_factor, dest, scratch_size);
+
+  uint64_t* scratch_dest = malloc(scratch_size);
+  memset(scratch_dest, 0, scratch_size);
+  scratch_dest[0] = 1;
+
+  while(pow) {
+    if(pow & 0x1) {
+      mul_segments(scratch_dest, scratch_factor, len);
+    }
+    memcpy(scratch_square, scratch_factor, scratch_size);
+    mul_segments(scratch_factor, scratch_square, len);
+    pow >>=1;
+  }
+  free(scratch_square);
+  free(scratch_factor);
+  memcpy(dest, scratch_dest, scratch_size);
+  free(scratch_dest);
+  STAT_END(STAT_POW, len);
+  return dest;
+}
+
+
+///
+///
+///
+
+/**
+ * Bitwise kernels. All of them are plain word loops so that the
+ * compiler can vectorize them at -O3; in-place forms require dest and
+ * mask to have the same length.
+ */
+uint64_t* and_segments(uint64_t* dest, uint64_t* mask, uint64_t length) {
+  uint64_t i;
+  for(i = 0; i < length; i++) {
+    dest[i] &= mask[i];
+  }
+  return dest;
+}
+
+uint64_t* or_segments(uint64_t* dest, uint64_t* mask, uint64_t length) {
+  uint64_t i;
+  for(i = 0; i < length; i++) {
+    dest[i] |= mask[i];
+  }
+  return dest;
+}
+
+uint64_t* xor_segments(uint64_t* dest, uint64_t* mask, uint64_t length) {
+  uint64_t i;
+  for(i = 0; i < length; i++) {
+    dest[i] ^= mask[i];
+  }
+  return dest;
+}
+
+/**
+ * dest = dest & ~mask
+ */
+uint64_t* andnot_segments(uint64_t* dest, uint64_t* mask, uint64_t length) {
+  uint64_t i;
+  for(i = 0; i < length; i++) {
+    dest[i] &= ~mask[i];
+  }
+  return dest;
+}
+
+uint64_t* not_segments(uint64_t* dest, uint64_t length) {
+  uint64_t i;
+  for(i = 0; i < length; i++) {
+    dest[i] = ~dest[i];
+  }
+  return dest;
+}
+
+/**
+ * Out of place variants: dest = a op b. dest may not partially
+ * overlap either operand.
+ */
+uint64_t* and_segments_into(uint64_t* dest, uint64_t* a, uint64_t* b, uint64_t length) {
+  uint64_t i;
+  for(i = 0; i < length; i++) {
+    dest[i] = a[i] & b[i];
+  }
+  return dest;
+}
+
+uint64_t* or_segments_into(uint64_t* dest, uint64_t* a, uint64_t* b, uint64_t length) {
+  uint64_t i;
+  for(i = 0; i < length; i++) {
+    dest[i] = a[i] | b[i];
+  }
+  return dest;
+}
+
+uint64_t* xor_segments_into(uint64_t* dest, uint64_t* a, uint64_t* b, uint64_t length) {
+  uint64_t i;
+  for(i = 0; i < length; i++) {
+    dest[i] = a[i] ^ b[i];
+  }
+  return dest;
+}
+
+uint64_t* andnot_segments_into(uint64_t* dest, uint64_t* a, uint64_t* b, uint64_t length) {
+  uint64_t i;
+  for(i = 0; i < length; i++) {
+    dest[i] = a[i] & ~b[i];
+  }
+  return dest;
+}
+
+uint64_t* not_segments_into(uint64_t* dest, uint64_t* src, uint64_t length) {
+  uint64_t i;
+  for(i = 0; i < length; i++) {
+    dest[i] = ~src[i];
+  }
+  return dest;
+}
+
+uint64_t popcount_segments(uint64_t* segments, uint64_t length) {
+  return _cpu.popcount(segments, length);
+}
+
+/**
+ * popcount(seg1 ^ seg2) without materializing the xor
+ */
+uint64_t xor_popcount_segments(uint64_t* seg1, uint64_t* seg2, uint64_t length) {
+  return _cpu.xor_popcount(seg1, seg2, length);
+}
+
+/**
+ * Single bit access. bit is an absolute bit index, bit 0 being the
+ * least significant bit of segments[0]. Out of range returns NULL.
+ */
+uint64_t* set_bit_segments(uint64_t* dest, uint64_t length, uint64_t bit) {
+  const byte segment_size_bits = sizeof(uint64_t) * 8;
+  if(bit / segment_size_bits >= length) {
+    return NULL;
+  }
+  dest[bit / segment_size_bits] |= (uint64_t) 1 << (bit % segment_size_bits);
+  return dest;
+}
+
+uint64_t* clear_bit_segments(uint64_t* dest, uint64_t length, uint64_t bit) {
+  const byte segment_size_bits = sizeof(uint64_t) * 8;
+  if(bit / segment_size_bits >= length) {
+    return NULL;
+  }
+  dest[bit / segment_size_bits] &= ~((uint64_t) 1 << (bit % segment_size_bits));
+  return dest;
+}
+
+bool test_bit_segments(uint64_t* segments, uint64_t length, uint64_t bit) {
+  const byte segment_size_bits = sizeof(uint64_t) * 8;
+  if(bit / segment_size_bits >= length) {
+    return FALSE;
+  }
+  return (segments[bit / segment_size_bits] >> (bit % segment_size_bits)) & 0x1;
+}
+
+/**
+ * Copy count bits of src starting at bit offset into the low bits of
+ * dest. dest must hold ceil(count / 64) segments; bits above count in
+ * the top segment are cleared. Bits past the end of src read as zero.
+ */
+uint64_t* extract_bits_segments(uint64_t* dest, uint64_t* src, uint64_t length,
+				uint64_t offset, uint64_t count) {
+  const byte segment_size_bits = sizeof(uint64_t) * 8;
+  uint64_t i, lo, hi, word = offset / segment_size_bits;
+  byte shift = offset % segment_size_bits;
+  uint64_t out_length = (count + segment_size_bits - 1) / segment_size_bits;
+
+  for(i = 0; i < out_length; i++, word++) {
+    lo = word < length ? src[word] : 0;
+    hi = word + 1 < length ? src[word + 1] : 0;
+    dest[i] = shift ? (lo >> shift) | (hi << (segment_size_bits - shift)) : lo;
+  }
+  if(count % segment_size_bits) {
+    dest[out_length - 1] &= ((uint64_t) 1 << (count % segment_size_bits)) - 1;
+  }
+  return dest;
+}
+
+/**
+ * Overwrite count bits of dest starting at bit offset with the low
+ * count bits of src. Returns NULL if the range does not fit in dest.
+ */
+uint64_t* insert_bits_segments(uint64_t* dest, uint64_t length, uint64_t* src,
+			       uint64_t offset, uint64_t count) {
+  const byte segment_size_bits = sizeof(uint64_t) * 8;
+  uint64_t i, bits, mask, word = offset / segment_size_bits;
+  byte shift = offset % segment_size_bits;
+
+  if(count == 0) {
+    return dest;
+  }
+  if(offset + count > length * segment_size_bits || offset + count < offset) {
+    return NULL;
+  }
+
+  for(i = 0; count; i++) {
+    bits = count < segment_size_bits ? count : segment_size_bits;
+    mask = bits == segment_size_bits ? ~(uint64_t) 0 : ((uint64_t) 1 << bits) - 1;
+
+    dest[word] = (dest[word] & ~(mask << shift)) | ((src[i] & mask) << shift);
+    if(shift && bits > segment_size_bits - shift) {
+      dest[word + 1] = (dest[word + 1] & ~(mask >> (segment_size_bits - shift))) |
+	((src[i] & mask) >> (segment_size_bits - shift));
+    }
+    word++;
+    count -= bits;
+  }
+  return dest;
+}
+
+bool gt(uint64_t* seg1, uint64_t* seg2, uint64_t length) {
+  return _gt(seg1, seg2, length, FALSE);
+}
+
+bool gte(uint64_t* seg1, uint64_t* seg2, uint64_t length) {
+  return _gt(seg1, seg2, length, TRUE);
+}
+
+bool _gt(uint64_t* seg1, uint64_t* seg2, uint64_t length, bool or_equal) {
+  int i;
+  for(i = length-1; i >= 0; i--) {
+    if(seg1[i] != seg2[i]) {
+      return seg1[i] > seg2[i];
+    }
+  }
+  return or_equal;
+}
+
+bool lt(uint64_t* seg1, uint64_t* seg2, uint64_t length) {
+  return _lt(seg1, seg2, length, FALSE);
+}
+
+bool lte(uint64_t* seg1, uint64_t* seg2, uint64_t length) {
+  return _lt(seg1, seg2, length, TRUE);
+}
+
+bool _lt(uint64_t* seg1, uint64_t* seg2, uint64_t length, bool or_equal) {
+  int i;
+  for(i = length-1; i >= 0; i--) {
+    if(seg1[i] != seg2[i]) {
+      return seg1[i] < seg2[i];
+    }
+  }
+  return or_equal;
+}
+
+bool eq(uint64_t* seg1, uint64_t* seg2, uint64_t length) {
+  int i;
+  for(i = 0; i < length; i++) {
+    if(seg1[i] != seg2[i]) return FALSE;
+  }
+  return TRUE;
+}
+
+uint64_t _msb(uint64_t* segments, uint64_t length) {
+  int i = length - 1;
+  byte segment_size_bits = sizeof(uint64_t) * 8;
+  for(; i >= 0; i--) {
+    if(segments[i]) {
+      return (i * segment_size_bits) + _log2(segments[i]);
+    }
+  }
+  return 0;
+}
+
+byte _log2(uint64_t segment) {
+  const uint64_t mask[] = {
+    0x2, 0xC, 0xF0, 0xFF00, 0xFFFF0000, 0xFFFFFFFF00000000
+  };
+  const byte offset[] = {
+    1, 2, 4, 8, 16, 32
+  };
+  int i;
+  register uint64_t l2 = 0;
+  for(i = 5; i >= 0; i--) {
+    if(segment & mask[i]) {
+      segment >>= offset[i];
+      l2 = l2 | offset[i];
+    }
+  }
+  return l2;
+}
+
+///
+///
+///
+
+/**
+ * Stein's binary gcd. Only shifts, compares and subtractions; the
+ * working size shrinks as the operands do.
+ */
+static uint64_t* _gcd_binary(uint64_t* dest, uint64_t* other, uint64_t length) {
+  size_t scratch_size = length * sizeof(uint64_t);
+  uint64_t *scratch, *u, *v, *t, size, shift;
+
+  size = _size_segments(dest, length);
+  if(_size_segments(other, length) > size) {
+    size = _size_segments(other, length);
+  }
+  if(_size_segments(other, length) == 0) {
+    return dest;
+  }
+  if(_size_segments(dest, length) == 0) {
+    memcpy(dest, other, scratch_size);
+    return dest;
+  }
+
+  scratch = malloc(2 * scratch_size);
+  STAT_BYTES(STAT_GCD_BINARY, 2 * scratch_size);
+  u = scratch;
+  v = scratch + length;
+  memcpy(u, dest, scratch_size);
+  memcpy(v, other, scratch_size);
+
+  shift = _ctz_segments(u, size);
+  if(_ctz_segments(v, size) < shift) {
+    shift = _ctz_segments(v, size);
+  }
+  _shr_bits(u, size, _ctz_segments(u, size));
+  _shr_bits(v, size, _ctz_segments(v, size));
+
+  while(TRUE) {
+    //both odd here
+    if(gt(u, v, size)) {
+      t = u;
+      u = v;
+      v = t;
+    }
+    sub_segments(v, u, size);
+    while(size > 1 && u[size-1] == 0 && v[size-1] == 0) {
+      size--;
+    }
+    if(_size_segments(v, size) == 0) {
+      break;
+    }
+    _shr_bits(v, size, _ctz_segments(v, size));
+  }
+
+  memcpy(dest, u, scratch_size);
+  shl_segments(dest, length, shift);
+  free(scratch);
+  return dest;
+}
+
+/**
+ * dest = cx * x + cy * y where cx and cy have opposite signs (or one
+ * is zero) and the result is known to be non negative and to fit in
+ * size segments.
+ */
+static void _lehmer_combine(uint64_t* dest, uint64_t* x, uint64_t* y, uint64_t size,
+			    long cx, long cy) {
+  if(cy <= 0) {
+    mul_1_segments(dest, x, size, cx);
+    submul_1_segments(dest, y, size, -cy);
+  } else {
+    mul_1_segments(dest, y, size, cy);
+    submul_1_segments(dest, x, size, -cx);
+  }
+}
+
+/**
+ * Euclid's algorithm on the leading 62 bits of u >= v, size segments,
+ * for as long as Knuth's test proves the quotients are those of u and v
+ * themselves. m receives A, B, C, D with u' = A u + B v and
+ * v' = C u + D v; B is zero when not even one step was certain.
+ */
+static void _lehmer_window(uint64_t* u, uint64_t* v, uint64_t size, __int128* m) {
+  const byte segment_size_bits = sizeof(uint64_t) * 8;
+  unsigned __int128 window_u, window_v;
+  __int128 uh, vh, qa, qb, T;
+  byte shift;
+
+  m[0] = 1; m[1] = 0; m[2] = 0; m[3] = 1;
+  if(size < 2) {
+    return;
+  }
+  window_u = (unsigned __int128) u[size-1] << 64 | u[size-2];
+  window_v = (unsigned __int128) v[size-1] << 64 | v[size-2];
+  shift = segment_size_bits + _log2(u[size-1]) - 61;
+  uh = window_u >> shift;
+  vh = window_v >> shift;
+
+  while(vh + m[2] > 0 && vh + m[3] > 0) {
+    qa = (uh + m[0]) / (vh + m[2]);
+    qb = (uh + m[1]) / (vh + m[3]);
+    if(qa != qb) {
+      break;
+    }
+    T = m[0] - qa * m[2]; m[0] = m[2]; m[2] = T;
+    T = m[1] - qa * m[3]; m[1] = m[3]; m[3] = T;
+    T = uh - qa * vh; uh = vh; vh = T;
+  }
+}
+
+///
+/// Half gcd
+///
+
+/**
+ * (a; b) = M (a'; b') for the operands a, b a half gcd started from
+ * and the a', b' it reduced them to. Entries are non negative and the
+ * determinant is 1: each step takes a multiple of the smaller operand
+ * off the larger in place, never swapping them (Möller, "On
+ * Schönhage's algorithm and subquadratic integer gcd computation").
+ */
+typedef struct {
+  uint64_t* r[4];   /* r00, r01, r10, r11, alloc segments each */
+  uint64_t size;    /* segments of the largest entry */
+  uint64_t alloc;
+} hgcd_matrix;
+
+/**
+ * Identity with room for the matrix of an n segment half gcd, whose
+ * entries stay below 2^(64 (ceil(n/2) - 1))
+ */
+static void _hgcd_matrix_init(hgcd_matrix* M, uint64_t n) {
+  int i;
+  M->alloc = (n + 1) / 2 + 2;
+  M->r[0] = calloc(4 * M->alloc, sizeof(uint64_t));
+  for(i = 1; i < 4; i++) {
+    M->r[i] = M->r[0] + i * M->alloc;
+  }
+  M->r[0][0] = M->r[3][0] = 1;
+  M->size = 1;
+}
+
+static void _hgcd_matrix_free(hgcd_matrix* M) {
+  free(M->r[0]);
+}
+
+static void _hgcd_matrix_resize(hgcd_matrix* M, uint64_t n) {
+  int i;
+  M->size = 0;
+  for(i = 0; i < 4; i++) {
+    if(_size_segments(M->r[i], n) > M->size) {
+      M->size = _size_segments(M->r[i], n);
+    }
+  }
+}
+
+/**
+ * M = M W for single segment w = w00, w01, w10, w11. scratch holds
+ * 2 (M->size + 1) segments.
+ */
+static void _hgcd_matrix_mul_1(hgcd_matrix* M, uint64_t* w, uint64_t* scratch) {
+  uint64_t n = M->size + 1, *t0 = scratch, *t1 = scratch + n;
+  int row;
+  for(row = 0; row < 4; row += 2) {
+    mul_1_segments(t0, M->r[row], n, w[0]);
+    addmul_1_segments(t0, M->r[row + 1], n, w[2]);
+    mul_1_segments(t1, M->r[row], n, w[1]);
+    addmul_1_segments(t1, M->r[row + 1], n, w[3]);
+    memcpy(M->r[row], t0, n * sizeof(uint64_t));
+    memcpy(M->r[row + 1], t1, n * sizeof(uint64_t));
+  }
+  _hgcd_matrix_resize(M, n);
+}
+
+/**
+ * Column col of M += q times the other column, for a step that took q
+ * times the other operand off the one in position col
+ */
+static void _hgcd_matrix_add_q(hgcd_matrix* M, uint64_t* q, uint64_t qsize, int col) {
+  uint64_t* product = malloc((M->size + qsize) * sizeof(uint64_t));
+  int row;
+  for(row = 0; row < 4; row += 2) {
+    _mul_full(product, M->r[row + 1 - col], M->size, q, qsize);
+    _add_into(M->r[row + col], M->alloc, product,
+	      _size_segments(product, M->size + qsize));
+  }
+  free(product);
+  _hgcd_matrix_resize(M, M->alloc);
+}
+
+/**
+ * M = M M1
+ */
+static void _hgcd_matrix_mul(hgcd_matrix* M, hgcd_matrix* M1) {
+  uint64_t n = M->size + M1->size + 1, *scratch = malloc(6 * n * sizeof(uint64_t));
+  uint64_t *product = scratch + 4 * n, *entry;
+  int i;
+  for(i = 0; i < 4; i++) {
+    //r_i = r_row0 s_0col + r_row1 s_1col
+    entry = scratch + i * n;
+    _mul_full(entry, M->r[i & 2], M->size, M1->r[i & 1], M1->size);
+    _mul_full(product, M->r[(i & 2) + 1], M->size, M1->r[(i & 1) + 2], M1->size);
+    entry[n-1] = _add_n(entry, product, n - 1);
+  }
+  for(i = 0; i < 4; i++) {
+    memset(M->r[i], 0, M->alloc * sizeof(uint64_t));
+    memcpy(M->r[i], scratch + i * n, (n < M->alloc ? n : M->alloc) * sizeof(uint64_t));
+  }
+  free(scratch);
+  _hgcd_matrix_resize(M, M->alloc);
+}
+
+/**
+ * The top n - p segments of a and b hold M^-1 of what they were; folds
+ * the low p segments in,
+ *   a = a_top 2^(64 p) + r11 a_low - r01 b_low
+ *   b = b_top 2^(64 p) - r10 a_low + r00 b_low
+ * both of which are non negative and no larger than before when the
+ * top parts were reduced above half their size. Returns the new size.
+ */
+static uint64_t _hgcd_adjust(hgcd_matrix* M, uint64_t* a, uint64_t* b,
+			     uint64_t n, uint64_t p) {
+  uint64_t length = p + M->size, *products = malloc(4 * length * sizeof(uint64_t));
+  uint64_t asize, bsize;
+
+  _mul_full(products, a, p, M->r[3], M->size);
+  _mul_full(products + length, b, p, M->r[1], M->size);
+  _mul_full(products + 2 * length, a, p, M->r[2], M->size);
+  _mul_full(products + 3 * length, b, p, M->r[0], M->size);
+  memset(a, 0, p * sizeof(uint64_t));
+  memset(b, 0, p * sizeof(uint64_t));
+  _add_into(a, n + 1, products, length);
+  _sub_from(a, n + 1, products + length, length);
+  _add_into(b, n + 1, products + 3 * length, length);
+  _sub_from(b, n + 1, products + 2 * length, length);
+  free(products);
+
+  asize = _size_segments(a, n);
+  bsize = _size_segments(b, n);
+  return asize > bsize ? asize : bsize;
+}
+
+/**
+ * One step of a half gcd on a, b of n segments: a Lehmer window when
+ * both results stay above s segments, otherwise a single division of
+ * the larger operand by the smaller, its quotient cut by one if the
+ * remainder would not. Returns the new size, 0 if no step fits.
+ * scratch holds 6 (n + 1) segments.
+ */
+static uint64_t _hgcd_step(uint64_t* a, uint64_t* b, uint64_t n, uint64_t s,
+			   hgcd_matrix* M, uint64_t* scratch) {
+  uint64_t *x = a, *y = b, *first = scratch, *second = scratch + n + 1;
+  uint64_t *q = scratch + 2 * (n + 1), *r = scratch + 3 * (n + 1), *swap;
+  uint64_t w[4], word, qsize, ysize, asize, bsize;
+  bool swapped = lt(a, b, n);
+  __int128 m[4];
+
+  if(swapped) {
+    x = b;
+    y = a;
+  }
+  _lehmer_window(x, y, n, m);
+  if(m[1] != 0) {
+    _lehmer_combine(first, x, y, n, m[0], m[1]);
+    _lehmer_combine(second, x, y, n, m[2], m[3]);
+  }
+  if(m[1] != 0 && _size_segments(first, n) > s && _size_segments(second, n) > s) {
+    //(x; y) = (|D| |B|; |C| |A|) (x'; y'), of determinant D's sign
+    w[0] = m[3] < 0 ? -m[3] : m[3];
+    w[1] = m[1] < 0 ? -m[1] : m[1];
+    w[2] = m[2] < 0 ? -m[2] : m[2];
+    w[3] = m[0] < 0 ? -m[0] : m[0];
+    if(m[3] < 0) {
+      word = w[0]; w[0] = w[1]; w[1] = word;
+      word = w[2]; w[2] = w[3]; w[3] = word;
+      swap = first; first = second; second = swap;
+    }
+    if(swapped) {
+      word = w[0]; w[0] = w[3]; w[3] = word;
+      word = w[1]; w[1] = w[2]; w[2] = word;
+    }
+    memcpy(x, first, n * sizeof(uint64_t));
+    memcpy(y, second, n * sizeof(uint64_t));
+    _hgcd_matrix_mul_1(M, w, scratch + 4 * (n + 1));
+  } else {
+    ysize = _size_segments(y, n);
+    if(ysize <= s) {
+      return 0;
+    }
+    qsize = n - ysize + 1;
+    memset(q, 0, (n + 1) * sizeof(uint64_t));
+    memset(r, 0, (n + 1) * sizeof(uint64_t));
+    _divrem_knuth(q, r, x, n, y, ysize);
+    if(_size_segments(r, ysize) <= s) {
+      r[ysize] = _add_into(r, ysize, y, ysize);
+      sub_1_segments(q, qsize, 1);
+      if(_size_segments(q, qsize) == 0) {
+	return 0;
+      }
+    }
+    memcpy(x, r, n * sizeof(uint64_t));
+    _hgcd_matrix_add_q(M, q, _size_segments(q, qsize), swapped ? 0 : 1);
+  }
+
+  asize = _size_segments(a, n);
+  bsize = _size_segments(b, n);
+  return asize > bsize ? asize : bsize;
+}
+
+/**
+ * Half gcd. a and b have n segments, a[n-1] or b[n-1] non zero, and
+ * room for n + 1 each. Reduces them in place for as long as both stay
+ * above s = n/2 + 1 segments, folding the steps into M, which comes in
+ * as the identity. Above GCD_HGCD_THRESHOLD the first and the second
+ * half of the reduction are each a half gcd of the top half of what is
+ * left, applied to the whole by _hgcd_adjust, so the cost is that of
+ * O(log n) full products. Returns the new size, 0 if nothing was done.
+ */
+static uint64_t _hgcd(uint64_t* a, uint64_t* b, uint64_t n, hgcd_matrix* M) {
+  uint64_t s = n / 2 + 1, n2 = 3 * n / 4 + 1, p, next;
+  uint64_t* scratch;
+  bool reduced = FALSE;
+  hgcd_matrix M1;
+
+  if(n <= s) {
+    return 0;
+  }
+  scratch = malloc(6 * (n + 1) * sizeof(uint64_t));
+  if(n > GCD_HGCD_THRESHOLD) {
+    p = n / 2;
+    next = _hgcd(a + p, b + p, n - p, M);
+    if(next) {
+      n = _hgcd_adjust(M, a, b, p + next, p);
+      reduced = TRUE;
+    }
+    while(n > n2 && (next = _hgcd_step(a, b, n, s, M, scratch)) != 0) {
+      n = next;
+      reduced = TRUE;
+    }
+    if(n > n2) {
+      free(scratch);
+      return reduced ? n : 0;
+    }
+
+    if(n > s + 2) {
+      //reduced above n - s segments, the top half leaves these above s
+      p = 2 * s - n + 1;
+      _hgcd_matrix_init(&M1, n - p);
+      next = _hgcd(a + p, b + p, n - p, &M1);
+      if(next) {
+	n = _hgcd_adjust(&M1, a, b, p + next, p);
+	_hgcd_matrix_mul(M, &M1);
+	reduced = TRUE;
+      }
+      _hgcd_matrix_free(&M1);
+    }
+  }
+
+  while((next = _hgcd_step(a, b, n, s, M, scratch)) != 0) {
+    n = next;
+    reduced = TRUE;
+  }
+  free(scratch);
+  return reduced ? n : 0;
+}
+
+/**
+ * The step _gcd_lehmer takes above GCD_HGCD_THRESHOLD: a half gcd of
+ * u and v, usize segments, and the matching update of the cofactor
+ * magnitudes su, sv (skipped when su is NULL). With
+ * (u; v) = M (u'; v') and det M = 1, the cofactors of u' and v' are
+ * r11 su + r01 sv and r10 su + r00 sv, the first keeping the sign of
+ * u's; both stay below other. FALSE, with nothing changed, when the
+ * half gcd could not reduce.
+ */
+static bool _gcd_hgcd_step(uint64_t* u, uint64_t* v, uint64_t usize,
+			   uint64_t* su, uint64_t* sv, uint64_t length) {
+  uint64_t *a = malloc(2 * (usize + 1) * sizeof(uint64_t)), *b = a + usize + 1;
+  uint64_t *products, ssize, plen;
+  hgcd_matrix M;
+  bool reduced;
+
+  memcpy(a, u, usize * sizeof(uint64_t));
+  memcpy(b, v, usize * sizeof(uint64_t));
+  a[usize] = b[usize] = 0;
+  _hgcd_matrix_init(&M, usize);
+  reduced = _hgcd(a, b, usize, &M) != 0;
+
+  if(reduced) {
+    memcpy(u, a, usize * sizeof(uint64_t));
+    memcpy(v, b, usize * sizeof(uint64_t));
+  }
+  if(reduced && su) {
+    ssize = _size_segments(su, length);
+    if(_size_segments(sv, length) > ssize) {
+      ssize = _size_segments(sv, length);
+    }
+    plen = ssize + M.size + 1;
+    products = malloc(4 * plen * sizeof(uint64_t));
+    _mul_full(products, su, ssize, M.r[3], M.size);
+    _mul_full(products + plen, sv, ssize, M.r[1], M.size);
+    _mul_full(products + 2 * plen, su, ssize, M.r[2], M.size);
+    _mul_full(products + 3 * plen, sv, ssize, M.r[0], M.size);
+    products[plen-1] = _add_n(products, products + plen, plen - 1);
+    products[3*plen-1] = _add_n(products + 2 * plen, products + 3 * plen, plen - 1);
+    memset(su, 0, length * sizeof(uint64_t));
+    memset(sv, 0, length * sizeof(uint64_t));
+    memcpy(su, products, (plen < length ? plen : length) * sizeof(uint64_t));
+    memcpy(sv, products + 2 * plen, (plen < length ? plen : length) * sizeof(uint64_t));
+    free(products);
+  }
+
+  _hgcd_matrix_free(&M);
+  free(a);
+  return reduced;
+}
+
+/**
+ * Lehmer's gcd (Knuth vol. 2, 4.5.2, algorithm L) using the leading 62
+ * bits of both operands to batch several euclidean steps into one
+ * 2x2 cofactor matrix, falling back to a full division step when the
+ * single precision quotients disagree.
+ *
+ * If cofactor is not NULL it receives s such that s * dest = gcd
+ * (mod other), 0 <= s < other. Cofactors are tracked by magnitude
+ * only; their signs strictly alternate, so every update is an
+ * addition and never exceeds other.
+ *
+ * While u has more than GCD_HGCD_THRESHOLD segments each step is a
+ * half gcd instead, which takes u to about half its size at once.
+ */
+static uint64_t* _gcd_lehmer(uint64_t* dest, uint64_t* cofactor, uint64_t* other,
+			     uint64_t length) {
+  size_t scratch_size = length * sizeof(uint64_t);
+  uint64_t *scratch, *u, *v, *t, *w, *su, *sv, *st, *sw, *q, *swap;
+  uint64_t usize, vsize, prev_usize, i;
+  __int128 m[4], A, B, C, D;
+  int sign_u = 1;
+
+  scratch = malloc(9 * scratch_size + sizeof(uint64_t));
+  memset(scratch, 0, 9 * scratch_size + sizeof(uint64_t));
+  STAT_BYTES(STAT_GCD_LEHMER, 9 * scratch_size + sizeof(uint64_t));
+  u  = scratch;
+  v  = scratch + length;
+  t  = scratch + 2 * length;
+  w  = scratch + 3 * length;
+  su = scratch + 4 * length;
+  sv = scratch + 5 * length;
+  st = scratch + 6 * length;
+  sw = scratch + 7 * length;
+  q  = scratch + 8 * length;
+
+  memcpy(u, dest, scratch_size);
+  memcpy(v, other, scratch_size);
+  su[0] = 1;
+  if(lt(u, v, length)) {
+    swap = u; u = v; v = swap;
+    swap = su; su = sv; sv = swap;
+    sign_u = -1;
+  }
+
+  usize = _size_segments(u, length);
+  while((vsize = _size_segments(v, usize)) != 0) {
+    if(usize > GCD_HGCD_THRESHOLD &&
+       _gcd_hgcd_step(u, v, usize, cofactor ? su : NULL, sv, length)) {
+      if(lt(u, v, usize)) {
+	swap = u; u = v; v = swap;
+	swap = su; su = sv; sv = swap;
+	sign_u = -sign_u;
+      }
+      usize = _size_segments(u, usize);
+      continue;
+    }
+
+    _lehmer_window(u, v, usize, m);
+    A = m[0]; B = m[1]; C = m[2]; D = m[3];
+
+    prev_usize = usize;
+    if(B == 0) {
+      memset(t, 0, scratch_size);
+      memset(q, 0, scratch_size + sizeof(uint64_t));
+      _divrem_knuth(q, t, u, usize, v, vsize);
+      if(cofactor) {
+	//sv' = su - q * sv, by magnitude su + q * sv
+	for(i = 0; i <= usize - vsize; i++) {
+	  if(q[i]) {
+	    addmul_1_segments(su + i, sv, length - i, q[i]);
+	  }
+	}
+	swap = su; su = sv; sv = swap;
+	sign_u = -sign_u;
+      }
+      swap = u; u = v; v = t; t = swap;
+    } else {
+      _lehmer_combine(t, u, v, usize, A, B);
+      _lehmer_combine(w, u, v, usize, C, D);
+      swap = u; u = t; t = swap;
+      swap = v; v = w; w = swap;
+      if(cofactor) {
+	mul_1_segments(st, su, length, A < 0 ? -A : A);
+	addmul_1_segments(st, sv, length, B < 0 ? -B : B);
+	mul_1_segments(sw, su, length, C < 0 ? -C : C);
+	addmul_1_segments(sw, sv, length, D < 0 ? -D : D);
+	swap = su; su = st; st = swap;
+	swap = sv; sv = sw; sw = swap;
+	if(A < 0 || (A == 0 && B > 0)) {
+	  sign_u = -sign_u;
+	}
+      }
+    }
+
+    usize = _size_segments(u, prev_usize);
+    memset(u + usize, 0, (length - usize) * sizeof(uint64_t));
+    memset(v + usize, 0, (length - usize) * sizeof(uint64_t));
+  }
+
+  memcpy(dest, u, scratch_size);
+  if(cofactor) {
+    if(_size_segments(other, length) && gte(su, other, length)) {
+      _divrem_knuth(NULL, st, su, length, other, _size_segments(other, length));
+      memset(st + _size_segments(other, length), 0,
+	     (length - _size_segments(other, length)) * sizeof(uint64_t));
+      memcpy(su, st, scratch_size);
+    }
+    if(sign_u < 0 && _size_segments(su, length)) {
+      memcpy(cofactor, other, scratch_size);
+      sub_segments(cofactor, su, length);
+    } else {
+      memcpy(cofactor, su, scratch_size);
+    }
+  }
+
+  free(scratch);
+  return dest;
+}
+
+/**
+ * dest = gcd(dest, other). Binary gcd below GCD_LEHMER_THRESHOLD
+ * segments, Lehmer above, and above GCD_HGCD_THRESHOLD Lehmer takes
+ * half gcd steps, subquadratic as they are built on _mul_full.
+ */
+uint64_t* gcd_segments(uint64_t* dest, uint64_t* other, uint64_t length) {
+  uint64_t size = _size_segments(dest, length);
+  if(_size_segments(other, length) > size) {
+    size = _size_segments(other, length);
+  }
+  STAT_BEGIN();
+  if(size <= GCD_LEHMER_THRESHOLD) {
+    _gcd_binary(dest, other, length);
+    STAT_END(STAT_GCD_BINARY, size);
+  } else if(size <= GCD_HGCD_THRESHOLD) {
+    _gcd_lehmer(dest, NULL, other, length);
+    STAT_END(STAT_GCD_LEHMER, size);
+  } else {
+    _gcd_lehmer(dest, NULL, other, length);
+    STAT_END(STAT_GCD_HGCD, size);
+  }
+  return dest;
+}
+
+/**
+ * dest = gcd(dest, other) and cofactor = s with s * dest = gcd
+ * (mod other), 0 <= s < other. Lehmer, with half gcd steps above
+ * GCD_HGCD_THRESHOLD segments.
+ */
+uint64_t* gcdext_segments(uint64_t* dest, uint64_t* cofactor, uint64_t* other,
+			  uint64_t length) {
+  uint64_t size = _size_segments(dest, length);
+  if(_size_segments(other, length) > size) {
+    size = _size_segments(other, length);
+  }
+  STAT_BEGIN();
+  _gcd_lehmer(dest, cofactor, other, length);
+  if(size <= GCD_HGCD_THRESHOLD) {
+    STAT_END(STAT_GCD_LEHMER, length);
+  } else {
+    STAT_END(STAT_GCD_HGCD, length);
+  }
+  return dest;
+}
+
+/**
+ * dest = dest^-1 mod modulus. Returns NULL and leaves dest untouched
+ * if dest and modulus are not coprime.
+ */
+uint64_t* invmod_segments(uint64_t* dest, uint64_t* modulus, uint64_t length) {
+  STAT_BEGIN();
+  size_t scratch_size = length * sizeof(uint64_t);
+  uint64_t* scratch = malloc(2 * scratch_size);
+  bool coprime;
+
+  STAT_BYTES(STAT_INVMOD, 2 * scratch_size);
+  memcpy(scratch, dest, scratch_size);
+  _gcd_lehmer(scratch, scratch + length, modulus, length);
+  coprime = _size_segments(scratch, length) == 1 && scratch[0] == 1;
+  if(coprime) {
+    memcpy(dest, scratch + length, scratch_size);
+  }
+  free(scratch);
+  STAT_END(STAT_INVMOD, length);
+  return coprime ? dest : NULL;
+}
+
+/**
+ * base^k <= x, without overflowing
+ */
+static bool _pow_word_lte(uint64_t base, uint64_t k, uint64_t x) {
+  unsigned __int128 acc = 1;
+  uint64_t i;
+  for(i = 0; i < k; i++) {
+    acc *= base;
+    if(acc > x) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+static uint64_t _root_word(uint64_t x, uint64_t k) {
+  uint64_t r;
+  if(k == 1 || x < 2) {
+    return x;
+  }
+  if(k >= sizeof(uint64_t) * 8) {
+    return 1;
+  }
+  r = (uint64_t) pow((double) x, 1.0 / k);
+  while(r && !_pow_word_lte(r, k, x)) {
+    r--;
+  }
+  while(_pow_word_lte(r + 1, k, x)) {
+    r++;
+  }
+  return r;
+}
+
+/**
+ * root = floor(x^(1/k)), root has xsize segments.
+ *
+ * The starting point is the root of the top half of x (by recursion,
+ * so each level doubles the precision of the one below), rounded up so
+ * that Newton's iteration
+ *   r' = ((k-1) r + x / r^(k-1)) / k
+ * descends monotonically onto the floor root. Only one or two
+ * iterations are needed per level. At the bottom the estimate is a
+ * power of two taken from _msb.
+ */
+static void _root_newton(uint64_t* root, uint64_t* x, uint64_t xsize, uint64_t k) {
+  const byte segment_size_bits = sizeof(uint64_t) * 8;
+  uint64_t *scratch, *r, *p, *q, *z, *rem, bits, shift, plen, psize, size, i;
+  uint64_t k_word = k;
+
+  memset(root, 0, xsize * sizeof(uint64_t));
+  size = _size_segments(x, xsize);
+  if(size == 0) {
+    return;
+  }
+  if(size == 1) {
+    root[0] = _root_word(x[0], k);
+    return;
+  }
+
+  bits = _msb(x, size) + 1;
+  plen = size + k / segment_size_bits + 2;
+  scratch = malloc(5 * plen * sizeof(uint64_t));
+  memset(scratch, 0, 5 * plen * sizeof(uint64_t));
+  STAT_BYTES(STAT_ROOT_NEWTON, 5 * plen * sizeof(uint64_t));
+  r = scratch;
+  p = scratch + plen;
+  q = scratch + 2 * plen;
+  z = scratch + 3 * plen;
+  rem = scratch + 4 * plen;
+
+  shift = bits / (2 * k);
+  if(shift) {
+    memcpy(z, x, size * sizeof(uint64_t));
+    _shr_bits(z, size, k * shift);
+    _root_newton(r, z, size, k);
+    //overestimate: (y + 1)^k > x >> k*shift
+    for(i = 0; i < plen && ++r[i] == 0; i++);
+    shl_segments(r, plen, shift);
+  } else {
+    set_bit_segments(r, plen, (bits + k - 1) / k);
+  }
+
+  while(TRUE) {
+    memcpy(p, r, plen * sizeof(uint64_t));
+    pow_segments(p, k - 1, plen);
+    psize = _size_segments(p, plen);
+
+    memset(q, 0, plen * sizeof(uint64_t));
+    if(psize < size || (psize == size && lte(p, x, size))) {
+      _divrem_knuth(q, rem, x, size, p, psize);
+    }
+
+    mul_1_segments(z, r, plen, k - 1);
+    _add_n(z, q, plen);
+    _divrem_knuth(p, rem, z, plen, &k_word, 1);
+
+    if(!lt(p, r, plen)) {
+      break;
+    }
+    memcpy(r, p, plen * sizeof(uint64_t));
+  }
+
+  memcpy(root, r, size * sizeof(uint64_t));
+  free(scratch);
+}
+
+/**
+ * dest = floor(dest^(1/k)). Returns NULL for k = 0.
+ */
+uint64_t* root_segments(uint64_t* dest, uint64_t k, uint64_t length) {
+  uint64_t* scratch;
+  if(k == 0) {
+    return NULL;
+  }
+  if(k == 1) {
+    return dest;
+  }
+  STAT_BEGIN();
+  STAT_BYTES(STAT_ROOT_NEWTON, length * sizeof(uint64_t));
+  scratch = malloc(length * sizeof(uint64_t));
+  _root_newton(scratch, dest, length, k);
+  memcpy(dest, scratch, length * sizeof(uint64_t));
+  free(scratch);
+  STAT_END(STAT_ROOT_NEWTON, length);
+  return dest;
+}
+
+/**
+ * dest = floor(sqrt(dest))
+ */
+uint64_t* sqrt_segments(uint64_t* dest, uint64_t length) {
+  return root_segments(dest, 2, length);
+}
+
+/**
+ * Quadratic residue tables for the cheap square test. 2^48 - 1 factors
+ * as 3^2 * 5 * 7 * 13 * 17 * 97 * 241 * 257 * 673, so one residue mod
+ * 2^48 - 1 (sums of 48 bit chunks, no division) feeds all the moduli
+ * below.
+ */
+static const uint64_t _square_moduli[] = {63, 65, 17, 97, 241, 257, 673};
+static byte _square_residues[7][673];
+
+__attribute__((constructor))
+static void _init_square_residues(void) {
+  uint64_t i, j;
+  for(i = 0; i < 7; i++) {
+    for(j = 0; j < _square_moduli[i]; j++) {
+      _square_residues[i][(j * j) % _square_moduli[i]] = TRUE;
+    }
+  }
+}
+
+static uint64_t _mod_2_48_minus_1(uint64_t* segments, uint64_t length) {
+  const uint64_t mask = ((uint64_t) 1 << 48) - 1;
+  uint64_t i, v, acc = 0;
+  byte rot;
+  for(i = 0; i < length; i++) {
+    //segment i carries weight 2^(64 i) = 2^(16 (i mod 3)) mod 2^48 - 1
+    v = (segments[i] & mask) + (segments[i] >> 48);
+    v = (v & mask) + (v >> 48);
+    rot = 16 * (i % 3);
+    if(rot) {
+      v = ((v << rot) & mask) | (v >> (48 - rot));
+    }
+    acc += v;
+    acc = (acc & mask) + (acc >> 48);
+  }
+  return acc == mask ? 0 : acc;
+}
+
+bool is_square_segments(uint64_t* segments, uint64_t length) {
+  uint64_t size = _size_segments(segments, length), residue, i;
+  uint64_t *root;
+  bool square;
+
+  if(size == 0) {
+    return TRUE;
+  }
+
+  //squares are 0, 1, 4 or 9 mod 16
+  if(((0x0213 >> (segments[0] & 0xf)) & 0x1) == 0) {
+    return FALSE;
+  }
+
+  residue = _mod_2_48_minus_1(segments, size);
+  for(i = 0; i < 7; i++) {
+    if(!_square_residues[i][residue % _square_moduli[i]]) {
+      return FALSE;
+    }
+  }
+
+  //only candidates past the residue filters are counted
+  STAT_BEGIN();
+  STAT_BYTES(STAT_IS_SQUARE, size * sizeof(uint64_t));
+  root = malloc(size * sizeof(uint64_t));
+  _root_newton(root, segments, size, 2);
+  mul_segments(root, root, size);
+  square = eq(root, segments, size);
+  free(root);
+  STAT_END(STAT_IS_SQUARE, size);
+  return square;
+}
+
+static uint64_t _powmod_word(uint64_t base, uint64_t exp, uint64_t mod) {
+  unsigned __int128 result = 1, square = base % mod;
+  while(exp) {
+    if(exp & 0x1) {
+      result = result * square % mod;
+    }
+    square = square * square % mod;
+    exp >>= 1;
+  }
+  return result;
+}
+
+static bool _is_prime_word(uint64_t value) {
+  uint64_t d;
+  if(value < 2) {
+    return FALSE;
+  }
+  for(d = 2; d * d <= value; d++) {
+    if(value % d == 0) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/**
+ * k-th power residue prefilter: for a prime p = 1 (mod k) not dividing
+ * x, a k-th power x satisfies x^((p-1)/k) = 1 (mod p). A few such
+ * primes are packed into one word so x is only reduced once.
+ */
+static bool _maybe_power(uint64_t* segments, uint64_t size, uint64_t k) {
+  uint64_t primes[4], count = 0, product = 1, residue, p, j, i;
+  for(j = 2; count < 4; j += 2) {
+    p = k * j + 1;
+    if(!_is_prime_word(p)) {
+      continue;
+    }
+    if(product > ~(uint64_t) 0 / p) {
+      break;
+    }
+    primes[count++] = p;
+    product *= p;
+  }
+  _divrem_knuth(NULL, &residue, segments, size, &product, 1);
+  for(i = 0; i < count; i++) {
+    if(residue % primes[i] &&
+       _powmod_word(residue % primes[i], (primes[i] - 1) / k, primes[i]) != 1) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/**
+ * Is segments = m^k for some k >= 2. Only prime k need checking; a k
+ * that does not divide the power of two in the value, or that fails
+ * the residue prefilter, is skipped without taking a root.
+ */
+bool is_power_segments(uint64_t* segments, uint64_t length) {
+  uint64_t size = _size_segments(segments, length), bits, twos, k, d;
+  uint64_t *root;
+  bool power = FALSE, prime;
+
+  if(size == 0 || (size == 1 && segments[0] == 1)) {
+    return TRUE;
+  }
+  if(is_square_segments(segments, size)) {
+    return TRUE;
+  }
+
+  STAT_BEGIN();
+  STAT_BYTES(STAT_IS_POWER, size * sizeof(uint64_t));
+  bits = _msb(segments, size) + 1;
+  twos = _ctz_segments(segments, size);
+  root = malloc(size * sizeof(uint64_t));
+  for(k = 3; k < bits && !power; k += 2) {
+    for(prime = TRUE, d = 3; d * d <= k && prime; d += 2) {
+      prime = k % d != 0;
+    }
+    if(!prime || (twos && twos % k) || !_maybe_power(segments, size, k)) {
+      continue;
+    }
+    _root_newton(root, segments, size, k);
+    if(_size_segments(root, size) == 1 && root[0] == 1) {
+      break;
+    }
+    pow_segments(root, k, size);
+    power = eq(root, segments, size);
+  }
+  free(root);
+  STAT_END(STAT_IS_POWER, size);
+  return power;
+}
+
+///
+///
+///
+
+inline char* bigint_to_new_str(bigint* value) {
+  return bigint_to_new_str_base(value, 10);
+}
+
+char* bigint_to_new_str_base(bigint* value, byte base) {
+  static const char decimal_alpha[] = {
+    '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 
+    'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J',
+    'K', 'L', 'M', 'N', 'O', 'P', 'Q', 'R', 'S', 'T',
+    'U', 'V', 'W', 'X', 'Y', 'Z'
+  }; //eulers will break for base > 36
+
+  STAT_BEGIN();
+  char* output;
+  if(base == 16) {
+    output = bigint_to_new_str_hex(value);
+  } else {
+    output = eulers(value, base, decimal_alpha);
+  }
+  STAT_END(STAT_TO_STR, value->length);
+  return output;
+}
+
+char* bigint_to_new_str_hex(bigint* value) {
+ size_t size;
+  char* buffer, *output;
+  uint64_t temp, i, j;
+  
+  size = sizeof(char) * value->length * sizeof(uint64_t) * 8 + 1;
+  buffer = malloc(size);
+  output = malloc(size);
+  output[0] = '\0';
+  
+  for(i = 0; i < value->length; i++) {
+    temp = value->data[i];
+    for(j = 0; j < 2*sizeof(uint64_t); j++) {
+      strcpy(buffer, output);
+      sprintf(output, "%x%s", (byte) temp & 0xf, buffer);
+      temp >>= 4;
+    }
+    //do we add spaces every qword?
+  }
+
+  free(buffer);
+
+  return output;
+}
+
+void print_bigint(bigint* value) {
+  char* output = bigint_to_new_str(value);
+  if(output != NULL) {
+    printf("%s", output);
+    free(output);
+  }
+}
+
+void print_bigint_base(bigint* value, byte base) {
+  char* output = bigint_to_new_str_base(value, base);
+  if(output != NULL) {
+    printf("%s", output);
+    free(output);
+  }
+}
+
+void print_bigint_hex(bigint* value) {
+  char* output = bigint_to_new_str_hex(value);
+  if(output != NULL) {
+    printf("%s", output);
+    free(output);
+  }
+}
+
+///
+///
+///
+
+/**
+ * Binary format, all fields little endian:
+ *
+ *   0  "BGMT"
+ *   4  version (16 bits)
+ *   6  sign, 0 or 1
+ *   7  reserved, 0
+ *   8  length in segments
+ *   16 checksum of length and segments
+ *   24 reserved, 0
+ *   32 segments, least significant first
+ *
+ * The header is a whole number of segments so a mapped file's limbs
+ * are aligned.
+ */
+static const char _bigint_magic[4] = {'B', 'G', 'M', 'T'};
+
+static inline uint64_t _le64(uint64_t word) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  return __builtin_bswap64(word);
+#else
+  return word;
+#endif
+}
+
+/**
+ * Fletcher style: a running sum and a sum of running sums, so both
+ * changed and reordered segments show up. Folds in length so that a
+ * truncated file does not match.
+ *
+ * The sum of running sums is kept as sum (length - i) * segments[i],
+ * which gives the same value but lets a value be folded in one range
+ * at a time in any order, see the chunked store.
+ */
+static void _checksum_fold(uint64_t* sum, uint64_t* weighted, uint64_t* segments,
+			   uint64_t start, uint64_t count, uint64_t length) {
+  uint64_t i;
+  for(i = 0; i < count; i++) {
+    *sum += segments[i];
+    *weighted += (length - start - i) * segments[i];
+  }
+}
+
+static inline uint64_t _checksum_finish(uint64_t sum, uint64_t weighted, uint64_t length) {
+  sum += length;
+  weighted += ~length + length * length;
+  return sum ^ (weighted << 32 | weighted >> 32);
+}
+
+static uint64_t _checksum_segments(uint64_t* segments, uint64_t length) {
+  uint64_t sum = 0, weighted = 0;
+  _checksum_fold(&sum, &weighted, segments, 0, length, length);
+  return _checksum_finish(sum, weighted, length);
+}
+
+static void _encode_bigint_header(byte* header, uint64_t length, uint64_t checksum,
+				  bool negative) {
+  memset(header, 0, BIGINT_HEADER_SIZE);
+  memcpy(header, _bigint_magic, 4);
+  header[4] = BIGINT_FORMAT_VERSION & 0xff;
+  header[5] = BIGINT_FORMAT_VERSION >> 8;
+  header[6] = negative ? 1 : 0;
+  length = _le64(length);
+  checksum = _le64(checksum);
+  memcpy(header + 8, &length, sizeof(uint64_t));
+  memcpy(header + 16, &checksum, sizeof(uint64_t));
+}
+
+/**
+ * Checks magic and version, FALSE if this is not a bigint header we
+ * can read
+ */
+static bool _decode_bigint_header(byte* header, uint64_t* length, uint64_t* checksum,
+				  bool* negative) {
+  if(memcmp(header, _bigint_magic, 4) != 0 ||
+     (header[4] | header[5] << 8) != BIGINT_FORMAT_VERSION || header[6] > 1) {
+    return FALSE;
+  }
+  memcpy(length, header + 8, sizeof(uint64_t));
+  memcpy(checksum, header + 16, sizeof(uint64_t));
+  *length = _le64(*length);
+  *checksum = _le64(*checksum);
+  if(negative != NULL) {
+    *negative = header[6];
+  }
+  return TRUE;
+}
+
+/**
+ * Write value to file in the binary format. The segments are streamed
+ * straight from value->data. Returns NULL on a write error.
+ */
+bigint* write_bigint(FILE* file, bigint* value, bool negative) {
+  byte header[BIGINT_HEADER_SIZE];
+  _encode_bigint_header(header, value->length,
+			_checksum_segments(value->data, value->length), negative);
+  if(fwrite(header, 1, BIGINT_HEADER_SIZE, file) != BIGINT_HEADER_SIZE) {
+    return NULL;
+  }
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  uint64_t i, word;
+  for(i = 0; i < value->length; i++) {
+    word = _le64(value->data[i]);
+    if(fwrite(&word, sizeof(uint64_t), 1, file) != 1) {
+      return NULL;
+    }
+  }
+#else
+  if(fwrite(value->data, sizeof(uint64_t), value->length, file) != value->length) {
+    return NULL;
+  }
+#endif
+  return value;
+}
+
+/**
+ * Read a bigint written by write_bigint. negative may be NULL. Returns
+ * NULL on a short read, an unknown format or a checksum mismatch.
+ */
+bigint* read_bigint(FILE* file, bool* negative) {
+  byte header[BIGINT_HEADER_SIZE];
+  uint64_t length, checksum, i;
+  bigint* value;
+
+  if(fread(header, 1, BIGINT_HEADER_SIZE, file) != BIGINT_HEADER_SIZE ||
+     !_decode_bigint_header(header, &length, &checksum, negative) ||
+     length > ~(size_t) 0 / sizeof(uint64_t)) {
+    return NULL;
+  }
+
+  value = malloc(sizeof(bigint));
+  value->length = length;
+  value->data = malloc((length ? length : 1) * sizeof(uint64_t));
+  if(value->data == NULL ||
+     fread(value->data, sizeof(uint64_t), length, file) != length) {
+    free(value->data);
+    free(value);
+    return NULL;
+  }
+  for(i = 0; i < length; i++) {
+    value->data[i] = _le64(value->data[i]);
+  }
+  if(_checksum_segments(value->data, length) != checksum) {
+    free_bigint(value);
+    return NULL;
+  }
+  return value;
+}
+
+/**
+ * Zero copy view of a file written by write_bigint: mapping->value.data
+ * points into the mapped file. Read only mappings are private, so in
+ * place arithmetic on the view never reaches the file; writable ones
+ * are shared and unmap_bigint refreshes the checksum. With verify the
+ * checksum is checked up front, which touches every page.
+ *
+ * Returns NULL if the file cannot be mapped or is not in the binary
+ * format, and on big endian hosts where the limbs cannot be used in
+ * place.
+ */
+bigint_mapping* map_bigint(const char* path, bool writable, bool verify) {
+  bigint_mapping* mapping;
+  struct stat info;
+  uint64_t length, checksum;
+  void* base;
+  int fd;
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  return NULL;
+#endif
+  fd = open(path, writable ? O_RDWR : O_RDONLY);
+  if(fd < 0) {
+    return NULL;
+  }
+  if(fstat(fd, &info) != 0 || info.st_size < BIGINT_HEADER_SIZE) {
+    close(fd);
+    return NULL;
+  }
+  base = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE,
+	      writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(base == MAP_FAILED) {
+    return NULL;
+  }
+
+  mapping = malloc(sizeof(bigint_mapping));
+  mapping->base = base;
+  mapping->size = info.st_size;
+  mapping->writable = writable;
+  if(!_decode_bigint_header(base, &length, &checksum, &mapping->negative) ||
+     length > (info.st_size - BIGINT_HEADER_SIZE) / sizeof(uint64_t)) {
+    munmap(base, info.st_size);
+    free(mapping);
+    return NULL;
+  }
+  mapping->value.data = (uint64_t*) ((byte*) base + BIGINT_HEADER_SIZE);
+  mapping->value.length = length;
+
+  if(verify && _checksum_segments(mapping->value.data, length) != checksum) {
+    munmap(base, info.st_size);
+    free(mapping);
+    return NULL;
+  }
+  return mapping;
+}
+
+void unmap_bigint(bigint_mapping* mapping) {
+  if(mapping->writable) {
+    _encode_bigint_header(mapping->base, mapping->value.length,
+			  _checksum_segments(mapping->value.data, mapping->value.length),
+			  mapping->negative);
+  }
+  munmap(mapping->base, mapping->size);
+  free(mapping);
+}
+
+/**
+ * Byte offset in a string of count words of size bytes of the k-th
+ * least significant byte of the number
+ */
+static inline uint64_t _byte_position(uint64_t k, uint64_t count, uint64_t size,
+				      int order, int endian) {
+  uint64_t word = k / size, offset = k % size;
+  if(endian == 0) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    endian = 1;
+#else
+    endian = -1;
+#endif
+  }
+  if(order > 0) {
+    word = count - 1 - word;
+  }
+  if(endian > 0) {
+    offset = size - 1 - offset;
+  }
+  return word * size + offset;
+}
+
+/**
+ * dest = the number in count words of size bytes at src. order is 1
+ * for most significant word first, -1 for least significant first;
+ * endian is 1 for big endian words, -1 for little, 0 for native.
+ * Returns NULL, with dest partially written, if the number does not
+ * fit in length segments.
+ */
+uint64_t* import_segments(uint64_t* dest, uint64_t length, const byte* src,
+			  uint64_t count, uint64_t size, int order, int endian) {
+  const uint64_t total = count * size, capacity = length * sizeof(uint64_t);
+  uint64_t k;
+
+  memset(dest, 0, capacity);
+#if __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__
+  if(order < 0 && endian <= 0 && total <= capacity) {
+    memcpy(dest, src, total);
+    return dest;
+  }
+#endif
+  for(k = 0; k < total; k++) {
+    byte b = src[_byte_position(k, count, size, order, endian)];
+    if(k >= capacity) {
+      if(b) {
+	return NULL;
+      }
+      continue;
+    }
+    dest[k / sizeof(uint64_t)] |= (uint64_t) b << (8 * (k % sizeof(uint64_t)));
+  }
+  return dest;
+}
+
+/**
+ * Writes src to dest as words of size bytes in the given order and
+ * endianness (see import_segments), using as few words as hold the
+ * significant bytes. dest needs room for ceil(length * 8 / size) words.
+ * Returns the number of words written, 0 for zero or a size of 0.
+ */
+uint64_t export_segments(byte* dest, uint64_t* src, uint64_t length, uint64_t size,
+			 int order, int endian) {
+  uint64_t bytes = length * sizeof(uint64_t), count, k;
+  if(size == 0) {
+    return 0;
+  }
+  while(bytes && ((src[(bytes-1) / sizeof(uint64_t)] >>
+		   (8 * ((bytes-1) % sizeof(uint64_t)))) & 0xff) == 0) {
+    bytes--;
+  }
+  count = (bytes + size - 1) / size;
+  for(k = 0; k < count * size; k++) {
+    dest[_byte_position(k, count, size, order, endian)] = k < bytes ?
+      (src[k / sizeof(uint64_t)] >> (8 * (k % sizeof(uint64_t)))) & 0xff : 0;
+  }
+  return count;
+}
+
+/**
+ * New bigint just long enough for the number at src, see
+ * import_segments
+ */
+bigint* import_bigint(const byte* src, uint64_t count, uint64_t size, int order,
+		      int endian) {
+  uint64_t length = (count * size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+  bigint* value = malloc(sizeof(bigint));
+  value->length = length ? length : 1;
+  value->data = malloc(value->length * sizeof(uint64_t));
+  import_segments(value->data, value->length, src, count, size, order, endian);
+  return value;
+}
+
+uint64_t export_bigint(byte* dest, bigint* value, uint64_t size, int order, int endian) {
+  return export_segments(dest, value->data, value->length, size, order, endian);
+}
+
+///
+/// Chunked out of core bigints
+///
+
+static inline off_t _chunk_offset(uint64_t index) {
+  return BIGINT_HEADER_SIZE + index * sizeof(uint64_t);
+}
+
+static bool _pread_all(int fd, void* buffer, uint64_t size, off_t offset) {
+  ssize_t done;
+  while(size) {
+    done = pread(fd, buffer, size, offset);
+    if(done <= 0) {
+      return FALSE;
+    }
+    buffer = (byte*) buffer + done;
+    size -= done;
+    offset += done;
+  }
+  return TRUE;
+}
+
+static bool _pwrite_all(int fd, const void* buffer, uint64_t size, off_t offset) {
+  ssize_t done;
+  while(size) {
+    done = pwrite(fd, buffer, size, offset);
+    if(done <= 0) {
+      return FALSE;
+    }
+    buffer = (const byte*) buffer + done;
+    size -= done;
+    offset += done;
+  }
+  return TRUE;
+}
+
+/**
+ * Segments start .. start + count of value, which may run off either
+ * end; those read as zero
+ */
+static bool _read_chunk(chunked_bigint* value, uint64_t* buffer, long start,
+			uint64_t count) {
+  uint64_t skip = 0, have, i;
+  if(start < 0) {
+    skip = -start < count ? -start : count;
+    memset(buffer, 0, skip * sizeof(uint64_t));
+    buffer += skip;
+    count -= skip;
+    start = 0;
+  }
+  have = (uint64_t) start < value->length ? value->length - start : 0;
+  have = have < count ? have : count;
+  if(!_pread_all(value->fd, buffer, have * sizeof(uint64_t), _chunk_offset(start))) {
+    return FALSE;
+  }
+  memset(buffer + have, 0, (count - have) * sizeof(uint64_t));
+  for(i = 0; i < have; i++) {
+    buffer[i] = _le64(buffer[i]);
+  }
+  return TRUE;
+}
+
+/**
+ * Store segments start .. start + count, dropping any past the end of
+ * value, and fold them into the running checksum
+ */
+static bool _write_chunk(chunked_bigint* value, uint64_t* buffer, uint64_t start,
+			 uint64_t count, uint64_t* sum, uint64_t* weighted) {
+  bool written;
+  uint64_t i;
+  if(start >= value->length) {
+    return TRUE;
+  }
+  count = count < value->length - start ? count : value->length - start;
+  _checksum_fold(sum, weighted, buffer, start, count, value->length);
+  for(i = 0; i < count; i++) {
+    buffer[i] = _le64(buffer[i]);
+  }
+  written = _pwrite_all(value->fd, buffer, count * sizeof(uint64_t), _chunk_offset(start));
+  for(i = 0; i < count; i++) {
+    buffer[i] = _le64(buffer[i]);
+  }
+  return written;
+}
+
+/**
+ * Hint the kernel to start reading the next chunk while this one is
+ * worked on
+ */
+static void _prefetch_chunk(chunked_bigint* value, long start, uint64_t count) {
+  if(start < 0) {
+    count = -start < count ? count + start : 0;
+    start = 0;
+  }
+  if(count && (uint64_t) start < value->length) {
+    posix_fadvise(value->fd, _chunk_offset(start), count * sizeof(uint64_t),
+		  POSIX_FADV_WILLNEED);
+  }
+}
+
+static bool _write_chunked_header(chunked_bigint* value, uint64_t sum, uint64_t weighted) {
+  byte header[BIGINT_HEADER_SIZE];
+  _encode_bigint_header(header, value->length,
+			_checksum_finish(sum, weighted, value->length), value->negative);
+  return _pwrite_all(value->fd, header, BIGINT_HEADER_SIZE, 0);
+}
+
+static chunked_bigint* _new_chunked(int fd, uint64_t length, uint64_t chunk_length,
+				    bool negative) {
+  chunked_bigint* value = malloc(sizeof(chunked_bigint));
+  value->fd = fd;
+  value->length = length;
+  value->chunk_length = chunk_length ? chunk_length : CHUNK_DEFAULT_LENGTH;
+  value->negative = negative;
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  return value;
+}
+
+/**
+ * Create or truncate path as a zero of length segments in the
+ * write_bigint format. The file is sparse until written. chunk_length
+ * is the number of segments held in memory per pass, 0 for
+ * CHUNK_DEFAULT_LENGTH.
+ */
+chunked_bigint* create_chunked_bigint(const char* path, uint64_t length,
+				      uint64_t chunk_length) {
+  chunked_bigint* value;
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0) {
+    return NULL;
+  }
+  if(ftruncate(fd, _chunk_offset(length)) != 0) {
+    close(fd);
+    return NULL;
+  }
+  value = _new_chunked(fd, length, chunk_length, FALSE);
+  if(!_write_chunked_header(value, 0, 0)) {
+    close_chunked_bigint(value);
+    return NULL;
+  }
+  return value;
+}
+
+/**
+ * Open a file written by write_bigint or a chunked operation for
+ * chunked arithmetic. With verify the checksum is checked, which
+ * reads the whole file once.
+ */
+chunked_bigint* open_chunked_bigint(const char* path, uint64_t chunk_length, bool verify) {
+  byte header[BIGINT_HEADER_SIZE];
+  chunked_bigint* value;
+  uint64_t length, checksum, sum = 0, weighted = 0, i, count;
+  uint64_t* buffer;
+  struct stat info;
+  bool negative;
+  int fd = open(path, O_RDWR);
+
+  if(fd < 0) {
+    return NULL;
+  }
+  if(fstat(fd, &info) != 0 || !_pread_all(fd, header, BIGINT_HEADER_SIZE, 0) ||
+     !_decode_bigint_header(header, &length, &checksum, &negative) ||
+     length > (info.st_size - BIGINT_HEADER_SIZE) / sizeof(uint64_t)) {
+    close(fd);
+    return NULL;
+  }
+  value = _new_chunked(fd, length, chunk_length, negative);
+  if(verify) {
+    buffer = malloc(value->chunk_length * sizeof(uint64_t));
+    for(i = 0; i < length; i += count) {
+      count = length - i < value->chunk_length ? length - i : value->chunk_length;
+      _prefetch_chunk(value, i + count, value->chunk_length);
+      if(!_read_chunk(value, buffer, i, count)) {
+	break;
+      }
+      _checksum_fold(&sum, &weighted, buffer, i, count, length);
+    }
+    free(buffer);
+    if(i < length || _checksum_finish(sum, weighted, length) != checksum) {
+      close_chunked_bigint(value);
+      return NULL;
+    }
+  }
+  return value;
+}
+
+void close_chunked_bigint(chunked_bigint* value) {
+  close(value->fd);
+  free(value);
+}
+
+/**
+ * dest += incr mod 2^(64 dest->length), one chunk of each in memory at
+ * a time. incr may be shorter or longer than dest.
+ */
+chunked_bigint* add_chunked(chunked_bigint* dest, chunked_bigint* incr) {
+  uint64_t chunk = dest->chunk_length, start, count, carry = 0, sum = 0, weighted = 0;
+  uint64_t* buffer = malloc(chunk * sizeof(uint64_t));
+  uint64_t* addend = malloc(chunk * sizeof(uint64_t));
+  bool ok = TRUE;
+
+  for(start = 0; ok && start < dest->length; start += count) {
+    count = dest->length - start < chunk ? dest->length - start : chunk;
+    _prefetch_chunk(dest, start + count, chunk);
+    _prefetch_chunk(incr, start + count, chunk);
+    ok = _read_chunk(dest, buffer, start, count) && _read_chunk(incr, addend, start, count);
+    if(ok) {
+      carry = add_1_segments(buffer, count, carry);
+      carry += _add_n(buffer, addend, count);
+      ok = _write_chunk(dest, buffer, start, count, &sum, &weighted);
+    }
+  }
+  free(buffer);
+  free(addend);
+  return ok && _write_chunked_header(dest, sum, weighted) ? dest : NULL;
+}
+
+/**
+ * dest <<= offset bits. Chunks are rewritten from the top down so that
+ * every source segment is read before it is overwritten.
+ */
+chunked_bigint* shl_chunked(chunked_bigint* dest, uint64_t offset) {
+  uint64_t chunk = dest->chunk_length, words = offset / 64, bits = offset % 64;
+  uint64_t* source = malloc((chunk + 1) * sizeof(uint64_t));
+  uint64_t* buffer = malloc(chunk * sizeof(uint64_t));
+  uint64_t end, start, count, i, sum = 0, weighted = 0;
+  bool ok = TRUE;
+
+  for(end = dest->length; ok && end > 0; end = start) {
+    start = end > chunk ? end - chunk : 0;
+    count = end - start;
+    //buffer[i] takes bits from source segments start + i - words - 1, start + i - words
+    ok = _read_chunk(dest, source, (long) start - (long) words - 1, count + 1);
+    _prefetch_chunk(dest, (long) start - (long) words - (long) chunk - 1, chunk + 1);
+    for(i = 0; ok && i < count; i++) {
+      buffer[i] = bits ? source[i+1] << bits | source[i] >> (64 - bits) : source[i+1];
+    }
+    ok = ok && _write_chunk(dest, buffer, start, count, &sum, &weighted);
+  }
+  free(source);
+  free(buffer);
+  return ok && _write_chunked_header(dest, sum, weighted) ? dest : NULL;
+}
+
+/**
+ * dest >>= offset bits, bottom up
+ */
+chunked_bigint* shr_chunked(chunked_bigint* dest, uint64_t offset) {
+  uint64_t chunk = dest->chunk_length, words = offset / 64, bits = offset % 64;
+  uint64_t* source = malloc((chunk + 1) * sizeof(uint64_t));
+  uint64_t* buffer = malloc(chunk * sizeof(uint64_t));
+  uint64_t start, count, i, sum = 0, weighted = 0;
+  bool ok = TRUE;
+
+  if(words > dest->length) {
+    words = dest->length;
+  }
+  for(start = 0; ok && start < dest->length; start += count) {
+    count = dest->length - start < chunk ? dest->length - start : chunk;
+    ok = _read_chunk(dest, source, start + words, count + 1);
+    _prefetch_chunk(dest, start + words + count, chunk + 1);
+    for(i = 0; ok && i < count; i++) {
+      buffer[i] = bits ? source[i] >> bits | source[i+1] << (64 - bits) : source[i];
+    }
+    ok = ok && _write_chunk(dest, buffer, start, count, &sum, &weighted);
+  }
+  free(source);
+  free(buffer);
+  return ok && _write_chunked_header(dest, sum, weighted) ? dest : NULL;
+}
+
+/**
+ * dest *= scale mod 2^(64 dest->length)
+ */
+chunked_bigint* mul_1_chunked(chunked_bigint* dest, uint64_t scale) {
+  uint64_t chunk = dest->chunk_length, start, count, carry = 0, sum = 0, weighted = 0;
+  uint64_t* buffer = malloc(chunk * sizeof(uint64_t));
+  uint64_t high;
+  bool ok = TRUE;
+
+  for(start = 0; ok && start < dest->length; start += count) {
+    count = dest->length - start < chunk ? dest->length - start : chunk;
+    _prefetch_chunk(dest, start + count, chunk);
+    ok = _read_chunk(dest, buffer, start, count);
+    if(ok) {
+      high = _cpu.mul_1(buffer, buffer, count, scale);
+      high += add_1_segments(buffer, count, carry);
+      carry = high;
+      ok = _write_chunk(dest, buffer, start, count, &sum, &weighted);
+    }
+  }
+  free(buffer);
+  return ok && _write_chunked_header(dest, sum, weighted) ? dest : NULL;
+}
+
+/**
+ * Forward transform every block of value into the scratch file, the
+ * NTT_PRIMES transforms of a block stored together
+ */
+static bool _spill_ntt_blocks(int scratch, off_t base, chunked_bigint* value,
+			      uint64_t blocks, uint64_t block, ntt_plan* plan,
+			      uint64_t* limbs, uint64_t* transform) {
+  uint64_t i, n = plan->size;
+  int k;
+  for(i = 0; i < blocks; i++) {
+    _prefetch_chunk(value, (i + 1) * block, block);
+    if(!_read_chunk(value, limbs, i * block, block)) {
+      return FALSE;
+    }
+    for(k = 0; k < NTT_PRIMES; k++) {
+      _ntt_load(transform + k * n, limbs, block, plan, k);
+      _ntt_forward(transform + k * n, plan, k);
+    }
+    if(!_pwrite_all(scratch, transform, NTT_PRIMES * n * sizeof(uint64_t),
+		    base + i * NTT_PRIMES * n * sizeof(uint64_t))) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/**
+ * dest = a * b mod 2^(64 dest->length); dest must be a different file
+ * from a and b.
+ *
+ * a and b are cut into blocks of half a transform and every block is
+ * transformed once into an unlinked scratch file. Output block k is
+ * then the sum over i + j = k of the products of block pairs, which is
+ * accumulated in the transform domain so each output block needs one
+ * inverse transform. The low half of the result goes to dest, the
+ * high half carries into the next block.
+ *
+ * Memory is about 12 * chunk_length segments. The scratch file holds
+ * 6 * (a->length + b->length) segments and is read once per block
+ * pair, so I/O grows as the square of length / chunk_length; give a
+ * large chunk_length to dest.
+ */
+chunked_bigint* mul_chunked(chunked_bigint* dest, chunked_bigint* a, chunked_bigint* b) {
+  uint64_t block = 1, n, a_blocks, b_blocks, out_blocks, i, j, k, sum = 0, weighted = 0;
+  uint64_t *limbs, *ta, *tb, *acc, *window, *product, *residues[NTT_PRIMES];
+  off_t b_base, stride;
+  ntt_plan* plan;
+  FILE* scratch;
+  bool ok;
+  int q, fd;
+
+  while(block * 2 <= dest->chunk_length / 2 && block * 2 <= (1UL << (NTT_MAX_LOG - 1))) {
+    block *= 2;
+  }
+  n = 2 * block;
+  a_blocks = ((a->length < dest->length ? a->length : dest->length) + block - 1) / block;
+  b_blocks = ((b->length < dest->length ? b->length : dest->length) + block - 1) / block;
+  out_blocks = (dest->length + block - 1) / block;
+
+  scratch = tmpfile();
+  if(scratch == NULL) {
+    return NULL;
+  }
+  fd = fileno(scratch);
+  plan = _create_ntt_plan(n);
+  limbs = malloc(block * sizeof(uint64_t));
+  ta = malloc(NTT_PRIMES * n * sizeof(uint64_t));
+  tb = malloc(NTT_PRIMES * n * sizeof(uint64_t));
+  acc = malloc(NTT_PRIMES * n * sizeof(uint64_t));
+  product = malloc((n + 2) * sizeof(uint64_t));
+  window = calloc(n + 2, sizeof(uint64_t));
+  stride = NTT_PRIMES * n * sizeof(uint64_t);
+  b_base = a_blocks * stride;
+
+  ok = _spill_ntt_blocks(fd, 0, a, a_blocks, block, plan, limbs, ta) &&
+    _spill_ntt_blocks(fd, b_base, b, b_blocks, block, plan, limbs, tb);
+
+  for(k = 0; ok && k < out_blocks; k++) {
+    memset(acc, 0, NTT_PRIMES * n * sizeof(uint64_t));
+    for(i = k + 1 > b_blocks ? k + 1 - b_blocks : 0; ok && i <= k && i < a_blocks; i++) {
+      j = k - i;
+      posix_fadvise(fd, (i + 1) * stride, stride, POSIX_FADV_WILLNEED);
+      posix_fadvise(fd, b_base + (j ? j - 1 : 0) * stride, stride, POSIX_FADV_WILLNEED);
+      ok = _pread_all(fd, ta, stride, i * stride) &&
+	_pread_all(fd, tb, stride, b_base + j * stride);
+      for(q = 0; ok && q < NTT_PRIMES; q++) {
+	_ntt_mul_add(acc + q * n, ta + q * n, tb + q * n, n, q);
+      }
+    }
+    for(q = 0; q < NTT_PRIMES; q++) {
+      _ntt_inverse(acc + q * n, plan, q);
+      residues[q] = acc + q * n;
+    }
+    _ntt_crt(product, residues, n);
+    _add_n(window, product, n + 2);
+
+    ok = ok && _write_chunk(dest, window, k * block, block, &sum, &weighted);
+    memmove(window, window + block, (n + 2 - block) * sizeof(uint64_t));
+    memset(window + n + 2 - block, 0, block * sizeof(uint64_t));
+  }
+
+  fclose(scratch);
+  _free_ntt_plan(plan);
+  free(limbs);
+  free(ta);
+  free(tb);
+  free(acc);
+  free(product);
+  free(window);
+  return ok && _write_chunked_header(dest, sum, weighted) ? dest : NULL;
+}
+
+///
+///
+///
+
+bigint* shl_bigint(bigint* dest, byte offset) {
+  if(offset > sizeof(uint64_t) * 8) {
+    return NULL;
+  }
+  
+  if(shl_segments(dest->data, dest->length, offset) == NULL) {
+    return NULL;
+  }
+
+  return dest;
+}
+
+bigint* shr_bigint(bigint* dest, byte offset) {
+  if(offset > sizeof(uint64_t) * 8) {
+    return NULL;
+  }
+
+  if(shr_segments(dest->data, dest->length, offset) == NULL) {
+    return NULL;
+  }
+  return dest;
+}
+
+bigint* add_bigint(bigint* dest, bigint* offset) {
+  if(dest->length != offset->length) {
+    return NULL;
+  }
+
+  if(add_segments(dest->data, offset->data, dest->length) == NULL) {
+    return NULL;
+  }
+
+  return dest;
+}
+
+bigint* sub_bigint(bigint* dest, bigint* offset) {
+  if(dest->length != offset->length) {
+    return NULL;
+  }
+  if(sub_segments(dest->data, offset->data, dest->length) == NULL) {
+    return NULL;
+  }
+  return dest;
+}
+
+bigint* and_bigint(bigint* dest, bigint* mask) {
+  if(dest->length != mask->length) {
+    return NULL;
+  }
+  and_segments(dest->data, mask->data, dest->length);
+  return dest;
+}
+
+bigint* or_bigint(bigint* dest, bigint* mask) {
+  if(dest->length != mask->length) {
+    return NULL;
+  }
+  or_segments(dest->data, mask->data, dest->length);
+  return dest;
+}
+
+bigint* xor_bigint(bigint* dest, bigint* mask) {
+  if(dest->length != mask->length) {
+    return NULL;
+  }
+  xor_segments(dest->data, mask->data, dest->length);
+  return dest;
+}
+
+bigint* andnot_bigint(bigint* dest, bigint* mask) {
+  if(dest->length != mask->length) {
+    return NULL;
+  }
+  andnot_segments(dest->data, mask->data, dest->length);
+  return dest;
+}
+
+bigint* not_bigint(bigint* dest) {
+  not_segments(dest->data, dest->length);
+  return dest;
+}
+
+bigint* set_bit_bigint(bigint* dest, uint64_t bit) {
+  if(set_bit_segments(dest->data, dest->length, bit) == NULL) {
+    return NULL;
+  }
+  return dest;
+}
+
+bigint* clear_bit_bigint(bigint* dest, uint64_t bit) {
+  if(clear_bit_segments(dest->data, dest->length, bit) == NULL) {
+    return NULL;
+  }
+  return dest;
+}
+
+bool test_bit_bigint(bigint* value, uint64_t bit) {
+  return test_bit_segments(value->data, value->length, bit);
+}
+
+bigint* gcd_bigint(bigint* dest, bigint* other) {
+  if(dest->length != other->length) {
+    return NULL;
+  }
+  gcd_segments(dest->data, other->data, dest->length);
+  return dest;
+}
+
+bigint* invmod_bigint(bigint* dest, bigint* modulus) {
+  if(dest->length != modulus->length) {
+    return NULL;
+  }
+  if(invmod_segments(dest->data, modulus->data, dest->length) == NULL) {
+    return NULL;
+  }
+  return dest;
+}
+
+bigint* sqrt_bigint(bigint* dest) {
+  sqrt_segments(dest->data, dest->length);
+  return dest;
+}
+
+bigint* root_bigint(bigint* dest, uint64_t k) {
+  if(root_segments(dest->data, k, dest->length) == NULL) {
+    return NULL;
+  }
+  return dest;
+}
+
+bool is_square_bigint(bigint* value) {
+  return is_square_segments(value->data, value->length);
+}
+
+bool is_power_bigint(bigint* value) {
+  return is_power_segments(value->data, value->length);
+}
+
+bigint* mul_bigint_nat(bigint* dest, uint64_t scale) {
+  mul_1_segments(dest->data, dest->data, dest->length, scale);
+  return dest;
+}
+
+bigint* add_bigint_nat(bigint* dest, uint64_t incr) {
+  add_1_segments(dest->data, dest->length, incr);
+  return dest;
+}
+
+bigint* sub_bigint_nat(bigint* dest, uint64_t decr) {
+  sub_1_segments(dest->data, dest->length, decr);
+  return dest;
+}
+
+bigint* mul_bigint(bigint* dest, bigint* scale) {
+  STAT_BEGIN();
+  size_t scratch_size = sizeof(uint64_t) * dest->length;
+  uint64_t* scratch = malloc(scratch_size);
+  memset(scratch, 0, scratch_size);
+  STAT_BYTES(STAT_MUL_BIGINT, scratch_size);
+
+  int i, j=0;
+  uint64_t multiplier;
   for(i = 0; i < scale->length; i++) {
     multiplier = scale->data[i];
     for(j=0; multiplier; j++) {
       if(multiplier & 0x1) {
 	add_segments(scratch, dest->data, dest->length);
       }
-      shl_segments(dest->data, dest->length, 1);
-      multiplier >>= 1;
+      shl_segments(dest->data, dest->length, 1);
+      multiplier >>= 1;
+    }
+    shl_segments(dest->data, dest->length, sizeof(uint64_t) * 8 - j);
+  }
+
+  memcpy(dest->data, scratch, scratch_size);
+  free(scratch);
+  STAT_END(STAT_MUL_BIGINT, dest->length);
+  return dest;
+}
+
+bigint* div_bigint_nat(bigint* dest, uint64_t divisor) {
+  if(divisor == 0) {
+    return NULL;
+  }
+  divrem_1_segments(dest->data, dest->data, dest->length, divisor);
+  return dest;
+}
+
+/**
+ * value % divisor. A zero divisor gives 0, which looks like a zero
+ * remainder, so callers that may pass one must check it first.
+ */
+uint64_t mod_bigint_nat(bigint* value, uint64_t divisor) {
+  if(divisor == 0) {
+    return 0;
+  }
+  return mod_1_segments(value->data, value->length, divisor);
+}
+
+/**
+ * Divide every value in place by the same precomputed divisor.
+ * remainders may be NULL.
+ */
+bigint** div_bigints_pre(bigint** values, uint64_t count, nat_divisor* pre,
+			 uint64_t* remainders) {
+  uint64_t i, r;
+  for(i = 0; i < count; i++) {
+    r = divrem_pre_segments(values[i]->data, values[i]->data, values[i]->length, pre);
+    if(remainders) {
+      remainders[i] = r;
+    }
+  }
+  return values;
+}
+
+uint64_t* mod_bigints_pre(uint64_t* remainders, bigint** values, uint64_t count,
+			  nat_divisor* pre) {
+  uint64_t i;
+  for(i = 0; i < count; i++) {
+    remainders[i] = mod_pre_segments(values[i]->data, values[i]->length, pre);
+  }
+  return remainders;
+}
+
+bigint* div_bigint(bigint* dest, bigint* divisor) {
+  //divide
+
+  return NULL;
+}
+
+
+char* eulers(bigint* value, byte base, const char* digit_map) {
+  int bitsper = sizeof(uint64_t) * 8,
+    bits = value->length * bitsper,
+    i;
+
+  size_t scratch_size = bits * sizeof(byte);
+  byte* scratch = malloc(scratch_size);
+  byte* scratch_prime = malloc(scratch_size);
+
+  for(i = 0; i < bits; i++) {
+    scratch[i] = (value->data[i/bitsper] >> (i % bitsper)) & 0x1;
+  }
+
+  eulers_node *curr = malloc(sizeof(eulers_node)), *temp;
+  curr->prev = NULL;
+  curr->value = '\0';
+
+  int length = 1;
+  byte running = TRUE;
+  while(running) {
+    byte rem = 0;
+    running = FALSE;
+    for(i = bits-1; i >= 0; i--) {
+      rem = rem * 2 + scratch[i];
+      if(rem >= base) {
+	scratch_prime[i] = 1;
+	rem -= base;
+      } else {
+	scratch_prime[i] = 0;
+      }
+      running = running || scratch_prime[i];
+      //?
+    }
+
+    temp = malloc(sizeof(eulers_node));
+    temp->prev = curr;
+    temp->value = digit_map[rem];
+
+    curr = temp;
+
+    memcpy(scratch, scratch_prime, scratch_size);
+    length++;
+  }
+  
+  char* output = malloc(sizeof(char) * length);
+  for(i = 0; i < length && curr != NULL; i++) {
+    output[i] = curr->value;
+    temp = curr;
+    curr = curr->prev;
+    free(temp);
+  }
+  
+  free(scratch);
+  free(scratch_prime);
+  return output;
+}
+
+
+///
+/// Binary splitting
+///
+
+static uint64_t _split_threads = 0;
+
+/**
+ * Threads the binary splitting products may use, 0 for one per online
+ * CPU. Returns the previous setting.
+ */
+uint64_t set_split_threads(uint64_t threads) {
+  uint64_t previous = _split_threads;
+  _split_threads = threads;
+  return previous;
+}
+
+/**
+ * A thread count setting, 0 meaning one per online CPU
+ */
+static uint64_t _thread_count(uint64_t setting) {
+  long online;
+  if(setting) {
+    return setting;
+  }
+  online = sysconf(_SC_NPROCESSORS_ONLN);
+  return online > 0 ? online : 1;
+}
+
+/**
+ * Evaluate two independent subtrees, the left one on its own thread
+ * when spawn is set. Falls back to running both here if no thread can
+ * be started.
+ */
+static void _split_fork(void* (*run)(void*), void* left, void* right, bool spawn) {
+  pthread_t thread;
+  if(spawn && pthread_create(&thread, NULL, run, left) == 0) {
+    run(right);
+    pthread_join(thread, NULL);
+  } else {
+    run(left);
+    run(right);
+  }
+}
+
+static bigint* _sized_bigint(uint64_t length) {
+  bigint* value = malloc(sizeof(bigint));
+  value->data = malloc((length ? length : 1) * sizeof(uint64_t));
+  value->length = length;
+  return value;
+}
+
+/**
+ * Drop high zero segments, keeping at least one
+ */
+static bigint* _trim_bigint(bigint* value) {
+  value->length = _size_segments(value->data, value->length);
+  if(value->length == 0) {
+    value->data[0] = 0;
+    value->length = 1;
+  }
+  return value;
+}
+
+static bigint* _copy_bigint(uint64_t* segments, uint64_t length) {
+  bigint* value = _sized_bigint(length);
+  memcpy(value->data, segments, length * sizeof(uint64_t));
+  return _trim_bigint(value);
+}
+
+static bigint* _product_bigint(bigint* a, bigint* b) {
+  bigint* product = _sized_bigint(a->length + b->length);
+  _mul_full(product->data, a->data, a->length, b->data, b->length);
+  return _trim_bigint(product);
+}
+
+/**
+ * Odd only sieve of Eratosthenes. Returns the primes up to limit and
+ * their number in count.
+ */
+static uint64_t* _sieve_primes(uint64_t limit, uint64_t* count) {
+  uint64_t half = limit / 2 + 1, i, j, found = 0;
+  byte* composite = calloc(half, 1);
+  uint64_t* primes = malloc((limit < 2 ? 1 : limit / 2 + 1) * sizeof(uint64_t));
+
+  if(limit >= 2) {
+    primes[found++] = 2;
+  }
+  //index i stands for 2i + 1
+  for(i = 1; 2 * i + 1 <= limit; i++) {
+    if(composite[i]) {
+      continue;
+    }
+    primes[found++] = 2 * i + 1;
+    for(j = 2 * i * (i + 1); j < half; j += 2 * i + 1) {
+      composite[j] = TRUE;
+    }
+  }
+  free(composite);
+  *count = found;
+  return primes;
+}
+
+/**
+ * Multiply runs of neighbouring factors together while they fit in a
+ * word, in place. Returns the new count.
+ */
+static uint64_t _pack_factors(uint64_t* factors, uint64_t count) {
+  uint64_t i, packed = 0, word, next;
+  for(i = 0; i < count; packed++) {
+    word = factors[i++];
+    while(i < count && !__builtin_mul_overflow(word, factors[i], &next)) {
+      word = next;
+      i++;
+    }
+    factors[packed] = word;
+  }
+  return packed;
+}
+
+typedef struct {
+  uint64_t* words;
+  uint64_t count;
+  uint64_t threads;
+  bigint* result;
+} split_words;
+
+/**
+ * Product tree over words. Halving by count keeps both sides the same
+ * size, so every multiplication is balanced.
+ */
+static void* _split_words(void* arg) {
+  split_words *job = arg, left, right;
+  uint64_t i, half = job->count / 2, carry;
+  bigint* result;
+
+  if(job->count <= SPLIT_LEAF_LENGTH) {
+    result = _sized_bigint(job->count + 1);
+    result->data[0] = 1;
+    result->length = 1;
+    for(i = 0; i < job->count; i++) {
+      carry = _cpu.mul_1(result->data, result->data, result->length, job->words[i]);
+      if(carry) {
+	result->data[result->length++] = carry;
+      }
+    }
+    job->result = _trim_bigint(result);
+    return NULL;
+  }
+
+  left = (split_words) {job->words, half, job->threads / 2, NULL};
+  right = (split_words) {job->words + half, job->count - half,
+			 job->threads - job->threads / 2, NULL};
+  _split_fork(_split_words, &left, &right,
+	      job->threads > 1 && job->count >= SPLIT_THREAD_WORDS);
+  job->result = _product_bigint(left.result, right.result);
+  free_bigint(left.result);
+  free_bigint(right.result);
+  return NULL;
+}
+
+static bigint* _product_words(uint64_t* words, uint64_t count) {
+  split_words job = {words, _pack_factors(words, count), _thread_count(_split_threads),
+		     NULL};
+  _split_words(&job);
+  return job.result;
+}
+
+/**
+ * Odd part of the swinging factorial m! / (m/2)!^2: each odd prime p
+ * appears to the power of the number of odd floor(m / p^i), and that
+ * power is at most m
+ */
+static bigint* _odd_swing(uint64_t m, uint64_t* primes, uint64_t prime_count,
+			  uint64_t* factors) {
+  uint64_t i, count = 0, q, power;
+  for(i = 1; i < prime_count && primes[i] <= m; i++) {
+    for(q = m, power = 1; q >= primes[i]; ) {
+      q /= primes[i];
+      if(q & 1) {
+	power *= primes[i];
+      }
+    }
+    if(power > 1) {
+      factors[count++] = power;
+    }
+  }
+  return _product_words(factors, count);
+}
+
+/**
+ * n! by prime swing: n! = 2^(n - popcount(n)) odd(n) with
+ * odd(n) = odd(n/2)^2 oddswing(n), so the work is a few large
+ * squarings and balanced products of prime powers.
+ */
+bigint* factorial_bigint(uint64_t n) {
+  uint64_t prime_count, level, shift = n - __builtin_popcountl(n), words;
+  uint64_t bits = n ? 64 - __builtin_clzl(n) : 0;
+  uint64_t* primes = _sieve_primes(n, &prime_count);
+  uint64_t* factors = malloc((prime_count + 1) * sizeof(uint64_t));
+  bigint *odd = _sized_bigint(1), *swing, *square, *result;
+
+  odd->data[0] = 1;
+  for(level = bits; level-- > 0; ) {
+    square = _product_bigint(odd, odd);
+    swing = _odd_swing(n >> level, primes, prime_count, factors);
+    free_bigint(odd);
+    odd = _product_bigint(square, swing);
+    free_bigint(square);
+    free_bigint(swing);
+  }
+  free(primes);
+  free(factors);
+
+  words = shift / 64;
+  result = _sized_bigint(odd->length + words + 1);
+  memset(result->data, 0, result->length * sizeof(uint64_t));
+  memcpy(result->data + words, odd->data, odd->length * sizeof(uint64_t));
+  shl_segments(result->data + words, odd->length + 1, shift % 64);
+  free_bigint(odd);
+  return _trim_bigint(result);
+}
+
+/**
+ * n choose k from its factorization: by Kummer the power of p is the
+ * number of borrows in n - k written in base p, and is at most n
+ */
+bigint* binomial_bigint(uint64_t n, uint64_t k) {
+  uint64_t prime_count, i, count = 0, power, top, bottom, borrow;
+  uint64_t* primes;
+  bigint* result;
+
+  if(k > n) {
+    result = _sized_bigint(1);
+    result->data[0] = 0;
+    return result;
+  }
+  primes = _sieve_primes(n, &prime_count);
+  for(i = 0; i < prime_count; i++) {
+    power = 1;
+    borrow = 0;
+    for(top = n, bottom = k; top; top /= primes[i], bottom /= primes[i]) {
+      borrow = top % primes[i] < bottom % primes[i] + borrow;
+      if(borrow) {
+	power *= primes[i];
+      }
+    }
+    if(power > 1) {
+      primes[count++] = power;
+    }
+  }
+  result = _product_words(primes, count);
+  free(primes);
+  return result;
+}
+
+/**
+ * Product of the primes up to n
+ */
+bigint* primorial_bigint(uint64_t n) {
+  uint64_t count;
+  uint64_t* primes = _sieve_primes(n, &count);
+  bigint* result = _product_words(primes, count);
+  free(primes);
+  return result;
+}
+
+typedef struct {
+  bigint** values;
+  uint64_t count;
+  uint64_t threads;
+  bigint* result;
+} split_bigints;
+
+/**
+ * Product tree over bigints of any sizes, split where the running
+ * total of segments crosses half so both sides are about as long
+ */
+static void* _split_bigints(void* arg) {
+  split_bigints *job = arg, left, right;
+  uint64_t i, total = 0, running = 0;
+
+  if(job->count == 1) {
+    job->result = _copy_bigint(job->values[0]->data, job->values[0]->length);
+    return NULL;
+  }
+  for(i = 0; i < job->count; i++) {
+    total += _size_segments(job->values[i]->data, job->values[i]->length);
+  }
+  for(i = 0; i < job->count - 2 && 2 * running < total; i++) {
+    running += _size_segments(job->values[i]->data, job->values[i]->length);
+  }
+  i = i ? i : 1;
+
+  left = (split_bigints) {job->values, i, job->threads / 2, NULL};
+  right = (split_bigints) {job->values + i, job->count - i,
+			   job->threads - job->threads / 2, NULL};
+  _split_fork(_split_bigints, &left, &right,
+	      job->threads > 1 && total >= SPLIT_THREAD_SEGMENTS);
+  job->result = _product_bigint(left.result, right.result);
+  free_bigint(left.result);
+  free_bigint(right.result);
+  return NULL;
+}
+
+/**
+ * Product of count values as a new bigint just long enough to hold
+ * it. The values are not changed.
+ */
+bigint* product_bigints(bigint** values, uint64_t count) {
+  split_bigints job = {values, count, _thread_count(_split_threads), NULL};
+  bigint* one;
+  if(count == 0) {
+    one = _sized_bigint(1);
+    one->data[0] = 1;
+    return one;
+  }
+  _split_bigints(&job);
+  return job.result;
+}
+
+/**
+ * Compare magnitudes of two trimmed values
+ */
+static int _cmp_bigint(bigint* a, bigint* b) {
+  uint64_t i = a->length;
+  if(a->length != b->length) {
+    return a->length < b->length ? -1 : 1;
+  }
+  while(i-- > 0) {
+    if(a->data[i] != b->data[i]) {
+      return a->data[i] < b->data[i] ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Signed a + b, both consumed
+ */
+static bigint* _signed_sum(bigint* a, bool* negative, bigint* b, bool b_negative) {
+  bool same = *negative == b_negative;
+  bigint *large = a, *small = b, *sum;
+  if(_cmp_bigint(a, b) < 0) {
+    large = b;
+    small = a;
+    *negative = b_negative;
+  }
+  sum = _sized_bigint(large->length + 1);
+  memcpy(sum->data, large->data, large->length * sizeof(uint64_t));
+  sum->data[large->length] = 0;
+  if(same) {
+    _add_into(sum->data, sum->length, small->data, small->length);
+  } else {
+    _sub_from(sum->data, sum->length, small->data, small->length);
+  }
+  free_bigint(a);
+  free_bigint(b);
+  _trim_bigint(sum);
+  if(sum->length == 1 && sum->data[0] == 0) {
+    *negative = FALSE;
+  }
+  return sum;
+}
+
+typedef struct {
+  series_terms terms;
+  void* context;
+  uint64_t start;
+  uint64_t end;
+  uint64_t threads;
+  series_sum sum;
+} split_series;
+
+/**
+ * P, Q and T over [start, end): P and Q multiply, and
+ * T = T_left Q_right + P_left T_right
+ */
+static void* _split_series(void* arg) {
+  split_series *job = arg, left, right;
+  uint64_t middle = job->start + (job->end - job->start) / 2;
+  series_term term;
+  series_sum* sum = &job->sum;
+  bigint* right_t;
+  bool right_negative;
+
+  if(job->end - job->start == 1) {
+    memset(&term, 0, sizeof(series_term));
+    job->terms(job->start, &term, job->context);
+    sum->p = _copy_bigint(term.p, SERIES_TERM_LENGTH);
+    sum->q = _copy_bigint(term.q, SERIES_TERM_LENGTH);
+    sum->t = _sized_bigint(2 * SERIES_TERM_LENGTH);
+    _mul_full(sum->t->data, term.a, SERIES_TERM_LENGTH, term.p, SERIES_TERM_LENGTH);
+    _trim_bigint(sum->t);
+    sum->p_negative = term.p_negative;
+    sum->t_negative = term.p_negative != term.a_negative &&
+      !(sum->t->length == 1 && sum->t->data[0] == 0);
+    return NULL;
+  }
+
+  left = *job;
+  left.end = middle;
+  left.threads = job->threads / 2;
+  right = *job;
+  right.start = middle;
+  right.threads = job->threads - job->threads / 2;
+  _split_fork(_split_series, &left, &right,
+	      job->threads > 1 && job->end - job->start >= SPLIT_THREAD_TERMS);
+
+  sum->t = _product_bigint(left.sum.t, right.sum.q);
+  sum->t_negative = left.sum.t_negative;
+  right_t = _product_bigint(left.sum.p, right.sum.t);
+  right_negative = left.sum.p_negative != right.sum.t_negative;
+  sum->t = _signed_sum(sum->t, &sum->t_negative, right_t, right_negative);
+  sum->p = _product_bigint(left.sum.p, right.sum.p);
+  sum->p_negative = left.sum.p_negative != right.sum.p_negative;
+  sum->q = _product_bigint(left.sum.q, right.sum.q);
+  free_bigint(left.sum.p);
+  free_bigint(left.sum.q);
+  free_bigint(left.sum.t);
+  free_bigint(right.sum.p);
+  free_bigint(right.sum.q);
+  free_bigint(right.sum.t);
+  return NULL;
+}
+
+/**
+ * Binary splitting of S = sum over k < count of
+ * a(k) p(0)...p(k) / (q(0)...q(k)), where terms fills in a(k), p(k)
+ * and q(k). Returns S = t / q exactly, along with the product p, so
+ * series can be continued. count must be at least 1.
+ */
+series_sum* sum_series(series_terms terms, uint64_t count, void* context) {
+  split_series job = {terms, context, 0, count, _thread_count(_split_threads)};
+  series_sum* sum;
+  if(count == 0) {
+    return NULL;
+  }
+  _split_series(&job);
+  sum = malloc(sizeof(series_sum));
+  memcpy(sum, &job.sum, sizeof(series_sum));
+  return sum;
+}
+
+void free_series_sum(series_sum* sum) {
+  free_bigint(sum->p);
+  free_bigint(sum->q);
+  free_bigint(sum->t);
+  free(sum);
+}
+
+///
+/// Product and remainder trees
+///
+
+/**
+ * A modulus prepared for Barrett reduction: shifted left so its top
+ * bit is set, with reciprocal = floor(B^(2 length) / modulus),
+ * B = 2^64, in length + 1 segments
+ */
+struct barrett_modulus {
+  uint64_t* modulus;
+  uint64_t* reciprocal;
+  uint64_t length;
+  byte shift;
+};
+
+/**
+ * floor(B^(2n) / m) into n + 1 segments for normalized m. Newton from
+ * below: the reciprocal of the top half, less 4 so that it cannot
+ * overshoot, then one step x += x (B^(2n) - m x) / B^(2n) doubles
+ * the correct segments and a few subtractions of m settle the last
+ * units.
+ */
+static void _reciprocal(uint64_t* reciprocal, uint64_t* m, uint64_t n) {
+  uint64_t h = (n + 1) / 2, *num, *rem, *quotient, *x0, *product, *error, *step;
+
+  if(n <= MUL_KARATSUBA_THRESHOLD) {
+    num = calloc(2 * n + 1, sizeof(uint64_t));
+    quotient = malloc((n + 2) * sizeof(uint64_t));
+    rem = malloc(n * sizeof(uint64_t));
+    num[2 * n] = 1;
+    _divrem_knuth(quotient, rem, num, 2 * n + 1, m, n);
+    memcpy(reciprocal, quotient, (n + 1) * sizeof(uint64_t));
+    free(num);
+    free(quotient);
+    free(rem);
+    return;
+  }
+
+  x0 = malloc((h + 1) * sizeof(uint64_t));
+  _reciprocal(x0, m + n - h, h);
+  sub_1_segments(x0, h + 1, 4);
+
+  //error = B^(n+h) - m x0, non negative and below B^(n+h)
+  product = malloc((n + h + 1) * sizeof(uint64_t));
+  error = calloc(n + h + 1, sizeof(uint64_t));
+  _mul_full(product, m, n, x0, h + 1);
+  error[n + h] = 1;
+  _sub_from(error, n + h + 1, product, n + h + 1);
+
+  //x = x0 B^(n-h) + floor(x0 error / B^(2h))
+  step = malloc((n + 2 * h + 1) * sizeof(uint64_t));
+  _mul_full(step, x0, h + 1, error, n + h);
+  memset(reciprocal, 0, (n + 1) * sizeof(uint64_t));
+  memcpy(reciprocal + n - h, x0, (h + 1) * sizeof(uint64_t));
+  _add_into(reciprocal, n + 1, step + 2 * h, n + 1);
+
+  //error = B^(2n) - m x, count up while it is still at least m
+  free(product);
+  free(error);
+  product = malloc((2 * n + 1) * sizeof(uint64_t));
+  error = calloc(2 * n + 1, sizeof(uint64_t));
+  _mul_full(product, m, n, reciprocal, n + 1);
+  error[2 * n] = 1;
+  _sub_from(error, 2 * n + 1, product, 2 * n + 1);
+  while(_size_segments(error + n, n + 1) || gte(error, m, n)) {
+    _sub_from(error, 2 * n + 1, m, n);
+    add_1_segments(reciprocal, n + 1, 1);
+  }
+  free(x0);
+  free(product);
+  free(error);
+  free(step);
+}
+
+static struct barrett_modulus* _create_barrett(uint64_t* modulus, uint64_t length) {
+  struct barrett_modulus* bm = malloc(sizeof(struct barrett_modulus));
+  length = _size_segments(modulus, length);
+  bm->length = length;
+  bm->shift = __builtin_clzl(modulus[length-1]);
+  bm->modulus = malloc(length * sizeof(uint64_t));
+  memcpy(bm->modulus, modulus, length * sizeof(uint64_t));
+  if(bm->shift) {
+    _shl_segments(bm->modulus, length, bm->shift);
+  }
+  bm->reciprocal = malloc((length + 1) * sizeof(uint64_t));
+  _reciprocal(bm->reciprocal, bm->modulus, length);
+  return bm;
+}
+
+static void _free_barrett(struct barrett_modulus* bm) {
+  free(bm->modulus);
+  free(bm->reciprocal);
+  free(bm);
+}
+
+/**
+ * remainder = x mod bm->modulus for x < B^(2n), where x is 2n
+ * segments and remainder n. The quotient estimate
+ * floor(floor(x / B^n) reciprocal / B^n) is at most 4 short for a
+ * normalized modulus. The top segment of the reciprocal is 1 or 2
+ * and is applied separately, so both products are n by n.
+ */
+static void _barrett(uint64_t* remainder, uint64_t* x, struct barrett_modulus* bm,
+		     uint64_t* scratch) {
+  uint64_t n = bm->length, *estimate = scratch, *product = scratch + 2 * n + 1;
+  uint64_t* quotient = estimate + n;
+  _mul_full(estimate, x + n, n, bm->reciprocal, n);
+  estimate[2 * n] = _cpu.addmul_1(estimate + n, x + n, n, bm->reciprocal[n]);
+
+  //x - quotient * modulus only matters mod B^(n+1)
+  _mul_full(product, quotient, n, bm->modulus, n);
+  memcpy(remainder, x, (n + 1) * sizeof(uint64_t));
+  _cpu.sub_n(remainder, product, n + 1);
+  remainder[n] -= quotient[n] * bm->modulus[0];
+  while(remainder[n] || gte(remainder, bm->modulus, n)) {
+    remainder[n] -= _cpu.sub_n(remainder, bm->modulus, n);
+  }
+}
+
+/**
+ * x mod the modulus of bm for x of any length, remainder getting
+ * bm->length segments. x is shifted like the modulus and reduced a
+ * block of n segments at a time from the top.
+ */
+static void _barrett_mod(uint64_t* remainder, uint64_t* x, uint64_t length,
+			 struct barrett_modulus* bm) {
+  uint64_t n = bm->length, position, count;
+  uint64_t* shifted = malloc((length + 1) * sizeof(uint64_t));
+  uint64_t* window = malloc(2 * n * sizeof(uint64_t));
+  uint64_t* scratch = malloc((5 * n + 3) * sizeof(uint64_t));
+  uint64_t* current = malloc((n + 1) * sizeof(uint64_t));
+
+  memcpy(shifted, x, length * sizeof(uint64_t));
+  shifted[length] = 0;
+  if(bm->shift) {
+    _shl_segments(shifted, length + 1, bm->shift);
+  }
+  position = _size_segments(shifted, length + 1);
+  memset(current, 0, (n + 1) * sizeof(uint64_t));
+  //the first window has no remainder above it and can take 2n segments
+  for(count = 2 * n; position > 0; count = n) {
+    count = position < count ? position : count;
+    position -= count;
+    //window = current B^count + next count segments, below m B^count <= B^(2n)
+    memset(window, 0, 2 * n * sizeof(uint64_t));
+    memcpy(window, shifted + position, count * sizeof(uint64_t));
+    if(count <= n) {
+      memcpy(window + count, current, n * sizeof(uint64_t));
+    }
+    //a short window, often the one segment the shift pushed out, is
+    //cheaper as count rows of schoolbook division than two products
+    if(n <= MUL_KARATSUBA_THRESHOLD || 4 * count < n) {
+      _divrem_knuth(NULL, current, window, _size_segments(window, 2 * n), bm->modulus, n);
+    } else {
+      _barrett(current, window, bm, scratch);
+    }
+  }
+  if(bm->shift) {
+    _shr_segments(current, n, bm->shift);
+  }
+  memcpy(remainder, current, n * sizeof(uint64_t));
+  free(shifted);
+  free(window);
+  free(scratch);
+  free(current);
+}
+
+/**
+ * Product tree over count non zero moduli: level 0 holds the moduli,
+ * every level above the products of pairs below it, an odd last node
+ * moving up as is. Barrett data for each node is built the first time
+ * mod_product_tree needs it and kept with the tree. NULL for count 0.
+ */
+product_tree* create_product_tree(bigint** moduli, uint64_t count) {
+  product_tree* tree;
+  uint64_t level, i, width;
+
+  if(count == 0) {
+    return NULL;
+  }
+  tree = malloc(sizeof(product_tree));
+
+  for(tree->levels = 1, width = count; width > 1; width = (width + 1) / 2) {
+    tree->levels++;
+  }
+  tree->count = count;
+  tree->level_count = malloc(tree->levels * sizeof(uint64_t));
+  tree->nodes = malloc(tree->levels * sizeof(bigint**));
+  tree->reducers = malloc(tree->levels * sizeof(struct barrett_modulus**));
+
+  for(level = 0, width = count; level < tree->levels; level++, width = (width + 1) / 2) {
+    tree->level_count[level] = width;
+    tree->nodes[level] = malloc(width * sizeof(bigint*));
+    tree->reducers[level] = calloc(width, sizeof(struct barrett_modulus*));
+    for(i = 0; i < width; i++) {
+      if(level == 0) {
+	tree->nodes[0][i] = _copy_bigint(moduli[i]->data, moduli[i]->length);
+      } else if(2 * i + 1 < tree->level_count[level-1]) {
+	tree->nodes[level][i] = _product_bigint(tree->nodes[level-1][2 * i],
+						tree->nodes[level-1][2 * i + 1]);
+      } else {
+	tree->nodes[level][i] = _copy_bigint(tree->nodes[level-1][2 * i]->data,
+					     tree->nodes[level-1][2 * i]->length);
+      }
+    }
+  }
+  return tree;
+}
+
+void free_product_tree(product_tree* tree) {
+  uint64_t level, i;
+  for(level = 0; level < tree->levels; level++) {
+    for(i = 0; i < tree->level_count[level]; i++) {
+      free_bigint(tree->nodes[level][i]);
+      if(tree->reducers[level][i]) {
+	_free_barrett(tree->reducers[level][i]);
+      }
+    }
+    free(tree->nodes[level]);
+    free(tree->reducers[level]);
+  }
+  free(tree->level_count);
+  free(tree->nodes);
+  free(tree->reducers);
+  free(tree);
+}
+
+/**
+ * value mod every leaf of tree: value is reduced by the root, and each
+ * node's remainder by its children, so the total cost is a constant
+ * number of full products per level. remainders[i] is set to a new
+ * bigint as long as the significant part of the i-th modulus. The
+ * first calls fill in the tree's Barrett data, so a tree may only be
+ * used by one thread at a time.
+ */
+bigint** mod_product_tree(bigint** remainders, bigint* value, product_tree* tree) {
+  uint64_t level = tree->levels - 1, i, width;
+  bigint **current = malloc(sizeof(bigint*)), **below;
+  struct barrett_modulus** reducer;
+
+  reducer = &tree->reducers[level][0];
+  if(*reducer == NULL) {
+    *reducer = _create_barrett(tree->nodes[level][0]->data, tree->nodes[level][0]->length);
+  }
+  current[0] = _sized_bigint((*reducer)->length);
+  _barrett_mod(current[0]->data, value->data, value->length, *reducer);
+
+  while(level-- > 0) {
+    width = tree->level_count[level];
+    below = level ? malloc(width * sizeof(bigint*)) : remainders;
+    for(i = 0; i < width; i++) {
+      reducer = &tree->reducers[level][i];
+      if(*reducer == NULL) {
+	*reducer = _create_barrett(tree->nodes[level][i]->data, tree->nodes[level][i]->length);
+      }
+      below[i] = _sized_bigint((*reducer)->length);
+      _barrett_mod(below[i]->data, current[i/2]->data, current[i/2]->length, *reducer);
+    }
+    for(i = 0; i < tree->level_count[level+1]; i++) {
+      free_bigint(current[i]);
+    }
+    free(current);
+    current = below;
+  }
+  if(tree->levels == 1) {
+    remainders[0] = current[0];
+    free(current);
+  }
+  return remainders;
+}
+
+/**
+ * Levels of a batch gcd tree, in memory or streamed through temporary
+ * files
+ */
+typedef struct {
+  bigint** values;
+  product_tree* tree;
+  FILE** files;
+  uint64_t* level_count;
+  uint64_t levels;
+} gcd_levels;
+
+/**
+ * Node i of level; nodes of streamed levels must be asked for in order
+ * and come back as copies for the caller to free
+ */
+static bigint* _gcd_level_node(gcd_levels* levels, uint64_t level, uint64_t i) {
+  if(levels->tree) {
+    return levels->tree->nodes[level][i];
+  }
+  return level ? read_bigint(levels->files[level], NULL) : levels->values[i];
+}
+
+static void _gcd_level_done(gcd_levels* levels, uint64_t level, bigint* node) {
+  if(levels->tree == NULL && level && node) {
+    free_bigint(node);
+  }
+}
+
+/**
+ * Close the temporary files of streamed levels
+ */
+static void _free_gcd_levels(gcd_levels* levels) {
+  uint64_t level;
+  for(level = 1; levels->files && level < levels->levels; level++) {
+    if(levels->files[level]) {
+      fclose(levels->files[level]);
+    }
+  }
+  free(levels->files);
+  free(levels->level_count);
+  levels->files = NULL;
+  levels->level_count = NULL;
+}
+
+/**
+ * Streamed product tree: every level above the inputs goes to its own
+ * temporary file as it is built, so only the pair being multiplied
+ * is in memory. On failure the files are closed again.
+ */
+static bool _stream_product_levels(gcd_levels* levels, uint64_t count) {
+  uint64_t level, i, width;
+  bigint *left, *right = NULL, *product;
+  bool pair;
+
+  for(levels->levels = 1, width = count; width > 1; width = (width + 1) / 2) {
+    levels->levels++;
+  }
+  levels->level_count = malloc(levels->levels * sizeof(uint64_t));
+  levels->files = calloc(levels->levels, sizeof(FILE*));
+  levels->level_count[0] = count;
+  for(level = 1; level < levels->levels; level++) {
+    levels->level_count[level] = (levels->level_count[level-1] + 1) / 2;
+    levels->files[level] = tmpfile();
+    if(levels->files[level] == NULL) {
+      _free_gcd_levels(levels);
+      return FALSE;
+    }
+    if(level > 1) {
+      rewind(levels->files[level-1]);
+    }
+    for(i = 0; i < levels->level_count[level-1]; i += 2) {
+      pair = i + 1 < levels->level_count[level-1];
+      left = _gcd_level_node(levels, level - 1, i);
+      if(pair) {
+	right = _gcd_level_node(levels, level - 1, i + 1);
+      }
+      if(left == NULL || (pair && right == NULL)) {
+	_gcd_level_done(levels, level - 1, left);
+	_gcd_level_done(levels, level - 1, pair ? right : NULL);
+	_free_gcd_levels(levels);
+	return FALSE;
+      }
+      if(pair) {
+	product = _product_bigint(left, right);
+	_gcd_level_done(levels, level - 1, right);
+      } else {
+	product = _copy_bigint(left->data, left->length);
+      }
+      _gcd_level_done(levels, level - 1, left);
+      if(write_bigint(levels->files[level], product, FALSE) == NULL) {
+	free_bigint(product);
+	_free_gcd_levels(levels);
+	return FALSE;
+      }
+      free_bigint(product);
+    }
+  }
+  return TRUE;
+}
+
+/**
+ * gcds[i] = gcd(values[i], product of all the other values), as new
+ * bigints, by Bernstein's batch gcd: the product P of all values is
+ * reduced down the tree modulo the squares of the nodes, and at leaf
+ * N, (P mod N^2) / N is P / N mod N.
+ *
+ * With streaming the tree levels live in temporary files and only two
+ * levels of remainders are held in memory, for inputs of millions of
+ * numbers. Returns NULL if a temporary file fails or a value is zero.
+ */
+bigint** batch_gcd(bigint** gcds, bigint** values, uint64_t count, bool streaming) {
+  gcd_levels levels = {values, NULL, NULL, NULL, 0};
+  uint64_t level, i, width, n, *quotient, *remainder, *other;
+  bigint **current = NULL, **below, *node, *square;
+  struct barrett_modulus* reducer;
+  bool ok = TRUE;
+
+  for(i = 0; i < count; i++) {
+    if(_size_segments(values[i]->data, values[i]->length) == 0) {
+      return NULL;
+    }
+  }
+  if(count == 0) {
+    return gcds;
+  }
+  if(streaming) {
+    ok = _stream_product_levels(&levels, count);
+  } else {
+    levels.tree = create_product_tree(values, count);
+    levels.levels = levels.tree->levels;
+    levels.level_count = levels.tree->level_count;
+  }
+
+  if(ok) {
+    level = levels.levels - 1;
+    if(streaming && level) {
+      rewind(levels.files[level]);
+    }
+    node = _gcd_level_node(&levels, level, 0);
+    current = malloc(sizeof(bigint*));
+    ok = node != NULL;
+    current[0] = ok ? _copy_bigint(node->data, node->length) : NULL;
+    _gcd_level_done(&levels, level, node);
+  }
+
+  //remainders of P modulo the squares of the nodes, level by level
+  while(ok && level-- > 0) {
+    width = levels.level_count[level];
+    below = calloc(width, sizeof(bigint*));
+    if(streaming && level) {
+      rewind(levels.files[level]);
+    }
+    for(i = 0; ok && i < width; i++) {
+      node = _gcd_level_node(&levels, level, i);
+      if(node == NULL) {
+	ok = FALSE;
+	break;
+      }
+      square = _product_bigint(node, node);
+      reducer = _create_barrett(square->data, square->length);
+      below[i] = _sized_bigint(reducer->length);
+      _barrett_mod(below[i]->data, current[i/2]->data, current[i/2]->length, reducer);
+      _free_barrett(reducer);
+      free_bigint(square);
+      _gcd_level_done(&levels, level, node);
+    }
+    for(i = 0; i < levels.level_count[level+1]; i++) {
+      free_bigint(current[i]);
+    }
+    free(current);
+    current = below;
+    if(!ok) {
+      for(i = 0; i < width; i++) {
+	if(below[i]) {
+	  free_bigint(below[i]);
+	}
+      }
+      free(below);
+      current = NULL;
+    }
+  }
+
+  //leaves: gcd((P mod N^2) / N, N)
+  for(i = 0; ok && i < count; i++) {
+    n = _size_segments(values[i]->data, values[i]->length);
+    quotient = calloc(current[i]->length + 2, sizeof(uint64_t));
+    remainder = malloc(n * sizeof(uint64_t));
+    other = calloc(n, sizeof(uint64_t));
+    _divrem_knuth(quotient, remainder, current[i]->data,
+		  _size_segments(current[i]->data, current[i]->length), values[i]->data, n);
+    memcpy(other, values[i]->data, n * sizeof(uint64_t));
+    gcd_segments(quotient, other, n);
+    gcds[i] = _copy_bigint(quotient, n);
+    free(quotient);
+    free(remainder);
+    free(other);
+    free_bigint(current[i]);
+  }
+  free(current);
+
+  if(streaming) {
+    _free_gcd_levels(&levels);
+  } else if(levels.tree) {
+    free_product_tree(levels.tree);
+  }
+  return ok ? gcds : NULL;
+}
+
+///
+/// Modular exponentiation and primality
+///
+
+/**
+ * An odd modulus set up for Montgomery multiplication with R =
+ * B^length: inverse is -modulus^-1 mod B, one is R mod modulus and
+ * square R^2 mod modulus.
+ */
+typedef struct montgomery_modulus {
+  uint64_t* modulus;
+  uint64_t length;
+  uint64_t inverse;
+  uint64_t* one;
+  uint64_t* square;
+} montgomery_modulus;
+
+/**
+ * modulus has length significant segments and is odd
+ */
+static montgomery_modulus* _create_montgomery(uint64_t* modulus, uint64_t length) {
+  montgomery_modulus* mm = malloc(sizeof(montgomery_modulus));
+  uint64_t* power = calloc(2 * length + 1, sizeof(uint64_t));
+  uint64_t inverse = modulus[0];
+  int i;
+
+  //modulus * modulus = 1 mod 8, each step doubles the correct bits
+  for(i = 0; i < 5; i++) {
+    inverse *= 2 - modulus[0] * inverse;
+  }
+  mm->inverse = -inverse;
+  mm->length = length;
+  mm->modulus = malloc(length * sizeof(uint64_t));
+  memcpy(mm->modulus, modulus, length * sizeof(uint64_t));
+  mm->one = malloc(length * sizeof(uint64_t));
+  mm->square = malloc(length * sizeof(uint64_t));
+  power[length] = 1;
+  _divrem_knuth(NULL, mm->one, power, length + 1, modulus, length);
+  power[length] = 0;
+  power[2 * length] = 1;
+  _divrem_knuth(NULL, mm->square, power, 2 * length + 1, modulus, length);
+  free(power);
+  return mm;
+}
+
+static void _free_montgomery(montgomery_modulus* mm) {
+  free(mm->modulus);
+  free(mm->one);
+  free(mm->square);
+  free(mm);
+}
+
+/**
+ * dest = t R^-1 mod modulus for t < modulus R. t is 2 length segments
+ * and is clobbered; dest may not overlap it.
+ */
+static void _montgomery_redc(uint64_t* dest, uint64_t* t, montgomery_modulus* mm) {
+  uint64_t n = mm->length, i, high, carry = 0;
+  for(i = 0; i < n; i++) {
+    high = _cpu.addmul_1(t + i, mm->modulus, n, t[i] * mm->inverse);
+    //the carry out of t[i + n - 1] lands in t[i + n] with this one
+    t[i + n] += carry;
+    carry = t[i + n] < carry;
+    t[i + n] += high;
+    carry += t[i + n] < high;
+  }
+  memcpy(dest, t + n, n * sizeof(uint64_t));
+  if(carry || gte(dest, mm->modulus, n)) {
+    _cpu.sub_n(dest, mm->modulus, n);
+  }
+}
+
+/**
+ * dest = a b R^-1 mod modulus, scratch is 2 length segments. dest may
+ * be a or b.
+ */
+static void _montgomery_mul(uint64_t* dest, uint64_t* a, uint64_t* b,
+			    montgomery_modulus* mm, uint64_t* scratch) {
+  _mul_full(scratch, a, mm->length, b, mm->length);
+  _montgomery_redc(dest, scratch, mm);
+}
+
+static void _montgomery_add(uint64_t* dest, uint64_t* a, uint64_t* b,
+			    montgomery_modulus* mm) {
+  uint64_t n = mm->length;
+  if(dest != a) {
+    memcpy(dest, a, n * sizeof(uint64_t));
+  }
+  if(_cpu.add_n(dest, b, n) || gte(dest, mm->modulus, n)) {
+    _cpu.sub_n(dest, mm->modulus, n);
+  }
+}
+
+static void _montgomery_sub(uint64_t* dest, uint64_t* a, uint64_t* b,
+			    montgomery_modulus* mm) {
+  uint64_t n = mm->length;
+  if(dest != a) {
+    memcpy(dest, a, n * sizeof(uint64_t));
+  }
+  if(_cpu.sub_n(dest, b, n)) {
+    _cpu.add_n(dest, mm->modulus, n);
+  }
+}
+
+/**
+ * dest = x R mod modulus for x < modulus
+ */
+static void _to_montgomery(uint64_t* dest, uint64_t* x, montgomery_modulus* mm,
+			   uint64_t* scratch) {
+  _montgomery_mul(dest, x, mm->square, mm, scratch);
+}
+
+static void _from_montgomery(uint64_t* dest, uint64_t* x, montgomery_modulus* mm,
+			     uint64_t* scratch) {
+  memcpy(scratch, x, mm->length * sizeof(uint64_t));
+  memset(scratch + mm->length, 0, mm->length * sizeof(uint64_t));
+  _montgomery_redc(dest, scratch, mm);
+}
+
+/**
+ * dest = base^exponent in Montgomery form, by sliding windows over the
+ * odd powers of base. dest may be base.
+ */
+static void _montgomery_pow(uint64_t* dest, uint64_t* base, uint64_t* exponent,
+			    uint64_t exponent_length, montgomery_modulus* mm) {
+  uint64_t n = mm->length, bits, window, low, value, i, *table, *scratch;
+  bool started = FALSE;
+
+  exponent_length = _size_segments(exponent, exponent_length);
+  if(exponent_length == 0) {
+    memcpy(dest, mm->one, n * sizeof(uint64_t));
+    return;
+  }
+  bits = exponent_length * 64 - __builtin_clzl(exponent[exponent_length-1]);
+  window = bits > 768 ? 6 : bits > 256 ? 5 : bits > 64 ? 4 : bits > 16 ? 3 : 1;
+
+  //table[i] = base^(2i + 1)
+  scratch = malloc(2 * n * sizeof(uint64_t));
+  table = malloc((n << (window - 1)) * sizeof(uint64_t));
+  memcpy(table, base, n * sizeof(uint64_t));
+  if(window > 1) {
+    _montgomery_mul(dest, base, base, mm, scratch);
+    for(i = 1; i < (uint64_t) 1 << (window - 1); i++) {
+      _montgomery_mul(table + i * n, table + (i - 1) * n, dest, mm, scratch);
+    }
+  }
+
+  //bits counts the exponent bits still to go
+  while(bits > 0) {
+    if(!((exponent[(bits - 1) / 64] >> ((bits - 1) % 64)) & 0x1)) {
+      _montgomery_mul(dest, dest, dest, mm, scratch);
+      bits--;
+      continue;
+    }
+    low = bits > window ? bits - window : 0;
+    while(!((exponent[low / 64] >> (low % 64)) & 0x1)) {
+      low++;
+    }
+    for(value = 0, i = bits; i-- > low;) {
+      value = value << 1 | ((exponent[i / 64] >> (i % 64)) & 0x1);
+      if(started) {
+	_montgomery_mul(dest, dest, dest, mm, scratch);
+      }
+    }
+    if(started) {
+      _montgomery_mul(dest, dest, table + (value >> 1) * n, mm, scratch);
+    } else {
+      memcpy(dest, table + (value >> 1) * n, n * sizeof(uint64_t));
+      started = TRUE;
+    }
+    bits = low;
+  }
+  free(table);
+  free(scratch);
+}
+
+/**
+ * dest = dest^exponent mod modulus, for an odd modulus of length
+ * segments. Returns NULL if the modulus is even or zero.
+ */
+uint64_t* powmod_segments(uint64_t* dest, uint64_t* exponent, uint64_t exponent_length,
+			  uint64_t* modulus, uint64_t length) {
+  uint64_t size = _size_segments(modulus, length), *base, *scratch;
+  montgomery_modulus* mm;
+
+  if(size == 0 || (modulus[0] & 0x1) == 0) {
+    return NULL;
+  }
+  STAT_BEGIN();
+  base = malloc(size * sizeof(uint64_t));
+  scratch = malloc(2 * size * sizeof(uint64_t));
+  mm = _create_montgomery(modulus, size);
+  STAT_BYTES(STAT_POWMOD, 5 * size * sizeof(uint64_t));
+  _divrem_knuth(NULL, base, dest, _size_segments(dest, length), modulus, size);
+  _to_montgomery(base, base, mm, scratch);
+  _montgomery_pow(base, base, exponent, exponent_length, mm);
+  memset(dest, 0, length * sizeof(uint64_t));
+  _from_montgomery(dest, base, mm, scratch);
+  _free_montgomery(mm);
+  free(base);
+  free(scratch);
+  STAT_END(STAT_POWMOD, size);
+  return dest;
+}
+
+bigint* powmod_bigint(bigint* dest, bigint* exponent, bigint* modulus) {
+  if(dest->length != modulus->length) {
+    return NULL;
+  }
+  if(powmod_segments(dest->data, exponent->data, exponent->length, modulus->data,
+		     dest->length) == NULL) {
+    return NULL;
+  }
+  return dest;
+}
+
+/**
+ * Reduce a length segment value into size segments in Montgomery form
+ */
+static void _load_montgomery(uint64_t* dest, uint64_t* value, uint64_t length,
+			     montgomery_modulus* mm, uint64_t* scratch) {
+  _divrem_knuth(NULL, dest, value, _size_segments(value, length), mm->modulus,
+		mm->length);
+  _to_montgomery(dest, dest, mm, scratch);
+}
+
+/**
+ * dest = the product of bases[i]^exponents[i] mod modulus for an odd
+ * modulus, bases and dest being length segments and every exponent
+ * exponent_length. Straus' interleaving: each exponent is cut into its
+ * own sliding windows over a table of odd powers of its base, and one
+ * chain of squarings serves them all; with two bases and one bit
+ * windows this is Shamir's trick. Returns NULL if the modulus is even
+ * or zero.
+ */
+uint64_t* multi_powmod_segments(uint64_t* dest, uint64_t** bases, uint64_t** exponents,
+				uint64_t exponent_length, uint64_t count,
+				uint64_t* modulus, uint64_t length) {
+  uint64_t size = _size_segments(modulus, length), bits = 0, window, low, value, i, j, k;
+  uint64_t *tables, *result, *scratch;
+  montgomery_modulus* mm;
+  byte* digits;
+  bool started = FALSE;
+
+  if(size == 0 || (modulus[0] & 0x1) == 0) {
+    return NULL;
+  }
+  for(i = 0; i < count; i++) {
+    k = _size_segments(exponents[i], exponent_length);
+    if(k && k * 64 - __builtin_clzl(exponents[i][k-1]) > bits) {
+      bits = k * 64 - __builtin_clzl(exponents[i][k-1]);
+    }
+  }
+  STAT_BEGIN();
+  window = bits > 768 ? 6 : bits > 256 ? 5 : bits > 64 ? 4 : bits > 16 ? 3 : 1;
+  mm = _create_montgomery(modulus, size);
+  scratch = malloc(2 * size * sizeof(uint64_t));
+  result = malloc(size * sizeof(uint64_t));
+  //tables[(i << (window - 1)) + j] = bases[i]^(2j + 1)
+  tables = malloc((count << (window - 1)) * size * sizeof(uint64_t));
+  STAT_BYTES(STAT_POWMOD, ((count << (window - 1)) + 4) * size * sizeof(uint64_t));
+  for(i = 0; i < count; i++) {
+    value = i << (window - 1);
+    _load_montgomery(tables + value * size, bases[i], length, mm, scratch);
+    _montgomery_mul(result, tables + value * size, tables + value * size, mm, scratch);
+    for(j = 1; j < (uint64_t) 1 << (window - 1); j++) {
+      _montgomery_mul(tables + (value + j) * size, tables + (value + j - 1) * size, result,
+		      mm, scratch);
+    }
+  }
+
+  //digits[i bits + p] is the odd window of exponent i ending at bit p
+  digits = calloc(count * bits + 1, 1);
+  for(i = 0; i < count; i++) {
+    for(k = bits; k > 0;) {
+      if(!test_bit_segments(exponents[i], exponent_length, k - 1)) {
+	k--;
+	continue;
+      }
+      low = k > window ? k - window : 0;
+      while(!test_bit_segments(exponents[i], exponent_length, low)) {
+	low++;
+      }
+      extract_bits_segments(&value, exponents[i], exponent_length, low, k - low);
+      digits[i * bits + low] = value;
+      k = low;
+    }
+  }
+
+  memcpy(result, mm->one, size * sizeof(uint64_t));
+  for(k = bits; k-- > 0;) {
+    if(started) {
+      _montgomery_mul(result, result, result, mm, scratch);
+    }
+    for(i = 0; i < count; i++) {
+      if(digits[i * bits + k]) {
+	_montgomery_mul(result, result,
+			tables + ((i << (window - 1)) + (digits[i * bits + k] >> 1)) * size,
+			mm, scratch);
+	started = TRUE;
+      }
+    }
+  }
+  memset(dest, 0, length * sizeof(uint64_t));
+  _from_montgomery(dest, result, mm, scratch);
+  _free_montgomery(mm);
+  free(digits);
+  free(tables);
+  free(result);
+  free(scratch);
+  STAT_END(STAT_POWMOD, size);
+  return dest;
+}
+
+static uint64_t _powmod_table_digits(uint64_t exponent_bits, uint64_t window) {
+  return exponent_bits / window + (exponent_bits % window != 0);
+}
+
+static uint64_t _powmod_table_entries(powmod_table* table) {
+  return _powmod_table_digits(table->exponent_bits, table->window) *
+    (((uint64_t) 1 << table->window) - 1);
+}
+
+/**
+ * Segments of powers in a table over a modulus of size segments, FALSE
+ * if they would not fit in the address space
+ */
+static bool _powmod_table_words(uint64_t exponent_bits, uint64_t window, uint64_t size,
+				uint64_t* words) {
+  uint64_t row = (((uint64_t) 1 << window) - 1) * size;
+  return !__builtin_mul_overflow(_powmod_table_digits(exponent_bits, window), row, words) &&
+    *words <= ~(uint64_t) 0 / sizeof(uint64_t) / 2;
+}
+
+/**
+ * A table with room for its powers, NULL if they are too large or
+ * cannot be allocated
+ */
+static powmod_table* _new_powmod_table(uint64_t* modulus, uint64_t length,
+				       uint64_t exponent_bits, uint64_t window) {
+  uint64_t size = _size_segments(modulus, length), words;
+  powmod_table* table;
+
+  if(!_powmod_table_words(exponent_bits, window, size, &words)) {
+    return NULL;
+  }
+  table = malloc(sizeof(powmod_table));
+  table->powers = malloc(words ? words * sizeof(uint64_t) : 1);
+  if(table->powers == NULL) {
+    free(table);
+    return NULL;
+  }
+  table->modulus = _create_montgomery(modulus, size);
+  table->length = length;
+  table->exponent_bits = exponent_bits;
+  table->window = window;
+  return table;
+}
+
+/**
+ * Precompute the powers of a fixed base for exponents of up to
+ * exponent_bits bits, split into digits of window bits: row i holds
+ * base^(j 2^(i window)) for every non zero digit j, so
+ * powmod_table_segments needs one multiplication per non zero digit
+ * and no squarings. The table takes exponent_bits / window (2^window
+ * - 1) values. Returns NULL for an even or zero modulus, a window
+ * outside 1 to 16, or a table too large to allocate.
+ */
+powmod_table* create_powmod_table(uint64_t* base, uint64_t* modulus, uint64_t length,
+				  uint64_t exponent_bits, uint64_t window) {
+  uint64_t size = _size_segments(modulus, length), row, j, digits, *powers, *scratch;
+  powmod_table* table;
+
+  if(size == 0 || (modulus[0] & 0x1) == 0 || window < 1 || window > 16) {
+    return NULL;
+  }
+  table = _new_powmod_table(modulus, length, exponent_bits, window);
+  if(table == NULL) {
+    return NULL;
+  }
+  digits = _powmod_table_digits(exponent_bits, window);
+  scratch = malloc(2 * size * sizeof(uint64_t));
+  for(row = 0, powers = table->powers; row < digits; row++) {
+    //the row's base is the previous row's last entry times its first
+    if(row == 0) {
+      _load_montgomery(powers, base, length, table->modulus, scratch);
+    } else {
+      _montgomery_mul(powers, powers - size, powers - (((uint64_t) 1 << window) - 1) * size,
+		      table->modulus, scratch);
+    }
+    for(j = 1, powers += size; j < ((uint64_t) 1 << window) - 1; j++, powers += size) {
+      _montgomery_mul(powers, powers - size, powers - j * size, table->modulus, scratch);
+    }
+  }
+  free(scratch);
+  return table;
+}
+
+void free_powmod_table(powmod_table* table) {
+  _free_montgomery(table->modulus);
+  free(table->powers);
+  free(table);
+}
+
+/**
+ * dest = base^exponent mod modulus from a create_powmod_table table,
+ * dest being table->length segments. Returns NULL if the exponent has
+ * more than table->exponent_bits bits.
+ */
+uint64_t* powmod_table_segments(uint64_t* dest, uint64_t* exponent, uint64_t exponent_length,
+				powmod_table* table) {
+  montgomery_modulus* mm = table->modulus;
+  uint64_t size = mm->length, row_size = (((uint64_t) 1 << table->window) - 1) * size;
+  uint64_t bits = _size_segments(exponent, exponent_length), row, digit, *result, *scratch;
+  bool started = FALSE;
+
+  if(bits) {
+    bits = bits * 64 - __builtin_clzl(exponent[bits-1]);
+  }
+  if(bits > table->exponent_bits) {
+    return NULL;
+  }
+  STAT_BEGIN();
+  STAT_BYTES(STAT_POWMOD, 3 * size * sizeof(uint64_t));
+  result = malloc(size * sizeof(uint64_t));
+  scratch = malloc(2 * size * sizeof(uint64_t));
+  memcpy(result, mm->one, size * sizeof(uint64_t));
+  for(row = 0; row * table->window < bits; row++) {
+    extract_bits_segments(&digit, exponent, exponent_length, row * table->window,
+			  table->window);
+    if(digit && started) {
+      _montgomery_mul(result, result, table->powers + row * row_size + (digit - 1) * size,
+		      mm, scratch);
+    } else if(digit) {
+      memcpy(result, table->powers + row * row_size + (digit - 1) * size,
+	     size * sizeof(uint64_t));
+      started = TRUE;
+    }
+  }
+  memset(dest, 0, table->length * sizeof(uint64_t));
+  _from_montgomery(dest, result, mm, scratch);
+  free(result);
+  free(scratch);
+  STAT_END(STAT_POWMOD, size);
+  return dest;
+}
+
+/**
+ * Write a table as three write_bigint records: the window and exponent
+ * bits, the modulus, then the powers. Returns NULL on a write error.
+ */
+powmod_table* write_powmod_table(FILE* file, powmod_table* table) {
+  uint64_t parameters[2] = {table->window, table->exponent_bits};
+  bigint record = {parameters, 2};
+  bool written;
+
+  written = write_bigint(file, &record, FALSE) != NULL;
+  record.data = calloc(table->length, sizeof(uint64_t));
+  record.length = table->length;
+  memcpy(record.data, table->modulus->modulus, table->modulus->length * sizeof(uint64_t));
+  written = written && write_bigint(file, &record, FALSE) != NULL;
+  free(record.data);
+  record.data = table->powers;
+  record.length = _powmod_table_entries(table) * table->modulus->length;
+  written = written && write_bigint(file, &record, FALSE) != NULL;
+  return written ? table : NULL;
+}
+
+/**
+ * Read a table written by write_powmod_table. Returns NULL if a record
+ * does not read back or the records do not make up a table, including
+ * exponent bits whose table would not fit in memory.
+ */
+powmod_table* read_powmod_table(FILE* file) {
+  bigint *parameters, *modulus = NULL, *powers = NULL;
+  powmod_table* table = NULL;
+  uint64_t size, words;
+
+  parameters = read_bigint(file, NULL);
+  if(parameters != NULL && parameters->length == 2 && parameters->data[0] >= 1 &&
+     parameters->data[0] <= 16) {
+    modulus = read_bigint(file, NULL);
+  }
+  if(modulus != NULL) {
+    size = _size_segments(modulus->data, modulus->length);
+    powers = read_bigint(file, NULL);
+  }
+  //the powers record must be exactly the table the header describes
+  if(powers != NULL && size && (modulus->data[0] & 0x1) &&
+     _powmod_table_words(parameters->data[1], parameters->data[0], size, &words) &&
+     powers->length == words) {
+    table = _new_powmod_table(modulus->data, modulus->length, parameters->data[1],
+			      parameters->data[0]);
+  }
+  if(table != NULL) {
+    memcpy(table->powers, powers->data, powers->length * sizeof(uint64_t));
+  }
+  if(parameters != NULL) {
+    free_bigint(parameters);
+  }
+  if(modulus != NULL) {
+    free_bigint(modulus);
+  }
+  if(powers != NULL) {
+    free_bigint(powers);
+  }
+  return table;
+}
+
+static uint64_t _prime_threads = 0;
+
+/**
+ * Threads random_prime_bigint may test candidates on, 0 for one per
+ * online CPU. Returns the previous setting.
+ */
+uint64_t set_prime_threads(uint64_t threads) {
+  uint64_t previous = _prime_threads;
+  _prime_threads = threads;
+  return previous;
+}
+
+//odd primes up to PRIME_SIEVE_LIMIT, the first _trial_count of them
+//up to PRIME_TRIAL_LIMIT, with divisor sets for both
+static uint64_t* _small_primes;
+static uint64_t _small_prime_count;
+static uint64_t _trial_count;
+static nat_divisor_set* _trial_set;
+static nat_divisor_set* _sieve_set;
+
+__attribute__((constructor))
+static void _init_small_primes(void) {
+  uint64_t* primes = _sieve_primes(PRIME_SIEVE_LIMIT, &_small_prime_count);
+  _small_primes = primes + 1;
+  _small_prime_count--;
+  for(_trial_count = 0; _trial_count < _small_prime_count &&
+	_small_primes[_trial_count] <= PRIME_TRIAL_LIMIT; _trial_count++);
+  _trial_set = create_nat_divisor_set(_small_primes, _trial_count);
+  _sieve_set = create_nat_divisor_set(_small_primes, _small_prime_count);
+}
+
+/**
+ * The default random source, the kernel's getrandom
+ */
+static bool _system_random(uint64_t* dest, uint64_t length, void* context) {
+  byte* bytes = (byte*) dest;
+  uint64_t left = length * sizeof(uint64_t);
+  ssize_t got;
+  while(left) {
+    got = getrandom(bytes, left, 0);
+    if(got < 0) {
+      return FALSE;
+    }
+    bytes += got;
+    left -= got;
+  }
+  return TRUE;
+}
+
+/**
+ * Strong probable prime test of the modulus to a base in Montgomery
+ * form, with modulus - 1 = odd 2^twos
+ */
+static bool _miller_rabin(montgomery_modulus* mm, uint64_t* base, uint64_t* odd,
+			  uint64_t twos) {
+  uint64_t n = mm->length, *x = malloc(n * sizeof(uint64_t)), *minus_one, *scratch;
+  bool prime = FALSE;
+
+  minus_one = malloc(n * sizeof(uint64_t));
+  scratch = malloc(2 * n * sizeof(uint64_t));
+  memcpy(minus_one, mm->modulus, n * sizeof(uint64_t));
+  _cpu.sub_n(minus_one, mm->one, n);
+  _montgomery_pow(x, base, odd, n, mm);
+  if(eq(x, mm->one, n) || eq(x, minus_one, n)) {
+    prime = TRUE;
+  }
+  while(!prime && twos-- > 1) {
+    _montgomery_mul(x, x, x, mm, scratch);
+    if(eq(x, minus_one, n)) {
+      prime = TRUE;
+    } else if(eq(x, mm->one, n)) {
+      break;
+    }
+  }
+  free(x);
+  free(minus_one);
+  free(scratch);
+  return prime;
+}
+
+static int _jacobi_word(uint64_t a, uint64_t n) {
+  uint64_t swap;
+  int result = 1;
+  a %= n;
+  while(a) {
+    while((a & 0x1) == 0) {
+      a >>= 1;
+      if((n & 0x7) == 3 || (n & 0x7) == 5) {
+	result = -result;
+      }
+    }
+    swap = a;
+    a = n;
+    n = swap;
+    if((a & 0x3) == 3 && (n & 0x3) == 3) {
+      result = -result;
+    }
+    a %= n;
+  }
+  return n == 1 ? result : 0;
+}
+
+/**
+ * Strong Lucas probable prime test with Selfridge's parameters: the
+ * first D of 5, -7, 9, -11, ... with (D / n) = -1, P = 1 and Q = (1 -
+ * D) / 4. Only the V sequence is run, from n + 1 = odd 2^twos; U_odd
+ * = 0 exactly when 2 V_(odd + 1) = P V_odd since D is prime to n.
+ */
+static bool _strong_lucas(montgomery_modulus* mm) {
+  uint64_t n = mm->length, *m = mm->modulus, *odd, twos, d, bit, i;
+  uint64_t *v, *next, *power, *q, *t, *scratch;
+  bool prime = FALSE, negative = FALSE;
+  int jacobi;
+
+  if(is_square_segments(m, n)) {
+    return FALSE;
+  }
+  for(d = 5;; d += 2) {
+    negative = (d & 0x2) != 0;
+    //(D / n) by reciprocity from (n mod |D| / |D|)
+    jacobi = _jacobi_word(mod_1_segments(m, n, d), d);
+    if(((d & 0x3) == 3) && ((m[0] & 0x3) == 3)) {
+      jacobi = -jacobi;
+    }
+    if(negative && (m[0] & 0x3) == 3) {
+      jacobi = -jacobi;
+    }
+    if(jacobi == 0) {
+      return FALSE;
+    }
+    if(jacobi == -1) {
+      break;
+    }
+  }
+
+  odd = calloc(n + 1, sizeof(uint64_t));
+  memcpy(odd, m, n * sizeof(uint64_t));
+  add_1_segments(odd, n + 1, 1);
+  for(twos = 0; ((odd[twos / 64] >> (twos % 64)) & 0x1) == 0; twos++);
+  shr_segments(odd, n + 1, twos);
+
+  v = malloc(n * sizeof(uint64_t));
+  next = malloc(n * sizeof(uint64_t));
+  power = malloc(n * sizeof(uint64_t));
+  q = calloc(n, sizeof(uint64_t));
+  t = malloc(n * sizeof(uint64_t));
+  scratch = malloc(2 * n * sizeof(uint64_t));
+
+  //Q = (1 - D) / 4 is (d + 1) / 4 for negative D, else -(d - 1) / 4
+  q[0] = negative ? (d + 1) / 4 : (d - 1) / 4;
+  if(n == 1) {
+    q[0] %= m[0];
+  }
+  _to_montgomery(q, q, mm, scratch);
+  if(!negative) {
+    memcpy(t, m, n * sizeof(uint64_t));
+    _cpu.sub_n(t, q, n);
+    memcpy(q, t, n * sizeof(uint64_t));
+  }
+
+  //(v, next, power) = (V_k, V_(k+1), Q^k) from k = 0
+  _montgomery_add(v, mm->one, mm->one, mm);
+  memcpy(next, mm->one, n * sizeof(uint64_t));
+  memcpy(power, mm->one, n * sizeof(uint64_t));
+  i = _size_segments(odd, n + 1);
+  for(bit = i * 64 - __builtin_clzl(odd[i-1]); bit-- > 0;) {
+    if((odd[bit / 64] >> (bit % 64)) & 0x1) {
+      //V_(2k+1) = V_k V_(k+1) - Q^k, V_(2k+2) = V_(k+1)^2 - 2 Q^(k+1)
+      _montgomery_mul(v, v, next, mm, scratch);
+      _montgomery_sub(v, v, power, mm);
+      _montgomery_mul(t, power, q, mm, scratch);
+      _montgomery_mul(power, power, t, mm, scratch);
+      _montgomery_mul(next, next, next, mm, scratch);
+      _montgomery_sub(next, next, t, mm);
+      _montgomery_sub(next, next, t, mm);
+    } else {
+      //V_(2k) = V_k^2 - 2 Q^k, V_(2k+1) = V_k V_(k+1) - Q^k
+      _montgomery_mul(next, v, next, mm, scratch);
+      _montgomery_sub(next, next, power, mm);
+      _montgomery_mul(v, v, v, mm, scratch);
+      _montgomery_sub(v, v, power, mm);
+      _montgomery_sub(v, v, power, mm);
+      _montgomery_mul(power, power, power, mm, scratch);
+    }
+  }
+
+  _montgomery_add(t, next, next, mm);
+  prime = eq(t, v, n) || _size_segments(v, n) == 0;
+  for(i = 1; !prime && i < twos; i++) {
+    _montgomery_mul(v, v, v, mm, scratch);
+    _montgomery_sub(v, v, power, mm);
+    _montgomery_sub(v, v, power, mm);
+    _montgomery_mul(power, power, power, mm, scratch);
+    prime = _size_segments(v, n) == 0;
+  }
+  free(odd);
+  free(v);
+  free(next);
+  free(power);
+  free(q);
+  free(t);
+  free(scratch);
+  return prime;
+}
+
+/**
+ * BPSW, a base 2 strong probable prime test and a strong Lucas test,
+ * then rounds more Miller-Rabin bases from source. segments is odd,
+ * has length significant segments and no factor up to
+ * PRIME_TRIAL_LIMIT. A failing source falls back to small prime bases.
+ */
+static bool _probable_prime(uint64_t* segments, uint64_t length, uint64_t rounds,
+			    random_source source, void* context) {
+  montgomery_modulus* mm = _create_montgomery(segments, length);
+  uint64_t *odd = malloc(length * sizeof(uint64_t)), *base, *range, *scratch;
+  uint64_t twos, i;
+  bool prime;
+
+  memcpy(odd, segments, length * sizeof(uint64_t));
+  odd[0]--;
+  for(twos = 0; ((odd[twos / 64] >> (twos % 64)) & 0x1) == 0; twos++);
+  shr_segments(odd, length, twos);
+
+  base = malloc(length * sizeof(uint64_t));
+  range = malloc(length * sizeof(uint64_t));
+  scratch = malloc(2 * length * sizeof(uint64_t));
+  _montgomery_add(base, mm->one, mm->one, mm);
+  prime = _miller_rabin(mm, base, odd, twos) && _strong_lucas(mm);
+
+  //bases uniform in [2, n - 2]
+  memcpy(range, segments, length * sizeof(uint64_t));
+  sub_1_segments(range, length, 3);
+  for(i = 0; prime && i < rounds; i++) {
+    memset(scratch, 0, length * sizeof(uint64_t));
+    if(source(scratch, length, context)) {
+      _divrem_knuth(NULL, base, scratch, length, range, _size_segments(range, length));
+      memset(base + _size_segments(range, length), 0,
+	     (length - _size_segments(range, length)) * sizeof(uint64_t));
+      add_1_segments(base, length, 2);
+    } else {
+      memset(base, 0, length * sizeof(uint64_t));
+      base[0] = _small_primes[i % _trial_count];
+    }
+    _to_montgomery(base, base, mm, scratch);
+    prime = _miller_rabin(mm, base, odd, twos);
+  }
+  _free_montgomery(mm);
+  free(odd);
+  free(base);
+  free(range);
+  free(scratch);
+  return prime;
+}
+
+/**
+ * Trial division of a value up to PRIME_TRIAL_LIMIT squared
+ */
+static bool _is_prime_small(uint64_t value) {
+  uint64_t i;
+  if(value < 4) {
+    return value > 1;
+  }
+  if((value & 0x1) == 0) {
+    return FALSE;
+  }
+  for(i = 0; i < _trial_count && _small_primes[i] * _small_primes[i] <= value; i++) {
+    if(value % _small_primes[i] == 0) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/**
+ * Is segments prime: trial division by the primes up to
+ * PRIME_TRIAL_LIMIT, which settles values below its square, then
+ * BPSW and rounds Miller-Rabin tests to random bases. No composite is
+ * known to pass BPSW alone.
+ */
+bool is_prime_segments(uint64_t* segments, uint64_t length, uint64_t rounds) {
+  uint64_t size = _size_segments(segments, length), *residues, i;
+  bool prime = TRUE;
+
+  if(size == 0) {
+    return FALSE;
+  }
+  if(size == 1 && segments[0] <= PRIME_TRIAL_LIMIT * PRIME_TRIAL_LIMIT) {
+    return _is_prime_small(segments[0]);
+  }
+  if((segments[0] & 0x1) == 0) {
+    return FALSE;
+  }
+  residues = malloc(_trial_count * sizeof(uint64_t));
+  mod_multi_segments(residues, segments, size, _trial_set);
+  for(i = 0; prime && i < _trial_count; i++) {
+    prime = residues[i] != 0;
+  }
+  free(residues);
+  return prime && _probable_prime(segments, size, rounds, &_system_random, NULL);
+}
+
+bool is_prime_bigint(bigint* value, uint64_t rounds) {
+  return is_prime_segments(value->data, value->length, rounds);
+}
+
+/**
+ * One sieved window of odd candidates start + 2 offsets[i], tested in
+ * order by several threads; found is the smallest index seen prime.
+ */
+typedef struct {
+  uint64_t* start;
+  uint64_t length;
+  uint64_t* offsets;
+  uint64_t count;
+  uint64_t next;
+  uint64_t found;
+  uint64_t rounds;
+  random_source source;
+  void* context;
+  pthread_mutex_t lock;
+} prime_window;
+
+/**
+ * The window's source for the testing threads, one call at a time
+ */
+static bool _window_random(uint64_t* dest, uint64_t length, void* context) {
+  prime_window* window = context;
+  bool drawn;
+  pthread_mutex_lock(&window->lock);
+  drawn = window->source(dest, length, window->context);
+  pthread_mutex_unlock(&window->lock);
+  return drawn;
+}
+
+static void* _test_window(void* arg) {
+  prime_window* window = arg;
+  uint64_t* candidate = malloc(window->length * sizeof(uint64_t));
+  uint64_t i, found;
+  bool prime;
+
+  for(;;) {
+    i = __atomic_fetch_add(&window->next, 1, __ATOMIC_RELAXED);
+    if(i >= window->count || i > __atomic_load_n(&window->found, __ATOMIC_RELAXED)) {
+      break;
+    }
+    memcpy(candidate, window->start, window->length * sizeof(uint64_t));
+    add_1_segments(candidate, window->length, 2 * window->offsets[i]);
+    if(window->length == 1 && candidate[0] <= PRIME_TRIAL_LIMIT * PRIME_TRIAL_LIMIT) {
+      prime = _is_prime_small(candidate[0]);
+    } else {
+      prime = _probable_prime(candidate, window->length, window->rounds, &_window_random,
+			      window);
+    }
+    if(prime) {
+      found = __atomic_load_n(&window->found, __ATOMIC_RELAXED);
+      while(i < found && !__atomic_compare_exchange_n(&window->found, &found, i, FALSE,
+						      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    }
+  }
+  free(candidate);
+  return NULL;
+}
+
+/**
+ * A random prime of exactly bits bits. A random odd start is reduced
+ * once by the primes up to PRIME_SIEVE_LIMIT; each window of
+ * PRIME_SIEVE_WINDOW odd candidates from it is sieved with those
+ * residues, which then step on to the next window without touching
+ * the start again. The survivors go to _probable_prime on
+ * set_prime_threads threads and the first prime in the window wins, so
+ * the result only depends on the random source. The threads draw
+ * their Miller-Rabin bases from it as well, but never at the same
+ * time, so source need not be thread safe. A NULL source is the
+ * system's. Returns NULL for bits < 2 or when the source fails.
+ */
+bigint* random_prime_bigint(uint64_t bits, uint64_t rounds, random_source source,
+			    void* context) {
+  uint64_t length = (bits + 63) / 64, sieve_count, room, i, j, p, threads;
+  uint64_t *residues, *gap;
+  byte* composite;
+  bool fresh = TRUE;
+  prime_window window;
+  pthread_t* workers;
+  bigint* prime = NULL;
+
+  if(bits < 2) {
+    return NULL;
+  }
+  if(source == NULL) {
+    source = &_system_random;
+  }
+  //only primes below the smallest candidate may be sieved out
+  for(sieve_count = 0; sieve_count < _small_prime_count && (bits > 64 ||
+	_small_primes[sieve_count] < (uint64_t) 1 << (bits - 1)); sieve_count++);
+  threads = _thread_count(_prime_threads);
+  residues = malloc(_small_prime_count * sizeof(uint64_t));
+  composite = malloc(PRIME_SIEVE_WINDOW);
+  gap = malloc(length * sizeof(uint64_t));
+  workers = malloc(threads * sizeof(pthread_t));
+  window.start = malloc(length * sizeof(uint64_t));
+  window.offsets = malloc(PRIME_SIEVE_WINDOW * sizeof(uint64_t));
+  window.length = length;
+  window.rounds = rounds;
+  window.source = source;
+  window.context = context;
+  pthread_mutex_init(&window.lock, NULL);
+
+  while(prime == NULL) {
+    if(fresh) {
+      if(!source(window.start, length, context)) {
+	break;
+      }
+      if(bits % 64) {
+	window.start[length-1] &= ((uint64_t) 1 << (bits % 64)) - 1;
+      }
+      set_bit_segments(window.start, length, bits - 1);
+      window.start[0] |= 1;
+      mod_multi_segments(residues, window.start, length, _sieve_set);
+      fresh = FALSE;
+    }
+
+    //odd candidates left below 2^bits, capped one past the window
+    memcpy(gap, window.start, length * sizeof(uint64_t));
+    not_segments(gap, length);
+    if(bits % 64) {
+      gap[length-1] &= ((uint64_t) 1 << (bits % 64)) - 1;
+    }
+    room = _size_segments(gap, length) > 1 || gap[0] / 2 >= PRIME_SIEVE_WINDOW ?
+      PRIME_SIEVE_WINDOW + 1 : gap[0] / 2 + 1;
+
+    //start + 2j = 0 mod p at j = (p - r) (p + 1) / 2 mod p
+    memset(composite, 0, PRIME_SIEVE_WINDOW);
+    for(i = 0; i < sieve_count; i++) {
+      p = _small_primes[i];
+      for(j = (p - residues[i]) % p * ((p + 1) / 2) % p; j < PRIME_SIEVE_WINDOW; j += p) {
+	composite[j] = TRUE;
+      }
+    }
+    for(window.count = 0, j = 0; j < PRIME_SIEVE_WINDOW && j < room; j++) {
+      if(!composite[j]) {
+	window.offsets[window.count++] = j;
+      }
+    }
+
+    window.next = 0;
+    window.found = window.count;
+    for(i = 1; i < threads && i < window.count; i++) {
+      if(pthread_create(&workers[i], NULL, &_test_window, &window)) {
+	break;
+      }
+    }
+    _test_window(&window);
+    while(--i > 0) {
+      pthread_join(workers[i], NULL);
+    }
+
+    if(window.found < window.count) {
+      prime = _sized_bigint(length);
+      memcpy(prime->data, window.start, length * sizeof(uint64_t));
+      add_1_segments(prime->data, length, 2 * window.offsets[window.found]);
+    } else if(room <= PRIME_SIEVE_WINDOW) {
+      fresh = TRUE;
+    } else {
+      add_1_segments(window.start, length, 2 * PRIME_SIEVE_WINDOW);
+      for(i = 0; i < sieve_count; i++) {
+	residues[i] = (residues[i] + 2 * PRIME_SIEVE_WINDOW) % _small_primes[i];
+      }
+    }
+  }
+  free(residues);
+  free(composite);
+  free(gap);
+  free(workers);
+  free(window.start);
+  free(window.offsets);
+  pthread_mutex_destroy(&window.lock);
+  return prime;
+}
+
+///
+/// Expressions
+///
+
+bigint_expr* create_expr(void) {
+  bigint_expr* expr = malloc(sizeof(bigint_expr));
+  expr->count = 0;
+  expr->capacity = 16;
+  expr->nodes = malloc(expr->capacity * sizeof(expr_node));
+  return expr;
+}
+
+void free_expr(bigint_expr* expr) {
+  free(expr->nodes);
+  free(expr);
+}
+
+static uint64_t _expr_node(bigint_expr* expr, expr_op op, uint64_t left, uint64_t right) {
+  expr_node* node;
+  if(op >= EXPR_ADD && (left >= expr->count || right >= expr->count)) {
+    return EXPR_INVALID;
+  }
+  if(expr->count == expr->capacity) {
+    expr->capacity *= 2;
+    expr->nodes = realloc(expr->nodes, expr->capacity * sizeof(expr_node));
+  }
+  node = &expr->nodes[expr->count];
+  node->op = op;
+  node->left = left;
+  node->right = right;
+  node->value = NULL;
+  node->word = 0;
+  return expr->count++;
+}
+
+/**
+ * A leaf reading value when the expression is evaluated, so one
+ * expression can be evaluated again after its values change
+ */
+uint64_t expr_value(bigint_expr* expr, bigint* value) {
+  uint64_t node = _expr_node(expr, EXPR_VALUE, 0, 0);
+  expr->nodes[node].value = value;
+  return node;
+}
+
+uint64_t expr_word(bigint_expr* expr, uint64_t word) {
+  uint64_t node = _expr_node(expr, EXPR_WORD, 0, 0);
+  expr->nodes[node].word = word;
+  return node;
+}
+
+/**
+ * Inner nodes take the handles of earlier nodes and return their own,
+ * or EXPR_INVALID if a handle is not a node of expr
+ */
+uint64_t expr_add(bigint_expr* expr, uint64_t left, uint64_t right) {
+  return _expr_node(expr, EXPR_ADD, left, right);
+}
+
+uint64_t expr_sub(bigint_expr* expr, uint64_t left, uint64_t right) {
+  return _expr_node(expr, EXPR_SUB, left, right);
+}
+
+uint64_t expr_mul(bigint_expr* expr, uint64_t left, uint64_t right) {
+  return _expr_node(expr, EXPR_MUL, left, right);
+}
+
+/**
+ * Evaluation state of a node. A fused node has a single use as a term
+ * of a sum and is folded into that sum's accumulator instead of
+ * getting storage of its own.
+ */
+typedef struct {
+  uint64_t* data;
+  uint64_t length;
+  uint64_t bound;
+  uint64_t uses;
+  bool in_sum;
+  bool fused;
+  bool negative;
+} expr_slot;
+
+/**
+ * acc += or -= x y modulo B^length, with the word multiply kernels
+ * when either factor is one segment
+ */
+static void _expr_product(uint64_t* acc, uint64_t length, expr_slot* x, expr_slot* y,
+			  bool subtract, uint64_t* scratch) {
+  expr_slot* swap;
+  uint64_t carry;
+
+  if(x->length == 0 || y->length == 0) {
+    return;
+  }
+  if(x->length == 1) {
+    swap = x;
+    x = y;
+    y = swap;
+  }
+  if(y->length == 1) {
+    if(subtract) {
+      carry = _cpu.submul_1(acc, x->data, x->length, y->data[0]);
+      sub_1_segments(acc + x->length, length - x->length, carry);
+    } else {
+      carry = _cpu.addmul_1(acc, x->data, x->length, y->data[0]);
+      add_1_segments(acc + x->length, length - x->length, carry);
+    }
+    return;
+  }
+  _mul_full(scratch, x->data, x->length, y->data, y->length);
+  if(subtract) {
+    _sub_from(acc, length, scratch, x->length + y->length);
+  } else {
+    _add_into(acc, length, scratch, x->length + y->length);
+  }
+}
+
+/**
+ * Fold a term of a sum into a two's complement accumulator of length
+ * segments, going through the fused nodes under it. Overflow along the
+ * way wraps harmlessly as long as the total fits.
+ */
+static void _expr_terms(bigint_expr* expr, expr_slot* slots, uint64_t node, bool negate,
+			uint64_t* acc, uint64_t length, uint64_t* scratch) {
+  expr_node* inner = &expr->nodes[node];
+  expr_slot* slot = &slots[node];
+
+  if(slot->fused && inner->op == EXPR_MUL) {
+    _expr_product(acc, length, &slots[inner->left], &slots[inner->right],
+		  negate ^ slots[inner->left].negative ^ slots[inner->right].negative, scratch);
+  } else if(slot->fused) {
+    _expr_terms(expr, slots, inner->left, negate, acc, length, scratch);
+    _expr_terms(expr, slots, inner->right, negate ^ (inner->op == EXPR_SUB), acc, length,
+		scratch);
+  } else if(negate ^ slot->negative) {
+    _sub_from(acc, length, slot->data, slot->length);
+  } else {
+    _add_into(acc, length, slot->data, slot->length);
+  }
+}
+
+/**
+ * Evaluate the expression at root into a new bigint, its sign going
+ * to negative, which may be NULL.
+ *
+ * All temporaries are sized up front from the operand lengths and come
+ * from one allocation. A tree of sums and differences is folded into a
+ * single accumulator, products under it are multiplied straight into
+ * the accumulator (addmul_1 and submul_1 for a one segment factor), and
+ * shared subexpressions are evaluated once. Returns NULL for an
+ * invalid root.
+ */
+bigint* eval_expr(bigint_expr* expr, uint64_t root, bool* negative) {
+  expr_slot* slots;
+  expr_node* node;
+  uint64_t i, size = 0, scratch_length = 0, *base, *arena, *scratch;
+  bigint* result;
+
+  if(root >= expr->count) {
+    return NULL;
+  }
+  slots = calloc(root + 1, sizeof(expr_slot));
+
+  //children always come before their parents, so reachability and
+  //uses run down from the root and everything else up to it
+  slots[root].uses = 1;
+  for(i = root + 1; i-- > 0;) {
+    node = &expr->nodes[i];
+    if(slots[i].uses && node->op >= EXPR_ADD) {
+      slots[node->left].uses++;
+      slots[node->right].uses++;
+      slots[node->left].in_sum = slots[node->right].in_sum = node->op != EXPR_MUL;
+    }
+  }
+  for(i = 0; i <= root; i++) {
+    node = &expr->nodes[i];
+    if(!slots[i].uses) {
+      continue;
+    }
+    if(node->op == EXPR_VALUE) {
+      slots[i].data = node->value->data;
+      slots[i].length = _size_segments(node->value->data, node->value->length);
+    } else if(node->op == EXPR_WORD) {
+      slots[i].data = &node->word;
+      slots[i].length = node->word != 0;
+    }
+    if(node->op < EXPR_ADD) {
+      slots[i].bound = slots[i].length;
+      continue;
+    }
+    slots[i].bound = slots[node->left].bound + slots[node->right].bound;
+    if(node->op != EXPR_MUL) {
+      slots[i].bound = (slots[node->left].bound > slots[node->right].bound ?
+			slots[node->left].bound : slots[node->right].bound) + 1;
+    }
+    slots[i].fused = i != root && slots[i].uses == 1 && slots[i].in_sum;
+    if(slots[i].fused && node->op == EXPR_MUL && slots[i].bound > scratch_length) {
+      scratch_length = slots[i].bound;
+    } else if(!slots[i].fused) {
+      //sums keep a sign segment
+      size += slots[i].bound + (node->op != EXPR_MUL);
+    }
+  }
+
+  base = arena = malloc((size + scratch_length + 1) * sizeof(uint64_t));
+  scratch = base + size;
+  for(i = 0; i <= root; i++) {
+    node = &expr->nodes[i];
+    if(!slots[i].uses || slots[i].fused || node->op < EXPR_ADD) {
+      continue;
+    }
+    slots[i].data = arena;
+    if(node->op == EXPR_MUL) {
+      _mul_full(arena, slots[node->left].data, slots[node->left].length,
+		slots[node->right].data, slots[node->right].length);
+      slots[i].length = _size_segments(arena, slots[node->left].length +
+				       slots[node->right].length);
+      slots[i].negative = slots[node->left].negative ^ slots[node->right].negative;
+      arena += slots[i].bound;
+      continue;
+    }
+    memset(arena, 0, (slots[i].bound + 1) * sizeof(uint64_t));
+    _expr_terms(expr, slots, node->left, FALSE, arena, slots[i].bound + 1, scratch);
+    _expr_terms(expr, slots, node->right, node->op == EXPR_SUB, arena, slots[i].bound + 1,
+		scratch);
+    if(arena[slots[i].bound] >> 63) {
+      not_segments(arena, slots[i].bound + 1);
+      add_1_segments(arena, slots[i].bound + 1, 1);
+      slots[i].negative = TRUE;
+    }
+    slots[i].length = _size_segments(arena, slots[i].bound + 1);
+    arena += slots[i].bound + 1;
+  }
+
+  result = _copy_bigint(slots[root].data, slots[root].length);
+  if(negative != NULL) {
+    *negative = slots[root].negative && slots[root].length;
+  }
+  free(base);
+  free(slots);
+  return result;
+}
+
+///
+/// Background jobs
+///
+
+struct bigint_job {
+  job_function function;
+  void* argument;
+  job_options options;
+  job_pool* pool;
+  void* result;
+  job_state state;
+  uint64_t sequence;
+  int references;
+  bool cancelled;
+  bool notified;
+  pthread_cond_t finished;
+};
+
+/**
+ * Queued jobs are a binary heap on (priority, sequence). A cancelled
+ * job stays in the heap and is dropped when it reaches the top.
+ */
+struct job_pool {
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  pthread_t* workers;
+  uint64_t worker_count;
+  bigint_job** queue;
+  uint64_t queued;
+  uint64_t capacity;
+  uint64_t sequence;
+  uint64_t memory_limit;
+  uint64_t memory_used;
+  uint64_t running;
+  int fd;
+  bool stopping;
+};
+
+static bool _job_before(bigint_job* a, bigint_job* b) {
+  return a->options.priority > b->options.priority ||
+    (a->options.priority == b->options.priority && a->sequence < b->sequence);
+}
+
+static void _push_job(job_pool* pool, bigint_job* job) {
+  uint64_t i = pool->queued++, parent;
+  if(pool->queued > pool->capacity) {
+    pool->capacity *= 2;
+    pool->queue = realloc(pool->queue, pool->capacity * sizeof(bigint_job*));
+  }
+  for(; i > 0 && _job_before(job, pool->queue[(parent = (i - 1) / 2)]); i = parent) {
+    pool->queue[i] = pool->queue[parent];
+  }
+  pool->queue[i] = job;
+}
+
+static void _pop_job(job_pool* pool) {
+  bigint_job* last = pool->queue[--pool->queued];
+  uint64_t i = 0, child;
+  while((child = 2 * i + 1) < pool->queued) {
+    if(child + 1 < pool->queued && _job_before(pool->queue[child + 1], pool->queue[child])) {
+      child++;
+    }
+    if(!_job_before(pool->queue[child], last)) {
+      break;
+    }
+    pool->queue[i] = pool->queue[child];
+    i = child;
+  }
+  pool->queue[i] = last;
+}
+
+/**
+ * Called with the lock held; drops it around the callback. Waiters are
+ * only woken once the callback and the eventfd are through, so a
+ * finished wait_job sees all of the job's effects. The job must still
+ * hold a reference for the caller.
+ */
+static void _finish_job(bigint_job* job, job_state state, void* result) {
+  job_pool* pool = job->pool;
+  uint64_t one = 1;
+  job->result = result;
+  job->state = state;
+  pthread_mutex_unlock(&pool->lock);
+  if(job->options.callback != NULL) {
+    job->options.callback(job, job->options.context);
+  }
+  if(write(pool->fd, &one, sizeof(one)) < 0) {
+    //the counter only saturates if nobody reads it
+  }
+  pthread_mutex_lock(&pool->lock);
+  job->notified = TRUE;
+  pthread_cond_broadcast(&job->finished);
+}
+
+static void _release_job(bigint_job* job) {
+  if(--job->references == 0) {
+    pthread_cond_destroy(&job->finished);
+    free(job);
+  }
+}
+
+static void* _job_worker(void* arg) {
+  job_pool* pool = arg;
+  bigint_job* job;
+  void* result;
+
+  pthread_mutex_lock(&pool->lock);
+  for(;;) {
+    while(pool->queued && pool->queue[0]->state == JOB_CANCELLED) {
+      job = pool->queue[0];
+      _pop_job(pool);
+      _release_job(job);
+    }
+    if(pool->stopping) {
+      break;
+    }
+    //a job over the memory limit still runs once nothing else does
+    if(pool->queued == 0 || (pool->running && pool->memory_limit &&
+			     pool->memory_used + pool->queue[0]->options.memory >
+			     pool->memory_limit)) {
+      pthread_cond_wait(&pool->ready, &pool->lock);
+      continue;
+    }
+    job = pool->queue[0];
+    _pop_job(pool);
+    job->state = JOB_RUNNING;
+    pool->memory_used += job->options.memory;
+    pool->running++;
+    pthread_mutex_unlock(&pool->lock);
+
+    result = job->function(job, job->argument);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->memory_used -= job->options.memory;
+    pool->running--;
+    pthread_cond_broadcast(&pool->ready);
+    _finish_job(job, job->cancelled && result == NULL ? JOB_CANCELLED : JOB_DONE, result);
+    _release_job(job);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+/**
+ * A pool of threads workers, 0 for one per online CPU. Jobs only start
+ * while the memory budgets of the running ones stay within
+ * memory_limit bytes, 0 for no limit. Returns NULL if no eventfd or
+ * thread can be had.
+ */
+job_pool* create_job_pool(uint64_t threads, uint64_t memory_limit) {
+  job_pool* pool = malloc(sizeof(job_pool));
+  uint64_t i;
+
+  pool->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if(pool->fd < 0) {
+    free(pool);
+    return NULL;
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->ready, NULL);
+  pool->capacity = 16;
+  pool->queue = malloc(pool->capacity * sizeof(bigint_job*));
+  pool->queued = pool->sequence = pool->memory_used = pool->running = 0;
+  pool->memory_limit = memory_limit;
+  pool->stopping = FALSE;
+  threads = _thread_count(threads);
+  pool->workers = malloc(threads * sizeof(pthread_t));
+  for(i = 0; i < threads; i++) {
+    if(pthread_create(&pool->workers[i], NULL, &_job_worker, pool) != 0) {
+      break;
+    }
+  }
+  pool->worker_count = i;
+  if(i == 0) {
+    free_job_pool(pool);
+    return NULL;
+  }
+  return pool;
+}
+
+/**
+ * Cancels the queued jobs, waits for the running ones and stops the
+ * workers. Every job from the pool must have been through free_job.
+ */
+void free_job_pool(job_pool* pool) {
+  bigint_job* job;
+  uint64_t i;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->stopping = TRUE;
+  while(pool->queued) {
+    job = pool->queue[0];
+    _pop_job(pool);
+    if(job->state == JOB_QUEUED) {
+      _finish_job(job, JOB_CANCELLED, NULL);
+    }
+    _release_job(job);
+  }
+  pthread_cond_broadcast(&pool->ready);
+  pthread_mutex_unlock(&pool->lock);
+  for(i = 0; i < pool->worker_count; i++) {
+    pthread_join(pool->workers[i], NULL);
+  }
+  close(pool->fd);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->ready);
+  free(pool->workers);
+  free(pool->queue);
+  free(pool);
+}
+
+/**
+ * An eventfd counting finished jobs, for an event loop to wait on
+ */
+int job_pool_fd(job_pool* pool) {
+  return pool->fd;
+}
+
+static bigint_job* _new_job(job_pool* pool, job_function function, void* argument,
+			    job_options* options) {
+  bigint_job* job = malloc(sizeof(bigint_job));
+  job->function = function;
+  job->argument = argument;
+  job->pool = pool;
+  job->result = NULL;
+  job->state = JOB_QUEUED;
+  job->references = 1;
+  job->cancelled = FALSE;
+  job->notified = FALSE;
+  pthread_cond_init(&job->finished, NULL);
+  if(options != NULL) {
+    job->options = *options;
+  } else {
+    memset(&job->options, 0, sizeof(job_options));
+  }
+  return job;
+}
+
+/**
+ * Queue function(job, argument) on the pool. options may be NULL for
+ * priority 0, no memory budget and no callback. The callback runs on
+ * the thread that finishes the job. Free the job with free_job, which
+ * may come before it finishes.
+ */
+bigint_job* submit_job(job_pool* pool, job_function function, void* argument,
+		       job_options* options) {
+  bigint_job* job = _new_job(pool, function, argument, options);
+
+  pthread_mutex_lock(&pool->lock);
+  if(pool->stopping) {
+    //the callback may free the caller's reference
+    job->references++;
+    _finish_job(job, JOB_CANCELLED, NULL);
+    _release_job(job);
+  } else {
+    job->references++;
+    job->sequence = pool->sequence++;
+    _push_job(pool, job);
+    pthread_cond_signal(&pool->ready);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return job;
+}
+
+/**
+ * Run a job on the calling thread, for work too small to be worth a
+ * hand off. A NULL function fails the job instead.
+ */
+static bigint_job* _inline_job(job_pool* pool, job_function function, void* argument,
+			       job_options* options) {
+  bigint_job* job = _new_job(pool, function, argument, options);
+  void* result = NULL;
+
+  if(function != NULL) {
+    job->state = JOB_RUNNING;
+    result = function(job, argument);
+  }
+  pthread_mutex_lock(&pool->lock);
+  //hold the job through _finish_job in case the callback frees it
+  job->references++;
+  _finish_job(job, function != NULL ? JOB_DONE : JOB_FAILED, result);
+  _release_job(job);
+  pthread_mutex_unlock(&pool->lock);
+  return job;
+}
+
+/**
+ * Queue a built in job that takes need bytes, or run it here if it is
+ * at most JOB_INLINE_LENGTH segments. A memory budget below need fails
+ * it at once.
+ */
+static bigint_job* _submit_sized(job_pool* pool, job_function function, void* argument,
+				 job_options* options, uint64_t length, uint64_t need) {
+  job_options sized = {0, 0, NULL, NULL};
+  if(options != NULL) {
+    sized = *options;
+  }
+  if(sized.memory && sized.memory < need) {
+    free(argument);
+    return _inline_job(pool, NULL, NULL, &sized);
+  }
+  if(length <= JOB_INLINE_LENGTH) {
+    return _inline_job(pool, function, argument, &sized);
+  }
+  if(sized.memory == 0) {
+    sized.memory = need;
+  }
+  return submit_job(pool, function, argument, &sized);
+}
+
+typedef struct {
+  uint64_t* dest;
+  uint64_t power;
+  uint64_t length;
+  bigint* value;
+  byte base;
+} builtin_job;
+
+/**
+ * pow_segments with a cancellation check between products; dest only
+ * changes if the job completes
+ */
+static void* _pow_job(bigint_job* job, void* argument) {
+  builtin_job* pow = argument;
+  uint64_t power = pow->power, size = pow->length * sizeof(uint64_t);
+  uint64_t *factor = malloc(size), *result = calloc(pow->length, sizeof(uint64_t));
+  void* done = pow->dest;
+
+  memcpy(factor, pow->dest, size);
+  result[0] = 1;
+  while(power) {
+    if(job_cancelled(job)) {
+      done = NULL;
+      break;
+    }
+    if(power & 0x1) {
+      mul_segments(result, factor, pow->length);
+    }
+    power >>= 1;
+    if(power) {
+      mul_segments(factor, factor, pow->length);
+    }
+  }
+  if(done != NULL) {
+    memcpy(pow->dest, result, size);
+  }
+  free(factor);
+  free(result);
+  free(pow);
+  return done;
+}
+
+static void* _to_str_job(bigint_job* job, void* argument) {
+  builtin_job* to_str = argument;
+  char* output = NULL;
+  if(!job_cancelled(job)) {
+    output = bigint_to_new_str_base(to_str->value, to_str->base);
+  }
+  free(to_str);
+  return output;
+}
+
+/**
+ * dest = dest^power as a job, the result being dest. The operand must
+ * stay untouched until the job finishes.
+ */
+bigint_job* submit_pow_job(job_pool* pool, uint64_t* dest, uint64_t power, uint64_t length,
+			   job_options* options) {
+  builtin_job* pow = malloc(sizeof(builtin_job));
+  pow->dest = dest;
+  pow->power = power;
+  pow->length = length;
+  return _submit_sized(pool, &_pow_job, pow, options, length,
+		       4 * length * sizeof(uint64_t));
+}
+
+/**
+ * bigint_to_new_str_base as a job, the result being the new string
+ */
+bigint_job* submit_to_str_job(job_pool* pool, bigint* value, byte base,
+			      job_options* options) {
+  builtin_job* to_str = malloc(sizeof(builtin_job));
+  to_str->value = value;
+  to_str->base = base;
+  return _submit_sized(pool, &_to_str_job, to_str, options, value->length,
+		       (value->length * 65 + 4 * value->length * sizeof(uint64_t)));
+}
+
+/**
+ * A queued job is cancelled at once. A running one is only asked to
+ * stop: job functions check job_cancelled, and one that then returns
+ * NULL finishes as JOB_CANCELLED. Returns FALSE if the job had
+ * already finished.
+ */
+bool cancel_job(bigint_job* job) {
+  job_pool* pool = job->pool;
+  bool pending;
+
+  pthread_mutex_lock(&pool->lock);
+  pending = job->state == JOB_QUEUED || job->state == JOB_RUNNING;
+  if(pending) {
+    __atomic_store_n(&job->cancelled, TRUE, __ATOMIC_RELAXED);
+  }
+  if(job->state == JOB_QUEUED) {
+    _finish_job(job, JOB_CANCELLED, NULL);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return pending;
+}
+
+bool job_cancelled(bigint_job* job) {
+  return __atomic_load_n(&job->cancelled, __ATOMIC_RELAXED);
+}
+
+job_state poll_job(bigint_job* job) {
+  job_state state;
+  pthread_mutex_lock(&job->pool->lock);
+  state = job->state;
+  pthread_mutex_unlock(&job->pool->lock);
+  return state;
+}
+
+/**
+ * Block until the job finishes and its callback has run; returns its
+ * result, NULL if it was cancelled or failed. A callback must not
+ * wait on its own job.
+ */
+void* wait_job(bigint_job* job) {
+  job_pool* pool = job->pool;
+  void* result;
+  pthread_mutex_lock(&pool->lock);
+  while(!job->notified) {
+    pthread_cond_wait(&job->finished, &pool->lock);
+  }
+  result = job->result;
+  pthread_mutex_unlock(&pool->lock);
+  return result;
+}
+
+/**
+ * Drop the caller's hold on a job. The pool keeps an unfinished job
+ * alive until it is done with it.
+ */
+void free_job(bigint_job* job) {
+  job_pool* pool = job->pool;
+  pthread_mutex_lock(&pool->lock);
+  _release_job(job);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+///
+/// Floating point
+///
+
+/**
+ * Whether rounding away the dropped bits moves the kept ones up by one
+ * unit. half is the first dropped bit, sticky any of the rest.
+ */
+static bool _round_up(round_mode mode, bool negative, bool half, bool sticky, bool odd) {
+  switch(mode) {
+  case ROUND_NEAREST:
+    return half && (sticky || odd);
+  case ROUND_DOWN:
+    return negative && (half || sticky);
+  case ROUND_UP:
+    return !negative && (half || sticky);
+  default:
+    return FALSE;
+  }
+}
+
+/**
+ * segments >>= drop, rounded by mode. sticky marks non zero bits lost
+ * before segments were formed. The increment is not allowed to carry
+ * out of length segments.
+ */
+static void _round_shr(uint64_t* segments, uint64_t length, uint64_t drop,
+		       bool negative, bool sticky, round_mode mode) {
+  const byte segment_size_bits = sizeof(uint64_t) * 8;
+  uint64_t total = length * segment_size_bits, below = 0, i;
+  bool half = FALSE;
+
+  if(drop) {
+    below = drop - 1 < total ? drop - 1 : total;
+    half = drop <= total && test_bit_segments(segments, length, drop - 1);
+  }
+  for(i = 0; i < below / segment_size_bits && !sticky; i++) {
+    sticky = segments[i] != 0;
+  }
+  if(!sticky && below % segment_size_bits) {
+    sticky = (segments[i] & (((uint64_t) 1 << (below % segment_size_bits)) - 1)) != 0;
+  }
+
+  if(drop >= total) {
+    memset(segments, 0, length * sizeof(uint64_t));
+  } else {
+    _shr_bits(segments, length, drop);
+  }
+  if(_round_up(mode, negative, half, sticky, segments[0] & 1)) {
+    add_1_segments(segments, length, 1);
+  }
+}
+
+/**
+ * dest = src << bits, src being length segments and dest dest_length
+ * of them, which must be enough to hold the result. dest may be src.
+ */
+static void _place_bits(uint64_t* dest, uint64_t dest_length, uint64_t* src, uint64_t length,
+			uint64_t bits) {
+  const byte segment_size_bits = sizeof(uint64_t) * 8;
+  uint64_t words = bits / segment_size_bits;
+  uint64_t count = length < dest_length - words ? length : dest_length - words;
+  memmove(dest + words, src, count * sizeof(uint64_t));
+  memset(dest, 0, words * sizeof(uint64_t));
+  memset(dest + words + count, 0, (dest_length - words - count) * sizeof(uint64_t));
+  _shl_segments(dest + words, dest_length - words, bits % segment_size_bits);
+}
+
+static bigfloat* _zero_bigfloat(bigfloat* dest) {
+  memset(dest->mantissa, 0, dest->length * sizeof(uint64_t));
+  dest->exponent = 0;
+  dest->negative = FALSE;
+  return dest;
+}
+
+static bool _is_zero_bigfloat(bigfloat* value) {
+  return value->mantissa[value->length-1] == 0;
+}
+
+/**
+ * dest = (-1)^negative * segments * 2^exponent rounded to dest's
+ * precision. segments is used as scratch and may not be dest's
+ * mantissa. When sticky is set it must hold more than precision bits.
+ */
+static bigfloat* _round_bigfloat(bigfloat* dest, uint64_t* segments, uint64_t length,
+				 long exponent, bool negative, bool sticky, round_mode mode) {
+  uint64_t size = _size_segments(segments, length), bits, drop;
+  uint64_t precision = dest->precision;
+
+  if(size == 0) {
+    return _zero_bigfloat(dest);
+  }
+  bits = _msb(segments, size) + 1;
+  if(bits > precision) {
+    drop = bits - precision;
+    _round_shr(segments, size, drop, negative, sticky, mode);
+    if(test_bit_segments(segments, size, precision)) {
+      //all ones rounded up to 2^precision
+      _shr_segments(segments, size, 1);
+      drop++;
+    }
+    memcpy(dest->mantissa, segments, dest->length * sizeof(uint64_t));
+    exponent += drop;
+  } else {
+    _place_bits(dest->mantissa, dest->length, segments, size, precision - bits);
+    exponent -= precision - bits;
+  }
+  dest->exponent = exponent;
+  dest->negative = negative;
+  return dest;
+}
+
+/**
+ * Zero with precision significant bits, at least 1
+ */
+bigfloat* create_bigfloat(uint64_t precision) {
+  const byte segment_size_bits = sizeof(uint64_t) * 8;
+  bigfloat* value;
+  if(precision == 0) {
+    return NULL;
+  }
+  value = malloc(sizeof(bigfloat));
+  value->precision = precision;
+  value->length = (precision + segment_size_bits - 1) / segment_size_bits;
+  value->mantissa = malloc(value->length * sizeof(uint64_t));
+  return _zero_bigfloat(value);
+}
+
+void free_bigfloat(bigfloat* value) {
+  free(value->mantissa);
+  free(value);
+}
+
+static bigfloat* _set_bigfloat(bigfloat* dest, bigfloat* src, bool negative, round_mode mode) {
+  uint64_t* scratch;
+  if(_is_zero_bigfloat(src)) {
+    return _zero_bigfloat(dest);
+  }
+  if(dest->precision == src->precision) {
+    if(dest != src) {
+      memcpy(dest->mantissa, src->mantissa, dest->length * sizeof(uint64_t));
+      dest->exponent = src->exponent;
+    }
+    dest->negative = negative;
+    return dest;
+  }
+  scratch = malloc(src->length * sizeof(uint64_t));
+  memcpy(scratch, src->mantissa, src->length * sizeof(uint64_t));
+  _round_bigfloat(dest, scratch, src->length, src->exponent, negative, FALSE, mode);
+  free(scratch);
+  return dest;
+}
+
+/**
+ * dest = src rounded to dest's precision. dest may be src.
+ */
+bigfloat* set_bigfloat(bigfloat* dest, bigfloat* src, round_mode mode) {
+  return _set_bigfloat(dest, src, src->negative, mode);
+}
+
+bigfloat* set_bigfloat_bigint(bigfloat* dest, bigint* value, bool negative, round_mode mode) {
+  uint64_t* scratch = malloc(value->length * sizeof(uint64_t));
+  memcpy(scratch, value->data, value->length * sizeof(uint64_t));
+  _round_bigfloat(dest, scratch, value->length, 0, negative, FALSE, mode);
+  free(scratch);
+  return dest;
+}
+
+/**
+ * Returns NULL for infinities and NaN
+ */
+bigfloat* set_bigfloat_double(bigfloat* dest, double value, round_mode mode) {
+  uint64_t mantissa;
+  int exponent;
+  if(isnan(value) || isinf(value)) {
+    return NULL;
+  }
+  mantissa = (uint64_t) ldexp(fabs(frexp(value, &exponent)), 53);
+  return _round_bigfloat(dest, &mantissa, 1, (long) exponent - 53, signbit(value) != 0,
+			 FALSE, mode);
+}
+
+/**
+ * Nearest double, infinity above its range and zero below. Values in
+ * the subnormal range are rounded once, straight to the bits they
+ * keep there.
+ */
+double bigfloat_to_double(bigfloat* value) {
+  long top = value->exponent + (long) value->precision - 1, quantum;
+  uint64_t* segments;
+  double result;
+
+  if(_is_zero_bigfloat(value)) {
+    result = 0;
+  } else if(top > 1023) {
+    result = INFINITY;
+  } else {
+    //the double's unit in the last place, 2^-1074 at the least
+    quantum = top - 52 > -1074 ? top - 52 : -1074;
+    if(value->exponent >= quantum) {
+      result = ldexp((double) value->mantissa[0], value->exponent);
+    } else {
+      segments = malloc(value->length * sizeof(uint64_t));
+      memcpy(segments, value->mantissa, value->length * sizeof(uint64_t));
+      _round_shr(segments, value->length, quantum - value->exponent, value->negative,
+		 FALSE, ROUND_NEAREST);
+      result = ldexp((double) segments[0], quantum);
+      free(segments);
+    }
+  }
+  return value->negative ? -result : result;
+}
+
+/**
+ * value rounded to an integer by mode, as a new bigint whose sign goes
+ * to negative
+ */
+bigint* bigfloat_to_bigint(bigfloat* value, bool* negative, round_mode mode) {
+  const byte segment_size_bits = sizeof(uint64_t) * 8;
+  uint64_t length = value->length + 1, size;
+  uint64_t* segments;
+
+  if(value->exponent > 0) {
+    length += value->exponent / segment_size_bits;
+  }
+  segments = malloc(length * sizeof(uint64_t));
+  if(value->exponent >= 0) {
+    _place_bits(segments, length, value->mantissa, value->length, value->exponent);
+  } else {
+    memcpy(segments, value->mantissa, value->length * sizeof(uint64_t));
+    segments[value->length] = 0;
+    _round_shr(segments, length, -value->exponent, value->negative, FALSE, mode);
+  }
+  size = _size_segments(segments, length);
+  if(negative != NULL) {
+    *negative = value->negative && size;
+  }
+  return create_bigint(segments, size ? size : 1);
+}
+
+/**
+ * -1, 0 or 1 as a is below, equal to or above b
+ */
+int cmp_bigfloat(bigfloat* a, bigfloat* b) {
+  uint64_t length, *scratch;
+  bool a_zero = _is_zero_bigfloat(a), b_zero = _is_zero_bigfloat(b);
+  long a_top, b_top;
+  int order;
+
+  if(a_zero || b_zero) {
+    if(a_zero && b_zero) {
+      return 0;
+    }
+    return (a_zero ? !b->negative : a->negative) ? -1 : 1;
+  }
+  if(a->negative != b->negative) {
+    return a->negative ? -1 : 1;
+  }
+
+  a_top = a->exponent + (long) a->precision;
+  b_top = b->exponent + (long) b->precision;
+  if(a_top != b_top) {
+    order = a_top < b_top ? -1 : 1;
+  } else if(a->precision == b->precision) {
+    order = eq(a->mantissa, b->mantissa, a->length) ? 0 :
+      gt(a->mantissa, b->mantissa, a->length) ? 1 : -1;
+  } else {
+    //line the shorter mantissa up with the longer one
+    length = a->length > b->length ? a->length : b->length;
+    scratch = malloc(length * sizeof(uint64_t));
+    if(a->precision < b->precision) {
+      _place_bits(scratch, length, a->mantissa, a->length, b->precision - a->precision);
+      order = eq(scratch, b->mantissa, length) ? 0 : gt(scratch, b->mantissa, length) ? 1 : -1;
+    } else {
+      _place_bits(scratch, length, b->mantissa, b->length, a->precision - b->precision);
+      order = eq(a->mantissa, scratch, length) ? 0 : gt(a->mantissa, scratch, length) ? 1 : -1;
+    }
+    free(scratch);
+  }
+  return a->negative ? -order : order;
+}
+
+/**
+ * Both operands and dest share precision and exponent, so the
+ * mantissas are combined where they lie. A sum overflows by at most
+ * one bit and a difference is exact.
+ */
+static bigfloat* _add_aligned(bigfloat* dest, bigfloat* a, bigfloat* b, bool b_negative,
+			      round_mode mode) {
+  const byte segment_size_bits = sizeof(uint64_t) * 8;
+  uint64_t length = dest->length, precision = dest->precision, carry, bits;
+  uint64_t* m = dest->mantissa;
+  bigfloat *large, *small;
+  long exponent = a->exponent;
+  bool half;
+
+  if(a->negative == b_negative) {
+    if(dest != a && dest != b) {
+      memcpy(m, a->mantissa, length * sizeof(uint64_t));
+    }
+    carry = _add_n(m, dest == b ? a->mantissa : b->mantissa, length);
+    if(precision % segment_size_bits) {
+      carry = test_bit_segments(m, length, precision);
+    }
+    if(carry) {
+      half = m[0] & 1;
+      _shr_segments(m, length, 1);
+      m[length-1] |= carry << ((precision - 1) % segment_size_bits);
+      exponent++;
+      if(_round_up(mode, a->negative, half, FALSE, m[0] & 1)) {
+	carry = add_1_segments(m, length, 1);
+	if(carry || test_bit_segments(m, length, precision)) {
+	  memset(m, 0, length * sizeof(uint64_t));
+	  set_bit_segments(m, length, precision - 1);
+	  exponent++;
+	}
+      }
     }
-    shl_segments(dest->data, dest->length, sizeof(uint64_t) * 8 - j);
+    dest->exponent = exponent;
+    dest->negative = a->negative;
+    return dest;
+  }
+
+  if(eq(a->mantissa, b->mantissa, length)) {
+    return _zero_bigfloat(dest);
+  }
+  large = gt(a->mantissa, b->mantissa, length) ? a : b;
+  small = large == a ? b : a;
+  dest->negative = large == a ? a->negative : b_negative;
+  if(dest == small) {
+    //m - large wraps to -(large - m)
+    _cpu.sub_n(m, large->mantissa, length);
+    not_segments(m, length);
+    add_1_segments(m, length, 1);
+  } else {
+    if(dest != large) {
+      memcpy(m, large->mantissa, length * sizeof(uint64_t));
+    }
+    _cpu.sub_n(m, small->mantissa, length);
+  }
+  bits = _msb(m, length) + 1;
+  _place_bits(m, length, m, length, precision - bits);
+  dest->exponent = exponent - (long) (precision - bits);
+  return dest;
+}
+
+static bigfloat* _add_bigfloat(bigfloat* dest, bigfloat* a, bigfloat* b, bool b_negative,
+			       round_mode mode) {
+  const byte segment_size_bits = sizeof(uint64_t) * 8;
+  uint64_t guard, shift, length, *scratch, *x, *y;
+  bigfloat* swap;
+  bool negative;
+  long exponent;
+
+  if(_is_zero_bigfloat(b)) {
+    return _set_bigfloat(dest, a, a->negative, mode);
+  }
+  if(_is_zero_bigfloat(a)) {
+    return _set_bigfloat(dest, b, b_negative, mode);
+  }
+  if(a->exponent == b->exponent && a->precision == dest->precision &&
+     b->precision == dest->precision) {
+    return _add_aligned(dest, a, b, b_negative, mode);
+  }
+
+  negative = a->negative;
+  if(a->exponent < b->exponent) {
+    swap = a;
+    a = b;
+    b = swap;
+    negative = b_negative;
+    b_negative = swap->negative;
+  }
+  shift = a->exponent - b->exponent;
+  guard = dest->precision + 2 > a->precision ? dest->precision + 2 - a->precision : 0;
+
+  if(shift >= b->precision + guard) {
+    //b is below half an ulp of a widened by guard bits: it only decides
+    //which way a rounds
+    length = (a->precision + guard) / segment_size_bits + 1;
+    x = malloc(length * sizeof(uint64_t));
+    _place_bits(x, length, a->mantissa, a->length, guard);
+    if(negative != b_negative) {
+      sub_1_segments(x, length, 1);
+    }
+    _round_bigfloat(dest, x, length, a->exponent - (long) guard, negative, TRUE, mode);
+    free(x);
+    return dest;
+  }
+
+  length = (a->precision + shift > b->precision ? a->precision + shift : b->precision) /
+    segment_size_bits + 1;
+  scratch = malloc(2 * length * sizeof(uint64_t));
+  x = scratch;
+  y = scratch + length;
+  _place_bits(x, length, a->mantissa, a->length, shift);
+  _place_bits(y, length, b->mantissa, b->length, 0);
+  exponent = b->exponent;
+  if(negative == b_negative) {
+    _add_n(x, y, length);
+  } else if(gte(x, y, length)) {
+    _cpu.sub_n(x, y, length);
+  } else {
+    _cpu.sub_n(y, x, length);
+    x = y;
+    negative = b_negative;
+  }
+  _round_bigfloat(dest, x, length, exponent, negative, FALSE, mode);
+  free(scratch);
+  return dest;
+}
+
+/**
+ * dest = a + b rounded to dest's precision. Operands sharing dest's
+ * precision and exponent are added in place without realignment. dest
+ * may be a or b.
+ */
+bigfloat* add_bigfloat(bigfloat* dest, bigfloat* a, bigfloat* b, round_mode mode) {
+  return _add_bigfloat(dest, a, b, b->negative, mode);
+}
+
+bigfloat* sub_bigfloat(bigfloat* dest, bigfloat* a, bigfloat* b, round_mode mode) {
+  return _add_bigfloat(dest, a, b, !b->negative, mode);
+}
+
+/**
+ * dest = a * b. The exact product comes from _mul_full and is rounded
+ * once.
+ */
+bigfloat* mul_bigfloat(bigfloat* dest, bigfloat* a, bigfloat* b, round_mode mode) {
+  uint64_t length = a->length + b->length;
+  uint64_t* product;
+  if(_is_zero_bigfloat(a) || _is_zero_bigfloat(b)) {
+    return _zero_bigfloat(dest);
   }
+  product = malloc(length * sizeof(uint64_t));
+  _mul_full(product, a->mantissa, a->length, b->mantissa, b->length);
+  _round_bigfloat(dest, product, length, a->exponent + b->exponent,
+		  a->negative != b->negative, FALSE, mode);
+  free(product);
+  return dest;
+}
 
-  memcpy(dest->data, scratch, scratch_size);
-  free(scratch);
+/**
+ * dest = a / b, NULL when b is zero. a is widened so the quotient has
+ * two bits past dest's precision; the remainder supplies the rest.
+ */
+bigfloat* div_bigfloat(bigfloat* dest, bigfloat* a, bigfloat* b, round_mode mode) {
+  const byte segment_size_bits = sizeof(uint64_t) * 8;
+  uint64_t widen, length, size, *numerator, *quotient, *remainder;
+  bool sticky;
+  long exponent;
+
+  if(_is_zero_bigfloat(b)) {
+    return NULL;
+  }
+  if(_is_zero_bigfloat(a)) {
+    return _zero_bigfloat(dest);
+  }
+  widen = dest->precision + 2 + b->precision > a->precision ?
+    dest->precision + 2 + b->precision - a->precision : 0;
+  length = (a->precision + widen) / segment_size_bits + 1;
+  numerator = malloc((2 * length + 1 + b->length) * sizeof(uint64_t));
+  quotient = numerator + length;
+  remainder = quotient + length + 1;
+  _place_bits(numerator, length, a->mantissa, a->length, widen);
+  size = _size_segments(numerator, length);
+  memset(quotient, 0, (length + 1) * sizeof(uint64_t));
+  _divrem_knuth(quotient, remainder, numerator, size, b->mantissa, b->length);
+  sticky = _size_segments(remainder, b->length) != 0;
+  exponent = a->exponent - b->exponent - (long) widen;
+  _round_bigfloat(dest, quotient, size - b->length + 1, exponent,
+		  a->negative != b->negative, sticky, mode);
+  free(numerator);
   return dest;
 }
 
-bigint* div_bigint_nat(bigint* dest, uint64_t divisor) {
-  uint64_t* segments;
-  bigint* scratch;
-  
-  segments = malloc(sizeof(uint64_t) * dest->length);
-  memset(segments, 0, sizeof(uint64_t) * dest->length);
-  segments[0] = divisor;
-  scratch = create_bigint(segments, dest->length);
-  
-  div_bigint(dest, scratch);
-  free_bigint(scratch);
+/**
+ * dest = sqrt(a), NULL when a is negative. The integer root of the
+ * mantissa, widened to an even exponent, has two bits past dest's
+ * precision; squaring it back tells if it was exact.
+ */
+bigfloat* sqrt_bigfloat(bigfloat* dest, bigfloat* a, round_mode mode) {
+  const byte segment_size_bits = sizeof(uint64_t) * 8;
+  uint64_t widen, length, *scaled, *root, *square;
+  bool sticky;
+
+  if(_is_zero_bigfloat(a)) {
+    return _zero_bigfloat(dest);
+  }
+  if(a->negative) {
+    return NULL;
+  }
+  widen = 2 * dest->precision + 4 > a->precision ? 2 * dest->precision + 4 - a->precision : 0;
+  if((a->exponent - (long) widen) & 1) {
+    widen++;
+  }
+  length = (a->precision + widen) / segment_size_bits + 1;
+  scaled = malloc(4 * length * sizeof(uint64_t));
+  root = scaled + length;
+  square = root + length;
+  _place_bits(scaled, length, a->mantissa, a->length, widen);
+  _root_newton(root, scaled, length, 2);
+  _mul_full(square, root, length, root, length);
+  sticky = !eq(square, scaled, length) || _size_segments(square + length, length);
+  _round_bigfloat(dest, root, length, (a->exponent - (long) widen) / 2, FALSE, sticky, mode);
+  free(scaled);
   return dest;
 }
 
-bigint* div_bigint(bigint* dest, bigint* divisor) {
-  //divide
+/**
+ * dest = dest * 2^offset, only the exponent changes
+ */
+bigfloat* ldexp_bigfloat(bigfloat* dest, long offset) {
+  if(!_is_zero_bigfloat(dest)) {
+    dest->exponent += offset;
+  }
+  return dest;
+}
 
-  return NULL;
+///
+/// Hashing and dedup
+///
+
+/**
+ * Drops leading zero segments, keeping at least one, so equal values
+ * get equal lengths. The allocation is left as it is.
+ */
+bigint* normalize_bigint(bigint* value) {
+  uint64_t size = _size_segments(value->data, value->length);
+  value->length = size ? size : 1;
+  return value;
 }
 
+/**
+ * Equality of values whatever the lengths they are stored in
+ */
+bool eq_bigint(bigint* a, bigint* b) {
+  bigint* swap;
+  if(a->length > b->length) {
+    swap = a;
+    a = b;
+    b = swap;
+  }
+  return eq(a->data, b->data, a->length) &&
+    _size_segments(b->data + a->length, b->length - a->length) == 0;
+}
 
-char* eulers(bigint* value, byte base, const char* digit_map) {
-  int bitsper = sizeof(uint64_t) * 8,
-    bits = value->length * bitsper,
-    i;
+/**
+ * Murmur3's 64 bit finalizer
+ */
+static uint64_t _mix64(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xFF51AFD7ED558CCD;
+  x ^= x >> 33;
+  x *= 0xC4CEB9FE1A85EC53;
+  x ^= x >> 33;
+  return x;
+}
 
-  size_t scratch_size = bits * sizeof(byte);
-  byte* scratch = malloc(scratch_size);
-  byte* scratch_prime = malloc(scratch_size);
+/**
+ * 64 bit hash of the significant segments, so equal values hash alike
+ * whatever their length. Different seeds give unrelated hashes. Not
+ * cryptographic.
+ */
+uint64_t hash_segments(uint64_t* segments, uint64_t length, uint64_t seed) {
+  static const uint64_t lane_keys[4] = {
+    0x243F6A8885A308D3, 0x13198A2E03707344, 0xA4093822299F31D0, 0x082EFA98EC4E6C89
+  };
+  const uint64_t odd = 0x9FB21C651E98DF25;
+  uint64_t size = _size_segments(segments, length), blocks = size / 4;
+  uint64_t acc[4] = {0, 0, 0, 0}, keys[4], i, hash;
 
-  for(i = 0; i < bits; i++) {
-    scratch[i] = (value->data[i/bitsper] >> (i % bitsper)) & 0x1;
+  for(i = 0; i < 4; i++) {
+    keys[i] = lane_keys[i] ^ seed;
+  }
+  _cpu.hash_blocks(acc, segments, blocks, keys);
+  for(i = 4 * blocks; i < size; i++) {
+    acc[i % 4] += _hash_limb(segments[i], keys[i % 4] + blocks * _hash_step);
   }
 
-  eulers_node *curr = malloc(sizeof(eulers_node)), *temp;
-  curr->prev = NULL;
-  curr->value = '\0';
+  hash = seed + size * odd;
+  for(i = 0; i < 4; i++) {
+    hash = (hash ^ _mix64(acc[i])) * odd;
+  }
+  return _mix64(hash);
+}
 
-  int length = 1;
-  byte running = TRUE;
-  while(running) {
-    byte rem = 0;
-    running = FALSE;
-    for(i = bits-1; i >= 0; i--) {
-      rem = rem * 2 + scratch[i];
-      if(rem >= base) {
-	scratch_prime[i] = 1;
-	rem -= base;
-      } else {
-	scratch_prime[i] = 0;
+uint64_t hash_bigint(bigint* value, uint64_t seed) {
+  return hash_segments(value->data, value->length, seed);
+}
+
+static const uint64_t _fingerprint_prime = ((uint64_t) 1 << 61) - 1;
+
+static inline uint64_t _fold61(uint64_t x) {
+  return (x & _fingerprint_prime) + (x >> 61);
+}
+
+/**
+ * x * 2^k mod 2^61 - 1 for x below 2^61 is a 61 bit rotation
+ */
+static inline uint64_t _rotate61(uint64_t x, byte k) {
+  return ((x << k) & _fingerprint_prime) | (x >> (61 - k));
+}
+
+/**
+ * The value mod 2^61 - 1. Equal values always match and unequal ones
+ * rarely do; sums and products of values have the sums and products
+ * of their fingerprints, mod the same prime.
+ *
+ * Segment i weighs 2^(64 i) = 2^(3 i) mod 2^61 - 1. Four Horner chains
+ * each take every fourth segment, stepping by 2^12, and are rotated
+ * into place at the end.
+ */
+uint64_t fingerprint_segments(uint64_t* segments, uint64_t length) {
+  uint64_t size = _size_segments(segments, length), i = size & ~(uint64_t) 3;
+  uint64_t top[4] = {0, 0, 0, 0}, c0, c1, c2, c3, residue;
+
+  //the partial top block as if zero padded
+  memcpy(top, segments + i, (size - i) * sizeof(uint64_t));
+  c0 = _fold61(_fold61(top[0]));
+  c1 = _fold61(_fold61(top[1]));
+  c2 = _fold61(_fold61(top[2]));
+  c3 = _fold61(_fold61(top[3]));
+  while(i > 0) {
+    i -= 4;
+    c0 = _fold61(_fold61(_rotate61(c0, 12) + _fold61(segments[i])));
+    c1 = _fold61(_fold61(_rotate61(c1, 12) + _fold61(segments[i+1])));
+    c2 = _fold61(_fold61(_rotate61(c2, 12) + _fold61(segments[i+2])));
+    c3 = _fold61(_fold61(_rotate61(c3, 12) + _fold61(segments[i+3])));
+  }
+  residue = c0 + _rotate61(c1, 3) + _rotate61(c2, 6) + _rotate61(c3, 9);
+  residue = _fold61(_fold61(residue));
+  return residue >= _fingerprint_prime ? residue - _fingerprint_prime : residue;
+}
+
+uint64_t fingerprint_bigint(bigint* value) {
+  return fingerprint_segments(value->data, value->length);
+}
+
+typedef struct {
+  uint64_t fingerprint;
+  bigint* value;
+} index_entry;
+
+typedef struct {
+  pthread_mutex_t lock;
+  index_entry* entries;
+  uint64_t capacity;
+  uint64_t count;
+} index_shard;
+
+struct bigint_index {
+  index_shard* shards;
+  uint64_t shard_count;
+  uint64_t seed;
+};
+
+#define INDEX_SHARD_CAPACITY 16
+
+/**
+ * A set of distinct values split into independently locked shards, so
+ * several threads can insert at once. Entries are picked by the
+ * fingerprint, scrambled with a per index seed, and only values with
+ * equal fingerprints are compared in full. shard_count is rounded up
+ * to a power of two, 0 meaning BIGINT_INDEX_SHARDS.
+ */
+bigint_index* create_bigint_index(uint64_t shard_count) {
+  bigint_index* index = malloc(sizeof(bigint_index));
+  uint64_t i;
+
+  if(shard_count == 0) {
+    shard_count = BIGINT_INDEX_SHARDS;
+  }
+  for(index->shard_count = 1; index->shard_count < shard_count; index->shard_count <<= 1);
+  if(!_system_random(&index->seed, 1, NULL)) {
+    index->seed = _hash_step;
+  }
+  index->shards = malloc(index->shard_count * sizeof(index_shard));
+  for(i = 0; i < index->shard_count; i++) {
+    pthread_mutex_init(&index->shards[i].lock, NULL);
+    index->shards[i].capacity = INDEX_SHARD_CAPACITY;
+    index->shards[i].count = 0;
+    index->shards[i].entries = calloc(INDEX_SHARD_CAPACITY, sizeof(index_entry));
+  }
+  return index;
+}
+
+/**
+ * Frees the index along with every value it holds
+ */
+void free_bigint_index(bigint_index* index) {
+  uint64_t i, j;
+  for(i = 0; i < index->shard_count; i++) {
+    for(j = 0; j < index->shards[i].capacity; j++) {
+      if(index->shards[i].entries[j].value != NULL) {
+	free_bigint(index->shards[i].entries[j].value);
       }
-      running = running || scratch_prime[i];
-      //?
     }
+    free(index->shards[i].entries);
+    pthread_mutex_destroy(&index->shards[i].lock);
+  }
+  free(index->shards);
+  free(index);
+}
 
-    temp = malloc(sizeof(eulers_node));
-    temp->prev = curr;
-    temp->value = digit_map[rem];
+/**
+ * The shard for a fingerprint comes from the high bits of its
+ * scrambled form and the slot from the low ones
+ */
+static index_shard* _index_shard(bigint_index* index, uint64_t fingerprint, uint64_t* mixed) {
+  *mixed = _mix64(fingerprint ^ index->seed);
+  return &index->shards[(*mixed >> 40) & (index->shard_count - 1)];
+}
 
-    curr = temp;
+/**
+ * Linear probing; returns the matching entry, or the empty one ending
+ * the probe. The shard lock must be held.
+ */
+static index_entry* _index_probe(index_shard* shard, uint64_t mixed, uint64_t fingerprint,
+				 bigint* value) {
+  uint64_t mask = shard->capacity - 1, slot;
+  index_entry* entry;
+  for(slot = mixed & mask; ; slot = (slot + 1) & mask) {
+    entry = &shard->entries[slot];
+    if(entry->value == NULL ||
+       (entry->fingerprint == fingerprint && eq_bigint(entry->value, value))) {
+      return entry;
+    }
+  }
+}
 
-    memcpy(scratch, scratch_prime, scratch_size);
-    length++;
+static void _grow_shard(bigint_index* index, index_shard* shard) {
+  index_entry* old = shard->entries;
+  uint64_t old_capacity = shard->capacity, i, mixed;
+  shard->capacity *= 2;
+  shard->entries = calloc(shard->capacity, sizeof(index_entry));
+  for(i = 0; i < old_capacity; i++) {
+    if(old[i].value != NULL) {
+      mixed = _mix64(old[i].fingerprint ^ index->seed);
+      *_index_probe(shard, mixed, old[i].fingerprint, old[i].value) = old[i];
+    }
   }
-  
-  char* output = malloc(sizeof(char) * length);
-  for(i = 0; i < length && curr != NULL; i++) {
-    output[i] = curr->value;
-    temp = curr;
-    curr = curr->prev;
-    free(temp);
+  free(old);
+}
+
+/**
+ * The index's own copy of value, or NULL if it holds none
+ */
+bigint* find_bigint_index(bigint_index* index, bigint* value) {
+  uint64_t fingerprint = fingerprint_bigint(value), mixed;
+  index_shard* shard = _index_shard(index, fingerprint, &mixed);
+  bigint* found;
+  pthread_mutex_lock(&shard->lock);
+  found = _index_probe(shard, mixed, fingerprint, value)->value;
+  pthread_mutex_unlock(&shard->lock);
+  return found;
+}
+
+/**
+ * Adds a normalized copy of value unless an equal one is already held.
+ * Returns the index's copy, valid until free_bigint_index; inserted,
+ * if not NULL, tells which happened.
+ */
+bigint* insert_bigint_index(bigint_index* index, bigint* value, bool* inserted) {
+  uint64_t fingerprint = fingerprint_bigint(value), mixed, size;
+  index_shard* shard = _index_shard(index, fingerprint, &mixed);
+  index_entry* entry;
+  bigint* copy;
+
+  pthread_mutex_lock(&shard->lock);
+  entry = _index_probe(shard, mixed, fingerprint, value);
+  if(entry->value != NULL) {
+    copy = entry->value;
+    pthread_mutex_unlock(&shard->lock);
+    if(inserted != NULL) {
+      *inserted = FALSE;
+    }
+    return copy;
   }
-  
-  free(scratch);
-  free(scratch_prime);
-  return output;
+  //keep the load at most half
+  if(2 * (shard->count + 1) > shard->capacity) {
+    _grow_shard(index, shard);
+    entry = _index_probe(shard, mixed, fingerprint, value);
+  }
+  size = _size_segments(value->data, value->length);
+  copy = create_bigint(calloc(size ? size : 1, sizeof(uint64_t)), size ? size : 1);
+  memcpy(copy->data, value->data, size * sizeof(uint64_t));
+  entry->fingerprint = fingerprint;
+  entry->value = copy;
+  shard->count++;
+  pthread_mutex_unlock(&shard->lock);
+  if(inserted != NULL) {
+    *inserted = TRUE;
+  }
+  return copy;
+}
+
+uint64_t bigint_index_count(bigint_index* index) {
+  uint64_t i, count = 0;
+  for(i = 0; i < index->shard_count; i++) {
+    pthread_mutex_lock(&index->shards[i].lock);
+    count += index->shards[i].count;
+    pthread_mutex_unlock(&index->shards[i].lock);
+  }
+  return count;
+}
+
+///
+/// Residue number systems
+///
+
+/**
+ * (a * b + c) % pre->divisor for a below the divisor. The 128 bit
+ * result stays below divisor * 2^64, so one reciprocal division
+ * reduces it.
+ */
+static inline uint64_t _muladd_mod(uint64_t a, uint64_t b, uint64_t c, nat_divisor* pre) {
+  const byte segment_size_bits = sizeof(uint64_t) * 8;
+  unsigned __int128 t = (unsigned __int128) a * b + c;
+  uint64_t high = t >> segment_size_bits, low = (uint64_t) t, r;
+  if(pre->shift) {
+    high = high << pre->shift | low >> (segment_size_bits - pre->shift);
+    low <<= pre->shift;
+  }
+  _divrem_2by1(&r, high, low, pre->norm, pre->reciprocal);
+  return r >> pre->shift;
+}
+
+/**
+ * a^-1 mod modulus by the extended Euclidean algorithm, 0 when they
+ * are not coprime
+ */
+static uint64_t _invmod_word(uint64_t a, uint64_t modulus) {
+  uint64_t r0 = modulus, r1 = a % modulus, q, r;
+  __int128 s0 = 0, s1 = 1, s;
+  while(r1) {
+    q = r0 / r1;
+    r = r0 - q * r1;
+    r0 = r1;
+    r1 = r;
+    s = s0 - (__int128) q * s1;
+    s0 = s1;
+    s1 = s;
+  }
+  if(r0 != 1) {
+    return 0;
+  }
+  return s0 < 0 ? (uint64_t) (s0 + modulus) : (uint64_t) s0;
+}
+
+/**
+ * Mixed radix digits, sum of digits[j] * (m_0 ... m_{j-1}) over the
+ * first count moduli of base, reduced by pre. Horner from the top.
+ */
+static uint64_t _mixed_radix_mod(uint64_t* digits, uint64_t count, rns_base* base,
+				 nat_divisor* pre) {
+  uint64_t j = count, x = 0;
+  while(j-- > 0) {
+    x = _muladd_mod(x, base->moduli[j], digits[j], pre);
+  }
+  return x;
+}
+
+/**
+ * Garner: the mixed radix digits of the value with the given residues,
+ * digit i being (r_i - digits below it) / (m_0 ... m_{i-1}) mod m_i
+ */
+static void _garner_digits(uint64_t* digits, uint64_t* residues, rns_base* base) {
+  uint64_t i, partial;
+  for(i = 0; i < base->count; i++) {
+    partial = _mixed_radix_mod(digits, i, base, base->divisors + i);
+    digits[i] = _muladd_mod(_mod_sub(residues[i], partial, base->moduli[i]),
+			    base->garner[i], 0, base->divisors + i);
+  }
+}
+
+/**
+ * A base of count pairwise coprime moduli in [2, 2^63), so a sum of two
+ * residues never overflows a word. NULL moduli picks the largest primes
+ * below 2^63, each adding almost 63 bits of range. Returns NULL if the
+ * moduli are out of range or share a factor.
+ */
+rns_base* create_rns_base(uint64_t* moduli, uint64_t count) {
+  const byte segment_size_bits = sizeof(uint64_t) * 8;
+  rns_base* base;
+  uint64_t i, j, candidate, product, carry;
+
+  if(count == 0) {
+    return NULL;
+  }
+  base = malloc(sizeof(rns_base));
+  base->count = count;
+  base->moduli = malloc(count * sizeof(uint64_t));
+  base->divisors = malloc(count * sizeof(nat_divisor));
+  base->garner = malloc(count * sizeof(uint64_t));
+  base->product = malloc((count + 1) * sizeof(uint64_t));
+  base->set = NULL;
+
+  candidate = ((uint64_t) 1 << 63) - 1;
+  for(i = 0; i < count; i++) {
+    if(moduli != NULL) {
+      base->moduli[i] = moduli[i];
+    } else {
+      while(!is_prime_segments(&candidate, 1, 0)) {
+	candidate -= 2;
+      }
+      base->moduli[i] = candidate;
+      candidate -= 2;
+    }
+    if(base->moduli[i] < 2 || base->moduli[i] >> (segment_size_bits - 1)) {
+      free_rns_base(base);
+      return NULL;
+    }
+    init_nat_divisor(base->divisors + i, base->moduli[i]);
+  }
+
+  //(m_0 ... m_{i-1})^-1 mod m_i, which only exists for coprime moduli
+  for(i = 0; i < count; i++) {
+    for(j = 0, product = 1 % base->moduli[i]; j < i; j++) {
+      product = _muladd_mod(product, base->moduli[j], 0, base->divisors + i);
+    }
+    base->garner[i] = _invmod_word(product, base->moduli[i]);
+    if(base->garner[i] == 0) {
+      free_rns_base(base);
+      return NULL;
+    }
+  }
+
+  memset(base->product, 0, (count + 1) * sizeof(uint64_t));
+  base->product[0] = 1;
+  for(i = 0; i < count; i++) {
+    carry = mul_1_segments(base->product, base->product, i + 1, base->moduli[i]);
+    base->product[i+1] = carry;
+  }
+  base->length = _size_segments(base->product, count + 1);
+  base->set = create_nat_divisor_set(base->moduli, count);
+  return base;
+}
+
+void free_rns_base(rns_base* base) {
+  if(base->set != NULL) {
+    free_nat_divisor_set(base->set);
+  }
+  free(base->moduli);
+  free(base->divisors);
+  free(base->garner);
+  free(base->product);
+  free(base);
+}
+
+/**
+ * residues = src mod each modulus of base, base->count of them, in one
+ * pass over src. Values at or above base->product wrap around it.
+ */
+uint64_t* to_rns_segments(uint64_t* residues, uint64_t* src, uint64_t length, rns_base* base) {
+  return mod_multi_segments(residues, src, length, base->set);
+}
+
+/**
+ * dest = the value below base->product with the given residues, in
+ * base->length segments. Garner's digits are expanded with mul_1 and
+ * add_1 on the segments, so the CRT never reduces modulo the product.
+ */
+uint64_t* from_rns_segments(uint64_t* dest, uint64_t* residues, rns_base* base) {
+  uint64_t* digits = malloc(base->count * sizeof(uint64_t));
+  uint64_t i = base->count - 1, used = 1, carry;
+
+  _garner_digits(digits, residues, base);
+  memset(dest, 0, base->length * sizeof(uint64_t));
+  dest[0] = digits[i];
+  //every modulus is below 2^63, so a segment per step is enough room
+  while(i-- > 0) {
+    carry = mul_1_segments(dest, dest, used, base->moduli[i]);
+    if(used < base->length) {
+      dest[used++] = carry;
+    }
+    add_1_segments(dest, used, digits[i]);
+  }
+  free(digits);
+  return dest;
+}
+
+/**
+ * Residues in dest_base of the value below base->product with the
+ * given residues in base. Exact: the value's mixed radix digits are
+ * evaluated by Horner modulo every new modulus at once, with no trip
+ * through segments. dest may not be residues.
+ */
+uint64_t* extend_rns(uint64_t* dest, rns_base* dest_base, uint64_t* residues, rns_base* base) {
+  uint64_t* digits = malloc(base->count * sizeof(uint64_t));
+  uint64_t i, j = base->count;
+  _garner_digits(digits, residues, base);
+  memset(dest, 0, dest_base->count * sizeof(uint64_t));
+  while(j-- > 0) {
+    for(i = 0; i < dest_base->count; i++) {
+      dest[i] = _muladd_mod(dest[i], base->moduli[j], digits[j], dest_base->divisors + i);
+    }
+  }
+  free(digits);
+  return dest;
+}
+
+/**
+ * Element wise arithmetic modulo base->product. Each residue is
+ * independent of the others: no carries, and dest may be a or b.
+ */
+uint64_t* add_rns(uint64_t* dest, uint64_t* a, uint64_t* b, rns_base* base) {
+  uint64_t i;
+  for(i = 0; i < base->count; i++) {
+    dest[i] = _mod_add(a[i], b[i], base->moduli[i]);
+  }
+  return dest;
+}
+
+uint64_t* sub_rns(uint64_t* dest, uint64_t* a, uint64_t* b, rns_base* base) {
+  uint64_t i;
+  for(i = 0; i < base->count; i++) {
+    dest[i] = _mod_sub(a[i], b[i], base->moduli[i]);
+  }
+  return dest;
+}
+
+uint64_t* mul_rns(uint64_t* dest, uint64_t* a, uint64_t* b, rns_base* base) {
+  uint64_t i;
+  for(i = 0; i < base->count; i++) {
+    dest[i] = _muladd_mod(a[i], b[i], 0, base->divisors + i);
+  }
+  return dest;
+}
+
+
+///
+///
+///
+
+static const char* _stat_kernel_names[STAT_KERNEL_COUNT] = {
+  "add", "sub", "shl", "shr", "mul_1", "addmul_1", "submul_1",
+  "divrem_1", "mod_1", "mod_multi", "mul_schoolbook", "div_knuth", "pow",
+  "gcd_binary", "gcd_lehmer", "gcd_hgcd", "invmod", "root_newton",
+  "is_square", "is_power", "mul_bigint", "to_str", "mul_ntt",
+  "mul_karatsuba", "powmod"
+};
+
+bool stats_enabled(void) {
+#ifdef BIGMATH_INSTRUMENT
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+/**
+ * Copies the calling thread's counters into dest. All zero when the
+ * library was built without BIGMATH_INSTRUMENT.
+ */
+bigmath_stats* snapshot_stats(bigmath_stats* dest) {
+#ifdef BIGMATH_INSTRUMENT
+  memcpy(dest, &_stats, sizeof(bigmath_stats));
+#else
+  memset(dest, 0, sizeof(bigmath_stats));
+#endif
+  return dest;
+}
+
+void reset_stats(void) {
+#ifdef BIGMATH_INSTRUMENT
+  memset(&_stats, 0, sizeof(bigmath_stats));
+#endif
+}
+
+const char* stat_kernel_name(stat_kernel kernel) {
+  if(kernel >= STAT_KERNEL_COUNT) {
+    return NULL;
+  }
+  return _stat_kernel_names[kernel];
 }
 
+/**
+ * Installs a process wide trace hook, NULL removes it. Set it before
+ * starting threads that use the library.
+ */
+void set_stats_trace(stat_trace_hook hook, void* context) {
+#ifdef BIGMATH_INSTRUMENT
+  _trace_context = context;
+  _trace_hook = hook;
+#endif
+}
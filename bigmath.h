@@ -15,20 +15,267 @@ typedef struct {
   uint64_t length;
 } bigint;
 
+/**
+ * A word divisor with its normalized form and Moller-Granlund
+ * reciprocal precomputed
+ */
+typedef struct {
+  uint64_t divisor;
+  uint64_t norm;
+  uint64_t reciprocal;
+  byte shift;
+} nat_divisor;
+
+typedef struct {
+  uint64_t count;
+  uint64_t* moduli;
+  nat_divisor* divisors;
+  uint64_t group_count;
+  nat_divisor* groups;
+  uint64_t* group_end;
+} nat_divisor_set;
+
+/**
+ * ISA specific kernel tiers, each adding to the ones below it. The
+ * best one the CPU supports is picked at load; the BIGMATH_CPU
+ * environment variable (portable, bmi2, avx2, avx512) caps it.
+ */
+typedef enum {
+  CPU_PORTABLE,
+  CPU_BMI2,
+  CPU_AVX2,
+  CPU_AVX512,
+  CPU_TIER_COUNT
+} cpu_tier;
+
+#define BIGINT_FORMAT_VERSION 1
+#define BIGINT_HEADER_SIZE 32
+
+/**
+ * A bigint whose segments live in a mapped file, see map_bigint
+ */
+typedef struct {
+  bigint value;
+  bool negative;
+  bool writable;
+  void* base;
+  uint64_t size;
+} bigint_mapping;
+
+//segments per pass of the chunked operations when none is given
+#define CHUNK_DEFAULT_LENGTH (1 << 20)
+
+/**
+ * A bigint in a write_bigint format file, worked on chunk_length
+ * segments at a time with pread and pwrite, see create_chunked_bigint
+ */
+typedef struct {
+  int fd;
+  uint64_t length;
+  uint64_t chunk_length;
+  bool negative;
+} chunked_bigint;
+
+#define SERIES_TERM_LENGTH 2
+
+/**
+ * Term k of a series for sum_series. Each part is SERIES_TERM_LENGTH
+ * segments, least significant first; q is taken as positive.
+ */
+typedef struct {
+  uint64_t a[SERIES_TERM_LENGTH];
+  uint64_t p[SERIES_TERM_LENGTH];
+  uint64_t q[SERIES_TERM_LENGTH];
+  bool a_negative;
+  bool p_negative;
+} series_term;
+
+typedef void (*series_terms)(uint64_t k, series_term* term, void* context);
+
+/**
+ * Result of sum_series: the series is t / q, p is the product of the
+ * p terms
+ */
+typedef struct {
+  bigint* p;
+  bigint* q;
+  bigint* t;
+  bool p_negative;
+  bool t_negative;
+} series_sum;
+
+struct barrett_modulus;
+
+/**
+ * Product tree over a set of moduli, see create_product_tree.
+ * nodes[0] are the moduli and nodes[levels-1][0] their product.
+ */
+typedef struct {
+  uint64_t count;
+  uint64_t levels;
+  uint64_t* level_count;
+  bigint*** nodes;
+  struct barrett_modulus*** reducers;
+} product_tree;
+
+struct montgomery_modulus;
+
+/**
+ * Powers of a fixed base, see create_powmod_table. Row i holds
+ * base^(j 2^(i window)) for j from 1 to 2^window - 1, in Montgomery
+ * form over the significant segments of the modulus.
+ */
+typedef struct {
+  struct montgomery_modulus* modulus;
+  uint64_t length;
+  uint64_t exponent_bits;
+  uint64_t window;
+  uint64_t* powers;
+} powmod_table;
+
+/**
+ * Fills dest with length random segments, FALSE if it could not. The
+ * library never calls one source from two threads at once.
+ */
+typedef bool (*random_source)(uint64_t* dest, uint64_t length, void* context);
+
+typedef enum {
+  EXPR_VALUE,
+  EXPR_WORD,
+  EXPR_ADD,
+  EXPR_SUB,
+  EXPR_MUL
+} expr_op;
+
+#define EXPR_INVALID (~(uint64_t) 0)
+
+/**
+ * A node of a bigint_expr: a leaf reading a bigint or holding a word,
+ * or an operation on two earlier nodes
+ */
+typedef struct {
+  expr_op op;
+  uint64_t left;
+  uint64_t right;
+  bigint* value;
+  uint64_t word;
+} expr_node;
+
+/**
+ * An expression DAG recorded by the expr_ builders, see eval_expr.
+ * Nodes are named by their index and only refer to earlier ones.
+ */
+typedef struct {
+  expr_node* nodes;
+  uint64_t count;
+  uint64_t capacity;
+} bigint_expr;
+
+typedef enum {
+  JOB_QUEUED,
+  JOB_RUNNING,
+  JOB_DONE,
+  JOB_CANCELLED,
+  JOB_FAILED
+} job_state;
+
+typedef struct job_pool job_pool;
+typedef struct bigint_job bigint_job;
+typedef struct bigint_index bigint_index;
+
+typedef void* (*job_function)(bigint_job* job, void* argument);
+typedef void (*job_callback)(bigint_job* job, void* context);
+
+/**
+ * Higher priority jobs start first, equal ones in submission order.
+ * memory is the job's budget in bytes against the pool's limit, 0 for
+ * none; the built in jobs fail rather than start with less than they
+ * need.
+ */
+typedef struct {
+  int priority;
+  uint64_t memory;
+  job_callback callback;
+  void* context;
+} job_options;
+
+/**
+ * Rounding of bigfloat results: to nearest with ties to even, toward
+ * zero, toward -infinity and toward +infinity
+ */
+typedef enum {
+  ROUND_NEAREST,
+  ROUND_ZERO,
+  ROUND_DOWN,
+  ROUND_UP
+} round_mode;
+
+/**
+ * A binary floating point value (-1)^negative * mantissa * 2^exponent.
+ * A non zero mantissa has exactly precision significant bits in length
+ * segments; zero is an all zero mantissa.
+ */
+typedef struct {
+  uint64_t* mantissa;
+  uint64_t length;
+  uint64_t precision;
+  long exponent;
+  bool negative;
+} bigfloat;
+
+/**
+ * A residue number system over count pairwise coprime word moduli,
+ * see create_rns_base. Values below product (length segments) are
+ * held as one residue per modulus, in plain uint64_t arrays.
+ */
+typedef struct {
+  uint64_t count;
+  uint64_t length;
+  uint64_t* moduli;
+  nat_divisor* divisors;
+  nat_divisor_set* set;
+  uint64_t* garner;
+  uint64_t* product;
+} rns_base;
+
 typedef struct {
   struct eulers_node* prev;
   char value;
 } eulers_node;
 
+cpu_tier cpu_tier_supported(void);
+cpu_tier cpu_tier_active(void);
+cpu_tier set_cpu_tier(cpu_tier tier);
+const char* cpu_tier_name(cpu_tier tier);
+
 bigint* create_bigint(uint64_t* segments, uint64_t length);
 bigint* alloc_bigint(uint64_t digits);
 bigint* alloc_bigint_base(uint64_t digits, byte base);
 void free_bigint(bigint* bigint);
 
 
-//TODO:
-//uint64_t* not_segments(uint64_t* dest, uint64_t length);
-//xor_segments?
+uint64_t* and_segments(uint64_t* dest, uint64_t* mask, uint64_t length);
+uint64_t* or_segments(uint64_t* dest, uint64_t* mask, uint64_t length);
+uint64_t* xor_segments(uint64_t* dest, uint64_t* mask, uint64_t length);
+uint64_t* andnot_segments(uint64_t* dest, uint64_t* mask, uint64_t length);
+uint64_t* not_segments(uint64_t* dest, uint64_t length);
+
+uint64_t* and_segments_into(uint64_t* dest, uint64_t* a, uint64_t* b, uint64_t length);
+uint64_t* or_segments_into(uint64_t* dest, uint64_t* a, uint64_t* b, uint64_t length);
+uint64_t* xor_segments_into(uint64_t* dest, uint64_t* a, uint64_t* b, uint64_t length);
+uint64_t* andnot_segments_into(uint64_t* dest, uint64_t* a, uint64_t* b, uint64_t length);
+uint64_t* not_segments_into(uint64_t* dest, uint64_t* src, uint64_t length);
+
+uint64_t popcount_segments(uint64_t* segments, uint64_t length);
+uint64_t xor_popcount_segments(uint64_t* seg1, uint64_t* seg2, uint64_t length);
+
+uint64_t* set_bit_segments(uint64_t* dest, uint64_t length, uint64_t bit);
+uint64_t* clear_bit_segments(uint64_t* dest, uint64_t length, uint64_t bit);
+bool test_bit_segments(uint64_t* segments, uint64_t length, uint64_t bit);
+uint64_t* extract_bits_segments(uint64_t* dest, uint64_t* src, uint64_t length,
+				uint64_t offset, uint64_t count);
+uint64_t* insert_bits_segments(uint64_t* dest, uint64_t length, uint64_t* src,
+			       uint64_t offset, uint64_t count);
 
 uint64_t* shl_segments(uint64_t* dest, uint64_t length, uint64_t offset);
 uint64_t* _shl_segments(uint64_t* dest, uint64_t length, byte offset);
@@ -37,10 +284,112 @@ uint64_t* _shr_segments(uint64_t* dest, uint64_t length, byte offset);
 uint64_t* add_segments(uint64_t* dest, uint64_t* incr, uint64_t length);
 uint64_t* sub_segments(uint64_t* dest, uint64_t* decr, uint64_t length);
 uint64_t* mul_segments(uint64_t* dest, uint64_t* scale, uint64_t length);
+uint64_t* mul_full_segments(uint64_t* dest, uint64_t* a, uint64_t a_length,
+			    uint64_t* b, uint64_t b_length);
+uint64_t mul_1_segments(uint64_t* dest, uint64_t* src, uint64_t length, uint64_t scale);
+uint64_t addmul_1_segments(uint64_t* dest, uint64_t* src, uint64_t length, uint64_t scale);
+uint64_t submul_1_segments(uint64_t* dest, uint64_t* src, uint64_t length, uint64_t scale);
+uint64_t add_1_segments(uint64_t* dest, uint64_t length, uint64_t incr);
+uint64_t sub_1_segments(uint64_t* dest, uint64_t length, uint64_t decr);
+uint64_t divrem_1_segments(uint64_t* dest, uint64_t* src, uint64_t length, uint64_t divisor);
+uint64_t mod_1_segments(uint64_t* src, uint64_t length, uint64_t divisor);
+uint64_t reciprocal_word(uint64_t divisor);
+
+void init_nat_divisor(nat_divisor* pre, uint64_t divisor);
+nat_divisor* create_nat_divisor(uint64_t divisor);
+void free_nat_divisor(nat_divisor* pre);
+uint64_t divrem_pre_segments(uint64_t* dest, uint64_t* src, uint64_t length,
+			     nat_divisor* pre);
+uint64_t mod_pre_segments(uint64_t* src, uint64_t length, nat_divisor* pre);
+
+nat_divisor_set* create_nat_divisor_set(uint64_t* moduli, uint64_t count);
+void free_nat_divisor_set(nat_divisor_set* set);
+uint64_t* mod_multi_segments(uint64_t* residues, uint64_t* src, uint64_t length,
+			     nat_divisor_set* set);
 uint64_t* div_segments(uint64_t* dest, uint64_t* divisor, uint64_t length);
 uint64_t* div_segments_mod(uint64_t* dest, uint64_t* divisor, uint64_t length);
 
 uint64_t* pow_segments(uint64_t* dest, uint64_t power, uint64_t length);
+uint64_t* powmod_segments(uint64_t* dest, uint64_t* exponent, uint64_t exponent_length,
+			  uint64_t* modulus, uint64_t length);
+uint64_t* multi_powmod_segments(uint64_t* dest, uint64_t** bases, uint64_t** exponents,
+				uint64_t exponent_length, uint64_t count,
+				uint64_t* modulus, uint64_t length);
+powmod_table* create_powmod_table(uint64_t* base, uint64_t* modulus, uint64_t length,
+				  uint64_t exponent_bits, uint64_t window);
+void free_powmod_table(powmod_table* table);
+uint64_t* powmod_table_segments(uint64_t* dest, uint64_t* exponent, uint64_t exponent_length,
+				powmod_table* table);
+
+//full products switch from schoolbook to Karatsuba, then to NTT, once
+//the shorter operand has this many segments
+#ifndef MUL_KARATSUBA_THRESHOLD
+#define MUL_KARATSUBA_THRESHOLD 32
+#endif
+#ifndef MUL_NTT_THRESHOLD
+#define MUL_NTT_THRESHOLD 3072
+#endif
+
+//binary splitting multiplies this many words in a row at the leaves;
+//a subtree gets its own thread from this many words in a product of
+//words, segments in a product of bigints, or terms of a series
+#ifndef SPLIT_LEAF_LENGTH
+#define SPLIT_LEAF_LENGTH 16
+#endif
+#ifndef SPLIT_THREAD_WORDS
+#define SPLIT_THREAD_WORDS 1024
+#endif
+#ifndef SPLIT_THREAD_SEGMENTS
+#define SPLIT_THREAD_SEGMENTS 1024
+#endif
+#ifndef SPLIT_THREAD_TERMS
+#define SPLIT_THREAD_TERMS 1024
+#endif
+
+//primality tests trial divide by the primes up to PRIME_TRIAL_LIMIT;
+//random primes sieve windows of PRIME_SIEVE_WINDOW odd candidates by
+//the primes up to PRIME_SIEVE_LIMIT
+#ifndef PRIME_TRIAL_LIMIT
+#define PRIME_TRIAL_LIMIT 1024
+#endif
+#ifndef PRIME_SIEVE_LIMIT
+#define PRIME_SIEVE_LIMIT 65536
+#endif
+#ifndef PRIME_SIEVE_WINDOW
+#define PRIME_SIEVE_WINDOW 4096
+#endif
+
+//built in jobs on operands up to this many segments run on the
+//submitting thread
+#ifndef JOB_INLINE_LENGTH
+#define JOB_INLINE_LENGTH 64
+#endif
+
+//independently locked shards of a bigint_index created with 0 shards
+#ifndef BIGINT_INDEX_SHARDS
+#define BIGINT_INDEX_SHARDS 64
+#endif
+
+//operands up to this many segments use binary gcd, larger ones Lehmer
+#ifndef GCD_LEHMER_THRESHOLD
+#define GCD_LEHMER_THRESHOLD 3
+#endif
+
+//above this many segments gcds step by half gcds built on full products
+#ifndef GCD_HGCD_THRESHOLD
+#define GCD_HGCD_THRESHOLD 100
+#endif
+
+uint64_t* gcd_segments(uint64_t* dest, uint64_t* other, uint64_t length);
+uint64_t* gcdext_segments(uint64_t* dest, uint64_t* cofactor, uint64_t* other,
+			  uint64_t length);
+uint64_t* invmod_segments(uint64_t* dest, uint64_t* modulus, uint64_t length);
+
+uint64_t* sqrt_segments(uint64_t* dest, uint64_t length);
+uint64_t* root_segments(uint64_t* dest, uint64_t k, uint64_t length);
+bool is_square_segments(uint64_t* segments, uint64_t length);
+bool is_power_segments(uint64_t* segments, uint64_t length);
+bool is_prime_segments(uint64_t* segments, uint64_t length, uint64_t rounds);
 
 bool eq(uint64_t* seg1, uint64_t* seg2, uint64_t length);
 bool gt(uint64_t* seg1, uint64_t* seg2, uint64_t length);
@@ -65,6 +414,31 @@ void print_bigint(bigint* bigint);
 void print_bigint_base(bigint* bigint, byte base);
 void print_bigint_hex(bigint* bigint);
 
+bigint* write_bigint(FILE* file, bigint* value, bool negative);
+bigint* read_bigint(FILE* file, bool* negative);
+bigint_mapping* map_bigint(const char* path, bool writable, bool verify);
+void unmap_bigint(bigint_mapping* mapping);
+
+uint64_t* import_segments(uint64_t* dest, uint64_t length, const byte* src,
+			  uint64_t count, uint64_t size, int order, int endian);
+uint64_t export_segments(byte* dest, uint64_t* src, uint64_t length, uint64_t size,
+			 int order, int endian);
+bigint* import_bigint(const byte* src, uint64_t count, uint64_t size, int order,
+		      int endian);
+uint64_t export_bigint(byte* dest, bigint* value, uint64_t size, int order, int endian);
+powmod_table* write_powmod_table(FILE* file, powmod_table* table);
+powmod_table* read_powmod_table(FILE* file);
+
+chunked_bigint* create_chunked_bigint(const char* path, uint64_t length,
+				      uint64_t chunk_length);
+chunked_bigint* open_chunked_bigint(const char* path, uint64_t chunk_length, bool verify);
+void close_chunked_bigint(chunked_bigint* value);
+chunked_bigint* add_chunked(chunked_bigint* dest, chunked_bigint* incr);
+chunked_bigint* shl_chunked(chunked_bigint* dest, uint64_t offset);
+chunked_bigint* shr_chunked(chunked_bigint* dest, uint64_t offset);
+chunked_bigint* mul_1_chunked(chunked_bigint* dest, uint64_t scale);
+chunked_bigint* mul_chunked(chunked_bigint* dest, chunked_bigint* a, chunked_bigint* b);
+
 ///
 
 bigint* shl_bigint(bigint* dest, byte offset);
@@ -73,13 +447,177 @@ bigint* shr_bigint(bigint* dest, byte offset);
 bigint* add_bigint(bigint* dest, bigint* offset);
 bigint* sub_bigint(bigint* dest, bigint* offset);
 
+bigint* and_bigint(bigint* dest, bigint* mask);
+bigint* or_bigint(bigint* dest, bigint* mask);
+bigint* xor_bigint(bigint* dest, bigint* mask);
+bigint* andnot_bigint(bigint* dest, bigint* mask);
+bigint* not_bigint(bigint* dest);
+
+bigint* set_bit_bigint(bigint* dest, uint64_t bit);
+bigint* clear_bit_bigint(bigint* dest, uint64_t bit);
+bool test_bit_bigint(bigint* value, uint64_t bit);
+
+bigint* gcd_bigint(bigint* dest, bigint* other);
+bigint* invmod_bigint(bigint* dest, bigint* modulus);
+bigint* powmod_bigint(bigint* dest, bigint* exponent, bigint* modulus);
+
+bigint* sqrt_bigint(bigint* dest);
+bigint* root_bigint(bigint* dest, uint64_t k);
+bool is_square_bigint(bigint* value);
+bool is_power_bigint(bigint* value);
+bool is_prime_bigint(bigint* value, uint64_t rounds);
+
 bigint* mul_bigint(bigint* dest, bigint* scale);
 bigint* mul_bigint_nat(bigint* dest, uint64_t scale);
+bigint* add_bigint_nat(bigint* dest, uint64_t incr);
+bigint* sub_bigint_nat(bigint* dest, uint64_t decr);
 
 bigint* div_bigint(bigint* dest, bigint* divisor);
 bigint* div_bigint_nat(bigint* dest, uint64_t divisor);
+uint64_t mod_bigint_nat(bigint* value, uint64_t divisor);
+bigint** div_bigints_pre(bigint** values, uint64_t count, nat_divisor* pre,
+			 uint64_t* remainders);
+uint64_t* mod_bigints_pre(uint64_t* remainders, bigint** values, uint64_t count,
+			  nat_divisor* pre);
+
+uint64_t set_split_threads(uint64_t threads);
+bigint* factorial_bigint(uint64_t n);
+bigint* binomial_bigint(uint64_t n, uint64_t k);
+bigint* primorial_bigint(uint64_t n);
+bigint* product_bigints(bigint** values, uint64_t count);
+series_sum* sum_series(series_terms terms, uint64_t count, void* context);
+void free_series_sum(series_sum* sum);
+
+product_tree* create_product_tree(bigint** moduli, uint64_t count);
+void free_product_tree(product_tree* tree);
+bigint** mod_product_tree(bigint** remainders, bigint* value, product_tree* tree);
+bigint** batch_gcd(bigint** gcds, bigint** values, uint64_t count, bool streaming);
+
+uint64_t set_prime_threads(uint64_t threads);
+bigint* random_prime_bigint(uint64_t bits, uint64_t rounds, random_source source,
+			    void* context);
+
+bigint_expr* create_expr(void);
+void free_expr(bigint_expr* expr);
+uint64_t expr_value(bigint_expr* expr, bigint* value);
+uint64_t expr_word(bigint_expr* expr, uint64_t word);
+uint64_t expr_add(bigint_expr* expr, uint64_t left, uint64_t right);
+uint64_t expr_sub(bigint_expr* expr, uint64_t left, uint64_t right);
+uint64_t expr_mul(bigint_expr* expr, uint64_t left, uint64_t right);
+bigint* eval_expr(bigint_expr* expr, uint64_t root, bool* negative);
+
+job_pool* create_job_pool(uint64_t threads, uint64_t memory_limit);
+void free_job_pool(job_pool* pool);
+int job_pool_fd(job_pool* pool);
+bigint_job* submit_job(job_pool* pool, job_function function, void* argument,
+		       job_options* options);
+bigint_job* submit_pow_job(job_pool* pool, uint64_t* dest, uint64_t power, uint64_t length,
+			   job_options* options);
+bigint_job* submit_to_str_job(job_pool* pool, bigint* value, byte base,
+			      job_options* options);
+bool cancel_job(bigint_job* job);
+bool job_cancelled(bigint_job* job);
+job_state poll_job(bigint_job* job);
+void* wait_job(bigint_job* job);
+void free_job(bigint_job* job);
+
+bigfloat* create_bigfloat(uint64_t precision);
+void free_bigfloat(bigfloat* value);
+bigfloat* set_bigfloat(bigfloat* dest, bigfloat* src, round_mode mode);
+bigfloat* set_bigfloat_bigint(bigfloat* dest, bigint* value, bool negative, round_mode mode);
+bigfloat* set_bigfloat_double(bigfloat* dest, double value, round_mode mode);
+double bigfloat_to_double(bigfloat* value);
+bigint* bigfloat_to_bigint(bigfloat* value, bool* negative, round_mode mode);
+int cmp_bigfloat(bigfloat* a, bigfloat* b);
+bigfloat* add_bigfloat(bigfloat* dest, bigfloat* a, bigfloat* b, round_mode mode);
+bigfloat* sub_bigfloat(bigfloat* dest, bigfloat* a, bigfloat* b, round_mode mode);
+bigfloat* mul_bigfloat(bigfloat* dest, bigfloat* a, bigfloat* b, round_mode mode);
+bigfloat* div_bigfloat(bigfloat* dest, bigfloat* a, bigfloat* b, round_mode mode);
+bigfloat* sqrt_bigfloat(bigfloat* dest, bigfloat* a, round_mode mode);
+bigfloat* ldexp_bigfloat(bigfloat* dest, long offset);
+
+bigint* normalize_bigint(bigint* value);
+bool eq_bigint(bigint* a, bigint* b);
+uint64_t hash_segments(uint64_t* segments, uint64_t length, uint64_t seed);
+uint64_t hash_bigint(bigint* value, uint64_t seed);
+uint64_t fingerprint_segments(uint64_t* segments, uint64_t length);
+uint64_t fingerprint_bigint(bigint* value);
+bigint_index* create_bigint_index(uint64_t shard_count);
+void free_bigint_index(bigint_index* index);
+bigint* find_bigint_index(bigint_index* index, bigint* value);
+bigint* insert_bigint_index(bigint_index* index, bigint* value, bool* inserted);
+uint64_t bigint_index_count(bigint_index* index);
 
+rns_base* create_rns_base(uint64_t* moduli, uint64_t count);
+void free_rns_base(rns_base* base);
+uint64_t* to_rns_segments(uint64_t* residues, uint64_t* src, uint64_t length, rns_base* base);
+uint64_t* from_rns_segments(uint64_t* dest, uint64_t* residues, rns_base* base);
+uint64_t* extend_rns(uint64_t* dest, rns_base* dest_base, uint64_t* residues, rns_base* base);
+uint64_t* add_rns(uint64_t* dest, uint64_t* a, uint64_t* b, rns_base* base);
+uint64_t* sub_rns(uint64_t* dest, uint64_t* a, uint64_t* b, rns_base* base);
+uint64_t* mul_rns(uint64_t* dest, uint64_t* a, uint64_t* b, rns_base* base);
 
 
 
 
+
+
+///
+
+/**
+ * Kernels and algorithm tiers counted when the library is built with
+ * -DBIGMATH_INSTRUMENT. Counters are inclusive: a tier that calls
+ * another kernel is charged for its cycles too.
+ */
+typedef enum {
+  STAT_ADD,
+  STAT_SUB,
+  STAT_SHL,
+  STAT_SHR,
+  STAT_MUL_1,
+  STAT_ADDMUL_1,
+  STAT_SUBMUL_1,
+  STAT_DIVREM_1,
+  STAT_MOD_1,
+  STAT_MOD_MULTI,
+  STAT_MUL_SCHOOLBOOK,
+  STAT_DIV_KNUTH,
+  STAT_POW,
+  STAT_GCD_BINARY,
+  STAT_GCD_LEHMER,
+  STAT_GCD_HGCD,
+  STAT_INVMOD,
+  STAT_ROOT_NEWTON,
+  STAT_IS_SQUARE,
+  STAT_IS_POWER,
+  STAT_MUL_BIGINT,
+  STAT_TO_STR,
+  STAT_MUL_NTT,
+  STAT_MUL_KARATSUBA,
+  STAT_POWMOD,
+  STAT_KERNEL_COUNT
+} stat_kernel;
+
+typedef struct {
+  uint64_t calls;
+  uint64_t limbs;
+  uint64_t cycles;
+  uint64_t bytes;
+} kernel_stats;
+
+typedef struct {
+  kernel_stats kernels[STAT_KERNEL_COUNT];
+} bigmath_stats;
+
+/**
+ * Called after every counted kernel on the thread that ran it, with the
+ * limbs it processed and the cycles it took
+ */
+typedef void (*stat_trace_hook)(stat_kernel kernel, uint64_t limbs,
+				uint64_t cycles, void* context);
+
+bool stats_enabled(void);
+bigmath_stats* snapshot_stats(bigmath_stats* dest);
+void reset_stats(void);
+const char* stat_kernel_name(stat_kernel kernel);
+void set_stats_trace(stat_trace_hook hook, void* context);
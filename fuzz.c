@@ -0,0 +1,1186 @@
+#include "bigmath.h"
+#include <time.h>
+#include <math.h>
+
+/**
+ * Differential fuzzing harness.
+ *
+ * Every kernel is run against a deliberately naive reference (bit by
+ * bit shifts and division, word schoolbook multiplication, Stein's gcd
+ * one bit at a time) and against algebraic identities: q * d + r = n,
+ * (a * b) / b = a, r^k <= x < (r + 1)^k, s * a = gcd (mod m), and
+ * format/parse round trips. Operand lengths are drawn mostly from
+ * around the points where an algorithm tier changes
+ * (GCD_LEHMER_THRESHOLD, single segment divisors) and operands take
+ * edge shapes: all ones, single bits, 2^k - 1, zero top segments and
+ * normalized divisors. Full products are fuzzed up to WIDE_LIMBS, past
+ * the Karatsuba and NTT thresholds; powmod against square and multiply,
+ * bigfloat against the hardware's doubles, and residue number systems
+ * against reduction by the product of their moduli. The half gcd starts
+ * above MAX_LIMBS; build the library with a small GCD_HGCD_THRESHOLD
+ * (make fuzz DEFINES=-DGCD_HGCD_THRESHOLD=8) to fuzz it.
+ *
+ * libFuzzer:
+ *   clang -fsanitize=fuzzer -DBIGMATH_LIBFUZZER fuzz.c bigmath.c
+ * standalone (make fuzz):
+ *   ./fuzz [--iterations n] [--seed s] [input files...]
+ *
+ * Standalone runs replay the given files, or feed random inputs from
+ * the seed. The first mismatch prints the operation, its operands and
+ * aborts.
+ */
+
+#define MAX_LIMBS 64
+#define WORK_LIMBS (2 * MAX_LIMBS + 2)
+#define WIDE_LIMBS (MUL_NTT_THRESHOLD + 64)
+
+typedef struct {
+  const byte* data;
+  size_t size;
+  size_t pos;
+} fuzz_input;
+
+static const char* current_op;
+static uint64_t current_a[WIDE_LIMBS];
+static uint64_t current_b[WIDE_LIMBS];
+static bool current_has_a;
+static bool current_has_b;
+static uint64_t current_length;
+
+///
+/// input decoding
+///
+
+static byte take_byte(fuzz_input* in) {
+  return in->pos < in->size ? in->data[in->pos++] : 0;
+}
+
+static uint64_t take_word(fuzz_input* in) {
+  uint64_t word = 0;
+  byte i;
+  for(i = 0; i < sizeof(uint64_t); i++) {
+    word |= (uint64_t) take_byte(in) << (8 * i);
+  }
+  return word;
+}
+
+/**
+ * Operand lengths, weighted towards tier boundaries
+ */
+static uint64_t take_length(fuzz_input* in) {
+  static const uint64_t boundaries[] = {
+    1, 2, 3, GCD_LEHMER_THRESHOLD - 1, GCD_LEHMER_THRESHOLD,
+    GCD_LEHMER_THRESHOLD + 1, GCD_LEHMER_THRESHOLD + 2, 8, 16, 17, 32, MAX_LIMBS
+  };
+  byte choice = take_byte(in);
+  uint64_t length;
+  if(choice < 192) {
+    length = boundaries[choice % (sizeof(boundaries) / sizeof(uint64_t))];
+  } else {
+    length = 1 + choice % MAX_LIMBS;
+  }
+  return length == 0 ? 1 : length;
+}
+
+static void take_operand(fuzz_input* in, uint64_t* dest, uint64_t length) {
+  const byte segment_size_bits = sizeof(uint64_t) * 8;
+  byte shape = take_byte(in);
+  uint64_t i, bit, size = 1 + take_byte(in) % length;
+
+  memset(dest, 0, length * sizeof(uint64_t));
+  switch(shape % 7) {
+  case 0:
+  case 1:
+    //size significant segments of raw input
+    for(i = 0; i < size; i++) {
+      dest[i] = take_word(in);
+    }
+    break;
+  case 2:
+    for(i = 0; i < size; i++) {
+      dest[i] = ~(uint64_t) 0;
+    }
+    break;
+  case 3:
+  case 4:
+    //2^bit, or 2^bit - 1
+    bit = take_word(in) % (length * segment_size_bits);
+    set_bit_segments(dest, length, bit);
+    if(shape % 7 == 4) {
+      sub_1_segments(dest, length, 1);
+    }
+    break;
+  case 5:
+    //normalized top segment, the Knuth D worst case
+    for(i = 0; i < size; i++) {
+      dest[i] = take_word(in);
+    }
+    dest[size-1] |= (uint64_t) 1 << (segment_size_bits - 1);
+    break;
+  case 6:
+    dest[0] = take_byte(in);
+    break;
+  }
+}
+
+/**
+ * Lengths for the full product, around where _mul_full changes tier:
+ * schoolbook, unbalanced, Karatsuba and NTT
+ */
+static uint64_t take_wide_length(fuzz_input* in) {
+  static const uint64_t boundaries[] = {
+    1, MUL_KARATSUBA_THRESHOLD - 1, MUL_KARATSUBA_THRESHOLD, MUL_KARATSUBA_THRESHOLD + 1,
+    2 * MUL_KARATSUBA_THRESHOLD - 1, 2 * MUL_KARATSUBA_THRESHOLD + 1, 4 * MUL_KARATSUBA_THRESHOLD,
+    MUL_NTT_THRESHOLD - 1, MUL_NTT_THRESHOLD, MUL_NTT_THRESHOLD + 1, WIDE_LIMBS
+  };
+  byte choice = take_byte(in);
+  uint64_t length;
+  if(choice < 160) {
+    length = boundaries[choice % (sizeof(boundaries) / sizeof(uint64_t))];
+  } else if(choice < 240) {
+    length = 1 + take_word(in) % (8 * MUL_KARATSUBA_THRESHOLD);
+  } else {
+    length = 1 + take_word(in) % WIDE_LIMBS;
+  }
+  return length > WIDE_LIMBS ? WIDE_LIMBS : length;
+}
+
+/**
+ * Operands too long to come from the input are spun out of a seed from
+ * it, in the same edge shapes
+ */
+static void take_wide_operand(fuzz_input* in, uint64_t* dest, uint64_t length) {
+  byte shape = take_byte(in);
+  uint64_t state = take_word(in) | 1, i;
+
+  for(i = 0; i < length; i++) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    switch(shape % 4) {
+    case 0:
+      dest[i] = state;
+      break;
+    case 1:
+      dest[i] = ~(uint64_t) 0;
+      break;
+    case 2:
+      //sparse, with runs of zero segments
+      dest[i] = state % 5 ? 0 : (uint64_t) 1 << (state >> 58);
+      break;
+    case 3:
+      //the top quarter zero
+      dest[i] = 4 * i < 3 * length ? state : 0;
+      break;
+    }
+  }
+}
+
+///
+/// reporting
+///
+
+static void print_segments(const char* name, uint64_t* segments, uint64_t length) {
+  uint64_t i;
+  fprintf(stderr, "  %s = 0x", name);
+  for(i = length; i-- > 0;) {
+    fprintf(stderr, "%016lx", segments[i]);
+  }
+  fprintf(stderr, "\n");
+}
+
+static void fail(const char* condition, int line) {
+  fprintf(stderr, "mismatch in %s (line %d): %s\n", current_op, line, condition);
+  fprintf(stderr, "  length = %lu\n", current_length);
+  if(current_has_a) {
+    print_segments("a", current_a, current_length);
+  }
+  if(current_has_b) {
+    print_segments("b", current_b, current_length);
+  }
+  abort();
+}
+
+#define CHECK(cond) do { if(!(cond)) fail(#cond, __LINE__); } while(0)
+
+/**
+ * Operands are copied for the report, the callers' arrays being gone
+ * by the time a later op fails
+ */
+static void begin_op(const char* op, uint64_t* a, uint64_t* b, uint64_t length) {
+  current_op = op;
+  current_has_a = a != NULL;
+  current_has_b = b != NULL;
+  current_length = length;
+  if(a) {
+    memcpy(current_a, a, length * sizeof(uint64_t));
+  }
+  if(b) {
+    memcpy(current_b, b, length * sizeof(uint64_t));
+  }
+}
+
+///
+/// reference implementations
+///
+
+static uint64_t ref_size(uint64_t* a, uint64_t n) {
+  while(n && a[n-1] == 0) {
+    n--;
+  }
+  return n;
+}
+
+static int ref_cmp(uint64_t* a, uint64_t* b, uint64_t n) {
+  uint64_t i;
+  for(i = n; i-- > 0;) {
+    if(a[i] != b[i]) {
+      return a[i] > b[i] ? 1 : -1;
+    }
+  }
+  return 0;
+}
+
+static bool ref_is_zero(uint64_t* a, uint64_t n) {
+  return ref_size(a, n) == 0;
+}
+
+static uint64_t ref_add(uint64_t* dest, uint64_t* a, uint64_t* b, uint64_t n) {
+  unsigned __int128 sum;
+  uint64_t i, carry = 0;
+  for(i = 0; i < n; i++) {
+    sum = (unsigned __int128) a[i] + b[i] + carry;
+    dest[i] = (uint64_t) sum;
+    carry = sum >> 64;
+  }
+  return carry;
+}
+
+static uint64_t ref_sub(uint64_t* dest, uint64_t* a, uint64_t* b, uint64_t n) {
+  uint64_t i, borrow = 0, next;
+  for(i = 0; i < n; i++) {
+    next = a[i] < b[i] || (a[i] == b[i] && borrow);
+    dest[i] = a[i] - b[i] - borrow;
+    borrow = next;
+  }
+  return borrow;
+}
+
+/**
+ * dest[0..alen+blen) = a * b, dest may not alias
+ */
+static void ref_mul(uint64_t* dest, uint64_t* a, uint64_t alen, uint64_t* b, uint64_t blen) {
+  unsigned __int128 t;
+  uint64_t i, j, carry;
+  memset(dest, 0, (alen + blen) * sizeof(uint64_t));
+  for(i = 0; i < alen; i++) {
+    carry = 0;
+    for(j = 0; j < blen; j++) {
+      t = (unsigned __int128) a[i] * b[j] + dest[i+j] + carry;
+      dest[i+j] = (uint64_t) t;
+      carry = t >> 64;
+    }
+    dest[i+blen] = carry;
+  }
+}
+
+static bool ref_bit(uint64_t* a, uint64_t bit) {
+  return (a[bit / 64] >> (bit % 64)) & 0x1;
+}
+
+static void ref_shl1(uint64_t* a, uint64_t n, bool in) {
+  uint64_t i, out;
+  for(i = 0; i < n; i++) {
+    out = a[i] >> 63;
+    a[i] = a[i] << 1 | in;
+    in = out;
+  }
+}
+
+static void ref_shr1(uint64_t* a, uint64_t n) {
+  uint64_t i;
+  for(i = 0; i < n; i++) {
+    a[i] = a[i] >> 1 | (i + 1 < n ? a[i+1] << 63 : 0);
+  }
+}
+
+/**
+ * Restoring division one bit at a time. q has n segments, r has dn.
+ */
+static void ref_divmod(uint64_t* q, uint64_t* r, uint64_t* num, uint64_t n,
+		       uint64_t* d, uint64_t dn) {
+  uint64_t acc[WORK_LIMBS], den[WORK_LIMBS], bit;
+  memset(acc, 0, sizeof(acc));
+  memset(den, 0, sizeof(den));
+  memcpy(den, d, dn * sizeof(uint64_t));
+  if(q) {
+    memset(q, 0, n * sizeof(uint64_t));
+  }
+  for(bit = n * 64; bit-- > 0;) {
+    ref_shl1(acc, dn + 1, ref_bit(num, bit));
+    if(ref_cmp(acc, den, dn + 1) >= 0) {
+      ref_sub(acc, acc, den, dn + 1);
+      if(q) {
+	q[bit / 64] |= (uint64_t) 1 << (bit % 64);
+      }
+    }
+  }
+  memcpy(r, acc, dn * sizeof(uint64_t));
+}
+
+/**
+ * Stein's gcd, one bit per step
+ */
+static void ref_gcd(uint64_t* dest, uint64_t* a, uint64_t* b, uint64_t n) {
+  uint64_t u[MAX_LIMBS], v[MAX_LIMBS], t[MAX_LIMBS], shift, i;
+  memcpy(u, a, n * sizeof(uint64_t));
+  memcpy(v, b, n * sizeof(uint64_t));
+  if(ref_is_zero(u, n) || ref_is_zero(v, n)) {
+    ref_add(dest, u, v, n);
+    return;
+  }
+  for(shift = 0; !ref_bit(u, 0) && !ref_bit(v, 0); shift++) {
+    ref_shr1(u, n);
+    ref_shr1(v, n);
+  }
+  while(!ref_bit(u, 0)) {
+    ref_shr1(u, n);
+  }
+  while(!ref_is_zero(v, n)) {
+    while(!ref_bit(v, 0)) {
+      ref_shr1(v, n);
+    }
+    if(ref_cmp(u, v, n) > 0) {
+      memcpy(t, u, n * sizeof(uint64_t));
+      memcpy(u, v, n * sizeof(uint64_t));
+      memcpy(v, t, n * sizeof(uint64_t));
+    }
+    ref_sub(v, v, u, n);
+  }
+  memcpy(dest, u, n * sizeof(uint64_t));
+  for(i = 0; i < shift; i++) {
+    ref_shl1(dest, n, 0);
+  }
+}
+
+/**
+ * base^k into dest (cap segments). FALSE if it does not fit.
+ */
+static bool ref_pow(uint64_t* dest, uint64_t* base, uint64_t n, uint64_t k, uint64_t cap) {
+  uint64_t acc[WORK_LIMBS], product[2 * WORK_LIMBS], i, size;
+  memset(acc, 0, sizeof(acc));
+  acc[0] = 1;
+  for(i = 0; i < k; i++) {
+    size = ref_size(acc, cap);
+    size = size ? size : 1;
+    ref_mul(product, acc, size, base, n);
+    size = ref_size(product, size + n);
+    if(size > cap) {
+      return FALSE;
+    }
+    memset(acc, 0, sizeof(acc));
+    memcpy(acc, product, size * sizeof(uint64_t));
+  }
+  memcpy(dest, acc, cap * sizeof(uint64_t));
+  return TRUE;
+}
+
+/**
+ * base^exponent mod modulus by square and multiply, modulus non zero.
+ * All but the exponent have n segments.
+ */
+static void ref_powmod(uint64_t* dest, uint64_t* base, uint64_t* exponent,
+		       uint64_t exponent_length, uint64_t* modulus, uint64_t n) {
+  uint64_t acc[MAX_LIMBS], x[MAX_LIMBS], product[2 * MAX_LIMBS], bit;
+  memset(x, 0, sizeof(x));
+  x[0] = 1;
+  ref_divmod(NULL, acc, x, n, modulus, n);
+  ref_divmod(NULL, x, base, n, modulus, n);
+  for(bit = exponent_length * 64; bit-- > 0;) {
+    ref_mul(product, acc, n, acc, n);
+    ref_divmod(NULL, acc, product, 2 * n, modulus, n);
+    if(ref_bit(exponent, bit)) {
+      ref_mul(product, acc, n, x, n);
+      ref_divmod(NULL, acc, product, 2 * n, modulus, n);
+    }
+  }
+  memcpy(dest, acc, n * sizeof(uint64_t));
+}
+
+static uint64_t ref_gcd_word(uint64_t a, uint64_t b) {
+  uint64_t t;
+  while(b) {
+    t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+///
+/// properties
+///
+
+static void fuzz_add_sub(uint64_t* a, uint64_t* b, uint64_t n) {
+  uint64_t x[MAX_LIMBS], expect[MAX_LIMBS];
+  begin_op("add/sub_segments", a, b, n);
+
+  memcpy(x, a, n * sizeof(uint64_t));
+  add_segments(x, b, n);
+  ref_add(expect, a, b, n);
+  CHECK(ref_cmp(x, expect, n) == 0);
+  sub_segments(x, b, n);
+  CHECK(ref_cmp(x, a, n) == 0);
+
+  sub_segments(x, b, n);
+  ref_sub(expect, a, b, n);
+  CHECK(ref_cmp(x, expect, n) == 0);
+}
+
+static void fuzz_shift(uint64_t* a, uint64_t n, uint64_t offset) {
+  uint64_t x[MAX_LIMBS], expect[MAX_LIMBS], i;
+  begin_op("shl/shr_segments", a, NULL, n);
+  offset %= n * 64 + 1;
+
+  memcpy(x, a, n * sizeof(uint64_t));
+  memcpy(expect, a, n * sizeof(uint64_t));
+  shl_segments(x, n, offset);
+  for(i = 0; i < offset; i++) {
+    ref_shl1(expect, n, 0);
+  }
+  CHECK(ref_cmp(x, expect, n) == 0);
+
+  memcpy(x, a, n * sizeof(uint64_t));
+  memcpy(expect, a, n * sizeof(uint64_t));
+  shr_segments(x, n, offset);
+  for(i = 0; i < offset; i++) {
+    ref_shr1(expect, n);
+  }
+  CHECK(ref_cmp(x, expect, n) == 0);
+}
+
+static void fuzz_bitwise(uint64_t* a, uint64_t* b, uint64_t n, uint64_t offset, uint64_t count) {
+  uint64_t x[MAX_LIMBS], y[MAX_LIMBS], i, pop = 0;
+  begin_op("bitwise segments", a, b, n);
+
+  and_segments_into(x, a, b, n);
+  or_segments_into(y, a, b, n);
+  for(i = 0; i < n; i++) {
+    CHECK(x[i] == (a[i] & b[i]));
+    CHECK(y[i] == (a[i] | b[i]));
+    pop += __builtin_popcountl(a[i] ^ b[i]);
+  }
+  CHECK(xor_popcount_segments(a, b, n) == pop);
+  xor_segments_into(x, a, b, n);
+  CHECK(popcount_segments(x, n) == pop);
+  andnot_segments_into(y, a, b, n);
+  not_segments(y, n);
+  or_segments(y, b, n);
+  for(i = 0; i < n; i++) {
+    CHECK(y[i] == ~(a[i] & ~b[i]));
+  }
+
+  //extract a range and put it back
+  offset %= n * 64;
+  count %= n * 64 - offset + 1;
+  memset(x, 0, sizeof(x));
+  extract_bits_segments(x, a, n, offset, count);
+  for(i = 0; i < count; i++) {
+    CHECK(ref_bit(x, i) == ref_bit(a, offset + i));
+  }
+  memcpy(y, b, n * sizeof(uint64_t));
+  CHECK(insert_bits_segments(y, n, x, offset, count) == y);
+  for(i = 0; i < n * 64; i++) {
+    CHECK(ref_bit(y, i) == (i >= offset && i < offset + count ? ref_bit(a, i) : ref_bit(b, i)));
+  }
+}
+
+static void fuzz_mul(uint64_t* a, uint64_t* b, uint64_t n) {
+  uint64_t x[MAX_LIMBS], product[2 * MAX_LIMBS], *rem, asize, bsize;
+  begin_op("mul_segments", a, b, n);
+
+  memcpy(x, a, n * sizeof(uint64_t));
+  mul_segments(x, b, n);
+  ref_mul(product, a, n, b, n);
+  CHECK(ref_cmp(x, product, n) == 0);
+
+  memcpy(x, b, n * sizeof(uint64_t));
+  mul_segments(x, a, n);
+  CHECK(ref_cmp(x, product, n) == 0);
+
+  //aliased square
+  memcpy(x, a, n * sizeof(uint64_t));
+  mul_segments(x, x, n);
+  ref_mul(product, a, n, a, n);
+  CHECK(ref_cmp(x, product, n) == 0);
+
+  //(a * b) / b = a when a * b fits
+  begin_op("(a * b) / b", a, b, n);
+  asize = ref_size(a, n);
+  bsize = ref_size(b, n);
+  if(bsize && asize + bsize <= n) {
+    memcpy(x, a, n * sizeof(uint64_t));
+    mul_segments(x, b, n);
+    rem = div_segments_mod(x, b, n);
+    CHECK(rem != NULL);
+    CHECK(ref_cmp(x, a, n) == 0);
+    CHECK(ref_is_zero(rem, n));
+    free(rem);
+  }
+}
+
+static void fuzz_mul_1(uint64_t* a, uint64_t* b, uint64_t n, uint64_t scale) {
+  uint64_t x[MAX_LIMBS], product[MAX_LIMBS + 1], sum[MAX_LIMBS + 1], carry;
+  begin_op("mul_1/addmul_1/submul_1_segments", a, b, n);
+
+  ref_mul(product, a, n, &scale, 1);
+  carry = mul_1_segments(x, a, n, scale);
+  CHECK(ref_cmp(x, product, n) == 0 && carry == product[n]);
+  x[0] = 0;
+  carry = mul_1_segments(x, x, 0, scale);
+  CHECK(carry == 0);
+
+  //b + a * scale, then back
+  memcpy(x, b, n * sizeof(uint64_t));
+  memcpy(sum, b, n * sizeof(uint64_t));
+  sum[n] = 0;
+  ref_add(sum, sum, product, n + 1);
+  carry = addmul_1_segments(x, a, n, scale);
+  CHECK(ref_cmp(x, sum, n) == 0 && carry == sum[n]);
+  carry = submul_1_segments(x, a, n, scale);
+  CHECK(ref_cmp(x, b, n) == 0 && carry == sum[n]);
+
+  begin_op("add_1/sub_1_segments", a, NULL, n);
+  memcpy(x, a, n * sizeof(uint64_t));
+  memset(sum, 0, sizeof(sum));
+  sum[0] = scale;
+  carry = add_1_segments(x, n, scale);
+  memcpy(product, a, n * sizeof(uint64_t));
+  CHECK(carry == ref_add(product, product, sum, n) && ref_cmp(x, product, n) == 0);
+  carry = sub_1_segments(x, n, scale);
+  CHECK(carry == ref_sub(product, product, sum, n) && ref_cmp(x, a, n) == 0);
+}
+
+static void fuzz_divrem_1(uint64_t* a, uint64_t n, uint64_t* divisors, uint64_t count) {
+  uint64_t q[MAX_LIMBS], expect[MAX_LIMBS], residues[8], r, expect_r, i;
+  nat_divisor pre;
+  nat_divisor_set* set;
+  begin_op("divrem_1/mod_1/divrem_pre_segments", a, NULL, n);
+
+  for(i = 0; i < count; i++) {
+    if(divisors[i] == 0) {
+      divisors[i] = 1;
+    }
+    ref_divmod(expect, &expect_r, a, n, divisors + i, 1);
+    r = divrem_1_segments(q, a, n, divisors[i]);
+    CHECK(r == expect_r && ref_cmp(q, expect, n) == 0);
+    CHECK(mod_1_segments(a, n, divisors[i]) == expect_r);
+
+    init_nat_divisor(&pre, divisors[i]);
+    memcpy(q, a, n * sizeof(uint64_t));
+    r = divrem_pre_segments(q, q, n, &pre);
+    CHECK(r == expect_r && ref_cmp(q, expect, n) == 0);
+  }
+
+  begin_op("mod_multi_segments", a, NULL, n);
+  set = create_nat_divisor_set(divisors, count);
+  CHECK(set != NULL);
+  mod_multi_segments(residues, a, n, set);
+  for(i = 0; i < count; i++) {
+    CHECK(residues[i] == mod_1_segments(a, n, divisors[i]));
+  }
+  free_nat_divisor_set(set);
+}
+
+static void fuzz_div(uint64_t* a, uint64_t* b, uint64_t n) {
+  uint64_t q[MAX_LIMBS], expect_q[MAX_LIMBS], expect_r[MAX_LIMBS];
+  uint64_t product[2 * MAX_LIMBS], *rem;
+  begin_op("div_segments_mod", a, b, n);
+
+  memcpy(q, a, n * sizeof(uint64_t));
+  rem = div_segments_mod(q, b, n);
+  if(ref_is_zero(b, n)) {
+    CHECK(rem == NULL);
+    return;
+  }
+  CHECK(rem != NULL);
+  ref_divmod(expect_q, expect_r, a, n, b, n);
+  CHECK(ref_cmp(q, expect_q, n) == 0);
+  CHECK(ref_cmp(rem, expect_r, n) == 0);
+
+  //q * d + r = n, r < d
+  CHECK(ref_cmp(rem, b, n) < 0);
+  ref_mul(product, q, n, b, n);
+  CHECK(ref_size(product, 2 * n) <= n);
+  ref_add(product, product, rem, n);
+  CHECK(ref_cmp(product, a, n) == 0);
+  free(rem);
+
+  memcpy(q, a, n * sizeof(uint64_t));
+  CHECK(div_segments(q, b, n) == q);
+  CHECK(ref_cmp(q, expect_q, n) == 0);
+}
+
+static void fuzz_pow(uint64_t* a, uint64_t n, uint64_t k) {
+  uint64_t x[MAX_LIMBS], expect[MAX_LIMBS], product[2 * MAX_LIMBS], i;
+  begin_op("pow_segments", a, NULL, n);
+  k %= 24;
+
+  memset(expect, 0, sizeof(expect));
+  expect[0] = 1;
+  for(i = 0; i < k; i++) {
+    ref_mul(product, expect, n, a, n);
+    memcpy(expect, product, n * sizeof(uint64_t));
+  }
+  memcpy(x, a, n * sizeof(uint64_t));
+  pow_segments(x, k, n);
+  CHECK(ref_cmp(x, expect, n) == 0);
+}
+
+static void fuzz_gcd(uint64_t* a, uint64_t* b, uint64_t n) {
+  uint64_t g[MAX_LIMBS], x[MAX_LIMBS], s[MAX_LIMBS], expect[MAX_LIMBS];
+  uint64_t product[2 * MAX_LIMBS], r[MAX_LIMBS], r2[MAX_LIMBS];
+  begin_op("gcd_segments", a, b, n);
+
+  ref_gcd(expect, a, b, n);
+  memcpy(g, a, n * sizeof(uint64_t));
+  gcd_segments(g, b, n);
+  CHECK(ref_cmp(g, expect, n) == 0);
+
+  //gcdext is Lehmer even where gcd_segments is binary
+  begin_op("gcdext_segments", a, b, n);
+  memcpy(x, a, n * sizeof(uint64_t));
+  gcdext_segments(x, s, b, n);
+  CHECK(ref_cmp(x, expect, n) == 0);
+  if(ref_is_zero(b, n) || (ref_size(b, n) == 1 && b[0] == 1)) {
+    return;
+  }
+
+  //s * a = gcd (mod b), s < b
+  CHECK(ref_cmp(s, b, n) < 0);
+  ref_mul(product, s, n, a, n);
+  ref_divmod(NULL, r, product, 2 * n, b, n);
+  ref_divmod(NULL, r2, expect, n, b, n);
+  CHECK(ref_cmp(r, r2, n) == 0);
+
+  begin_op("invmod_segments", a, b, n);
+  memcpy(x, a, n * sizeof(uint64_t));
+  if(ref_size(expect, n) == 1 && expect[0] == 1) {
+    CHECK(invmod_segments(x, b, n) == x);
+    ref_mul(product, x, n, a, n);
+    ref_divmod(NULL, r, product, 2 * n, b, n);
+    CHECK(ref_size(r, n) == 1 && r[0] == 1);
+  } else {
+    CHECK(invmod_segments(x, b, n) == NULL);
+    CHECK(ref_cmp(x, a, n) == 0);
+  }
+}
+
+static void fuzz_root(uint64_t* a, uint64_t n, uint64_t k) {
+  uint64_t r[MAX_LIMBS], power[WORK_LIMBS], one[MAX_LIMBS];
+  bool exact;
+  begin_op("root_segments", a, NULL, n);
+  k = 2 + k % 40;
+
+  memcpy(r, a, n * sizeof(uint64_t));
+  CHECK(root_segments(r, k, n) == r);
+  CHECK(ref_pow(power, r, n, k, n + 1));
+  CHECK(ref_cmp(power, a, n) <= 0 && power[n] == 0);
+  exact = ref_cmp(power, a, n) == 0;
+
+  memset(one, 0, sizeof(one));
+  one[0] = 1;
+  ref_add(r, r, one, n);
+  if(ref_pow(power, r, n, k, n + 1)) {
+    CHECK(power[n] || ref_cmp(power, a, n) > 0);
+  }
+
+  begin_op("is_square_segments", a, NULL, n);
+  if(k == 2) {
+    CHECK(is_square_segments(a, n) == exact);
+  }
+  if(exact) {
+    CHECK(is_power_segments(a, n));
+  }
+}
+
+static void fuzz_square(uint64_t* a, uint64_t n) {
+  uint64_t x[MAX_LIMBS], product[2 * MAX_LIMBS], half = (n + 1) / 2, base;
+  begin_op("is_square/is_power_segments", a, NULL, n);
+
+  //a^2, a^3 with a cut down so the power fits
+  ref_mul(product, a, half, a, half);
+  memcpy(x, product, n * sizeof(uint64_t));
+  if(ref_size(product, 2 * half) <= n) {
+    CHECK(is_square_segments(x, n));
+    CHECK(is_power_segments(x, n));
+  }
+  if(ref_size(x, n) > 1 || x[0] > 1) {
+    add_1_segments(x, n, 1);
+    if(ref_size(product, 2 * half) <= n && !ref_is_zero(x, n)) {
+      CHECK(!is_square_segments(x, n));
+    }
+  }
+  //a 21 bit cube always fits
+  base = a[0] >> 43;
+  memset(x, 0, sizeof(x));
+  CHECK(ref_pow(x, &base, 1, 3, n));
+  CHECK(is_power_segments(x, n));
+}
+
+static void fuzz_format(uint64_t* a, uint64_t n) {
+  uint64_t x[MAX_LIMBS], digit[MAX_LIMBS], product[MAX_LIMBS + 1], ten = 10;
+  bigint value = {a, n};
+  char *text, *c;
+  begin_op("bigint_to_new_str_hex", a, NULL, n);
+
+  text = bigint_to_new_str_hex(&value);
+  memset(x, 0, sizeof(x));
+  for(c = text; *c; c++) {
+    CHECK((*c >= '0' && *c <= '9') || (*c >= 'a' && *c <= 'f'));
+    shl_segments(x, n, 4);
+    x[0] |= *c <= '9' ? *c - '0' : *c - 'a' + 10;
+  }
+  CHECK(ref_cmp(x, a, n) == 0);
+  free(text);
+
+  if(n > 8) {
+    return;
+  }
+  begin_op("bigint_to_new_str", a, NULL, n);
+  text = bigint_to_new_str(&value);
+  memset(x, 0, sizeof(x));
+  memset(digit, 0, sizeof(digit));
+  for(c = text; *c; c++) {
+    CHECK(*c >= '0' && *c <= '9');
+    ref_mul(product, x, n, &ten, 1);
+    CHECK(product[n] == 0);
+    digit[0] = *c - '0';
+    CHECK(ref_add(x, product, digit, n) == 0);
+  }
+  CHECK(c != text);
+  CHECK(text[0] != '0' || text[1] == '\0');
+  CHECK(ref_cmp(x, a, n) == 0);
+  free(text);
+}
+
+static void fuzz_mul_wide(fuzz_input* in) {
+  uint64_t a_length = take_wide_length(in), b_length = take_wide_length(in), n;
+  uint64_t *a = calloc(WIDE_LIMBS, sizeof(uint64_t)), *b = calloc(WIDE_LIMBS, sizeof(uint64_t));
+  uint64_t *product = malloc(2 * WIDE_LIMBS * sizeof(uint64_t));
+  uint64_t *expect = malloc(2 * WIDE_LIMBS * sizeof(uint64_t));
+
+  take_wide_operand(in, a, a_length);
+  take_wide_operand(in, b, b_length);
+  n = a_length > b_length ? a_length : b_length;
+  begin_op("mul_full_segments", a, b, n);
+  ref_mul(expect, a, a_length, b, b_length);
+  CHECK(mul_full_segments(product, a, a_length, b, b_length) == product);
+  CHECK(ref_cmp(product, expect, a_length + b_length) == 0);
+
+  //truncated, from the longer operand's length
+  begin_op("mul_segments", a, b, n);
+  memcpy(product, a, n * sizeof(uint64_t));
+  mul_segments(product, b, n);
+  CHECK(ref_cmp(product, expect, n) == 0);
+
+  //squares share one transform
+  begin_op("mul_full_segments square", a, NULL, a_length);
+  ref_mul(expect, a, a_length, a, a_length);
+  mul_full_segments(product, a, a_length, a, a_length);
+  CHECK(ref_cmp(product, expect, 2 * a_length) == 0);
+
+  free(a);
+  free(b);
+  free(product);
+  free(expect);
+}
+
+static void fuzz_powmod(uint64_t* a, uint64_t* b, uint64_t n, uint64_t* exponents,
+			byte window) {
+  uint64_t modulus[MAX_LIMBS], other[MAX_LIMBS], x[MAX_LIMBS], expect[MAX_LIMBS];
+  uint64_t second[MAX_LIMBS], product[2 * MAX_LIMBS], bits, i;
+  uint64_t *bases[2] = {a, other}, *powers[2] = {exponents, exponents + 1};
+  powmod_table* table;
+  begin_op("powmod_segments", a, b, n);
+
+  memcpy(modulus, b, n * sizeof(uint64_t));
+  memcpy(x, a, n * sizeof(uint64_t));
+  for(i = 0; i < n; i++) {
+    other[i] = a[n - 1 - i];
+  }
+  if(ref_is_zero(modulus, n) || (modulus[0] & 0x1) == 0) {
+    CHECK(powmod_segments(x, exponents, 1, modulus, n) == NULL);
+    CHECK(multi_powmod_segments(x, bases, powers, 1, 2, modulus, n) == NULL);
+    CHECK(create_powmod_table(a, modulus, n, 64, 4) == NULL);
+    return;
+  }
+  ref_powmod(expect, a, exponents, 1, modulus, n);
+  CHECK(powmod_segments(x, exponents, 1, modulus, n) == x);
+  CHECK(ref_cmp(x, expect, n) == 0);
+
+  //Straus: a^e0 other^e1
+  begin_op("multi_powmod_segments", a, b, n);
+  ref_powmod(second, other, exponents + 1, 1, modulus, n);
+  ref_mul(product, expect, n, second, n);
+  ref_divmod(NULL, second, product, 2 * n, modulus, n);
+  CHECK(multi_powmod_segments(x, bases, powers, 1, 2, modulus, n) == x);
+  CHECK(ref_cmp(x, second, n) == 0);
+
+  //fixed base, refusing exponents past its bits
+  begin_op("powmod_table_segments", a, b, n);
+  window %= 18;
+  bits = 1 + exponents[1] % 64;
+  table = create_powmod_table(a, modulus, n, bits, window);
+  if(window == 0 || window > 16) {
+    CHECK(table == NULL);
+    return;
+  }
+  CHECK(table != NULL);
+  if(exponents[0] >> (bits - 1) > 1) {
+    CHECK(powmod_table_segments(x, exponents, 1, table) == NULL);
+  } else {
+    CHECK(powmod_table_segments(x, exponents, 1, table) == x);
+    CHECK(ref_cmp(x, expect, n) == 0);
+  }
+  free_powmod_table(table);
+}
+
+/**
+ * x op y at 53 bits in mode, as a double
+ */
+static double bigfloat_op(byte op, double x, double y, round_mode mode, bool* defined) {
+  bigfloat *a = create_bigfloat(53), *b = create_bigfloat(53), *c = create_bigfloat(53);
+  bigfloat* result = NULL;
+  double value = 0;
+
+  set_bigfloat_double(a, x, ROUND_NEAREST);
+  set_bigfloat_double(b, y, ROUND_NEAREST);
+  switch(op) {
+  case 0:
+    result = add_bigfloat(c, a, b, mode);
+    break;
+  case 1:
+    result = sub_bigfloat(c, a, b, mode);
+    break;
+  case 2:
+    result = mul_bigfloat(c, a, b, mode);
+    break;
+  case 3:
+    result = div_bigfloat(c, a, b, mode);
+    break;
+  case 4:
+    result = sqrt_bigfloat(c, a, mode);
+    break;
+  }
+  *defined = result != NULL;
+  if(result) {
+    value = bigfloat_to_double(c);
+  }
+  free_bigfloat(a);
+  free_bigfloat(b);
+  free_bigfloat(c);
+  return value;
+}
+
+static void fuzz_bigfloat(uint64_t* a, uint64_t n, uint64_t x_bits, uint64_t y_bits) {
+  uint64_t low[MAX_LIMBS + 1], high[MAX_LIMBS + 1], exact[MAX_LIMBS + 1], precision;
+  uint64_t size = ref_size(a, n);
+  double x, y, expect = 0, nearest, down, up, zero;
+  bigint value = {a, n}, *integer;
+  bigfloat* f;
+  bool defined, negative;
+  byte op;
+  begin_op("bigfloat against doubles", &x_bits, &y_bits, 1);
+
+  memcpy(&x, &x_bits, sizeof(double));
+  memcpy(&y, &y_bits, sizeof(double));
+  for(op = 0; isfinite(x) && isfinite(y) && op < 5; op++) {
+    switch(op) {
+    case 0:
+      expect = x + y;
+      break;
+    case 1:
+      expect = x - y;
+      break;
+    case 2:
+      expect = x * y;
+      break;
+    case 3:
+      expect = x / y;
+      break;
+    case 4:
+      expect = sqrt(x);
+      break;
+    }
+    nearest = bigfloat_op(op, x, y, ROUND_NEAREST, &defined);
+    if(!defined) {
+      CHECK((op == 3 && y == 0) || (op == 4 && x < 0));
+      continue;
+    }
+    down = bigfloat_op(op, x, y, ROUND_DOWN, &defined);
+    up = bigfloat_op(op, x, y, ROUND_UP, &defined);
+    zero = bigfloat_op(op, x, y, ROUND_ZERO, &defined);
+    //below 2^-1022 the double has fewer bits than the bigfloat
+    if(!isnormal(expect) || !isnormal(down) || !isnormal(up)) {
+      continue;
+    }
+    CHECK(nearest == expect);
+    CHECK(down <= expect && expect <= up);
+    CHECK(down == up || nextafter(down, INFINITY) == up);
+    CHECK(zero == (expect > 0 ? down : up));
+  }
+
+  //an integer rounded to precision bits lands on either side of
+  //itself, and on itself if it fits
+  begin_op("bigfloat integers", a, NULL, n);
+  precision = 1 + x_bits % (64 * n);
+  f = create_bigfloat(precision);
+  memset(low, 0, sizeof(low));
+  memset(high, 0, sizeof(high));
+  memset(exact, 0, sizeof(exact));
+  memcpy(exact, a, n * sizeof(uint64_t));
+  set_bigfloat_bigint(f, &value, FALSE, ROUND_DOWN);
+  integer = bigfloat_to_bigint(f, &negative, ROUND_ZERO);
+  CHECK(integer->length <= n + 1 && !negative);
+  memcpy(low, integer->data, integer->length * sizeof(uint64_t));
+  free_bigint(integer);
+  set_bigfloat_bigint(f, &value, FALSE, ROUND_UP);
+  integer = bigfloat_to_bigint(f, &negative, ROUND_ZERO);
+  CHECK(integer->length <= n + 1 && !negative);
+  memcpy(high, integer->data, integer->length * sizeof(uint64_t));
+  free_bigint(integer);
+  CHECK(ref_cmp(low, exact, n + 1) <= 0 && ref_cmp(exact, high, n + 1) <= 0);
+  if(size == 0 || 64 * size - __builtin_clzl(a[size-1]) <= precision) {
+    CHECK(ref_cmp(low, exact, n + 1) == 0 && ref_cmp(high, exact, n + 1) == 0);
+  }
+  free_bigfloat(f);
+}
+
+static bool valid_moduli(uint64_t* moduli, uint64_t count) {
+  uint64_t i, j;
+  for(i = 0; i < count; i++) {
+    if(moduli[i] < 2 || moduli[i] >> 63) {
+      return FALSE;
+    }
+    for(j = 0; j < i; j++) {
+      if(ref_gcd_word(moduli[i], moduli[j]) != 1) {
+	return FALSE;
+      }
+    }
+  }
+  return TRUE;
+}
+
+static void fuzz_rns(uint64_t* a, uint64_t* b, uint64_t n, uint64_t* moduli, uint64_t count,
+		     uint64_t other_count) {
+  uint64_t ra[8], rb[8], rc[8], extended[8], value[MAX_LIMBS], expect[MAX_LIMBS];
+  uint64_t am[MAX_LIMBS], bm[MAX_LIMBS], sum[MAX_LIMBS], product[2 * MAX_LIMBS], p, i;
+  uint64_t modulus[MAX_LIMBS];
+  rns_base *base = create_rns_base(moduli, count), *other;
+  begin_op("to_rns/from_rns_segments", a, b, n);
+
+  if(!valid_moduli(moduli, count)) {
+    CHECK(base == NULL);
+    return;
+  }
+  CHECK(base != NULL);
+  p = base->length;
+  CHECK(p == ref_size(base->product, count + 1));
+  memset(modulus, 0, sizeof(modulus));
+  memcpy(modulus, base->product, p * sizeof(uint64_t));
+  to_rns_segments(ra, a, n, base);
+  to_rns_segments(rb, b, n, base);
+  for(i = 0; i < count; i++) {
+    CHECK(ra[i] == mod_1_segments(a, n, moduli[i]));
+  }
+  memset(value, 0, sizeof(value));
+  from_rns_segments(value, ra, base);
+  ref_divmod(NULL, am, a, n, modulus, p);
+  ref_divmod(NULL, bm, b, n, modulus, p);
+  CHECK(ref_cmp(value, am, p) == 0);
+
+  begin_op("mul_rns", a, b, n);
+  mul_rns(rc, ra, rb, base);
+  from_rns_segments(value, rc, base);
+  ref_mul(product, a, n, b, n);
+  ref_divmod(NULL, expect, product, 2 * n, modulus, p);
+  CHECK(ref_cmp(value, expect, p) == 0);
+
+  //the sum and difference of the reduced operands, reduced again
+  begin_op("add_rns/sub_rns", a, b, n);
+  add_rns(rb, ra, rb, base);
+  from_rns_segments(value, rb, base);
+  am[p] = bm[p] = 0;
+  ref_add(sum, am, bm, p + 1);
+  ref_divmod(NULL, expect, sum, p + 1, modulus, p);
+  CHECK(ref_cmp(value, expect, p) == 0);
+  //(a + b) - a - a is b - a
+  sub_rns(rb, rb, ra, base);
+  sub_rns(rb, rb, ra, base);
+  from_rns_segments(value, rb, base);
+  ref_add(sum, bm, modulus, p + 1);
+  ref_sub(sum, sum, am, p + 1);
+  ref_divmod(NULL, expect, sum, p + 1, modulus, p);
+  CHECK(ref_cmp(value, expect, p) == 0);
+
+  //the product's residues carried over to the other moduli
+  begin_op("extend_rns", a, b, n);
+  other = create_rns_base(moduli + count, other_count);
+  if(!valid_moduli(moduli + count, other_count)) {
+    CHECK(other == NULL);
+  } else {
+    CHECK(extend_rns(extended, other, rc, base) == extended);
+    from_rns_segments(value, rc, base);
+    for(i = 0; i < other_count; i++) {
+      CHECK(extended[i] == mod_1_segments(value, p, moduli[count + i]));
+    }
+    free_rns_base(other);
+  }
+  free_rns_base(base);
+}
+
+///
+
+int LLVMFuzzerTestOneInput(const byte* data, size_t size) {
+  fuzz_input in = {data, size, 0};
+  uint64_t a[MAX_LIMBS], b[MAX_LIMBS], divisors[16], exponents[2], i, count, other_count;
+  byte op = take_byte(&in);
+  uint64_t n = take_length(&in);
+
+  take_operand(&in, a, n);
+  take_operand(&in, b, n);
+
+  switch(op % 15) {
+  case 0:
+    fuzz_add_sub(a, b, n);
+    break;
+  case 1:
+    fuzz_shift(a, n, take_word(&in));
+    break;
+  case 2:
+    fuzz_bitwise(a, b, n, take_word(&in), take_word(&in));
+    break;
+  case 3:
+    fuzz_mul(a, b, n);
+    break;
+  case 4:
+    fuzz_mul_1(a, b, n, take_word(&in));
+    break;
+  case 5:
+    count = 1 + take_byte(&in) % 8;
+    for(i = 0; i < count; i++) {
+      divisors[i] = take_word(&in) >> (take_byte(&in) % 64);
+    }
+    fuzz_divrem_1(a, n, divisors, count);
+    break;
+  case 6:
+    fuzz_div(a, b, n);
+    break;
+  case 7:
+    fuzz_pow(a, n, take_byte(&in));
+    break;
+  case 8:
+    fuzz_gcd(a, b, n);
+    break;
+  case 9:
+    fuzz_root(a, n > 16 ? 16 : n, take_byte(&in));
+    break;
+  case 10:
+    if(take_byte(&in) & 0x1) {
+      fuzz_square(a, n > 16 ? 16 : n);
+    } else {
+      fuzz_format(a, n);
+    }
+    break;
+  case 11:
+    fuzz_mul_wide(&in);
+    break;
+  case 12:
+    exponents[0] = take_word(&in);
+    exponents[1] = take_word(&in) >> (take_byte(&in) % 64);
+    fuzz_powmod(a, b, n > 8 ? 8 : n, exponents, take_byte(&in));
+    break;
+  case 13:
+    fuzz_bigfloat(a, n, take_word(&in), take_word(&in));
+    break;
+  case 14:
+    count = 1 + take_byte(&in) % 8;
+    other_count = 1 + take_byte(&in) % 8;
+    for(i = 0; i < count + other_count; i++) {
+      divisors[i] = take_word(&in) >> (1 + take_byte(&in) % 63);
+      divisors[i] |= take_byte(&in) & 0x1;
+    }
+    fuzz_rns(a, b, n > 16 ? 16 : n, divisors, count, other_count);
+    break;
+  }
+  return 0;
+}
+
+#ifndef BIGMATH_LIBFUZZER
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {
+  //xorshift64*
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 0x2545F4914F6CDD1DUL;
+}
+
+static void replay_file(const char* path) {
+  FILE* file = fopen(path, "rb");
+  byte* data;
+  long size;
+  if(file == NULL) {
+    fprintf(stderr, "cannot open %s\n", path);
+    exit(2);
+  }
+  fseek(file, 0, SEEK_END);
+  size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  data = malloc(size ? size : 1);
+  if(fread(data, 1, size, file) != (size_t) size) {
+    fprintf(stderr, "cannot read %s\n", path);
+    exit(2);
+  }
+  fclose(file);
+  LLVMFuzzerTestOneInput(data, size);
+  free(data);
+}
+
+int main(int argc, char** argv) {
+  uint64_t iterations = 100000, seed = time(NULL), i, j, size;
+  byte data[1024];
+  int arg, files = 0;
+
+  for(arg = 1; arg < argc; arg++) {
+    if(strcmp(argv[arg], "--iterations") == 0 && arg + 1 < argc) {
+      iterations = strtoul(argv[++arg], NULL, 10);
+    } else if(strcmp(argv[arg], "--seed") == 0 && arg + 1 < argc) {
+      seed = strtoul(argv[++arg], NULL, 10);
+    } else {
+      replay_file(argv[arg]);
+      files++;
+    }
+  }
+  if(files) {
+    printf("%d inputs replayed\n", files);
+    return 0;
+  }
+
+  printf("seed %lu\n", seed);
+  rng_state = seed ? seed : 1;
+  for(i = 0; i < iterations; i++) {
+    size = rng_next() % sizeof(data);
+    for(j = 0; j < size; j++) {
+      data[j] = rng_next();
+    }
+    LLVMFuzzerTestOneInput(data, size);
+  }
+  printf("%lu iterations passed\n", iterations);
+  return 0;
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "bigmath.h"
+#include <unistd.h>
 
 void run_test(bool (*func)(void), char*);
 
@@ -8,6 +9,34 @@ bool test_shr_segments(void);
 bool test_shl_segments(void);
 bool test_add_segments(void);
 bool test_sub_segments(void);
+bool test_bitwise_segments(void);
+bool test_bit_access(void);
+bool test_bit_range_segments(void);
+bool test_gcd_segments(void);
+bool test_invmod_segments(void);
+bool test_hgcd_segments(void);
+bool test_root_segments(void);
+bool test_is_power_segments(void);
+bool test_1_segments(void);
+bool test_mul_nat(void);
+bool test_div_nat(void);
+bool test_nat_divisor(void);
+bool test_mod_multi_segments(void);
+bool test_stats(void);
+bool test_cpu_tiers(void);
+bool test_serialize(void);
+bool test_map_bigint(void);
+bool test_import_export(void);
+bool test_chunked(void);
+bool test_binary_splitting(void);
+bool test_product_tree(void);
+bool test_primes(void);
+bool test_multi_powmod(void);
+bool test_expr(void);
+bool test_jobs(void);
+bool test_bigfloat(void);
+bool test_hash_index(void);
+bool test_rns(void);
 
 /*
 bool test_shl(void);
@@ -51,6 +80,34 @@ int main() {
   run_test(&test_shl_segments, "shl_segments");
   run_test(&test_add_segments, "add_segments");
   run_test(&test_sub_segments, "sub_segments");
+  run_test(&test_bitwise_segments, "and/or/xor/not segments");
+  run_test(&test_bit_access, "single bit access");
+  run_test(&test_bit_range_segments, "bit range extract/insert");
+  run_test(&test_gcd_segments, "binary and lehmer gcd");
+  run_test(&test_invmod_segments, "extended gcd and modular inverse");
+  run_test(&test_hgcd_segments, "half gcd above GCD_HGCD_THRESHOLD");
+  run_test(&test_root_segments, "integer square and k-th root");
+  run_test(&test_is_power_segments, "perfect square and perfect power");
+  run_test(&test_1_segments, "single segment kernels");
+  run_test(&test_mul_nat, "mul_bigint_nat");
+  run_test(&test_div_nat, "div_bigint_nat");
+  run_test(&test_nat_divisor, "precomputed word divisor");
+  run_test(&test_mod_multi_segments, "multi-modulus reduction");
+  run_test(&test_stats, "kernel counters and trace");
+  run_test(&test_cpu_tiers, "cpu dispatch tiers agree");
+  run_test(&test_serialize, "binary write/read");
+  run_test(&test_map_bigint, "memory mapped bigint");
+  run_test(&test_import_export, "byte import/export");
+  run_test(&test_chunked, "chunked out of core arithmetic");
+  run_test(&test_binary_splitting, "binary splitting products and series");
+  run_test(&test_product_tree, "product tree remainders and batch gcd");
+  run_test(&test_primes, "powmod, primality and random primes");
+  run_test(&test_multi_powmod, "multi-exponentiation and fixed base tables");
+  run_test(&test_expr, "fused expression evaluation");
+  run_test(&test_jobs, "background job pool");
+  run_test(&test_bigfloat, "binary floating point");
+  run_test(&test_hash_index, "hashing, fingerprints and dedup index");
+  run_test(&test_rns, "residue number systems");
 
   run_test(&test_gt, "greater than");
   run_test(&test_lt, "less than");
@@ -286,6 +343,1451 @@ bool test_sub_segments() {
   return test;
 }
 
+bool test_bitwise_segments() {
+  bool test = TRUE;
+  uint64_t a[3] = {0xFF00FF00FF00FF00, 0xF0F0F0F0F0F0F0F0, 0x1};
+  uint64_t b[3] = {0x0FF00FF00FF00FF0, 0xFFFFFFFF00000000, 0x3};
+  uint64_t out[3];
+
+  and_segments_into(out, a, b, 3);
+  assert(&test, out[0] == 0x0F000F000F000F00);
+  assert(&test, out[1] == 0xF0F0F0F000000000);
+  assert(&test, out[2] == 0x1);
+
+  or_segments_into(out, a, b, 3);
+  assert(&test, out[0] == 0xFFF0FFF0FFF0FFF0);
+  assert(&test, out[1] == 0xFFFFFFFFF0F0F0F0);
+  assert(&test, out[2] == 0x3);
+
+  xor_segments_into(out, a, b, 3);
+  assert(&test, out[0] == 0xF0F0F0F0F0F0F0F0);
+  assert(&test, out[2] == 0x2);
+  assert(&test, xor_popcount_segments(a, b, 3) == popcount_segments(out, 3));
+  printf("hamming distance: %lu\n", xor_popcount_segments(a, b, 3));
+
+  andnot_segments_into(out, a, b, 3);
+  assert(&test, out[0] == 0xF000F000F000F000);
+  assert(&test, out[1] == 0x00000000F0F0F0F0);
+  assert(&test, out[2] == 0x0);
+
+  memcpy(out, a, sizeof(a));
+  xor_segments(out, b, 3);
+  xor_segments(out, b, 3);
+  assert(&test, eq(out, a, 3));
+
+  not_segments(out, 3);
+  and_segments(out, a, 3);
+  assert(&test, popcount_segments(out, 3) == 0);
+
+  bigint* x = get_ones(4);
+  bigint* y = get_zeros(4);
+  bigint* z = get_zeros(3);
+  assert(&test, andnot_bigint(x, y) == x);
+  assert(&test, popcount_segments(x->data, 4) == 256);
+  assert(&test, not_bigint(x) == x && popcount_segments(x->data, 4) == 0);
+  assert(&test, or_bigint(x, z) == NULL);
+
+  free_bigint(x);
+  free_bigint(y);
+  free_bigint(z);
+  return test;
+}
+
+bool test_bit_access() {
+  bool test = TRUE;
+  bigint* value = get_zeros(3);
+
+  assert(&test, set_bit_bigint(value, 0) == value);
+  assert(&test, set_bit_bigint(value, 64) == value);
+  assert(&test, set_bit_bigint(value, 191) == value);
+  assert(&test, set_bit_bigint(value, 192) == NULL);
+  print_bigint_hex(value);
+  printf("\nExpecting: 0x8000000000000000 0x1 0x1\n");
+
+  assert(&test, value->data[0] == 0x1);
+  assert(&test, value->data[1] == 0x1);
+  assert(&test, value->data[2] == 0x8000000000000000);
+  assert(&test, test_bit_bigint(value, 64));
+  assert(&test, !test_bit_bigint(value, 65));
+  assert(&test, !test_bit_bigint(value, 1000));
+
+  clear_bit_bigint(value, 64);
+  assert(&test, value->data[1] == 0x0);
+  assert(&test, !test_bit_segments(value->data, value->length, 64));
+
+  free_bigint(value);
+  return test;
+}
+
+bool test_bit_range_segments() {
+  bool test = TRUE;
+  uint64_t src[3] = {0xFEDCBA9876543210, 0x0123456789ABCDEF, 0xAAAAAAAAAAAAAAAA};
+  uint64_t dest[3] = {0, 0, 0};
+  uint64_t out[2];
+
+  extract_bits_segments(out, src, 3, 32, 64);
+  assert(&test, out[0] == 0x89ABCDEFFEDCBA98);
+
+  extract_bits_segments(out, src, 3, 60, 72);
+  assert(&test, out[0] == 0x123456789ABCDEFF);
+  assert(&test, out[1] == 0xA0);
+
+  extract_bits_segments(out, src, 3, 184, 16);
+  assert(&test, out[0] == 0xAA);
+
+  insert_bits_segments(dest, 3, out, 60, 16);
+  assert(&test, dest[0] == 0xA000000000000000);
+  assert(&test, dest[1] == 0xA);
+
+  extract_bits_segments(out, src, 3, 4, 128);
+  insert_bits_segments(dest, 3, out, 4, 128);
+  extract_bits_segments(out, dest, 3, 4, 128);
+  assert(&test, dest[0] == (src[0] & ~0xFULL));
+  assert(&test, dest[1] == src[1]);
+  assert(&test, dest[2] == (src[2] & 0xF));
+
+  assert(&test, insert_bits_segments(dest, 3, out, 190, 4) == NULL);
+
+  return test;
+}
+
+bool test_gcd_segments() {
+  bool test = TRUE;
+  uint64_t a[5] = {0xe0000000cfd41b91, 0xffffffffe6057c8d, 0xffffffffffffffff,
+		   0x1fffffff302be46e, 0x0000000019fa8372};
+  uint64_t b[5] = {0x1fffffffffffe65f, 0x0000000000000334, 0x7fffffffffffddd4,
+		   0x0000000000000445, 0x0};
+  uint64_t g[5] = {0xdfffffffffff90f1, 0x0000000000000de1, 0x0, 0x0, 0x0};
+  uint64_t x[5], y[5];
+
+  //lehmer
+  memcpy(x, a, sizeof(a));
+  gcd_segments(x, b, 5);
+  assert(&test, eq(x, g, 5));
+  bigint* printing = create_bigint(x, 5);
+  print_bigint_hex(printing);
+  free(printing);
+  printf("\nExpecting: 0xde1dfffffffffff90f1\n");
+
+  //binary, with a common power of two
+  memset(x, 0, sizeof(x));
+  memset(y, 0, sizeof(y));
+  x[0] = 0x0;
+  x[1] = 0x60;
+  y[0] = 0x0;
+  y[1] = 0x48;
+  gcd_segments(x, y, 2);
+  assert(&test, x[0] == 0x0 && x[1] == 0x18);
+
+  //gcd(x, 0) = x
+  x[0] = 0x1234;
+  x[1] = 0x0;
+  memset(y, 0, sizeof(y));
+  gcd_segments(x, y, 2);
+  assert(&test, x[0] == 0x1234);
+  gcd_segments(y, x, 2);
+  assert(&test, y[0] == 0x1234);
+
+  return test;
+}
+
+bool test_invmod_segments() {
+  bool test = TRUE;
+  uint64_t x[4] = {0x3039, 0x0, 0x0, 0x100};
+  uint64_t m[4] = {0xffffffffffffffed, 0xffffffffffffffff, 0xffffffffffffffff,
+		   0x7fffffffffffffff};
+  uint64_t inverse[4] = {0xbecc34f47b31e357, 0x3bb76fda109c66c2, 0x1a3eb72316725db3,
+			 0x71102662a8472176};
+  uint64_t g[4], s[4];
+
+  memcpy(g, x, sizeof(x));
+  gcdext_segments(g, s, m, 4);
+  assert(&test, g[0] == 1 && g[1] == 0 && g[2] == 0 && g[3] == 0);
+  assert(&test, eq(s, inverse, 4));
+
+  assert(&test, invmod_segments(x, m, 4) == x);
+  assert(&test, eq(x, inverse, 4));
+
+  //not coprime: 6^-1 mod 9
+  memset(x, 0, sizeof(x));
+  memset(m, 0, sizeof(m));
+  x[0] = 6;
+  m[0] = 9;
+  assert(&test, invmod_segments(x, m, 4) == NULL);
+  assert(&test, x[0] == 6);
+
+  //3^-1 mod 10 = 7
+  x[0] = 3;
+  m[0] = 10;
+  invmod_segments(x, m, 4);
+  printf("3^-1 mod 10 = %lu\n", x[0]);
+  assert(&test, x[0] == 7);
+
+  return test;
+}
+
+/**
+ * Consecutive Fibonacci numbers, where every quotient is 1. Cassini's
+ * identity gives F(n)^2 = (-1)^(n+1) (mod F(n+1)), so F(n) is its own
+ * inverse for odd n and F(n-1) is the inverse for even n.
+ */
+bool test_hgcd_segments() {
+  bool test = TRUE;
+  uint64_t length = 3 * GCD_HGCD_THRESHOLD, factor_length = GCD_HGCD_THRESHOLD / 2 + 1;
+  uint64_t wide = length + factor_length, n = 2, i;
+  uint64_t *prev = calloc(length, sizeof(uint64_t)), *cur = calloc(length, sizeof(uint64_t));
+  uint64_t *next = calloc(length, sizeof(uint64_t)), *x = calloc(length, sizeof(uint64_t));
+  uint64_t *s = calloc(length, sizeof(uint64_t)), *swap;
+  uint64_t *factor = calloc(wide, sizeof(uint64_t)), *a = calloc(wide, sizeof(uint64_t));
+  uint64_t *b = calloc(wide, sizeof(uint64_t)), *g = calloc(wide, sizeof(uint64_t));
+
+  //F(n-1) = prev, F(n) = cur, up to a segment below length
+  prev[0] = cur[0] = 1;
+  while(cur[length - 2] == 0) {
+    add_segments(prev, cur, length);
+    swap = prev; prev = cur; cur = swap;
+    n++;
+  }
+  memcpy(next, prev, length * sizeof(uint64_t));
+  add_segments(next, cur, length);
+
+  memcpy(x, cur, length * sizeof(uint64_t));
+  gcd_segments(x, next, length);
+  assert(&test, x[0] == 1 && popcount_segments(x + 1, length - 1) == 0);
+
+  memcpy(x, cur, length * sizeof(uint64_t));
+  gcdext_segments(x, s, next, length);
+  assert(&test, x[0] == 1 && popcount_segments(x + 1, length - 1) == 0);
+  assert(&test, eq(s, n % 2 ? cur : prev, length));
+
+  memcpy(x, cur, length * sizeof(uint64_t));
+  assert(&test, invmod_segments(x, next, length) == x);
+  assert(&test, eq(x, n % 2 ? cur : prev, length));
+  printf("F(%lu), %lu segments\n", n, length);
+
+  //a common factor comes back whole and makes the inverse fail
+  for(i = 0; i < factor_length; i++) {
+    factor[i] = 0x9e3779b97f4a7c15 * (i + 1);
+  }
+  mul_full_segments(a, factor, factor_length, next, length);
+  mul_full_segments(b, factor, factor_length, cur, length);
+  memcpy(g, a, wide * sizeof(uint64_t));
+  gcd_segments(g, b, wide);
+  assert(&test, eq(g, factor, wide));
+  memcpy(g, a, wide * sizeof(uint64_t));
+  assert(&test, invmod_segments(g, b, wide) == NULL);
+  assert(&test, eq(g, a, wide));
+
+  free(prev);
+  free(cur);
+  free(next);
+  free(x);
+  free(s);
+  free(factor);
+  free(a);
+  free(b);
+  free(g);
+  return test;
+}
+
+bool test_root_segments() {
+  bool test = TRUE;
+  //3^200 + 17
+  uint64_t x[5] = {0x5bfaff1eaaf8b0b2, 0x83ecf6f6e4a7ae22, 0xfd73d97e447606b6,
+		   0xc21a937a76f3432f, 0x1fd5863c3eb0469e};
+  uint64_t sqrt_x[5] = {0xd6947d55cf3813d1, 0x673768565b41f775, 0x000000005a4653ca,
+			0x0, 0x0};
+  uint64_t value[5];
+
+  memcpy(value, x, sizeof(x));
+  assert(&test, sqrt_segments(value, 5) == value);
+  assert(&test, eq(value, sqrt_x, 5));
+  bigint* printing = create_bigint(value, 5);
+  print_bigint_hex(printing);
+  printf("\n");
+
+  memcpy(value, x, sizeof(x));
+  root_segments(value, 7, 5);
+  print_bigint_hex(printing);
+  printf("\nExpecting: 0x26fabf178321\n");
+  assert(&test, value[0] == 0x000026fabf178321 && value[1] == 0x0);
+  free(printing);
+
+  memcpy(value, x, sizeof(x));
+  root_segments(value, 1000, 5);
+  assert(&test, value[0] == 1 && value[1] == 0);
+  assert(&test, root_segments(value, 0, 5) == NULL);
+
+  memset(value, 0, sizeof(value));
+  value[0] = 99;
+  sqrt_segments(value, 5);
+  assert(&test, value[0] == 9);
+
+  return test;
+}
+
+bool test_is_power_segments() {
+  bool test = TRUE;
+  //12345678901234567^5
+  uint64_t fifth[5] = {0x63bc471d59bd4b27, 0xfbcc1ff38f95dd03, 0x4d97c1944fe84af2,
+		       0xd42eeb251b2529ab, 0x00000000000009ac};
+  uint64_t square[5];
+
+  assert(&test, is_power_segments(fifth, 5));
+  assert(&test, !is_square_segments(fifth, 5));
+  fifth[0] += 2;
+  assert(&test, !is_power_segments(fifth, 5));
+
+  memset(square, 0, sizeof(square));
+  square[0] = 0xd6947d55cf3813d1;
+  square[1] = 0x673768565b41f775;
+  mul_segments(square, square, 5);
+  assert(&test, is_square_segments(square, 5));
+  assert(&test, is_power_segments(square, 5));
+  square[0] -= 1;
+  assert(&test, !is_square_segments(square, 5));
+
+  memset(square, 0, sizeof(square));
+  assert(&test, is_square_segments(square, 5));
+  square[1] = 0x1; //2^64
+  assert(&test, is_square_segments(square, 5));
+  square[1] = 0x8; //2^67
+  assert(&test, !is_square_segments(square, 5));
+  assert(&test, is_power_segments(square, 5));
+
+  return test;
+}
+
+bool test_1_segments() {
+  bool test = TRUE;
+  //3^120
+  uint64_t x[3] = {0x60f0fcebb0ee4461, 0x89b11e42db8e5bb0, 0x4949a9b699bf15c7};
+  uint64_t product[3] = {0xeddccc94be133810, 0x89059d3cc44ef0b5, 0xa3e8c4eed5959ff5};
+  uint64_t out[3], carry;
+
+  carry = mul_1_segments(out, x, 3, 0xfedcba9876543210);
+  assert(&test, carry == 0x48f6471c306336ad);
+  assert(&test, eq(out, product, 3));
+
+  //out - x * scale = 0 with the carry as the borrow out
+  assert(&test, submul_1_segments(out, x, 3, 0xfedcba9876543210) == carry);
+  assert(&test, out[0] == 0 && out[1] == 0 && out[2] == 0);
+  assert(&test, addmul_1_segments(out, x, 3, 0xfedcba9876543210) == carry);
+  assert(&test, eq(out, product, 3));
+
+  out[0] = 0xFFFFFFFFFFFFFFFF;
+  out[1] = 0xFFFFFFFFFFFFFFFF;
+  out[2] = 0x0;
+  assert(&test, add_1_segments(out, 3, 1) == 0);
+  assert(&test, out[0] == 0 && out[1] == 0 && out[2] == 1);
+  assert(&test, sub_1_segments(out, 3, 1) == 0);
+  assert(&test, out[0] == 0xFFFFFFFFFFFFFFFF && out[2] == 0);
+  assert(&test, add_1_segments(out, 2, 1) == 1);
+  assert(&test, sub_1_segments(out, 2, 1) == 1);
+
+  assert(&test, divrem_1_segments(out, x, 3, 10000000000000000000UL) == 0x147a7b6d6e664461);
+  assert(&test, out[0] == 0x334c9a3220459ca5 && out[1] == 0x873128d302dbeb1d && out[2] == 0);
+  assert(&test, mod_1_segments(x, 3, 7) == 1);
+  assert(&test, mod_1_segments(x, 3, 3) == 0);
+  assert(&test, mod_1_segments(x, 3, 0x8000000000000000) == 0x60f0fcebb0ee4461);
+
+  //in place
+  divrem_1_segments(x, x, 3, 3);
+  mul_1_segments(x, x, 3, 3);
+  assert(&test, x[0] == 0x60f0fcebb0ee4461);
+
+  return test;
+}
+
+bool test_mul_nat() {
+  bool test = TRUE;
+  bigint* value = get_zeros(3);
+  value->data[0] = 0xFFFFFFFFFFFFFFFF;
+
+  mul_bigint_nat(value, 0x10);
+  print_bigint_hex(value);
+  printf("\nExpecting: 0xF 0xFFFFFFFFFFFFFFF0\n");
+  assert(&test, value->data[0] == 0xFFFFFFFFFFFFFFF0);
+  assert(&test, value->data[1] == 0xF);
+
+  add_bigint_nat(value, 0x10);
+  assert(&test, value->data[0] == 0x0 && value->data[1] == 0x10);
+  sub_bigint_nat(value, 0x1);
+  assert(&test, value->data[0] == 0xFFFFFFFFFFFFFFFF && value->data[1] == 0xF);
+
+  free_bigint(value);
+  return test;
+}
+
+bool test_div_nat() {
+  bool test = TRUE;
+  bigint* value = get_zeros(3);
+  value->data[0] = 0x0;
+  value->data[1] = 0x1;
+
+  assert(&test, mod_bigint_nat(value, 10) == 6);
+  div_bigint_nat(value, 10);
+  printf("2^64 / 10 = %lu\n", value->data[0]);
+  assert(&test, value->data[0] == 1844674407370955161UL);
+  assert(&test, value->data[1] == 0x0);
+  assert(&test, div_bigint_nat(value, 0) == NULL);
+
+  free_bigint(value);
+  return test;
+}
+
+bool test_nat_divisor() {
+  bool test = TRUE;
+  bigint* values[3];
+  uint64_t remainders[3], expected[3];
+  int i;
+
+  assert(&test, create_nat_divisor(0) == NULL);
+  nat_divisor* pre = create_nat_divisor(10000000000000000000UL);
+
+  for(i = 0; i < 3; i++) {
+    values[i] = get_ones(4);
+    values[i]->data[0] = i * 0x123456789;
+    expected[i] = mod_1_segments(values[i]->data, 4, 10000000000000000000UL);
+  }
+  mod_bigints_pre(remainders, values, 3, pre);
+  for(i = 0; i < 3; i++) {
+    assert(&test, remainders[i] == expected[i]);
+  }
+
+  div_bigints_pre(values, 3, pre, remainders);
+  for(i = 0; i < 3; i++) {
+    assert(&test, remainders[i] == expected[i]);
+    mul_bigint_nat(values[i], 10000000000000000000UL);
+    add_bigint_nat(values[i], remainders[i]);
+    assert(&test, values[i]->data[0] == i * 0x123456789);
+    assert(&test, values[i]->data[3] == 0xFFFFFFFFFFFFFFFF);
+    free_bigint(values[i]);
+  }
+  printf("remainders: %lu %lu %lu\n", remainders[0], remainders[1], remainders[2]);
+
+  free_nat_divisor(pre);
+  return test;
+}
+
+bool test_mod_multi_segments() {
+  bool test = TRUE;
+  uint64_t moduli[64], residues[64];
+  uint64_t i, count = 0, candidate, d;
+  bigint* value = get_ones(6);
+  value->data[2] = 0x0123456789ABCDEF;
+
+  for(candidate = 3; count < 62; candidate += 2) {
+    for(d = 3; d * d <= candidate && candidate % d; d += 2);
+    if(d * d > candidate) {
+      moduli[count++] = candidate;
+    }
+  }
+  moduli[count++] = 0xFFFFFFFFFFFFFFC5; //largest 64 bit prime
+  moduli[count++] = 0x8000000000000000;
+
+  nat_divisor_set* set = create_nat_divisor_set(moduli, count);
+  printf("%lu moduli in %lu groups\n", set->count, set->group_count);
+  assert(&test, set->group_count < count);
+
+  mod_multi_segments(residues, value->data, value->length, set);
+  for(i = 0; i < count; i++) {
+    assert(&test, residues[i] == mod_1_segments(value->data, value->length, moduli[i]));
+  }
+
+  moduli[5] = 0;
+  assert(&test, create_nat_divisor_set(moduli, count) == NULL);
+
+  free_nat_divisor_set(set);
+  free_bigint(value);
+  return test;
+}
+
+static uint64_t traced_calls = 0;
+
+static void count_trace(stat_kernel kernel, uint64_t limbs, uint64_t cycles,
+			void* context) {
+  if(kernel == *(stat_kernel*) context) {
+    traced_calls++;
+  }
+}
+
+bool test_stats() {
+  bool test = TRUE;
+  bigmath_stats stats;
+  stat_kernel traced = STAT_GCD_LEHMER;
+  bigint* a = get_fill(6, 0x35);
+  bigint* b = get_fill(6, 0x17);
+  bigint* wide = get_fill(MUL_KARATSUBA_THRESHOLD + 8, 0x5b);
+  uint64_t product[2 * MUL_KARATSUBA_THRESHOLD + 16];
+  uint64_t i;
+
+  assert(&test, strcmp(stat_kernel_name(STAT_GCD_BINARY), "gcd_binary") == 0);
+  assert(&test, strcmp(stat_kernel_name(STAT_MUL_KARATSUBA), "mul_karatsuba") == 0);
+  assert(&test, stat_kernel_name(STAT_KERNEL_COUNT) == NULL);
+
+  reset_stats();
+  set_stats_trace(&count_trace, &traced);
+  mul_segments(a->data, b->data, a->length);
+  gcd_segments(a->data, b->data, a->length);
+  gcd_segments(a->data, b->data, 2);
+  set_stats_trace(NULL, NULL);
+  gcd_segments(a->data, b->data, a->length);
+  snapshot_stats(&stats);
+
+  if(!stats_enabled()) {
+    for(i = 0; i < STAT_KERNEL_COUNT; i++) {
+      assert(&test, stats.kernels[i].calls == 0);
+    }
+    assert(&test, traced_calls == 0);
+  } else {
+    assert(&test, stats.kernels[STAT_MUL_SCHOOLBOOK].calls == 1);
+    assert(&test, stats.kernels[STAT_MUL_SCHOOLBOOK].limbs == 6);
+    assert(&test, stats.kernels[STAT_MUL_SCHOOLBOOK].bytes == 6 * sizeof(uint64_t));
+    assert(&test, stats.kernels[STAT_ADDMUL_1].calls > 0);
+    assert(&test, stats.kernels[STAT_GCD_LEHMER].calls == 2);
+    assert(&test, stats.kernels[STAT_GCD_LEHMER].cycles > 0);
+    assert(&test, stats.kernels[STAT_GCD_BINARY].calls == 1);
+    assert(&test, traced_calls == 1);
+
+    reset_stats();
+    snapshot_stats(&stats);
+    assert(&test, stats.kernels[STAT_GCD_LEHMER].calls == 0);
+
+    // one Karatsuba call at the top, its halves drop to schoolbook
+    mul_full_segments(product, wide->data, wide->length, wide->data, wide->length);
+    snapshot_stats(&stats);
+    assert(&test, stats.kernels[STAT_MUL_KARATSUBA].calls == 1);
+    assert(&test, stats.kernels[STAT_MUL_KARATSUBA].limbs == 2 * wide->length);
+    assert(&test, stats.kernels[STAT_MUL_SCHOOLBOOK].calls == 3);
+    assert(&test, stats.kernels[STAT_MUL_NTT].calls == 0);
+  }
+
+  free_bigint(a);
+  free_bigint(b);
+  free_bigint(wide);
+  return test;
+}
+
+/**
+ * Runs every dispatched kernel on a and b, results packed into out
+ */
+static void run_cpu_kernels(uint64_t* out, uint64_t* a, uint64_t* b, uint64_t length) {
+  uint64_t i, *row;
+  for(i = 0; i < 5; i++) {
+    memcpy(out + i * (length + 1), i < 2 ? a : b, length * sizeof(uint64_t));
+  }
+  row = out;
+  add_segments(row, b, length);
+  row += length + 1;
+  sub_segments(row, b, length);
+  row += length + 1;
+  row[length] = mul_1_segments(row, a, length, b[length-1]);
+  row += length + 1;
+  row[length] = addmul_1_segments(row, a, length, ~(uint64_t) 0);
+  row += length + 1;
+  row[length] = submul_1_segments(row, a, length, ~(uint64_t) 0);
+  row += length + 1;
+  for(i = 0; i <= length; i++) {
+    row[i] = popcount_segments(a, i) << 32 | xor_popcount_segments(a, b, i);
+  }
+}
+
+bool test_cpu_tiers() {
+  bool test = TRUE;
+  const uint64_t length = 37;
+  uint64_t a[37], b[37], expect[6 * 38], got[6 * 38];
+  uint64_t i, seed = 0x9E3779B97F4A7C15;
+  cpu_tier tier, active = cpu_tier_active();
+
+  //the low half of b is all ones so carries run across it
+  for(i = 0; i < length; i++) {
+    seed = seed * 6364136223846793005 + 1442695040888963407;
+    a[i] = seed;
+    b[i] = i < length / 2 ? ~(uint64_t) 0 : seed >> 7;
+  }
+  printf("supported: %s, active: %s\n", cpu_tier_name(cpu_tier_supported()),
+	 cpu_tier_name(active));
+  assert(&test, cpu_tier_name(CPU_TIER_COUNT) == NULL);
+
+  set_cpu_tier(CPU_PORTABLE);
+  memset(expect, 0, sizeof(expect));
+  run_cpu_kernels(expect, a, b, length);
+  for(tier = CPU_BMI2; tier <= cpu_tier_supported(); tier++) {
+    assert(&test, set_cpu_tier(tier) == tier && cpu_tier_active() == tier);
+    memset(got, 0, sizeof(got));
+    run_cpu_kernels(got, a, b, length);
+    assert(&test, memcmp(got, expect, sizeof(got)) == 0);
+  }
+
+  assert(&test, set_cpu_tier(CPU_AVX512) == cpu_tier_supported());
+  set_cpu_tier(active);
+  return test;
+}
+
+bool test_serialize() {
+  bool test = TRUE, negative;
+  bigint* value = get_fill(5, 0x5A);
+  bigint* copy;
+  FILE* file = tmpfile();
+  byte flip;
+
+  value->data[3] = 0x0123456789ABCDEF;
+  assert(&test, write_bigint(file, value, TRUE) == value);
+  assert(&test, ftell(file) == BIGINT_HEADER_SIZE + 5 * sizeof(uint64_t));
+  rewind(file);
+  copy = read_bigint(file, &negative);
+  assert(&test, copy != NULL && negative == TRUE);
+  assert(&test, copy->length == 5 && eq(copy->data, value->data, 5));
+  free_bigint(copy);
+
+  //a flipped bit in the limbs fails the checksum
+  fseek(file, BIGINT_HEADER_SIZE + 20, SEEK_SET);
+  flip = fgetc(file) ^ 0x10;
+  fseek(file, BIGINT_HEADER_SIZE + 20, SEEK_SET);
+  fputc(flip, file);
+  rewind(file);
+  assert(&test, read_bigint(file, NULL) == NULL);
+
+  //as does a bad magic or a short file
+  rewind(file);
+  fputc('X', file);
+  rewind(file);
+  assert(&test, read_bigint(file, NULL) == NULL);
+  fclose(file);
+
+  file = tmpfile();
+  write_bigint(file, value, FALSE);
+  fflush(file);
+  assert(&test, ftruncate(fileno(file), BIGINT_HEADER_SIZE + 8) == 0);
+  rewind(file);
+  assert(&test, read_bigint(file, NULL) == NULL);
+  fclose(file);
+
+  free_bigint(value);
+  return test;
+}
+
+bool test_map_bigint() {
+  bool test = TRUE;
+  char path[] = "/tmp/bigmath_map_XXXXXX";
+  bigint* value = get_fill(64, 0x33);
+  bigint* copy;
+  bigint_mapping* mapping;
+  FILE* file = fdopen(mkstemp(path), "w+");
+
+  write_bigint(file, value, FALSE);
+  fclose(file);
+
+  mapping = map_bigint(path, FALSE, TRUE);
+  assert(&test, mapping != NULL && !mapping->negative);
+  assert(&test, mapping->value.length == 64 && eq(mapping->value.data, value->data, 64));
+  //private view: in place arithmetic stays in memory
+  add_bigint_nat(&mapping->value, 1);
+  unmap_bigint(mapping);
+  file = fopen(path, "r");
+  copy = read_bigint(file, NULL);
+  fclose(file);
+  assert(&test, copy != NULL && eq(copy->data, value->data, 64));
+  free_bigint(copy);
+
+  //shared view: the change and a fresh checksum land in the file
+  mapping = map_bigint(path, TRUE, FALSE);
+  add_bigint_nat(&mapping->value, 1);
+  unmap_bigint(mapping);
+  file = fopen(path, "r");
+  copy = read_bigint(file, NULL);
+  fclose(file);
+  add_bigint_nat(value, 1);
+  assert(&test, copy != NULL && eq(copy->data, value->data, 64));
+  free_bigint(copy);
+
+  assert(&test, map_bigint("/nonexistent/bigint", FALSE, FALSE) == NULL);
+  unlink(path);
+  free_bigint(value);
+  return test;
+}
+
+bool test_import_export() {
+  bool test = TRUE;
+  byte bytes[24], out[32];
+  uint64_t segments[3], i, count;
+  bigint* value;
+
+  //0x0102...18 as a big endian byte string
+  for(i = 0; i < 24; i++) {
+    bytes[i] = i + 1;
+  }
+  import_segments(segments, 3, bytes, 24, 1, 1, 0);
+  assert(&test, segments[0] == 0x1112131415161718 && segments[2] == 0x0102030405060708);
+
+  //the same number as little endian 32 bit words, least significant first
+  count = export_segments(out, segments, 3, 4, -1, -1);
+  assert(&test, count == 6);
+  assert(&test, out[0] == 0x18 && out[3] == 0x15 && out[4] == 0x14 && out[23] == 0x01);
+  import_segments(segments, 3, out, count, 4, -1, -1);
+  assert(&test, segments[1] == 0x090A0B0C0D0E0F10);
+
+  //big endian 16 bit words, most significant first, is the byte string
+  count = export_segments(out, segments, 3, 2, 1, 1);
+  assert(&test, count == 12 && memcmp(out, bytes, 24) == 0);
+
+  //leading zeros are dropped, a partial top word is padded
+  segments[2] = 0;
+  segments[1] = 0xABCDEF;
+  count = export_segments(out, segments, 3, 4, 1, 1);
+  assert(&test, count == 3);
+  assert(&test, out[0] == 0x00 && out[1] == 0xAB && out[2] == 0xCD && out[11] == 0x18);
+  assert(&test, export_segments(out, segments, 3, 0, 1, 1) == 0);
+
+  value = import_bigint(bytes, 24, 1, 1, 1);
+  assert(&test, value->length == 3 && value->data[2] == 0x0102030405060708);
+  assert(&test, export_bigint(out, value, 8, -1, 0) == 3);
+  assert(&test, memcmp(out, value->data, 24) == 0);
+  free_bigint(value);
+
+  //does not fit
+  assert(&test, import_segments(segments, 2, bytes, 24, 1, 1, 1) == NULL);
+  memset(out, 0, sizeof(out));
+  out[31] = 7;
+  assert(&test, import_segments(segments, 2, out, 32, 1, 1, 1) == segments);
+  assert(&test, segments[0] == 7 && segments[1] == 0);
+  return test;
+}
+
+/**
+ * Write segments to a fresh temp file in the write_bigint format and
+ * open it for chunked arithmetic with a small chunk, so every
+ * operation crosses many chunk boundaries
+ */
+static chunked_bigint* temp_chunked(char* path, uint64_t* segments, uint64_t length) {
+  bigint value = {segments, length};
+  FILE* file = fdopen(mkstemp(path), "w+");
+  write_bigint(file, &value, FALSE);
+  fclose(file);
+  return open_chunked_bigint(path, 8, TRUE);
+}
+
+static bool chunked_equals(char* path, uint64_t* expect, uint64_t length) {
+  FILE* file = fopen(path, "r");
+  bigint* value = read_bigint(file, NULL);
+  bool equal = value != NULL && value->length == length &&
+    memcmp(value->data, expect, length * sizeof(uint64_t)) == 0;
+  fclose(file);
+  if(value != NULL) {
+    free_bigint(value);
+  }
+  return equal;
+}
+
+bool test_chunked() {
+  bool test = TRUE;
+  char a_path[] = "/tmp/bigmath_chunk_a_XXXXXX";
+  char b_path[] = "/tmp/bigmath_chunk_b_XXXXXX";
+  char dest_path[] = "/tmp/bigmath_chunk_c_XXXXXX";
+  uint64_t a[150] = {0}, b[150] = {0}, expect[150], seed = 0x243F6A8885A308D3, i;
+  chunked_bigint *ca, *cb, *dest;
+
+  for(i = 0; i < 100; i++) {
+    seed = seed * 6364136223846793005 + 1442695040888963407;
+    a[i] = seed;
+    b[i] = i < 70 ? seed ^ (seed >> 29) : 0;
+  }
+  a[99] = b[69] = ~(uint64_t) 0;
+  ca = temp_chunked(a_path, a, 100);
+  cb = temp_chunked(b_path, b, 70);
+  assert(&test, ca != NULL && cb != NULL && ca->length == 100);
+
+  //a carry runs across a chunk boundary
+  memcpy(expect, a, 100 * sizeof(uint64_t));
+  add_segments(expect, b, 100);
+  assert(&test, add_chunked(ca, cb) != NULL && chunked_equals(a_path, expect, 100));
+
+  shl_segments(expect, 100, 131);
+  assert(&test, shl_chunked(ca, 131) != NULL && chunked_equals(a_path, expect, 100));
+  shr_segments(expect, 100, 67);
+  assert(&test, shr_chunked(ca, 67) != NULL && chunked_equals(a_path, expect, 100));
+  mul_1_segments(expect, expect, 100, 0xFEDCBA9876543211);
+  assert(&test, mul_1_chunked(ca, 0xFEDCBA9876543211) != NULL &&
+	 chunked_equals(a_path, expect, 100));
+
+  //170 limb product truncated to 150
+  memcpy(a, expect, 100 * sizeof(uint64_t));
+  memcpy(expect, a, 150 * sizeof(uint64_t));
+  mul_segments(expect, b, 150);
+  close(mkstemp(dest_path));
+  dest = create_chunked_bigint(dest_path, 150, 16);
+  assert(&test, dest != NULL && mul_chunked(dest, ca, cb) != NULL);
+  close_chunked_bigint(dest);
+  assert(&test, chunked_equals(dest_path, expect, 150));
+  assert(&test, open_chunked_bigint("/nonexistent/bigint", 0, FALSE) == NULL);
+
+  close_chunked_bigint(ca);
+  close_chunked_bigint(cb);
+  unlink(a_path);
+  unlink(b_path);
+  unlink(dest_path);
+  return test;
+}
+
+static void e_terms(uint64_t k, series_term* term, void* context) {
+  term->a[0] = 1;
+  term->p[0] = 1;
+  term->q[0] = k ? k : 1;
+}
+
+static void chudnovsky_terms(uint64_t k, series_term* term, void* context) {
+  unsigned __int128 q = (unsigned __int128) k * k * k * 10939058860032000;
+  term->a[0] = 13591409 + 545140134 * k;
+  if(k == 0) {
+    term->p[0] = term->q[0] = 1;
+    return;
+  }
+  term->p[0] = (6 * k - 5) * (2 * k - 1) * (6 * k - 1);
+  term->p_negative = TRUE;
+  term->q[0] = q;
+  term->q[1] = q >> 64;
+}
+
+bool test_binary_splitting() {
+  bool test = TRUE;
+  const char* pi = "3141592653589793238462643383279502884197169399375105820974944592307816406286";
+  uint64_t expect[600] = {0}, x[16] = {0}, divisor[16] = {0}, i, size = 1, sum = 0, term;
+  bigint *value, *other, *parts[3000];
+  series_sum* series;
+  char* digits;
+
+  value = factorial_bigint(20);
+  assert(&test, value->length == 1 && value->data[0] == 2432902008176640000);
+  free_bigint(value);
+  value = factorial_bigint(0);
+  assert(&test, value->length == 1 && value->data[0] == 1);
+  free_bigint(value);
+
+  //3000! against a product built one factor at a time, on one and on four threads
+  expect[0] = 1;
+  for(i = 2; i <= 3000; i++) {
+    expect[size] = mul_1_segments(expect, expect, size, i);
+    size += expect[size] != 0;
+  }
+  set_split_threads(1);
+  value = factorial_bigint(3000);
+  assert(&test, value->length == size && eq(value->data, expect, size));
+  free_bigint(value);
+  set_split_threads(4);
+  value = factorial_bigint(3000);
+  assert(&test, value->length == size && eq(value->data, expect, size));
+  free_bigint(value);
+
+  for(i = 0; i < 3000; i++) {
+    parts[i] = create_bigint(malloc(sizeof(uint64_t)), 1);
+    parts[i]->data[0] = i + 1;
+  }
+  value = product_bigints(parts, 3000);
+  assert(&test, value->length == size && eq(value->data, expect, size));
+  free_bigint(value);
+  for(i = 0; i < 3000; i++) {
+    free_bigint(parts[i]);
+  }
+  set_split_threads(0);
+
+  value = binomial_bigint(100, 50);
+  assert(&test, value->length == 2 && value->data[0] == 0x1070380DC8085568 &&
+	 value->data[1] == 0x145FF5D3B);
+  free_bigint(value);
+  value = binomial_bigint(5, 7);
+  assert(&test, value->length == 1 && value->data[0] == 0);
+  free_bigint(value);
+  value = primorial_bigint(30);
+  assert(&test, value->length == 1 && value->data[0] == 6469693230);
+  free_bigint(value);
+
+  //e: t / q with q = 19!, t = sum of 19! / k!
+  series = sum_series(&e_terms, 20, NULL);
+  for(i = 20, term = 1; i-- > 0; term *= i ? i : 1) {
+    sum += term;
+  }
+  assert(&test, series->q->data[0] == 121645100408832000 && series->t->data[0] == sum);
+  assert(&test, !series->t_negative);
+  free_series_sum(series);
+
+  //Chudnovsky: pi = 426880 sqrt(10005) q / t, to 76 digits from six terms
+  series = sum_series(&chudnovsky_terms, 6, NULL);
+  assert(&test, !series->t_negative && series->p_negative);
+  x[0] = 10005;
+  for(i = 0; i < 2 * 80; i++) {
+    mul_1_segments(x, x, 16, 10);
+  }
+  sqrt_segments(x, 16);
+  mul_1_segments(x, x, 16, 426880);
+  memcpy(divisor, series->q->data, series->q->length * sizeof(uint64_t));
+  mul_segments(x, divisor, 16);
+  memset(divisor, 0, sizeof(divisor));
+  memcpy(divisor, series->t->data, series->t->length * sizeof(uint64_t));
+  div_segments(x, divisor, 16);
+  other = create_bigint(x, 16);
+  digits = bigint_to_new_str(other);
+  printf("%.80s\n", digits);
+  assert(&test, strncmp(digits, pi, 76) == 0);
+  free(digits);
+  free(other);
+  free_series_sum(series);
+  return test;
+}
+
+bool test_product_tree() {
+  bool test = TRUE;
+  uint64_t i, j, k, x[1024], divisor[1024], *expected;
+  uint64_t small[4] = {6, 35, 15, 11}, expect[4] = {3, 5, 15, 1};
+  bigint *moduli[40], *value, *remainders[40], *values[4], *gcds[4];
+  product_tree* tree;
+
+  //40 moduli of 1 to 12 segments against a 1000 segment value, twice
+  //so that the second pass runs on the cached reciprocals
+  for(i = 0; i < 40; i++) {
+    moduli[i] = create_bigint(malloc(12 * sizeof(uint64_t)), 1 + i % 12);
+    for(j = 0; j < moduli[i]->length; j++) {
+      moduli[i]->data[j] = 0x9E3779B97F4A7C15 * (i * 13 + j + 1);
+    }
+    moduli[i]->data[moduli[i]->length - 1] |= 1;
+  }
+  value = create_bigint(malloc(1000 * sizeof(uint64_t)), 1000);
+  for(i = 0; i < 1000; i++) {
+    value->data[i] = 0xD1B54A32D192ED03 * (i + 7);
+  }
+  assert(&test, create_product_tree(moduli, 0) == NULL);
+  tree = create_product_tree(moduli, 40);
+  assert(&test, tree != NULL && tree->count == 40);
+  for(k = 0; k < 2; k++) {
+    mod_product_tree(remainders, value, tree);
+    for(i = 0; i < 40; i++) {
+      memset(x, 0, sizeof(x));
+      memset(divisor, 0, sizeof(divisor));
+      memcpy(x, value->data, 1000 * sizeof(uint64_t));
+      memcpy(divisor, moduli[i]->data, moduli[i]->length * sizeof(uint64_t));
+      expected = div_segments_mod(x, divisor, 1024);
+      memset(divisor, 0, sizeof(divisor));
+      memcpy(divisor, remainders[i]->data, remainders[i]->length * sizeof(uint64_t));
+      assert(&test, remainders[i]->length <= moduli[i]->length && eq(divisor, expected, 1024));
+      free(expected);
+      free_bigint(remainders[i]);
+    }
+  }
+  free_product_tree(tree);
+  free_bigint(value);
+  for(i = 0; i < 40; i++) {
+    free_bigint(moduli[i]);
+  }
+
+  for(i = 0; i < 4; i++) {
+    values[i] = create_bigint(&small[i], 1);
+  }
+  for(k = 0; k < 2; k++) {
+    assert(&test, batch_gcd(gcds, values, 4, k) == gcds);
+    for(i = 0; i < 4; i++) {
+      assert(&test, gcds[i]->data[0] == expect[i] &&
+	     popcount_segments(gcds[i]->data + 1, gcds[i]->length - 1) == 0);
+      free_bigint(gcds[i]);
+    }
+  }
+  for(i = 0; i < 4; i++) {
+    free(values[i]);
+  }
+  return test;
+}
+
+static bool counting_random(uint64_t* dest, uint64_t length, void* context) {
+  uint64_t* state = context, i;
+  for(i = 0; i < length; i++) {
+    *state = *state * 6364136223846793005 + 1442695040888963407;
+    dest[i] = *state ^ (*state >> 29);
+  }
+  return TRUE;
+}
+
+bool test_primes() {
+  bool test = TRUE;
+  uint64_t x[4], exponent[4], modulus[4], i, d, state, value;
+  uint64_t composites[5] = {561, 5459, 3215031751, 2047, 1194649};
+  bool prime;
+  bigint *first, *second;
+
+  //Fermat for 2^127 - 1 and 3^(10^9 + 6) mod 10^9 + 7
+  modulus[0] = exponent[0] = ~(uint64_t) 0;
+  modulus[1] = exponent[1] = ~(uint64_t) 0 >> 1;
+  exponent[0]--;
+  x[0] = 2;
+  x[1] = 0;
+  assert(&test, powmod_segments(x, exponent, 2, modulus, 2) == x);
+  assert(&test, x[0] == 1 && x[1] == 0);
+  x[0] = 3;
+  modulus[0] = 1000000007;
+  exponent[0] = 1000000006;
+  powmod_segments(x, exponent, 1, modulus, 1);
+  assert(&test, x[0] == 1);
+  modulus[0] = 10;
+  assert(&test, powmod_segments(x, exponent, 1, modulus, 1) == NULL);
+
+  for(value = 0; value < 2000; value++) {
+    for(prime = value > 1, d = 2; d * d <= value; d++) {
+      prime = prime && value % d;
+    }
+    assert(&test, is_prime_segments(&value, 1, 1) == prime);
+  }
+  //Carmichael, strong Lucas and base 2 strong pseudoprimes
+  for(i = 0; i < 5; i++) {
+    assert(&test, !is_prime_segments(&composites[i], 1, 0));
+  }
+  memset(x, 0, sizeof(x));
+  x[0] = ~(uint64_t) 0;
+  x[1] = ~(uint64_t) 0 >> 1;
+  assert(&test, is_prime_segments(x, 4, 2));
+  x[1] = ~(uint64_t) 0 >> 61;
+  assert(&test, !is_prime_segments(x, 4, 2));
+  //(2^61 - 1)(2^89 - 1)
+  memset(x, 0, sizeof(x));
+  x[0] = ~(uint64_t) 0 >> 3;
+  memset(modulus, 0, sizeof(modulus));
+  modulus[0] = ~(uint64_t) 0;
+  modulus[1] = ~(uint64_t) 0 >> 39;
+  mul_segments(x, modulus, 4);
+  assert(&test, !is_prime_segments(x, 4, 2));
+
+  //the same source gives the same prime on any number of threads
+  state = 1;
+  set_prime_threads(1);
+  first = random_prime_bigint(256, 2, &counting_random, &state);
+  state = 1;
+  set_prime_threads(4);
+  second = random_prime_bigint(256, 2, &counting_random, &state);
+  set_prime_threads(0);
+  assert(&test, first->length == 4 && first->data[3] >> 63 == 1);
+  assert(&test, eq(first->data, second->data, 4) && is_prime_bigint(first, 8));
+  free_bigint(first);
+  free_bigint(second);
+  first = random_prime_bigint(20, 0, &counting_random, &state);
+  assert(&test, first->data[0] >> 19 == 1 && is_prime_bigint(first, 0));
+  free_bigint(first);
+  assert(&test, random_prime_bigint(1, 0, &counting_random, &state) == NULL);
+  return test;
+}
+
+bool test_multi_powmod() {
+  bool test = TRUE;
+  uint64_t modulus[8], g[8], h[8], a[8], b[8], sum[8], zero[8] = {0}, x[8], y[8], i;
+  uint64_t *bases[3] = {g, h, g}, *exponents[3] = {a, zero, b};
+  uint64_t header[2];
+  powmod_table *table, *loaded;
+  bigint record;
+  FILE* file;
+
+  for(i = 0; i < 8; i++) {
+    modulus[i] = 0x9E3779B97F4A7C15 * (i + 3);
+    g[i] = 0xD1B54A32D192ED03 * (i + 5);
+    h[i] = 0x8CB92BA72F3D8DD7 * (i + 7);
+    a[i] = 0xA0761D6478BD642F * (i + 11);
+    b[i] = 0xE7037ED1A0B428DB * (i + 13);
+  }
+  modulus[0] |= 1;
+  a[7] >>= 2;
+  b[7] >>= 2;
+  memcpy(sum, a, sizeof(sum));
+  add_segments(sum, b, 8);
+
+  //g^a h^0 g^b = g^(a + b)
+  assert(&test, multi_powmod_segments(x, bases, exponents, 8, 3, modulus, 8) == x);
+  memcpy(y, g, sizeof(y));
+  powmod_segments(y, sum, 8, modulus, 8);
+  assert(&test, eq(x, y, 8));
+  modulus[0]--;
+  assert(&test, multi_powmod_segments(x, bases, exponents, 8, 3, modulus, 8) == NULL);
+  assert(&test, create_powmod_table(g, modulus, 8, 511, 4) == NULL);
+  modulus[0]++;
+
+  table = create_powmod_table(g, modulus, 8, 511, 5);
+  assert(&test, powmod_table_segments(x, sum, 8, table) == x && eq(x, y, 8));
+  assert(&test, powmod_table_segments(x, zero, 8, table) == x && x[0] == 1);
+  set_bit_segments(sum, 8, 511);
+  assert(&test, powmod_table_segments(x, sum, 8, table) == NULL);
+  clear_bit_segments(sum, 8, 511);
+
+  file = tmpfile();
+  assert(&test, write_powmod_table(file, table) == table);
+  rewind(file);
+  loaded = read_powmod_table(file);
+  assert(&test, loaded != NULL && loaded->window == 5 && loaded->exponent_bits == 511);
+  assert(&test, powmod_table_segments(x, sum, 8, loaded) == x && eq(x, y, 8));
+  fclose(file);
+
+  //a header whose powers would wrap the table size to nothing
+  file = tmpfile();
+  header[0] = 2;
+  header[1] = ~(uint64_t) 0;
+  record = (bigint) {header, 2};
+  write_bigint(file, &record, FALSE);
+  record = (bigint) {modulus, 8};
+  write_bigint(file, &record, FALSE);
+  record = (bigint) {zero, 0};
+  write_bigint(file, &record, FALSE);
+  rewind(file);
+  assert(&test, read_powmod_table(file) == NULL);
+  fclose(file);
+  assert(&test, create_powmod_table(g, modulus, 8, ~(uint64_t) 0, 2) == NULL);
+
+  free_powmod_table(table);
+  free_powmod_table(loaded);
+  return test;
+}
+
+bool test_expr() {
+  bool test = TRUE, negative;
+  uint64_t a_data[3] = {~(uint64_t) 0, ~(uint64_t) 0, 5}, b_data[3] = {7, 1, 0};
+  uint64_t c_data[1] = {3}, expect[6], sum[3];
+  bigint a = {a_data, 3}, b = {b_data, 3}, c = {c_data, 1}, *value;
+  bigint_expr* expr = create_expr();
+  uint64_t x, y, z, shared, root;
+
+  x = expr_value(expr, &a);
+  y = expr_value(expr, &b);
+  z = expr_value(expr, &c);
+
+  //a b + 3 c - a b through a second leaf for b
+  root = expr_sub(expr, expr_add(expr, expr_mul(expr, x, y),
+				 expr_mul(expr, expr_word(expr, 3), z)),
+		  expr_mul(expr, x, expr_value(expr, &b)));
+  value = eval_expr(expr, root, &negative);
+  assert(&test, value->length == 1 && value->data[0] == 9 && !negative);
+  free_bigint(value);
+
+  //c - a b is negative
+  root = expr_sub(expr, z, expr_mul(expr, x, y));
+  value = eval_expr(expr, root, &negative);
+  mul_full_segments(expect, a_data, 3, b_data, 3);
+  expect[0] -= 3;
+  assert(&test, negative && value->length == 4 && eq(value->data, expect, 4));
+  free_bigint(value);
+
+  //(a + b)^2 with the sum shared, after b changes
+  shared = expr_add(expr, x, y);
+  root = expr_mul(expr, shared, shared);
+  b_data[1] = 0;
+  value = eval_expr(expr, root, &negative);
+  memcpy(sum, a_data, sizeof(sum));
+  add_segments(sum, b_data, 3);
+  mul_full_segments(expect, sum, 3, sum, 3);
+  assert(&test, !negative && value->length == 5 && eq(value->data, expect, 5));
+  free_bigint(value);
+
+  value = eval_expr(expr, expr_sub(expr, x, x), &negative);
+  assert(&test, value->length == 1 && value->data[0] == 0 && !negative);
+  free_bigint(value);
+
+  assert(&test, expr_add(expr, x, expr->count) == EXPR_INVALID);
+  assert(&test, expr_mul(expr, EXPR_INVALID, x) == EXPR_INVALID);
+  assert(&test, eval_expr(expr, EXPR_INVALID, NULL) == NULL);
+  free_expr(expr);
+  return test;
+}
+
+static void* gated_job(bigint_job* job, void* argument) {
+  while(!__atomic_load_n((bool*) argument, __ATOMIC_ACQUIRE)) {
+    usleep(100);
+  }
+  return argument;
+}
+
+static void* ordered_job(bigint_job* job, void* argument) {
+  uint64_t* order = argument;
+  order[++order[0]] = (uint64_t) job;
+  return argument;
+}
+
+static void* cancellable_job(bigint_job* job, void* argument) {
+  while(!job_cancelled(job)) {
+    usleep(100);
+  }
+  return NULL;
+}
+
+static void count_job(bigint_job* job, void* context) {
+  __atomic_add_fetch((uint64_t*) context, 1, __ATOMIC_RELAXED);
+}
+
+static void release_job(bigint_job* job, void* context) {
+  free_job(job);
+  __atomic_add_fetch((uint64_t*) context, 1, __ATOMIC_RELAXED);
+}
+
+bool test_jobs() {
+  bool test = TRUE, open = FALSE;
+  uint64_t expect[200] = {0}, x[200] = {0}, order[8] = {0}, finished = 0, events, i;
+  job_options options = {0, 0, &count_job, &finished};
+  bigint_job *gate, *jobs[4];
+  bigint value = {expect, 200};
+  job_pool* pool = create_job_pool(1, 0);
+  char *digits, *inline_digits;
+
+  //held up by the gate, the queued jobs start by priority
+  gate = submit_job(pool, &gated_job, &open, &options);
+  for(i = 0; i < 4; i++) {
+    options.priority = i == 3 ? 2 : i;
+    jobs[i] = submit_job(pool, &ordered_job, order, &options);
+  }
+  assert(&test, cancel_job(jobs[1]) && poll_job(jobs[1]) == JOB_CANCELLED);
+  __atomic_store_n(&open, TRUE, __ATOMIC_RELEASE);
+  assert(&test, wait_job(gate) == &open);
+  for(i = 0; i < 4; i++) {
+    wait_job(jobs[i]);
+  }
+  assert(&test, order[0] == 3 && order[1] == (uint64_t) jobs[2] &&
+	 order[2] == (uint64_t) jobs[3] && order[3] == (uint64_t) jobs[0]);
+  assert(&test, finished == 5 && read(job_pool_fd(pool), &events, sizeof(events)) == 8 &&
+	 events == 5);
+  free_job(gate);
+  for(i = 0; i < 4; i++) {
+    free_job(jobs[i]);
+  }
+
+  gate = submit_job(pool, &cancellable_job, NULL, NULL);
+  assert(&test, cancel_job(gate) && wait_job(gate) == NULL);
+  assert(&test, poll_job(gate) == JOB_CANCELLED && !cancel_job(gate));
+  free_job(gate);
+
+  //pow in the background against pow_segments, formatting inline
+  x[0] = expect[0] = 3;
+  pow_segments(expect, 7000, 200);
+  gate = submit_pow_job(pool, x, 7000, 200, NULL);
+  assert(&test, wait_job(gate) == x && eq(x, expect, 200));
+  free_job(gate);
+  gate = submit_to_str_job(pool, &value, 10, NULL);
+  digits = wait_job(gate);
+  free_job(gate);
+  value.length = 8;
+  gate = submit_to_str_job(pool, &value, 10, NULL);
+  assert(&test, poll_job(gate) == JOB_DONE);
+  inline_digits = wait_job(gate);
+  assert(&test, strlen(digits) > 2000 && strlen(inline_digits) < 200);
+  free(digits);
+  free(inline_digits);
+  free_job(gate);
+
+  options.memory = 64;
+  gate = submit_pow_job(pool, x, 3, 200, &options);
+  assert(&test, poll_job(gate) == JOB_FAILED && wait_job(gate) == NULL && eq(x, expect, 200));
+  free_job(gate);
+
+  //an inline job whose callback drops the only reference
+  finished = 0;
+  options.memory = 0;
+  options.callback = &release_job;
+  memset(x, 0, sizeof(x));
+  x[0] = 3;
+  submit_pow_job(pool, x, 5, 8, &options);
+  assert(&test, finished == 1 && x[0] == 243);
+  free_job_pool(pool);
+  return test;
+}
+
+bool test_bigfloat() {
+  bool test = TRUE, negative;
+  uint64_t word = 11, wide[8] = {0}, root[8];
+  bigint value = {&word, 1}, *integer;
+  bigfloat *a = create_bigfloat(64), *b = create_bigfloat(64), *c = create_bigfloat(64);
+  bigfloat *small = create_bigfloat(3), *wide_root = create_bigfloat(256);
+
+  //11 = 1011b ties to 12 at 3 bits, 9 = 1001b to 8
+  set_bigfloat_bigint(small, &value, FALSE, ROUND_NEAREST);
+  assert(&test, small->mantissa[0] == 6 && small->exponent == 1);
+  word = 9;
+  set_bigfloat_bigint(small, &value, FALSE, ROUND_NEAREST);
+  assert(&test, bigfloat_to_double(small) == 8.0);
+  word = 11;
+  set_bigfloat_bigint(small, &value, TRUE, ROUND_DOWN);
+  assert(&test, bigfloat_to_double(small) == -12.0);
+  set_bigfloat_bigint(small, &value, TRUE, ROUND_UP);
+  assert(&test, bigfloat_to_double(small) == -10.0);
+
+  //1/3 is 0.0101...b
+  set_bigfloat_double(a, 1, ROUND_NEAREST);
+  set_bigfloat_double(b, 3, ROUND_NEAREST);
+  div_bigfloat(c, a, b, ROUND_ZERO);
+  assert(&test, c->mantissa[0] == 0xAAAAAAAAAAAAAAAA && c->exponent == -65);
+  div_bigfloat(c, a, b, ROUND_NEAREST);
+  assert(&test, c->mantissa[0] == 0xAAAAAAAAAAAAAAAB && c->exponent == -65);
+  mul_bigfloat(c, c, b, ROUND_NEAREST);
+  assert(&test, cmp_bigfloat(c, a) == 0);
+  assert(&test, div_bigfloat(c, a, small, ROUND_NEAREST) != NULL);
+  sub_bigfloat(small, small, small, ROUND_NEAREST);
+  assert(&test, div_bigfloat(c, a, small, ROUND_NEAREST) == NULL);
+
+  //1 + 2^-100 only rounds; 1 - 2^-100 cancels
+  set_bigfloat_double(b, ldexp(1, -100), ROUND_NEAREST);
+  add_bigfloat(c, a, b, ROUND_NEAREST);
+  assert(&test, cmp_bigfloat(c, a) == 0);
+  add_bigfloat(c, a, b, ROUND_UP);
+  assert(&test, c->mantissa[0] == 0x8000000000000001 && c->exponent == -63);
+  sub_bigfloat(c, a, b, ROUND_DOWN);
+  assert(&test, c->mantissa[0] == ~(uint64_t) 0 && c->exponent == -64);
+
+  //equal exponents add in place, overflowing into the exponent
+  add_bigfloat(c, c, c, ROUND_NEAREST);
+  assert(&test, c->mantissa[0] == ~(uint64_t) 0 && c->exponent == -63);
+  add_bigfloat(c, c, a, ROUND_NEAREST);
+  assert(&test, bigfloat_to_double(c) == 3.0 && cmp_bigfloat(a, c) < 0);
+  sub_bigfloat(b, a, c, ROUND_NEAREST);
+  assert(&test, bigfloat_to_double(b) == -2.0 && cmp_bigfloat(b, a) < 0);
+
+  //sqrt(2) at 256 bits is floor(sqrt(2^511)) * 2^-255 when truncated
+  set_bigfloat_double(a, 2, ROUND_NEAREST);
+  sqrt_bigfloat(wide_root, a, ROUND_DOWN);
+  set_bit_segments(wide, 8, 511);
+  memcpy(root, wide, sizeof(root));
+  sqrt_segments(root, 8);
+  assert(&test, wide_root->exponent == -255 && eq(wide_root->mantissa, root, 4));
+  sqrt_bigfloat(wide_root, a, ROUND_UP);
+  add_1_segments(root, 4, 1);
+  assert(&test, eq(wide_root->mantissa, root, 4));
+  assert(&test, sqrt_bigfloat(c, b, ROUND_NEAREST) == NULL);
+
+  //integer rounding
+  set_bigfloat_double(a, -2.5, ROUND_NEAREST);
+  integer = bigfloat_to_bigint(a, &negative, ROUND_NEAREST);
+  assert(&test, integer->data[0] == 2 && negative);
+  free_bigint(integer);
+  integer = bigfloat_to_bigint(a, &negative, ROUND_DOWN);
+  assert(&test, integer->data[0] == 3 && negative);
+  free_bigint(integer);
+  ldexp_bigfloat(a, 70);
+  integer = bigfloat_to_bigint(a, &negative, ROUND_ZERO);
+  assert(&test, integer->length == 2 && integer->data[0] == 0 && integer->data[1] == 160);
+  free_bigint(integer);
+
+  //doubles: out of range both ways, and 2^-1075 (1 + 2^-125) rounded
+  //once to the least subnormal rather than to 2^-1075 and then to 0
+  ldexp_bigfloat(a, (long) 1 << 40);
+  assert(&test, bigfloat_to_double(a) == -INFINITY);
+  ldexp_bigfloat(a, -((long) 1 << 41));
+  assert(&test, bigfloat_to_double(a) == 0);
+  set_bigfloat_double(wide_root, 1, ROUND_NEAREST);
+  set_bigfloat_double(b, ldexp(1, -125), ROUND_NEAREST);
+  add_bigfloat(wide_root, wide_root, b, ROUND_NEAREST);
+  ldexp_bigfloat(wide_root, -1075);
+  assert(&test, bigfloat_to_double(wide_root) == ldexp(1, -1074));
+  ldexp_bigfloat(wide_root, 2);
+  assert(&test, bigfloat_to_double(wide_root) == ldexp(1, -1073));
+
+  free_bigfloat(a);
+  free_bigfloat(b);
+  free_bigfloat(c);
+  free_bigfloat(small);
+  free_bigfloat(wide_root);
+  return test;
+}
+
+bool test_hash_index() {
+  bool test = TRUE, inserted;
+  uint64_t short_data[2] = {5, 7}, long_data[11] = {5, 7}, other_data[11] = {5, 7};
+  uint64_t i, hash, tier, mersenne = ((uint64_t) 1 << 61) - 1;
+  bigint short_value = {short_data, 2}, long_value = {long_data, 11};
+  bigint other = {other_data, 11}, *stored;
+  bigint_index* index;
+
+  for(i = 2; i < 11; i++) {
+    other_data[i] = i * 0x0123456789ABCDEF;
+  }
+
+  assert(&test, eq_bigint(&short_value, &long_value) && eq_bigint(&long_value, &short_value));
+  assert(&test, !eq_bigint(&short_value, &other));
+  assert(&test, normalize_bigint(&long_value)->length == 2);
+  long_value.length = 11;
+  assert(&test, hash_bigint(&short_value, 1) == hash_bigint(&long_value, 1));
+  assert(&test, hash_bigint(&short_value, 1) != hash_bigint(&short_value, 2));
+  assert(&test, hash_bigint(&short_value, 1) != hash_bigint(&other, 1));
+
+  //every kernel tier hashes alike
+  hash = hash_bigint(&other, 3);
+  for(tier = CPU_PORTABLE; tier <= cpu_tier_supported(); tier++) {
+    set_cpu_tier(tier);
+    assert(&test, hash_bigint(&other, 3) == hash);
+  }
+  set_cpu_tier(cpu_tier_supported());
+
+  //2^64 = 8 and 2^61 - 1 = 0
+  assert(&test, fingerprint_bigint(&long_value) == 5 + 7 * 8);
+  short_data[0] = mersenne;
+  short_data[1] = 0;
+  assert(&test, fingerprint_bigint(&short_value) == 0);
+  short_data[0] = 5;
+  short_data[1] = 7;
+  assert(&test, fingerprint_bigint(&other) != fingerprint_bigint(&long_value));
+
+  index = create_bigint_index(4);
+  stored = insert_bigint_index(index, &short_value, &inserted);
+  assert(&test, inserted && stored != &short_value && stored->length == 2);
+  assert(&test, insert_bigint_index(index, &long_value, &inserted) == stored && !inserted);
+  assert(&test, find_bigint_index(index, &other) == NULL);
+  for(i = 0; i < 1000; i++) {
+    other_data[0] = i % 500;
+    insert_bigint_index(index, &other, NULL);
+  }
+  assert(&test, bigint_index_count(index) == 501);
+  other_data[0] = 123;
+  stored = find_bigint_index(index, &other);
+  assert(&test, stored != NULL && eq_bigint(stored, &other));
+  free_bigint_index(index);
+  return test;
+}
+
+bool test_rns() {
+  bool test = TRUE;
+  uint64_t small[3] = {3, 5, 7}, shared[2] = {15, 21}, wide[2] = {3, (uint64_t) 1 << 63};
+  uint64_t residues[3] = {2, 3, 2}, value[10] = {0};
+  uint64_t a[4] = {~(uint64_t) 0, 0x0123456789ABCDEF, 42, 0xFEDCBA9876543210};
+  uint64_t b[4] = {7, ~(uint64_t) 0, 0, 0x8000000000000000}, product[8];
+  uint64_t ra[10], rb[10], rp[10], extended[12], direct[12];
+  rns_base *base, *other;
+
+  //x = 2 mod 3, 3 mod 5, 2 mod 7
+  base = create_rns_base(small, 3);
+  assert(&test, base->length == 1 && base->product[0] == 105);
+  assert(&test, from_rns_segments(value, residues, base)[0] == 23);
+  free_rns_base(base);
+  assert(&test, create_rns_base(shared, 2) == NULL);
+  assert(&test, create_rns_base(wide, 2) == NULL);
+
+  //nine primes below 2^63 hold the 512 bit product
+  base = create_rns_base(NULL, 9);
+  assert(&test, base->length == 9 && base->moduli[0] == 0x7FFFFFFFFFFFFFE7);
+  mul_full_segments(product, a, 4, b, 4);
+  to_rns_segments(ra, a, 4, base);
+  to_rns_segments(rb, b, 4, base);
+  mul_rns(rp, ra, rb, base);
+  from_rns_segments(value, rp, base);
+  assert(&test, eq(value, product, 8) && value[8] == 0);
+
+  add_rns(rp, ra, rb, base);
+  sub_rns(rp, rp, rb, base);
+  assert(&test, eq(rp, ra, 9));
+  sub_rns(rp, rp, ra, base);
+  from_rns_segments(value, rp, base);
+  assert(&test, value[0] == 0 && eq(value, value + 1, 8));
+
+  //the product carried into a base of other moduli
+  other = create_rns_base(small, 3);
+  mul_rns(rp, ra, rb, base);
+  extend_rns(extended, other, rp, base);
+  to_rns_segments(direct, product, 8, other);
+  assert(&test, eq(extended, direct, 3));
+  free_rns_base(other);
+  other = create_rns_base(NULL, 12);
+  extend_rns(extended, other, rp, base);
+  to_rns_segments(direct, product, 8, other);
+  assert(&test, eq(extended, direct, 12));
+  free_rns_base(other);
+  free_rns_base(base);
+  return test;
+}
+
 bool test_mul_segments() {
   bool test = TRUE;
   int i;